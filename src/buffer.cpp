@@ -1,14 +1,18 @@
 #include "buffer.h"
 
+#include <algorithm>
 #include <cstdio>
 #include <cstring>
 #include <gsl/util>
+#include <iterator>
 
 #include "cursor.h"
+#include "draw.h"
 #include "exception.h"
 #include "filetype.h"
 #include "logging.h"
 #include "options.h"
+#include "trace.h"
 
 namespace mango {
 
@@ -41,6 +45,14 @@ Buffer::Buffer(GlobalOpts* global_opts, const std::string& path, bool read_only)
 Buffer::Buffer(GlobalOpts* global_opts, const Path& path, bool read_only)
     : path_(path), read_only_(read_only), opts_(global_opts) {}
 
+Buffer Buffer::CreateScratch(GlobalOpts* global_opts,
+                             const std::string& name) {
+    MGO_ASSERT(!name.empty());
+    Buffer buffer(global_opts, false);
+    buffer.scratch_name_ = name;
+    return buffer;
+}
+
 Buffer::~Buffer() {
     if (new_file_info_) {
         new_file_alloced_ids_[new_file_info_->id - 1] = false;
@@ -48,6 +60,7 @@ Buffer::~Buffer() {
 }
 
 void Buffer::Load() {
+    MGO_TRACE_SCOPE("Buffer::Load");
     auto _ = gsl::finally([this] {
         opts_.InitAfterBufferLoad(this);
         if (GetOpt<bool>(kOptBasicWordCompletion) && IsLoad() && !read_only()) {
@@ -59,6 +72,7 @@ void Buffer::Load() {
 
     try {
         lines_.clear();
+        ResetWrapRows();
 
         if (path_.Empty()) {
             lines_.push_back({});
@@ -108,6 +122,7 @@ void Buffer::Clear() {
     state_ = BufferState::kNotModified;
     lines_.clear();
     lines_.push_back({});
+    ResetWrapRows();
     version_++;
 }
 
@@ -188,6 +203,7 @@ Result Buffer::SaveAs(const Path& path) {
             new_file_alloced_ids_[new_file_info_->id - 1] = false;
             new_file_info_.reset();
         }
+        scratch_name_.clear();
     }
     read_only_ = old_read_only;
 
@@ -220,7 +236,7 @@ std::string Buffer::GetContent(const Range& range) const {
                        range.end.byte_offset - begin.byte_offset);
             break;
         }
-        ret.append(lines_[begin.line].line_str);
+        ret.append(lines_[begin.line].line_str, begin.byte_offset);
         ret.append(1, '\n');
         begin.line++;
         begin.byte_offset = 0;
@@ -228,6 +244,133 @@ std::string Buffer::GetContent(const Range& range) const {
     return ret;
 }
 
+static void BuildLineInfo(std::string_view line, LineInfo& info) {
+    char bits = 0;
+    for (char c : line) {
+        bits |= c;
+    }
+    info.ascii = IsAscii(bits);
+
+    size_t i = 0;
+    while (i < line.size() && (line[i] == kSpaceChar || line[i] == '\t')) {
+        i++;
+    }
+    // A space may be combined with what follows.
+    if (i > 0 && !info.ascii && !CharacterBoundaryValid(line, i)) {
+        i--;
+    }
+    info.indent_end = i;
+
+    // Backward codepoint scan is correct and enough. '\t' will break all, ' '
+    // only may after a pretend codepoint, but we render from begin so we will
+    // skip it if it's wrong.
+    i = line.size();
+    while (i > 0 && (line[i - 1] == kSpaceChar || line[i - 1] == '\t')) {
+        i--;
+    }
+    info.trailing_white_begin = i;
+
+    if (info.ascii) {
+        info.character_cnt = line.size();
+        return;
+    }
+    info.character_cnt = 0;
+    for (size_t offset = 0; offset < line.size(); info.character_cnt++) {
+        int byte_len;
+        ThisCharacterWidth(line, offset, byte_len);
+        offset += byte_len;
+    }
+}
+
+const LineInfo& Buffer::GetLineInfo(size_t line) const {
+    MGO_ASSERT(LineCnt() > line);
+    std::shared_ptr<LineInfo>& info = lines_[line].info;
+    if (!info) {
+        info = std::make_shared<LineInfo>();
+        BuildLineInfo(lines_[line].line_str, *info);
+    }
+    return *info;
+}
+
+const WrapLayout& Buffer::GetWrapLayout(size_t line, size_t width,
+                                        int tabstop) const {
+    MGO_ASSERT(LineCnt() > line);
+    std::shared_ptr<WrapLayout>& layout = lines_[line].wrap_layout;
+    if (!layout) {
+        layout = std::make_shared<WrapLayout>();
+    } else if (layout->width == width && layout->tabstop == tabstop) {
+        return *layout;
+    }
+    ArrangeWrapLayout(lines_[line].line_str, width, tabstop, *layout);
+    return *layout;
+}
+
+const ColumnIndex& Buffer::GetColumnIndex(size_t line, int tabstop) const {
+    MGO_ASSERT(LineCnt() > line);
+    std::shared_ptr<ColumnIndex>& index = lines_[line].column_index;
+    if (!index) {
+        index = std::make_shared<ColumnIndex>();
+    } else if (index->tabstop == tabstop) {
+        return *index;
+    }
+    BuildColumnIndex(lines_[line].line_str, tabstop, *index);
+    return *index;
+}
+
+const PrefixSumTree* Buffer::GetWrapRows(size_t width, int tabstop) const {
+    if (wrap_rows_width_ != width || wrap_rows_tabstop_ != tabstop ||
+        wrap_rows_built_ != lines_.size()) {
+        return nullptr;
+    }
+    return &wrap_rows_;
+}
+
+bool Buffer::BuildWrapRowsSlice(size_t width, int tabstop, size_t max_bytes) {
+    if (wrap_rows_width_ != width || wrap_rows_tabstop_ != tabstop) {
+        ResetWrapRows();
+        wrap_rows_width_ = width;
+        wrap_rows_tabstop_ = tabstop;
+    }
+    std::vector<size_t> rows;
+    size_t end = wrap_rows_built_;
+    // The eol counts, so a slice of empty lines is bounded too.
+    for (size_t bytes = 0; end < lines_.size() && bytes < max_bytes; end++) {
+        const std::string& line_str = lines_[end].line_str;
+        rows.push_back(ScreenRows(line_str, width, tabstop));
+        bytes += line_str.size() + 1;
+    }
+    wrap_rows_.Insert(wrap_rows_built_, rows);
+    wrap_rows_built_ = end;
+    return wrap_rows_built_ == lines_.size();
+}
+
+void Buffer::UpdateWrapRows(size_t first, size_t old_last, size_t new_last) {
+    if (first >= wrap_rows_built_) {
+        // Not indexed yet.
+        return;
+    }
+    if (old_last >= wrap_rows_built_) {
+        // Lines from first will be indexed again.
+        wrap_rows_.Erase(first, wrap_rows_built_ - first);
+        wrap_rows_built_ = first;
+        return;
+    }
+    std::vector<size_t> rows;
+    rows.reserve(new_last - first + 1);
+    for (size_t line = first; line <= new_last; line++) {
+        rows.push_back(ScreenRows(lines_[line].line_str, wrap_rows_width_,
+                                  wrap_rows_tabstop_));
+    }
+    wrap_rows_.Erase(first, old_last - first + 1);
+    wrap_rows_.Insert(first, rows);
+    wrap_rows_built_ = wrap_rows_built_ + new_last - old_last;
+}
+
+void Buffer::ResetWrapRows() {
+    wrap_rows_.Clear();
+    wrap_rows_built_ = 0;
+}
+
 void Buffer::Edit(const BufferEdit& edit, Pos& cursor_pos_hint) {
     if (edit.str.empty()) {
         // delete
@@ -243,8 +386,10 @@ void Buffer::Edit(const BufferEdit& edit, Pos& cursor_pos_hint) {
 
 void Buffer::AddInner(Pos pos, std::string_view str, Pos& cursor_pos_hint,
                       bool record_ts_edit) {
+    MGO_TRACE_SCOPE("Buffer::Add");
     auto _ = gsl::finally([this, record_ts_edit, &pos, &cursor_pos_hint, &str] {
         Modified();
+        UpdateWrapRows(pos.line, pos.line, cursor_pos_hint.line);
         if (record_ts_edit) {
             ts_edit_.start_point.row = pos.line;
             ts_edit_.start_point.column = pos.byte_offset;
@@ -257,6 +402,8 @@ void Buffer::AddInner(Pos pos, std::string_view str, Pos& cursor_pos_hint,
             ts_edit_.new_end_byte = ts_edit_.start_byte + str.size();
         }
     });
+    // Other lines added are new ones.
+    lines_[pos.line].ResetCaches();
 
     size_t i = 0;
     cursor_pos_hint = pos;
@@ -316,6 +463,7 @@ void Buffer::AddInner(Pos pos, std::string_view str, Pos& cursor_pos_hint,
 
 std::string Buffer::DeleteInner(const Range& range, Pos& cursor_pos_hint,
                                 bool record_reverse, bool record_ts_edit) {
+    MGO_TRACE_SCOPE("Buffer::Delete");
     auto _ = gsl::finally([this] { Modified(); });
 
     std::string old_str;
@@ -325,6 +473,8 @@ std::string Buffer::DeleteInner(const Range& range, Pos& cursor_pos_hint,
 
     Pos end = range.end;
     MGO_ASSERT(lines_.size() > end.line);
+    // Other lines are erased.
+    lines_[range.begin.line].ResetCaches();
     MGO_ASSERT(range.begin.line < end.line ||
                (range.begin.line == range.end.line &&
                 range.begin.byte_offset <= range.end.byte_offset));
@@ -388,6 +538,7 @@ std::string Buffer::DeleteInner(const Range& range, Pos& cursor_pos_hint,
     }
 
     cursor_pos_hint = range.begin;
+    UpdateWrapRows(range.begin.line, range.end.line, range.begin.line);
 
     if (record_ts_edit) {
         ts_edit_.start_point.row = range.begin.line;
@@ -404,15 +555,70 @@ std::string Buffer::DeleteInner(const Range& range, Pos& cursor_pos_hint,
     return old_str;
 }
 
+// Lines are spliced in place instead of deleting and adding line by line, so
+// replacing a huge range(e.g. a substitution, or undoing it) is linear.
 std::string Buffer::ReplaceInner(const Range& range, std::string_view str,
                                  Pos& cursor_pos_hint, bool record_reverse) {
-    Pos out_pos;
-    std::string old_str = DeleteInner(range, out_pos, record_reverse, true);
-    AddInner(out_pos, str, cursor_pos_hint, false);
+    MGO_TRACE_SCOPE("Buffer::Replace");
+    auto _ = gsl::finally([this] { Modified(); });
 
-    // Others record in DeleteInner
+    MGO_ASSERT(lines_.size() > range.end.line);
+    MGO_ASSERT(range.begin.line < range.end.line ||
+               (range.begin.line == range.end.line &&
+                range.begin.byte_offset <= range.end.byte_offset));
+    std::string old_str;
+    if (record_reverse) {
+        old_str = GetContent(range);
+    }
+    size_t old_str_size = range.end.byte_offset;
+    for (size_t line = range.begin.line; line < range.end.line; line++) {
+        old_str_size += lines_[line].line_str.size() + 1;  // 1 for '\n'
+    }
+    old_str_size -= range.begin.byte_offset;
+
+    std::string line_after_end =
+        lines_[range.end.line].line_str.substr(range.end.byte_offset);
+    std::string& first = lines_[range.begin.line].line_str;
+    // Other lines are new ones.
+    lines_[range.begin.line].ResetCaches();
+    first.erase(range.begin.byte_offset);
+    size_t eol = str.find('\n');
+    first.append(str.substr(0, eol));
+    std::vector<Line> new_lines;
+    while (eol != std::string_view::npos) {
+        size_t next = str.find('\n', eol + 1);
+        new_lines.emplace_back(
+            std::string(str.substr(eol + 1, next - (eol + 1))));
+        eol = next;
+    }
+    std::string& last = new_lines.empty() ? first : new_lines.back().line_str;
+    cursor_pos_hint = {range.begin.line + new_lines.size(), last.size()};
+    last.append(line_after_end);
+
+    // Lines after the first one are overwritten, then the rest are erased or
+    // inserted at once.
+    auto iter = lines_.begin() + range.begin.line + 1;
+    size_t old_cnt = range.end.line - range.begin.line;
+    size_t common = std::min(old_cnt, new_lines.size());
+    std::move(new_lines.begin(), new_lines.begin() + common, iter);
+    if (old_cnt > common) {
+        lines_.erase(iter + common, iter + old_cnt);
+    } else {
+        lines_.insert(iter + common,
+                      std::make_move_iterator(new_lines.begin() + common),
+                      std::make_move_iterator(new_lines.end()));
+    }
+
+    UpdateWrapRows(range.begin.line, range.end.line, cursor_pos_hint.line);
+
+    ts_edit_.start_point.row = range.begin.line;
+    ts_edit_.start_point.column = range.begin.byte_offset;
+    ts_edit_.old_end_point.row = range.end.line;
+    ts_edit_.old_end_point.column = range.end.byte_offset;
     ts_edit_.new_end_point.row = cursor_pos_hint.line;
     ts_edit_.new_end_point.column = cursor_pos_hint.byte_offset;
+    ts_edit_.start_byte = OffsetAndInvalidAfterPos(range.begin);
+    ts_edit_.old_end_byte = ts_edit_.start_byte + old_str_size;
     ts_edit_.new_end_byte = ts_edit_.start_byte + str.size();
 
     return old_str;
@@ -549,7 +755,7 @@ Result Buffer::Replace(const Range& range, std::string_view str,
     item.origin.str = str;
     item.origin_pos_hint = cursor_pos_hint;
 
-    item.reverse.range = {range.begin, cursor_pos_hint};
+    item.reverse.range = {range.begin, origin_pos_hint};
     item.reverse.str = std::move(old_str);
     item.reverse_pos_hint = cursor_pos ? *cursor_pos : range.end;
     Record(std::move(item));
@@ -625,7 +831,9 @@ bool Buffer::IsFirstBuffer() const { return prev_->prev_ == nullptr; }
 
 void Buffer::Modified() {
     MGO_ASSERT(IsLoad() && !read_only());
-    state_ = BufferState::kModified;
+    if (scratch_name_.empty()) {
+        state_ = BufferState::kModified;
+    }
     version_++;
 }
 
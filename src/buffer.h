@@ -11,6 +11,7 @@
 #include "gsl/span"
 #include "options.h"
 #include "pos.h"
+#include "prefix_sum_tree.h"
 #include "result.h"
 #include "state.h"
 #include "tree_sitter/api.h"
@@ -20,10 +21,31 @@ namespace mango {
 
 constexpr const char* kSwapSuffix = ".mango_swap";
 
+struct WrapLayout;
+struct ColumnIndex;
+
+// Facts of a line wanted on every frame or keystroke. Blanks are ' ' and '\t'.
+struct LineInfo {
+    bool ascii;                   // all bytes are ascii
+    size_t indent_end;            // byte offset after the leading blanks
+    size_t trailing_white_begin;  // byte offset of the trailing blanks
+    size_t character_cnt;
+};
+
 struct Line {
     std::string line_str;
+    // Caches of line_str, they are reset when line_str is modified.
+    mutable std::shared_ptr<LineInfo> info;
+    mutable std::shared_ptr<WrapLayout> wrap_layout;
+    mutable std::shared_ptr<ColumnIndex> column_index;
     Line() {}
     Line(std::string _line_str) : line_str(std::move(_line_str)) {}
+
+    void ResetCaches() {
+        info.reset();
+        wrap_layout.reset();
+        column_index.reset();
+    }
 };
 
 struct Cursor;
@@ -75,6 +97,11 @@ class Buffer {
     MGO_DEFAULT_MOVE(Buffer);
     ~Buffer();
 
+    // A no file backup buffer with a name like "[grep]", for contents made by
+    // the editor. It's never considered modified, so quitting won't be
+    // blocked by it.
+    static Buffer CreateScratch(GlobalOpts* options, const std::string& name);
+
     // throws IOException, FileCreateException, CodingException
     // if it is a no file backup buffer, any of above exceptions won't throw.
     void Load();
@@ -121,6 +148,30 @@ class Buffer {
     // GetConent will copy out a string in range.
     std::string GetContent(const Range& range) const;
 
+    // Computed when first asked, cached like the wrap layout.
+    const LineInfo& GetLineInfo(size_t line) const;
+
+    // The layout of a line wrapped in width cells. It's cached in the line, so
+    // it's only arranged again when the line is modified or width or tabstop
+    // changes. The reference is valid until the next call for the same line
+    // or the buffer is modified.
+    const WrapLayout& GetWrapLayout(size_t line, size_t width,
+                                    int tabstop) const;
+    // Checkpoints of a line arranged without wrap, cached like the wrap
+    // layout.
+    const ColumnIndex& GetColumnIndex(size_t line, int tabstop) const;
+
+    // Screen rows of every line wrapped in width cells, to map between lines
+    // and screen rows in O(log n). The index is built in slices by
+    // BuildWrapRowsSlice, then edits keep it up to date.
+    // Return nullptr if the index for width and tabstop isn't complete.
+    const PrefixSumTree* GetWrapRows(size_t width, int tabstop) const;
+    // Index more lines until about max_bytes of them are arranged, the time
+    // taken is bounded by bytes rather than lines, which may be long. What
+    // has been indexed for another width or tabstop is dropped.
+    // Return true if all lines are indexed.
+    bool BuildWrapRowsSlice(size_t width, int tabstop, size_t max_bytes);
+
     // Edit operations
    private:
     // Some operations used inner
@@ -202,7 +253,10 @@ class Buffer {
     bool lsp_attached() { return lsp_attached_; }
 
     zstring_view Name() noexcept {
-        return path_.Empty() ? new_file_info_->name : path_.ThisPath();
+        if (!path_.Empty()) {
+            return path_.ThisPath();
+        }
+        return scratch_name_.empty() ? new_file_info_->name : scratch_name_;
     }
     Path& path() noexcept { return path_; }
 
@@ -219,6 +273,10 @@ class Buffer {
 
     void Modified();
 
+    // Lines [first, old_last] have been replaced by lines [first, new_last].
+    void UpdateWrapRows(size_t first, size_t old_last, size_t new_last);
+    void ResetWrapRows();
+
    public:
     Buffer* next_ = nullptr;
     Buffer* prev_ = nullptr;
@@ -232,6 +290,7 @@ class Buffer {
         int64_t id;
     };
     std::unique_ptr<NewFileInfo> new_file_info_;
+    std::string scratch_name_;  // not empty if it is a scratch buffer
     zstring_view filetype_;
     BufferState state_ = BufferState::kHaveNotRead;
     EOLSeq eol_seq_ = EOLSeq::kLF;  // Default LF
@@ -255,6 +314,13 @@ class Buffer {
     // A prefiex offset cache, for fast offset calculation.
     std::vector<size_t> offset_per_line_ = {0};
 
+    // Screen rows of lines in [0, wrap_rows_built_) wrapped in
+    // wrap_rows_width_ cells.
+    PrefixSumTree wrap_rows_;
+    size_t wrap_rows_built_ = 0;
+    size_t wrap_rows_width_ = 0;
+    int wrap_rows_tabstop_ = 0;
+
     std::unique_ptr<BufferBasicWordCompleter> basic_word_completer_;
 
     // lsp
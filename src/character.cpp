@@ -1,5 +1,10 @@
 #include "character.h"
 
+#include <cstdint>
+#include <cstring>
+
+#include "width_table.inc"
+
 namespace mango {
 
 int Character::Width() {
@@ -19,33 +24,40 @@ int Character::Width() {
 // Finally ref:
 // https://sw.kovidgoyal.net/kitty/text-sizing-protocol
 
-static constexpr Codepoint kRIStart = 0x1F1E6;
-static constexpr int kRICnt = 26;
 static constexpr Codepoint kVS15 = 0xFE0E;
 static constexpr Codepoint kVS16 = 0xFE0F;
 
-static int WCWidth(Codepoint codepoint) {
-    // Fix RI width
-    if (codepoint >= kRIStart && codepoint < kRIStart + kRICnt) {
-        return 2;
+// The table is generated by tools/gen_width_table.cpp at build time, which
+// also fixes RI width.
+int CodepointWidth(Codepoint codepoint) {
+    if (static_cast<uint32_t>(codepoint) >= kWidthTableEnd) {
+        return utf8proc_charwidth(codepoint);
     }
-    return utf8proc_charwidth(codepoint);
+    return kWidthTableBlocks[(kWidthTableIndex[codepoint >> kWidthTableShift]
+                              << kWidthTableShift) |
+                             (codepoint & ((1 << kWidthTableShift) - 1))];
 }
+
 // We use the first codepoint wcwidth. If we encounter VS later, we adjust the
 // width. It is pretty fine enough, although VSes only take effect after certain
 // categories of codepoints, but we don't check categories now.
+static int AdjustWidth(int width, Codepoint codepoint) {
+    if (codepoint == kVS16 && width == 1) {
+        return 2;
+    } else if (codepoint == kVS15 && width == 2) {
+        return 1;
+    }
+    return width;
+}
+
 int CharacterWidth(const Codepoint* codepoints, size_t cnt) {
-    int width = WCWidth(codepoints[0]);
+    int width = CodepointWidth(codepoints[0]);
     if (cnt == 1) {
         return width;
     }
 
     for (size_t i = 1; i < cnt; i++) {
-        if (codepoints[i] == kVS16 && width == 1) {
-            width = 2;
-        } else if (codepoints[i] == kVS15 && width == 2) {
-            width = 1;
-        }
+        width = AdjustWidth(width, codepoints[i]);
     }
     return width;
 }
@@ -245,6 +257,33 @@ Result ThisCharacterInner(std::string_view str, int64_t offset,
     return kOk;
 }
 
+int ThisCharacterWidthInner(std::string_view str, int64_t offset,
+                            int& byte_len) {
+    MGO_ASSERT(static_cast<size_t>(offset) < str.size());
+    int64_t cur_offset = offset;
+    int64_t end_offset = str.size();
+
+    int byte_eat;
+    Codepoint codepoint;
+    Utf8ToUnicode(&str[cur_offset], -1, byte_eat, codepoint);
+    int width = CodepointWidth(codepoint);
+    Codepoint last_codepoint = codepoint;
+    cur_offset += byte_eat;
+    utf8proc_int32_t state = 0;
+    while (cur_offset < end_offset) {
+        Utf8ToUnicode(&str[cur_offset], -1, byte_eat, codepoint);
+        if (utf8proc_grapheme_break_stateful(last_codepoint, codepoint,
+                                             &state)) {
+            break;
+        }
+        width = AdjustWidth(width, codepoint);
+        last_codepoint = codepoint;
+        cur_offset += byte_eat;
+    }
+    byte_len = cur_offset - offset;
+    return width;
+}
+
 Result PrevCharacterInner(std::string_view str, int64_t offset,
                           Character& character, int& byte_len) {
     MGO_ASSERT(offset > 0);
@@ -399,13 +438,18 @@ Result PrevWordBegin(std::string_view str, size_t offset,
 }
 
 size_t StringWidth(const std::string& str) {
-    Character character;
     size_t offset = 0;
     size_t width = 0;
     while (offset < str.size()) {
+        size_t ascii_cnt = PrintableAsciiRun(str, offset);
+        offset += ascii_cnt;
+        width += ascii_cnt;
+        if (offset == str.size()) {
+            break;
+        }
+
         int len;
-        ThisCharacter(str, offset, character, len);
-        int character_width = character.Width();
+        int character_width = ThisCharacterWidth(str, offset, len);
         if (character_width <= 0) {
             character_width = kReplacementCharWidth;
         }
@@ -415,4 +459,33 @@ size_t StringWidth(const std::string& str) {
     return width;
 }
 
+size_t PrintableAsciiRun(std::string_view str, size_t offset,
+                         size_t max_len) {
+    MGO_ASSERT(offset <= str.size());
+    size_t end =
+        max_len < str.size() - offset ? offset + max_len : str.size();
+    size_t i = offset;
+
+    // 8 bytes a time. A byte is printable if it neither becomes negative
+    // after subtracting ' ', nor after adding 1, nor is. Borrows and carries
+    // only come from bytes out of the range, so a word is reported exactly.
+    constexpr uint64_t kOnes = 0x0101010101010101;
+    constexpr uint64_t kHighBits = 0x8080808080808080;
+    for (; i + 8 <= end; i += 8) {
+        uint64_t word;
+        memcpy(&word, str.data() + i, 8);
+        if (((word - kOnes * ' ') | (word + kOnes) | word) & kHighBits) {
+            break;
+        }
+    }
+    while (i < end && str[i] >= ' ' && str[i] <= '~') {
+        i++;
+    }
+
+    if (i > offset && i < str.size() && !IsAscii(str[i])) {
+        i--;
+    }
+    return i - offset;
+}
+
 }  // namespace mango
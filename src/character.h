@@ -1,5 +1,6 @@
 #pragma once
 #include <string>
+#include <string_view>
 #include <vector>
 
 #include "result.h"
@@ -35,45 +36,40 @@ constexpr Codepoint kTrailingTab = 0x2192;    // "→"
 class Character {
    public:
     bool Ascii(char& c) const {
-        if (codepoints_cnt_ == 1 && codepoint_ <= CHAR_MAX) {
-            c = static_cast<char>(codepoint_);
+        if (codepoints_cnt_ == 1 && codepoints_[0] <= CHAR_MAX) {
+            c = static_cast<char>(codepoints_[0]);
             return true;
         }
         return false;
     }
 
     void Push(Codepoint codepoint) {
-        codepoints_cnt_++;
-        if (codepoints_cnt_ == 1) {
-            codepoint_ = codepoint;
-        } else if (codepoints_cnt_ == 2) {
-            codepoints_.resize(2);
-            codepoints_[0] = codepoint_;
-            codepoints_[1] = codepoint;
+        if (codepoints_cnt_ < kInlineCnt) {
+            codepoints_[codepoints_cnt_] = codepoint;
         } else {
-            codepoints_.push_back(codepoint);
+            if (codepoints_cnt_ == kInlineCnt) {
+                spilled_codepoints_.assign(codepoints_,
+                                           codepoints_ + kInlineCnt);
+            }
+            spilled_codepoints_.push_back(codepoint);
         }
+        codepoints_cnt_++;
     }
 
     // Explicitly set codepoint
     void Set(Codepoint codepoint) {
-        codepoint_ = codepoint;
+        codepoints_[0] = codepoint;
         codepoints_cnt_ = 1;
     }
 
-    void Clear() {
-        if (codepoints_cnt_ > 1) {
-            codepoints_.clear();
-        }
-        codepoints_cnt_ = 0;
-    }
+    void Clear() { codepoints_cnt_ = 0; }
 
     const Codepoint* Codepoints() const {
         MGO_ASSERT(codepoints_cnt_ != 0);
-        if (codepoints_cnt_ == 1) {
-            return &codepoint_;
+        if (codepoints_cnt_ <= kInlineCnt) {
+            return codepoints_;
         }
-        return codepoints_.data();
+        return spilled_codepoints_.data();
     }
 
     size_t CodePointCount() const { return codepoints_cnt_; }
@@ -81,8 +77,12 @@ class Character {
     int Width();
 
    private:
-    std::vector<Codepoint> codepoints_;
-    Codepoint codepoint_;
+    // Most graphemes, even emoji zwj sequences, have only a few codepoints.
+    // They are kept inline, and only longer ones go to the heap.
+    static constexpr int kInlineCnt = 8;
+
+    Codepoint codepoints_[kInlineCnt];
+    std::vector<Codepoint> spilled_codepoints_;
     int codepoints_cnt_ = 0;
 };
 
@@ -111,6 +111,8 @@ inline int UnicodeToUtf8(uint32_t in, char* out) {
     return utf8proc_encode_char(in, reinterpret_cast<utf8proc_uint8_t*>(out));
 }
 
+// Width of a single codepoint, see CharacterWidth for a character.
+int CodepointWidth(Codepoint codepoint);
 int CharacterWidth(const Codepoint* codepoints, size_t cnt);
 
 bool CheckUtf8Valid(std::string_view str);
@@ -145,6 +147,27 @@ inline Result ThisCharacter(std::string_view str, int64_t offset,
     return ThisCharacterInner(str, offset, character, byte_len);
 }
 
+// Like ThisCharacterInner, but the character isn't kept, only its width (same
+// as Character::Width) is returned. For callers only caring about the layout.
+int ThisCharacterWidthInner(std::string_view str, int64_t offset,
+                            int& byte_len);
+
+// Wrap of ThisCharacterWidthInner, and ascii friendly
+inline int ThisCharacterWidth(std::string_view str, int64_t offset,
+                              int& byte_len) {
+    MGO_ASSERT(static_cast<size_t>(offset) < str.size());
+    int64_t cur_offset = offset;
+    int64_t end_offset = str.size();
+    // ascii happy path
+    if ((cur_offset <= end_offset - 2 && IsAscii(str[cur_offset]) &&
+         IsAscii(str[cur_offset + 1])) ||
+        (cur_offset == end_offset - 1)) {
+        byte_len = 1;
+        return CodepointWidth(str[cur_offset]);
+    }
+    return ThisCharacterWidthInner(str, offset, byte_len);
+}
+
 // Make sure that str[offset] must be a character beginnig byte.
 // offset shouldn't <= 0.
 // Current only return kOk
@@ -244,4 +267,11 @@ inline bool IsPair(char open, char close) {
 
 size_t StringWidth(const std::string& str);
 
+// Return the count of bytes from offset, at most max_len, which are
+// printable ascii characters (' ' to '~'). Each of them is a grapheme one
+// cell wide, so callers can handle them in bulk. The last one right before a
+// non-ascii byte is excluded, since it may be combined with what follows.
+size_t PrintableAsciiRun(std::string_view str, size_t offset,
+                         size_t max_len = std::string_view::npos);
+
 }  // namespace mango
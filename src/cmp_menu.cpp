@@ -13,6 +13,7 @@ void CmpMenu::SetEntries(std::vector<std::string>&& entries) {
     entries_ = std::move(entries);
     menu_cursor_ = 0;
     menu_view_line_ = 0;
+    entries_changed_ = true;
 }
 
 void CmpMenu::DecideLocAndSize() {
@@ -61,14 +62,46 @@ void CmpMenu::DecideLocAndSize() {
                          global_opts_->GetOpt<int64_t>(kOptCmpMenuMaxWidth));
 }
 
-void CmpMenu::Draw() {
-    if (!visible_) {
+bool CmpMenu::StaleRows(size_t& row, size_t& height) {
+    if (!drawn_) {
+        return false;
+    }
+    if (visible_ && !entries_.empty()) {
+        DecideLocAndSize();
+        if (col_ == drawn_col_ && row_ == drawn_row_ &&
+            width_ == drawn_width_ && height_ == drawn_height_) {
+            return false;
+        }
+    }
+    row = drawn_row_;
+    height = drawn_height_;
+    return true;
+}
+
+void CmpMenu::Draw(bool force) {
+    if (!visible_ || entries_.empty()) {
+        drawn_ = false;
         return;
     }
 
     DecideLocAndSize();
+    if (!force && drawn_ && !entries_changed_ && col_ == drawn_col_ &&
+        row_ == drawn_row_ && width_ == drawn_width_ &&
+        height_ == drawn_height_ && menu_cursor_ == drawn_menu_cursor_ &&
+        menu_view_line_ == drawn_menu_view_line_) {
+        return;
+    }
+    drawn_ = true;
+    entries_changed_ = false;
+    drawn_col_ = col_;
+    drawn_row_ = row_;
+    drawn_width_ = width_;
+    drawn_height_ = height_;
+    drawn_menu_cursor_ = menu_cursor_;
+    drawn_menu_view_line_ = menu_view_line_;
 
     auto scheme = global_opts_->GetOpt<ColorScheme>(kOptColorScheme);
+    Terminal::RowCells cells;
     for (size_t r = 0; r < height_; r++) {
         const Terminal::AttrPair& attr = r + menu_view_line_ == menu_cursor_
                                              ? scheme[kMenuSelection]
@@ -78,10 +111,10 @@ void CmpMenu::Draw() {
         size_t offset = 0;
         size_t menu_col = 0;
         Character character;
-        Codepoint space = kSpaceChar;
+        cells.Clear();
         // leading space
         if (width_ >= 1) {
-            term_->SetCell(col_, r + row_, &space, 1, attr);
+            cells.Push(kSpaceChar, attr);
             menu_col++;
         }
         // content
@@ -97,9 +130,8 @@ void CmpMenu::Draw() {
             // TODO: use entries_width
             // for show ... when space is not enough for long width entries
             if (menu_col + character_width <= width_) {
-                term_->SetCell(menu_col + col_, r + row_,
-                               character.Codepoints(),
-                               character.CodePointCount(), attr);
+                cells.Push(character.Codepoints(), character.CodePointCount(),
+                           character_width, attr);
             } else {
                 break;
             }
@@ -107,10 +139,8 @@ void CmpMenu::Draw() {
             offset += byte_len;
         }
         // make paddings because menu have different bg color
-        while (menu_col < width_) {
-            term_->SetCell(menu_col + col_, r + row_, &space, 1, attr);
-            menu_col++;
-        }
+        cells.PushSpaces(width_ - menu_col, attr);
+        term_->BlitRow(col_, r + row_, cells);
     }
 }
 
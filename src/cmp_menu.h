@@ -23,7 +23,17 @@ class CmpMenu {
 
     void SetEntries(std::vector<std::string>&& entries);
 
-    void Draw();
+    // The menu is drawn over other parts of the screen, if force, it's
+    // repainted even if it's the same as the last drawn one, because the
+    // parts under it have been repainted.
+    void Draw(bool force);
+    // Return true if rows [row, row + height) have been drawn by the menu
+    // last time but it won't be drawn there by the next Draw(hidden or
+    // moved), so the parts under it should be repainted.
+    bool StaleRows(size_t& row, size_t& height);
+    // The screen has been cleared, nothing is drawn by the menu now.
+    void Invalidate() { drawn_ = false; }
+
     void SelectNext(size_t count);
     void SelectPrev(size_t count);
     size_t Accept();
@@ -49,6 +59,16 @@ class CmpMenu {
 
     bool visible_ = false;
 
+    // What is on the screen now.
+    bool drawn_ = false;
+    bool entries_changed_ = false;
+    size_t drawn_col_ = 0;
+    size_t drawn_row_ = 0;
+    size_t drawn_width_ = 0;
+    size_t drawn_height_ = 0;
+    size_t drawn_menu_cursor_ = 0;
+    size_t drawn_menu_view_line_ = 0;
+
     GlobalOpts* global_opts_;
     Cursor* cursor_;
     Terminal* term_ = &Terminal::GetInstance();
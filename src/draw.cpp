@@ -1,5 +1,9 @@
 #include "draw.h"
 
+#include <algorithm>
+
+#include "trace.h"
+
 namespace mango {
 
 // Locate a pos in ranges, select a range when a pos just locate in, or just
@@ -20,26 +24,128 @@ static inline int64_t LocateInPos(const std::vector<Highlight>& highlight,
     return left;
 }
 
-// TODO: when wrap, do not break word. same as ArrangeLine and
-// Frame::SetCursorByViewCol.
-size_t DrawLine(Terminal& term, std::string_view line, const Pos& begin_pos,
-                size_t begin_view_col, size_t width, size_t screen_row,
-                size_t screen_col,
-                const std::vector<const std::vector<Highlight>*>* highlights,
-                ColorScheme scheme, ColorSchemeType fallback_type,
-                int64_t trailing_white_begin, int tabstop, bool wrap) {
-    std::vector<int64_t> highlights_i;
-    if (highlights) {
-        highlights_i.resize(highlights->size());
-        for (size_t i = 0; i < highlights->size(); i++) {
-            highlights_i[i] = LocateInPos(*(*highlights)[i], begin_pos);
+static inline void MergeAttr(Terminal::AttrPair& attr,
+                             const Terminal::AttrPair& this_attr) {
+    if (!attr.fg_exist && this_attr.fg_exist) {
+        attr.fg = this_attr.fg;
+        attr.fg_exist = true;
+    }
+    if (!attr.bg_exist && this_attr.bg_exist) {
+        attr.bg = this_attr.bg;
+        attr.bg_exist = true;
+    }
+}
+
+void ResolveAttrRuns(
+    size_t line, size_t begin, size_t end,
+    const std::vector<const std::vector<Highlight>*>* highlights,
+    ColorScheme scheme, ColorSchemeType fallback_type,
+    std::vector<AttrRun>& runs) {
+    runs.clear();
+    if (begin >= end) {
+        return;
+    }
+    size_t layer_cnt = highlights ? highlights->size() : 0;
+    std::vector<int64_t> highlights_i(layer_cnt);
+    for (size_t i = 0; i < layer_cnt; i++) {
+        highlights_i[i] = LocateInPos(*(*highlights)[i], {line, begin});
+    }
+
+    // Sweep the bytes, the attr of bytes from pos only changes where a
+    // highlight deciding it ends, or a higher priority one begins.
+    size_t byte_offset = begin;
+    while (byte_offset < end) {
+        Pos pos = {line, byte_offset};
+        size_t next = end;
+        Terminal::AttrPair attr;
+        attr.fg_exist = false;
+        attr.bg_exist = false;
+        for (size_t i = 0; i < layer_cnt; i++) {
+            const auto& highlight = *(*highlights)[i];
+            int64_t& highlight_i = highlights_i[i];
+            while (highlight_i < static_cast<int64_t>(highlight.size()) &&
+                   highlight[highlight_i].range.PosAfterMe(pos)) {
+                highlight_i++;
+            }
+            if (highlight_i == static_cast<int64_t>(highlight.size())) {
+                continue;
+            }
+            const Range& range = highlight[highlight_i].range;
+            if (range.PosInMe(pos)) {
+                if (range.end.line == line) {
+                    next = std::min(next, range.end.byte_offset);
+                }
+                MergeAttr(attr, scheme[highlight[highlight_i].hl_type]);
+                if (attr.bg_exist && attr.fg_exist) {
+                    // Lower priority layers can't change anything.
+                    break;
+                }
+            } else if (range.begin.line == line) {
+                next = std::min(next, range.begin.byte_offset);
+            }
         }
+        MergeAttr(attr, scheme[fallback_type]);
+
+        if (!runs.empty() && runs.back().attr.fg == attr.fg &&
+            runs.back().attr.bg == attr.bg) {
+            runs.back().end = next;
+        } else {
+            runs.push_back({byte_offset, next, attr});
+        }
+        byte_offset = next;
     }
+}
+
+// TODO: when wrap, do not break word. same as ArrangeLine and
+// Frame::SetCursorByViewCol.
+size_t DrawLine(std::string_view line, const Pos& begin_pos,
+                size_t begin_view_col, size_t width,
+                const std::vector<AttrRun>& runs, int64_t trailing_white_begin,
+                int tabstop, bool wrap, Terminal::RowCells& cells) {
+    MGO_TRACE_SCOPE("DrawLine");
+    // The run the first character is in.
+    auto run = std::upper_bound(
+        runs.begin(), runs.end(), begin_pos.byte_offset,
+        [](size_t offset, const AttrRun& r) { return offset < r.end; });
 
     Character character;
     size_t view_col = 0;
     size_t byte_offset = begin_pos.byte_offset;
     while (byte_offset < line.size()) {
+        // Printable ascii happy path, see ArrangeLine.
+        if (view_col < begin_view_col) {
+            // Characters before begin_view_col are skipped.
+            size_t ascii_cnt =
+                PrintableAsciiRun(line, byte_offset, begin_view_col - view_col);
+            byte_offset += ascii_cnt;
+            view_col += ascii_cnt;
+            if (ascii_cnt > 0) {
+                continue;
+            }
+        } else {
+            size_t ascii_cnt = PrintableAsciiRun(
+                line, byte_offset, width + begin_view_col - view_col);
+            if (wrap && ascii_cnt > 0 &&
+                byte_offset + ascii_cnt == line.size() &&
+                view_col + ascii_cnt == width) {
+                ascii_cnt--;
+            }
+            for (size_t i = 0; i < ascii_cnt; i++, byte_offset++) {
+                while (run->end <= byte_offset) {
+                    run++;
+                }
+                cells.Push(
+                    static_cast<int64_t>(byte_offset) >= trailing_white_begin
+                        ? kTrailingSpace
+                        : line[byte_offset],
+                    run->attr);
+            }
+            view_col += ascii_cnt;
+            if (ascii_cnt > 0) {
+                continue;
+            }
+        }
+
         int character_width;
         int byte_len;
         bool is_tab = false;
@@ -56,77 +162,50 @@ size_t DrawLine(Terminal& term, std::string_view line, const Pos& begin_pos,
                 character_width = kReplacementCharWidth;
             }
         }
-        if (view_col >= begin_view_col &&
-            view_col + character_width <= width + begin_view_col) {
+        if (view_col < begin_view_col) {
+            if (view_col + character_width > begin_view_col) {
+                // Part of the character is after begin_view_col, e.g. a tab
+                // or a wide character. The part is drawn blank.
+                size_t cell_cnt = view_col + character_width - begin_view_col;
+                if (cell_cnt > width) {
+                    break;
+                }
+                while (run->end <= byte_offset) {
+                    run++;
+                }
+                cells.PushSpaces(cell_cnt, run->attr);
+            }
+            byte_offset += byte_len;
+            view_col += character_width;
+            continue;
+        }
+        if (view_col + character_width <= width + begin_view_col) {
             // When wrap, we leave a cell for cursor.
             if (wrap && byte_offset + byte_len == line.size() &&
                 view_col + character_width == width) {
                 break;
             }
-            // Decide attr
-            Terminal::AttrPair attr;
-            attr.fg_exist = false;
-            attr.bg_exist = false;
-            if (highlights) {
-                for (size_t i = 0; i < highlights->size(); i++) {
-                    int64_t highlight_i = highlights_i[i];
-                    const auto& highlight = *(*highlights)[i];
-                    if (highlight_i != static_cast<int64_t>(highlight.size()) &&
-                        highlight[highlight_i].range.PosInMe(
-                            {begin_pos.line, byte_offset})) {
-                        const Terminal::AttrPair& this_attr =
-                            scheme[highlight[highlight_i].hl_type];
-                        if (!attr.fg_exist && this_attr.fg_exist) {
-                            attr.fg = this_attr.fg;
-                            attr.fg_exist = true;
-                        }
-                        if (!attr.bg_exist && this_attr.bg_exist) {
-                            attr.bg = this_attr.bg;
-                            attr.bg_exist = true;
-                        }
-                        if (attr.bg_exist && attr.fg_exist) {
-                            break;
-                        }
-                    }
-                }
-            }
-            if (!attr.fg_exist) {
-                attr.fg = scheme[fallback_type].fg;
-                attr.fg_exist = true;
-            }
-            if (!attr.bg_exist) {
-                attr.bg = scheme[fallback_type].bg;
-                attr.bg_exist = true;
+            while (run->end <= byte_offset) {
+                run++;
             }
+            MGO_ASSERT(run != runs.end() && run->begin <= byte_offset &&
+                       byte_offset < run->end);
+            const Terminal::AttrPair& attr = run->attr;
 
-            int cur_screen_col = view_col - begin_view_col + screen_col;
             if (static_cast<int64_t>(byte_offset) >= trailing_white_begin) {
                 if (!is_tab) {
-                    term.SetCell(cur_screen_col, screen_row, &kTrailingSpace, 1,
-                                 attr);
+                    cells.Push(kTrailingSpace, attr);
                 } else {
-                    Codepoint space = kSpaceChar;
-                    term.SetCell(cur_screen_col, screen_row, &kTrailingTab, 1,
-                                 attr);
-                    cur_screen_col++;
-                    for (int i = 1; i < character_width; i++) {
-                        term.SetCell(cur_screen_col, screen_row, &space, 1,
-                                     attr);
-                        cur_screen_col++;
-                    }
+                    cells.Push(kTrailingTab, attr);
+                    cells.PushSpaces(character_width - 1, attr);
                 }
             } else {
                 if (!is_tab) {
-                    term.SetCell(cur_screen_col, screen_row,
-                                 character.Codepoints(),
-                                 character.CodePointCount(), attr);
+                    cells.Push(character.Codepoints(),
+                               character.CodePointCount(), character_width,
+                               attr);
                 } else {
-                    Codepoint space = kSpaceChar;
-                    for (int i = 0; i < character_width; i++) {
-                        term.SetCell(cur_screen_col, screen_row, &space, 1,
-                                     attr);
-                        cur_screen_col++;
-                    }
+                    cells.PushSpaces(character_width, attr);
                 }
             }
         } else {
@@ -134,19 +213,6 @@ size_t DrawLine(Terminal& term, std::string_view line, const Pos& begin_pos,
         }
         byte_offset += byte_len;
         view_col += character_width;
-
-        // Try goto next syntax highlight range
-        if (highlights) {
-            for (size_t i = 0; i < highlights->size(); i++) {
-                const auto& highlight = *(*highlights)[i];
-                while (highlights_i[i] <
-                           static_cast<int64_t>(highlight.size()) &&
-                       highlight[highlights_i[i]].range.PosAfterMe(
-                           {begin_pos.line, byte_offset})) {
-                    highlights_i[i]++;
-                }
-            }
-        }
     }
     return byte_offset;
 }
@@ -162,17 +228,39 @@ size_t ArrangeLine(std::string_view line, size_t begin_byte_offset,
         *character_cnt = 0;
     }
 
-    Character character;
     size_t view_col = 0;
     size_t byte_offset = begin_byte_offset;
     while (byte_offset < line.size()) {
-        int character_width;
+        // Printable ascii happy path, they are one cell wide each, so we take
+        // as many as possible at once. The character after them is left to
+        // the general path.
+        if (view_col >= begin_view_col) {
+            size_t ascii_cnt = PrintableAsciiRun(
+                line, byte_offset, width + begin_view_col - view_col);
+            // When wrap, we leave a cell for cursor.
+            if (wrap && ascii_cnt > 0 &&
+                byte_offset + ascii_cnt == line.size() &&
+                view_col + ascii_cnt == width) {
+                ascii_cnt--;
+            }
+            if (target_byte_offset && *target_byte_offset >= byte_offset &&
+                *target_byte_offset < byte_offset + ascii_cnt) {
+                ascii_cnt = *target_byte_offset - byte_offset;
+            }
+            if (ascii_cnt > 0) {
+                if (character_cnt) {
+                    *character_cnt += ascii_cnt;
+                }
+                byte_offset += ascii_cnt;
+                view_col += ascii_cnt;
+                continue;
+            }
+        }
+
         int byte_len;
-        ThisCharacter(line, byte_offset, character, byte_len);
-        character_width = character.Width();
+        int character_width = ThisCharacterWidth(line, byte_offset, byte_len);
         if (character_width == 0) {
-            char c;
-            if (character.Ascii(c) && c == '\t') {
+            if (byte_len == 1 && line[byte_offset] == '\t') {
                 character_width = tabstop - view_col % tabstop;
             } else {
                 character_width = kReplacementCharWidth;
@@ -217,10 +305,111 @@ size_t ScreenRows(std::string_view line, size_t width, int tabstop) {
     size_t byte_offset = 0;
     size_t row_cnt = 0;
     do {
-        byte_offset = ArrangeLine(line, byte_offset, 0, width, tabstop, true);
+        size_t next = ArrangeLine(line, byte_offset, 0, width, tabstop, true);
         row_cnt++;
+        if (next == byte_offset) {
+            // Same as ArrangeWrapLayout.
+            break;
+        }
+        byte_offset = next;
     } while (byte_offset < line.size());
     return row_cnt;
 }
 
+size_t WrapLayout::SublineOf(size_t byte_offset) const {
+    auto iter = std::upper_bound(
+        sublines.begin(), sublines.end(), byte_offset,
+        [](size_t offset, const Subline& s) { return offset < s.begin; });
+    MGO_ASSERT(iter != sublines.begin());
+    return iter - sublines.begin() - 1;
+}
+
+void ArrangeWrapLayout(std::string_view line, size_t width, int tabstop,
+                       WrapLayout& layout) {
+    layout.width = width;
+    layout.tabstop = tabstop;
+    layout.sublines.clear();
+    size_t byte_offset = 0;
+    size_t character_cnt = 0;
+    do {
+        size_t end_view_col;
+        size_t cnt;
+        size_t next = ArrangeLine(line, byte_offset, 0, width, tabstop, true,
+                                  &end_view_col, nullptr, nullptr, &cnt);
+        layout.sublines.push_back({byte_offset, character_cnt, end_view_col});
+        character_cnt += cnt;
+        if (next == byte_offset) {
+            // A character wider than width, nothing can be arranged anymore.
+            break;
+        }
+        byte_offset = next;
+    } while (byte_offset < line.size());
+}
+
+const ColumnIndex::Checkpoint& ColumnIndex::BeforeViewCol(
+    size_t view_col) const {
+    auto iter = std::upper_bound(
+        checkpoints.begin(), checkpoints.end(), view_col,
+        [](size_t col, const Checkpoint& c) { return col < c.view_col; });
+    MGO_ASSERT(iter != checkpoints.begin());
+    return *(iter - 1);
+}
+
+const ColumnIndex::Checkpoint& ColumnIndex::BeforeByteOffset(
+    size_t byte_offset) const {
+    auto iter = std::upper_bound(
+        checkpoints.begin(), checkpoints.end(), byte_offset,
+        [](size_t offset, const Checkpoint& c) {
+            return offset < c.byte_offset;
+        });
+    MGO_ASSERT(iter != checkpoints.begin());
+    return *(iter - 1);
+}
+
+void BuildColumnIndex(std::string_view line, int tabstop, ColumnIndex& index) {
+    index.tabstop = tabstop;
+    index.checkpoints.assign(1, {0, 0, 0});
+    if (line.size() < kColumnIndexMinLineSize) {
+        return;
+    }
+
+    ColumnIndex::Checkpoint cur = {0, 0, 0};
+    while (cur.byte_offset < line.size()) {
+        // Take ascii in bulk, but stop where the next checkpoint may be put.
+        size_t since_last =
+            cur.byte_offset - index.checkpoints.back().byte_offset;
+        size_t max_ascii_cnt;
+        if (since_last < kColumnCheckpointInterval) {
+            max_ascii_cnt = kColumnCheckpointInterval - since_last;
+        } else if (cur.view_col % tabstop == 0) {
+            index.checkpoints.push_back(cur);
+            continue;
+        } else {
+            max_ascii_cnt = tabstop - cur.view_col % tabstop;
+        }
+        size_t ascii_cnt =
+            PrintableAsciiRun(line, cur.byte_offset, max_ascii_cnt);
+        if (ascii_cnt > 0) {
+            cur.byte_offset += ascii_cnt;
+            cur.view_col += ascii_cnt;
+            cur.character_cnt += ascii_cnt;
+            continue;
+        }
+
+        int byte_len;
+        int character_width =
+            ThisCharacterWidth(line, cur.byte_offset, byte_len);
+        if (character_width == 0) {
+            if (byte_len == 1 && line[cur.byte_offset] == '\t') {
+                character_width = tabstop - cur.view_col % tabstop;
+            } else {
+                character_width = kReplacementCharWidth;
+            }
+        }
+        cur.byte_offset += byte_len;
+        cur.view_col += character_width;
+        cur.character_cnt++;
+    }
+}
+
 }  // namespace mango
@@ -8,15 +8,35 @@
 
 namespace mango {
 
-// Draw a line on the terminal.
-// in highlights, index 0 means highest priority.
+// Bytes [begin, end) of a line are drawn in attr.
+struct AttrRun {
+    size_t begin;
+    size_t end;
+    Terminal::AttrPair attr;
+};
+
+// Resolve highlights of bytes [begin, end) of a line into runs, which are
+// sorted, adjacent, cover [begin, end) and have different attrs from their
+// neighbours. So drawing doesn't look up highlights per cell.
+// in highlights, index 0 means highest priority. What no highlight gives is
+// taken from fallback_type.
+void ResolveAttrRuns(
+    size_t line, size_t begin, size_t end,
+    const std::vector<const std::vector<Highlight>*>* highlights,
+    ColorScheme scheme, ColorSchemeType fallback_type,
+    std::vector<AttrRun>& runs);
+
+// Draw a line into a row of cells, which are appended to cells, the caller
+// blits them with Terminal::BlitRow.
+// runs are resolved by ResolveAttrRuns, at least for bytes drawn.
+// Characters before begin_view_col, which is counted from begin_pos, are
+// skipped. Without wrap, seek a ColumnIndex checkpoint for begin_pos first.
 // return the not drawn start byte_offset of the line.
-size_t DrawLine(Terminal& term, std::string_view line, const Pos& begin_pos,
-                size_t begin_view_col, size_t width, size_t screen_row,
-                size_t screen_col,
-                const std::vector<const std::vector<Highlight>*>* highlights,
-                ColorScheme scheme, ColorSchemeType fallback_type,
-                int64_t trailing_white_begin, int tabstop, bool wrap);
+// At most width cols are appended, the rest of the row is left to the caller.
+size_t DrawLine(std::string_view line, const Pos& begin_pos,
+                size_t begin_view_col, size_t width,
+                const std::vector<AttrRun>& runs, int64_t trailing_white_begin,
+                int tabstop, bool wrap, Terminal::RowCells& cells);
 
 // Nearly Same as the above, but not draw at terminal.
 // If target_byte_offset != nullptr, if corresponding character can be drawed in
@@ -33,4 +53,52 @@ size_t ArrangeLine(std::string_view line, size_t begin_byte_offset,
 // Return screen row cnt of a line for wrap.
 size_t ScreenRows(std::string_view line, size_t width, int tabstop);
 
+// How a line is divided into screen rows(sublines) when wrapped, same as
+// calling ArrangeLine row by row.
+struct WrapLayout {
+    struct Subline {
+        size_t begin;          // byte offset
+        size_t character_cnt;  // characters before the subline in the line
+        size_t width;          // cells the subline takes
+    };
+
+    size_t width = 0;  // width to wrap in
+    int tabstop = 0;
+    std::vector<Subline> sublines;  // never empty
+
+    size_t ScreenRows() const { return sublines.size(); }
+    // Return which subline byte_offset is in.
+    size_t SublineOf(size_t byte_offset) const;
+};
+
+void ArrangeWrapLayout(std::string_view line, size_t width, int tabstop,
+                       WrapLayout& layout);
+
+// Sparse checkpoints of a line arranged without wrap, so a view col or a byte
+// offset far from the line begin is located without arranging the line from
+// 0. Checkpoints are only put at view cols which are multiples of tabstop, so
+// arranging from one is the same as from the line begin.
+struct ColumnIndex {
+    struct Checkpoint {
+        size_t byte_offset;
+        size_t view_col;
+        size_t character_cnt;  // characters before byte_offset
+    };
+
+    int tabstop = 0;
+    std::vector<Checkpoint> checkpoints;  // never empty, the first is 0
+
+    // Return the last checkpoint at or before view_col.
+    const Checkpoint& BeforeViewCol(size_t view_col) const;
+    // Return the last checkpoint at or before byte_offset.
+    const Checkpoint& BeforeByteOffset(size_t byte_offset) const;
+};
+
+// Lines shorter than this are cheap to arrange from 0, no checkpoint is put.
+constexpr size_t kColumnIndexMinLineSize = 4096;
+// Bytes between two checkpoints, roughly.
+constexpr size_t kColumnCheckpointInterval = 1024;
+
+void BuildColumnIndex(std::string_view line, int tabstop, ColumnIndex& index);
+
 }  // namespace mango
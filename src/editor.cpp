@@ -6,6 +6,7 @@
 #include "fs.h"
 #include "inttypes.h"  // IWYU pragma: keep
 #include "options.h"
+#include "substitute.h"
 #include "term.h"
 
 // TODO: show sth. to users if modify the readonly buffer.
@@ -14,6 +15,7 @@ namespace mango {
 
 static constexpr int kScreenMinWidth = 10;
 static constexpr int kScreenMinHeight = 3;
+static constexpr const char* kGrepBufferName = "[grep]";
 
 void Editor::Init(std::unique_ptr<GlobalOpts> global_opts,
                   std::unique_ptr<InitOpts> init_opts) {
@@ -76,6 +78,11 @@ void Editor::Init(std::unique_ptr<GlobalOpts> global_opts,
     }
 
     RegisterEditorEventHandlers();
+
+    // Keep the index of cwd up to date if it has been built before.
+    if (File::FileReadable(TrigramIndex::CachePath(Path::GetCwd()))) {
+        CreateTrigramIndex();
+    }
 }
 
 void Editor::RegisterEditorEventHandlers() {
@@ -119,8 +126,21 @@ void Editor::Loop() {
             }
         }
 
-        PreProcess();
+        // Input arrived within a frame interval is handled before drawing,
+        // so a burst of input only draws once per frame.
+        if (!FrameDue()) {
+            // Background search goes on while the frame waits.
+            StartSearchSliceTimer();
+            return;
+        }
+        {
+            LatencyScope scope(PerfStats(), kLatencyPreProcess);
+            PreProcess();
+        }
         Draw();
+        frame_pacer_.FrameDrawn(std::chrono::steady_clock::now());
+        StartSearchSliceTimer();
+        ScheduleWrapRowsJob();
     };
 
     auto term_handler = [this, &in_bracketed_paste,
@@ -139,6 +159,12 @@ void Editor::Loop() {
         // it.
         while (term_.Poll(0)) {
             show_cmp_menu_ = false;
+            frame_pacer_.InputHandled();
+            // Cancel in-flight background work, it will be resumed before the
+            // next poll so input is always handled first.
+            if (search_slice_timer_ && search_slice_timer_->IsTimingOn()) {
+                loop_->timer_manager_.StopTimer(search_slice_timer_.get());
+            }
             if (autocmp_trigger_timer_ &&
                 autocmp_trigger_timer_->IsTimingOn()) {
                 loop_->timer_manager_.StopTimer(autocmp_trigger_timer_.get());
@@ -169,6 +195,9 @@ void Editor::Loop() {
                     in_bracketed_paste = true;
                     break;
                 }
+                case Terminal::EventType::kReply: {
+                    break;
+                }
                 case Terminal::EventType::kBracketedPasteClose: {
                     in_bracketed_paste = false;
                     if (IsPeel(mode_)) {
@@ -182,6 +211,10 @@ void Editor::Loop() {
                     break;
                 }
             }
+
+            if (LatencyStats* stats = PerfStats()) {
+                stats->EventHandled(term_.EventTime());
+            }
         }
 
         // If autocmp trigger timer has started,
@@ -222,21 +255,33 @@ void Editor::Loop() {
 
 void Editor::InitKeymaps() {
     // Navigation
-    MGO_KEYMAP("h", {[this] { cursor_.in_window->CursorGoLeft(Count()); }},
+    MGO_KEYMAP("h",
+               {[this] { cursor_.in_window->CursorGoLeft(Count()); },
+                kKeyseqCountedMotion},
                {MGO_DEFAULT_MODES});
-    MGO_KEYMAP("l", {[this] { cursor_.in_window->CursorGoRight(Count()); }},
+    MGO_KEYMAP("l",
+               {[this] { cursor_.in_window->CursorGoRight(Count()); },
+                kKeyseqCountedMotion},
                {MGO_DEFAULT_MODES});
-    MGO_KEYMAP("b", {[this] { cursor_.in_window->CursorGoWordBegin(Count()); }},
+    MGO_KEYMAP("b",
+               {[this] { cursor_.in_window->CursorGoWordBegin(Count()); },
+                kKeyseqCountedMotion},
                {MGO_DEFAULT_MODES});
     MGO_KEYMAP("e",
-               {[this] { cursor_.in_window->CursorGoNextWordEnd(Count()); }},
+               {[this] { cursor_.in_window->CursorGoNextWordEnd(Count()); },
+                kKeyseqCountedMotion},
                {MGO_DEFAULT_MODES});
     MGO_KEYMAP("w",
-               {[this] { cursor_.in_window->CursorGoNextWordBegin(Count()); }},
+               {[this] { cursor_.in_window->CursorGoNextWordBegin(Count()); },
+                kKeyseqCountedMotion},
                {MGO_DEFAULT_MODES});
-    MGO_KEYMAP("k", {[this] { cursor_.in_window->CursorGoUp(Count()); }},
+    MGO_KEYMAP("k",
+               {[this] { cursor_.in_window->CursorGoUp(Count()); },
+                kKeyseqCountedMotion},
                {MGO_DEFAULT_MODES});
-    MGO_KEYMAP("j", {[this] { cursor_.in_window->CursorGoDown(Count()); }},
+    MGO_KEYMAP("j",
+               {[this] { cursor_.in_window->CursorGoDown(Count()); },
+                kKeyseqCountedMotion},
                {MGO_DEFAULT_MODES});
     MGO_KEYMAP("0", {[this] { cursor_.in_window->CursorGoHome(); }},
                {MGO_DEFAULT_MODES});
@@ -312,7 +357,11 @@ void Editor::InitKeymaps() {
                {[this] { CursorGoSearch(search_foward_, Count(), false); }},
                {Mode::kNormal});
     MGO_KEYMAP(":", {[this] { GotoPeel(); }}, {Mode::kNormal});
-    MGO_KEYMAP("<enter>", {[this] { GotoPeel(Mode::kPeelShow); }},
+    MGO_KEYMAP("<enter>", {[this] {
+                   if (!GrepJumpAtCursor()) {
+                       GotoPeel(Mode::kPeelShow);
+                   }
+               }},
                {Mode::kNormal});
     MGO_KEYMAP("<c-r>\"", {[this] { peel_->Paste(); }},
                {Mode::kPeelCommand, Mode::kPeelSearch});
@@ -551,6 +600,54 @@ void Editor::InitCommands() {
                  (void)args;
                  RemoveCurrentBuffer();
              }});
+    MGO_CMD({"grep",
+             "gr",
+             "",
+             {Type::kString, Type::kString},
+             [this](CommandArgs args) {
+                 MGO_ENSURE_ARGEXITS(0);
+                 StartGrep(std::get<std::string>(args[0].value()),
+                           args[1].has_value()
+                               ? std::get<std::string>(args[1].value())
+                               : "");
+             },
+             2,
+             1});
+    MGO_CMD({"index", "", "", {}, [this](CommandArgs args) {
+                 (void)args;
+                 ShowTrigramIndexStatus();
+             }});
+    MGO_CMD({"reindex", "", "", {}, [this](CommandArgs args) {
+                 (void)args;
+                 RebuildTrigramIndex();
+             }});
+    MGO_CMD({"perf",
+             "",
+             "",
+             {Type::kString, Type::kString},
+             [this](CommandArgs args) {
+                 PerfCommand(args[0].has_value()
+                                 ? std::get<std::string>(args[0].value())
+                                 : "",
+                             args[1].has_value()
+                                 ? std::get<std::string>(args[1].value())
+                                 : "");
+             },
+             2,
+             2});
+    MGO_CMD({"trace",
+             "",
+             "",
+             {Type::kString, Type::kString},
+             [this](CommandArgs args) {
+                 MGO_ENSURE_ARGEXITS(0);
+                 TraceCommand(std::get<std::string>(args[0].value()),
+                              args[1].has_value()
+                                  ? std::get<std::string>(args[1].value())
+                                  : "");
+             },
+             2,
+             1});
     MGO_CMD({"smile",
              "",
              "",
@@ -607,6 +704,7 @@ void Editor::HandleBracketedPaste(std::string& bracketed_paste_buffer) {
 }
 
 void Editor::HandleKey() {
+    MGO_TRACE_SCOPE("Editor::HandleKey");
     Terminal::KeyInfo key_info = term_.EventKeyInfo();
 
 #ifndef NDEBUG
@@ -636,6 +734,11 @@ void Editor::HandleKey() {
         res = keymap_manager_.FeedKey(key_info, handler);
     }
     if (res == kKeyseqDone) {
+        if (handler->type == kKeyseqCountedMotion) {
+            // The same keys arrived in this input burst, e.g. holding j, are
+            // folded into the count and move in one go.
+            count_ = Count() + term_.EatRepeatedEvents();
+        }
         handler->f();
         input_state_ = InputState::kNone;
         if (mode_ == Mode::kOperatorPending) {
@@ -794,18 +897,22 @@ void Editor::HandleMouse() {
         }
         case mk::kWheelDown: {
             Window* win = LocateWindow(mouse_info.col, mouse_info.row);
+            // Scroll as far as all the wheel events arrived in one go.
+            int64_t cnt = 1 + term_.EatRepeatedEvents();
             if (win) {
                 cursor_.in_window->ScrollRows(
-                    global_opts_->GetOpt<int64_t>(kOptScrollRows));
+                    cnt * global_opts_->GetOpt<int64_t>(kOptScrollRows));
             }
             // Not locate any area, do nothing
             break;
         }
         case mk::kWheelUp: {
             Window* win = LocateWindow(mouse_info.col, mouse_info.row);
+            // Scroll as far as all the wheel events arrived in one go.
+            int64_t cnt = 1 + term_.EatRepeatedEvents();
             if (win) {
                 cursor_.in_window->ScrollRows(
-                    -global_opts_->GetOpt<int64_t>(kOptScrollRows));
+                    -cnt * global_opts_->GetOpt<int64_t>(kOptScrollRows));
             }
             // Not locate any area, do nothing
             break;
@@ -813,22 +920,46 @@ void Editor::HandleMouse() {
     }
 }
 
-void Editor::HandleResize() { layout_manager_->ArrangeLayout(); }
+void Editor::HandleResize() {
+    layout_manager_->ArrangeLayout();
+    // The terminal has cleared the screen.
+    window_->area_.Invalidate();
+    peel_->area_.Invalidate();
+    status_line_->Invalidate();
+    cmp_menu_->Invalidate();
+}
 
 void Editor::Draw() {
-    // TODO: do not redraw not modified part
-    // TODO: should we redraw if any events trigger?
-
-    // First clear the screen so we don't need to print spaces for blank
-    // screen parts
-    term_.Clear();
+    MGO_TRACE_SCOPE("Editor::Draw");
+    LatencyStats* stats = PerfStats();
+    LatencyScope draw_scope(stats, kLatencyDraw);
+
+    // The screen is not cleared, every part only repaints itself when what it
+    // shows has changed, so an idle frame draws nothing.
+
+    // Parts under where the cmp menu was should be repainted.
+    size_t menu_row, menu_height;
+    if (cmp_menu_->StaleRows(menu_row, menu_height)) {
+        auto under_menu = [menu_row, menu_height](size_t row, size_t height) {
+            return row < menu_row + menu_height && menu_row < row + height;
+        };
+        if (under_menu(window_->area_.row_, window_->area_.height_)) {
+            window_->area_.Invalidate();
+        }
+        if (under_menu(status_line_->row_, 1)) {
+            status_line_->Invalidate();
+        }
+        if (under_menu(peel_->area_.row_, peel_->area_.height_)) {
+            peel_->area_.Invalidate();
+        }
+    }
 
-    window_->Draw(highlight_search_);
-    status_line_->Draw();
-    peel_->Draw();
+    bool repainted = window_->Draw(highlight_search_);
+    repainted = status_line_->Draw() || repainted;
+    repainted = peel_->Draw() || repainted;
 
     // Put it at last so it can override some parts
-    cmp_menu_->Draw();
+    cmp_menu_->Draw(repainted);
 
     // Draw cursor
     if (cursor_.s_col == -1 && cursor_.s_row == -1) {
@@ -837,23 +968,47 @@ void Editor::Draw() {
     } else {
         term_.SetCursor(cursor_.s_col, cursor_.s_row);
     }
+    draw_scope.End();
+
+    {
+        LatencyScope scope(stats, kLatencyPresent);
+        term_.Present();
+    }
+    if (stats) {
+        stats->FramePresented();
+    }
+}
 
-    term_.Present();
+bool Editor::FrameDue() {
+    auto wait = frame_pacer_.Wait(std::chrono::steady_clock::now(),
+                                  global_opts_->GetOpt<int64_t>(kOptMaxFps));
+    bool timing_on = frame_timer_ && frame_timer_->IsTimingOn();
+    if (wait == wait.zero()) {
+        // A lone input may come when a frame is waiting.
+        if (timing_on) {
+            loop_->timer_manager_.StopTimer(frame_timer_.get());
+        }
+        return true;
+    }
+    if (timing_on) {
+        return false;
+    }
+    // Nothing to do when it times out, the loop wakes up and draws then.
+    frame_timer_ = std::make_unique<SingleTimer>(
+        std::chrono::ceil<std::chrono::milliseconds>(wait), [] {});
+    loop_->timer_manager_.StartTimer(frame_timer_.get());
+    return false;
+}
+
+LatencyStats* Editor::PerfStats() {
+    return global_opts_->GetOpt<bool>(kOptPerfStats) ? &latency_stats_
+                                                      : nullptr;
 }
 
 void Editor::PreProcess() {
+    MGO_TRACE_SCOPE("Editor::PreProcess");
     // Try Load All Buffers in all windows
-    if (window_->area_.buffer_->state() == BufferState::kHaveNotRead) {
-        try {
-            window_->area_.buffer_->Load();
-            // TODO: Not init if file is too big.
-            syntax_parser_->SyntaxInit(window_->area_.buffer_);
-        } catch (Exception& e) {
-            MGO_LOG_ERROR("buffer {} : {}", window_->area_.buffer_->Name(),
-                          e.what());
-            // TODO: Maybe Notify the user
-        }
-    }
+    TryLoadBuffer(window_->area_.buffer_);
 
     layout_manager_->EnsureLayout();
 
@@ -866,6 +1021,20 @@ void Editor::PreProcess() {
     }
 }
 
+void Editor::TryLoadBuffer(Buffer* buffer) {
+    if (buffer->state() != BufferState::kHaveNotRead) {
+        return;
+    }
+    try {
+        buffer->Load();
+        // TODO: Not init if file is too big.
+        syntax_parser_->SyntaxInit(buffer);
+    } catch (Exception& e) {
+        MGO_LOG_ERROR("buffer {} : {}", buffer->Name(), e.what());
+        // TODO: Maybe Notify the user
+    }
+}
+
 Window* Editor::LocateWindow(int s_col, int s_row) {
     if (window_->area_.In(s_col, s_row)) {
         return window_.get();
@@ -992,7 +1161,6 @@ void Editor::GotoMode(Mode mode) {
 }
 
 void Editor::SearchCurrentBuffer(const std::string& pattern) {
-    // TODO: Maybe we can eliminate duplicate searching?
     if (cursor_.in_window) {
         cursor_.in_window->BuildSearchContext(pattern);
         CursorGoSearch(search_foward_, 1, true);
@@ -1014,19 +1182,37 @@ void Editor::SearchCurrentBuffer(const std::string& pattern) {
 }
 
 void Editor::CursorGoSearch(bool next, size_t count, bool keep_current_if_one) {
-    std::stringstream ss;
     Window* w = cursor_.in_window;
-    auto& pattern = w->GetSearchPattern();
     BufferSearchState state =
         w->CursorGoSearchResult(next, count, keep_current_if_one);
-    ss << "Searching \"" << pattern << "\" ";
+    if (state.total != 0) {
+        highlight_search_ = true;
+    }
+    NotifySearchState(w->b_search_context_, state);
+}
+
+void Editor::NotifySearchState(const BufferSearchContext& context,
+                               const BufferSearchState& state) {
+    if (!context.compile_error.empty()) {
+        NotifyUser(fmt::format("Invalid pattern: {}", context.compile_error));
+        return;
+    }
+    std::stringstream ss;
+    ss << "Searching \"" << context.search_pattern << "\" ";
     if (state.total == 0) {
         ss << "[No result]";
     } else {
-        ss << "[" << state.i << "/" << state.total << "]";
-        highlight_search_ = true;
+        ss << "[";
+        if (state.i_final) {
+            ss << state.i;
+        } else {
+            // Results before it are still being searched.
+            ss << "?";
+        }
+        ss << "/" << (state.total_final ? "" : "≥") << state.total << "]";
     }
     NotifyUser(ss.str());
+    search_notify_peel_version_ = peel_->buffer_.version();
 }
 
 void Editor::TriggerCompletion(bool autocmp) {
@@ -1109,6 +1295,14 @@ void Editor::CommandHitEnter() {
         return;
     }
 
+    // A substitute command is not split by whitespace like other commands.
+    if (IsSubstituteCommand(peel_->GetUserInput())) {
+        std::string cmd_str(peel_->GetUserInput());
+        ExitFromMode();
+        SubstituteCurrentBuffer(cmd_str);
+        return;
+    }
+
     CommandArgs args;
     Command* c;
     Result res = command_manager_.EvalCommand(peel_->GetUserInput(), args, c);
@@ -1134,6 +1328,62 @@ void Editor::SearchHitEnter() {
     SearchCurrentBuffer(std::string(peel_->GetUserInput()));
 }
 
+void Editor::SubstituteCurrentBuffer(const std::string& cmd_str) {
+    Window* w = cursor_.in_window;
+    Buffer* b = w->area_.buffer_;
+    SubstituteCommand cmd;
+    if (ParseSubstituteCommand(cmd_str, cursor_.pos.line, b->LineCnt(),
+                               cmd) != kOk) {
+        if (!cmd.error.empty()) {
+            NotifyUser(fmt::format("[substitute] {}", cmd.error));
+        } else {
+            NotifyUser(
+                "[substitute] Usage: [range]s/pattern/replacement/[flags]");
+        }
+        return;
+    }
+    // Like vim, but swapped without asking.
+    std::string_view swapped_note =
+        cmd.range_swapped ? " (backwards range swapped)" : "";
+    int flags = SearchRegexFlags(
+        cmd.pattern, global_opts_->GetOpt<bool>(kOptSearchIgnoreCase));
+    if (cmd.ignore_case.has_value()) {
+        flags = (flags & ~kRegexIgnoreCase) |
+                (cmd.ignore_case.value() ? kRegexIgnoreCase : kRegexNone);
+    }
+    if (flags & kRegexMultiLine) {
+        NotifyUser("[substitute] Multi-line patterns are not supported");
+        return;
+    }
+
+    std::shared_ptr<Regex> regex;
+    try {
+        regex = RegexCache::GetInstance().Get(cmd.pattern, flags);
+    } catch (RegexCompileException& e) {
+        NotifyUser(fmt::format("Invalid pattern: {}", e.what()));
+        return;
+    }
+    Substitution sub;
+    if (!BuildSubstitution(
+            [b](size_t line) { return b->GetLine(line); }, *regex, cmd,
+            sub)) {
+        NotifyUser(fmt::format("[substitute] Pattern not found: {}{}",
+                               cmd.pattern, swapped_note));
+        return;
+    }
+
+    Result res = w->Replace(sub.range, sub.content, &sub.cursor);
+    if (res == kBufferCannotLoad) {
+        NotifyUser("Buffer can't load");
+        return;
+    } else if (res == kBufferReadOnly) {
+        NotifyUser("Buffer read only");
+        return;
+    }
+    NotifyUser(fmt::format("[substitute] {} substitutions on {} lines{}",
+                           sub.match_cnt, sub.line_cnt, swapped_note));
+}
+
 void Editor::CursorUp(size_t count) {
     if (CompletionTriggered()) {
         cmp_menu_->SelectPrev(count);
@@ -1152,6 +1402,268 @@ void Editor::CursorDown(size_t count) {
     }
 }
 
+// Get dir(a grep root) relative to cwd, with a slash at the end or empty for
+// cwd itself. Return false if dir may be not under cwd.
+static bool GrepDirInCwd(const std::string& dir, std::string& rel) {
+    rel = dir;
+    if (!rel.empty() && rel[0] == kPathSeperator) {
+        const std::string& cwd = Path::GetCwd();
+        if (rel.compare(0, cwd.size(), cwd) != 0) {
+            return false;
+        }
+        rel.erase(0, cwd.size());
+    }
+    while (rel.compare(0, 2, "./") == 0) {
+        rel.erase(0, 2);
+    }
+    return rel.find("..") == std::string::npos;
+}
+
+void Editor::StartGrep(const std::string& pattern, const std::string& dir) {
+    grep_.reset();
+    std::string root = dir;
+    if (!root.empty() && root.back() != kPathSeperator) {
+        root.push_back(kPathSeperator);
+    }
+    std::string dir_in_cwd;
+    bool in_cwd = GrepDirInCwd(root, dir_in_cwd);
+    std::vector<std::string> candidates;
+    bool indexed = false;
+    try {
+        int flags = SearchRegexFlags(
+            pattern, global_opts_->GetOpt<bool>(kOptSearchIgnoreCase));
+        if (flags & kRegexMultiLine) {
+            // Files are matched line by line.
+            NotifyUser("[grep] Multi-line patterns are not supported");
+            return;
+        }
+        if (trigram_index_ && in_cwd) {
+            indexed = trigram_index_->Candidates(
+                *RegexCache::GetInstance().Get(pattern, flags), dir_in_cwd,
+                candidates);
+        }
+        // Candidates are relative to cwd.
+        grep_ = std::make_unique<Grep>(
+            pattern, flags, indexed ? "" : root, loop_.get(),
+            [this](std::vector<GrepMatch>& matches, bool done) {
+                OnGrepMatches(matches, done);
+            },
+            indexed ? &candidates : nullptr);
+    } catch (RegexCompileException& e) {
+        NotifyUser(fmt::format("Invalid pattern: {}", e.what()));
+        return;
+    } catch (OSException& e) {
+        MGO_LOG_ERROR("grep error: {}", e.what());
+        NotifyUser(fmt::format("Grep error: {}", e.what()));
+        return;
+    }
+    // A new results buffer each time, so the window shows it from the top.
+    Buffer* b = buffer_manager_->FindBuffer(grep_buffer_id_);
+    if (b) {
+        buffer_manager_->RemoveBuffer(b);
+    }
+    b = buffer_manager_->AddBuffer(
+        Buffer::CreateScratch(global_opts_.get(), kGrepBufferName));
+    b->Load();
+    grep_buffer_id_ = b->id();
+    grep_match_cnt_ = 0;
+    cursor_.in_window->AttachBuffer(b);
+    if (indexed) {
+        NotifyUser(fmt::format("[grep] Searching {} in {} indexed files ...",
+                               pattern, candidates.size()));
+    } else {
+        NotifyUser(fmt::format("[grep] Searching {} ...", pattern));
+    }
+}
+
+void Editor::OnGrepMatches(std::vector<GrepMatch>& matches, bool done) {
+    Buffer* b = buffer_manager_->FindBuffer(grep_buffer_id_);
+    if (b == nullptr) {
+        // Results buffer has been removed.
+        grep_->Stop();
+        return;
+    }
+
+    if (!matches.empty()) {
+        std::string str;
+        for (const auto& match : matches) {
+            if (grep_match_cnt_++ != 0) {
+                str.push_back('\n');
+            }
+            str.append(FormatGrepMatch(match));
+        }
+        size_t last_line = b->LineCnt() - 1;
+        Pos pos;
+        b->Add({last_line, b->GetLine(last_line).size()}, str, nullptr, false,
+               pos);
+    }
+
+    if (done) {
+        NotifyUser(fmt::format("[grep] {} matches in {} files{}",
+                               grep_match_cnt_, grep_->searched_files(),
+                               grep_->truncated() ? ", truncated" : ""));
+    }
+}
+
+bool Editor::GrepJumpAtCursor() {
+    Buffer* b = cursor_.in_window->area_.buffer_;
+    if (b->id() != grep_buffer_id_) {
+        return false;
+    }
+    std::string path;
+    Pos pos;
+    if (!ParseGrepMatch(b->GetLine(cursor_.pos.line), path, pos)) {
+        return false;
+    }
+
+    Path p(path);
+    Buffer* target = buffer_manager_->FindBuffer(p);
+    if (target == nullptr) {
+        target = buffer_manager_->AddBuffer(
+            Buffer(global_opts_.get(), std::move(p)));
+    }
+    cursor_.in_window->AttachBuffer(target);
+    TryLoadBuffer(target);
+    if (target->IsLoad()) {
+        cursor_.in_window->CursorGoPos(pos);
+    }
+    return true;
+}
+
+bool Editor::CreateTrigramIndex() {
+    const std::string& cwd = Path::GetCwd();
+    try {
+        trigram_index_ = std::make_unique<TrigramIndex>(
+            cwd, TrigramIndex::CachePath(cwd));
+    } catch (Exception& e) {
+        MGO_LOG_ERROR("trigram index error: {}", e.what());
+        NotifyUser(fmt::format("Index error: {}", e.what()));
+        return false;
+    }
+    return true;
+}
+
+void Editor::RebuildTrigramIndex() {
+    if (trigram_index_) {
+        trigram_index_->Rebuild();
+    } else if (!CreateTrigramIndex()) {
+        return;
+    }
+    NotifyUser("[index] Building ...");
+}
+
+void Editor::ShowTrigramIndexStatus() {
+    if (!trigram_index_) {
+        NotifyUser("[index] No index, :reindex to build one");
+        return;
+    }
+    TrigramIndex::Status status = trigram_index_->GetStatus();
+    std::string_view state;
+    switch (status.state) {
+        case TrigramIndex::State::kLoading:
+            state = "loading";
+            break;
+        case TrigramIndex::State::kBuilding:
+            state = "building";
+            break;
+        case TrigramIndex::State::kReady:
+            state = "ready";
+            break;
+        case TrigramIndex::State::kNotWatching:
+            state =
+                "not watching changes, raise fs.inotify.max_user_watches and "
+                ":reindex";
+            break;
+    }
+    NotifyUser(fmt::format(
+        "[index] {}: {} files, {} trigrams, {:.1f}MB, {} pending", state,
+        status.files, status.trigrams, status.bytes / 1024.0 / 1024.0,
+        status.pending));
+}
+
+void Editor::PerfCommand(const std::string& action, const std::string& path) {
+    if (action == "on" || action == "off") {
+        global_opts_->SetOpt(kOptPerfStats, action == "on");
+        NotifyUser(fmt::format("[perf] perf_stats {}", action));
+        return;
+    }
+    if (action == "reset") {
+        latency_stats_.Clear();
+        RegexCache::GetInstance().ResetCounters();
+        NotifyUser("[perf] stats reset");
+        return;
+    }
+    if (action == "dump") {
+        if (path.empty()) {
+            NotifyUser("[perf] dump needs a file path");
+            return;
+        }
+        try {
+            latency_stats_.Dump(path);
+            NotifyUser(fmt::format("[perf] stats dumped to {}", path));
+        } catch (IOException& e) {
+            std::string err_str =
+                fmt::format("[perf] can't dump stats: {}", e.what());
+            MGO_LOG_ERROR("{}", err_str);
+            NotifyUser(err_str);
+        }
+        return;
+    }
+    if (!action.empty()) {
+        NotifyUser(fmt::format("[perf] unknown action: {}", action));
+        return;
+    }
+    if (!global_opts_->GetOpt<bool>(kOptPerfStats)) {
+        NotifyUser("[perf] perf_stats is off, :perf on to turn it on");
+        return;
+    }
+    const RegexCache& regex_cache = RegexCache::GetInstance();
+    NotifyUser(fmt::format("{}\nregex cache: {} cached, {} hits, {} misses",
+                           latency_stats_.Report(), regex_cache.size(),
+                           regex_cache.hits(), regex_cache.misses()));
+}
+
+void Editor::TraceCommand(const std::string& action,
+                          const std::string& path) {
+    if (action == "start") {
+        TraceStart();
+        NotifyUser("[trace] started");
+        return;
+    }
+    if (action != "stop") {
+        NotifyUser(fmt::format("[trace] unknown action: {}", action));
+        return;
+    }
+    if (!trace_enabled.load(std::memory_order_relaxed)) {
+        NotifyUser("[trace] not started");
+        return;
+    }
+    if (path.empty()) {
+        NotifyUser("[trace] stop needs a file path");
+        return;
+    }
+    try {
+        TraceStop(path);
+        NotifyUser(fmt::format("[trace] written to {}", path));
+    } catch (IOException& e) {
+        std::string err_str =
+            fmt::format("[trace] can't write trace: {}", e.what());
+        MGO_LOG_ERROR("{}", err_str);
+        NotifyUser(err_str);
+    }
+}
+
+void Editor::OnFileSaved(const Path& path) {
+    if (!trigram_index_) {
+        return;
+    }
+    const std::string& abs_path = path.AbsolutePath();
+    const std::string& root = trigram_index_->root();
+    if (abs_path.compare(0, root.size(), root) == 0) {
+        trigram_index_->FileChanged(abs_path.substr(root.size()));
+    }
+}
+
 void Editor::RemoveCurrentBuffer() {
     buffer_manager_->RemoveBuffer(cursor_.in_window->area_.buffer_);
 }
@@ -1160,6 +1672,7 @@ void Editor::SaveCurrentBuffer() {
     try {
         Result res = cursor_.in_window->area_.buffer_->Write();
         if (res == kOk) {
+            OnFileSaved(cursor_.in_window->area_.buffer_->path());
             NotifyUser(fmt::format(
                 "\"{}\" saved",
                 cursor_.in_window->area_.buffer_->path().FileName()));
@@ -1188,7 +1701,9 @@ void Editor::SaveCurrentBufferAs(const Path& path) {
     }
     try {
         Result res = cur_b->SaveAs(path);
-        if (res == kBufferCannotLoad) {
+        if (res == kOk) {
+            OnFileSaved(path);
+        } else if (res == kBufferCannotLoad) {
             NotifyUser("Buffer can't load");
         } else if (res == kBufferReadOnly) {
             NotifyUser("Buffer read only");
@@ -1228,6 +1743,76 @@ void Editor::StartSearchOnTypeTimer() {
     }
 }
 
+void Editor::StartSearchSliceTimer() {
+    const BufferSearchContext& context = window_->b_search_context_;
+    if (!highlight_search_ || context.search_buffer_version == -1 ||
+        context.Complete()) {
+        return;
+    }
+    // The user is still typing the pattern, don't search a pattern that
+    // will be dropped soon.
+    if (mode_ == Mode::kPeelSearch && search_on_type_timer_ &&
+        search_on_type_timer_->IsTimingOn()) {
+        return;
+    }
+    if (!search_slice_timer_) {
+        search_slice_timer_ = std::make_unique<SingleTimer>(
+            std::chrono::milliseconds(0), [this] { SearchSlice(); });
+    }
+    if (!search_slice_timer_->IsTimingOn()) {
+        loop_->timer_manager_.StartTimer(search_slice_timer_.get());
+    }
+}
+
+void Editor::SearchSlice() {
+    // Lines searched in a slice, small enough to keep the ui responsive.
+    static constexpr size_t kSearchSliceLines = 2000;
+
+    Buffer* buffer = window_->area_.buffer_;
+    BufferSearchContext& context = window_->b_search_context_;
+    if (!context.EnsureUpToDate(buffer) || context.Complete()) {
+        return;
+    }
+    context.SearchSlice(buffer, kSearchSliceLines);
+
+    // Update the search state if the user can still see it.
+    if (context.current_search != -1 &&
+        peel_->buffer_.version() == search_notify_peel_version_) {
+        NotifySearchState(context, context.CurrentState());
+    }
+    // Next slice will be scheduled before the next poll.
+}
+
+void Editor::ScheduleWrapRowsJob() {
+    if (window_->area_.WrapRowsComplete()) {
+        return;
+    }
+    if (!wrap_rows_job_) {
+        wrap_rows_job_ = std::make_unique<IdleJob>(
+            [this](std::chrono::steady_clock::time_point deadline) {
+                return WrapRowsJob(deadline);
+            });
+    }
+    loop_->idle_scheduler_.Schedule(wrap_rows_job_.get());
+}
+
+bool Editor::WrapRowsJob(std::chrono::steady_clock::time_point deadline) {
+    // Bytes arranged between deadline checks, well below the time of a
+    // job even with long lines. A single line longer than it still runs
+    // over.
+    static constexpr size_t kWrapRowsBatchBytes = 16 * 1024;
+
+    while (!window_->area_.WrapRowsComplete()) {
+        if (std::chrono::steady_clock::now() >= deadline) {
+            return true;
+        }
+        window_->area_.BuildWrapRowsSlice(kWrapRowsBatchBytes);
+    }
+    // Scheduled again after drawing if the index is dropped by an edit or a
+    // resize.
+    return false;
+}
+
 void Editor::TrySearchOnType() {
     // Whether user is still searching?
     // If yes we search the pattern, otherwise we just ignore.
@@ -9,7 +9,9 @@
 #include "cursor.h"
 #include "editor_event_manager.h"
 #include "event_loop.h"
+#include "grep.h"
 #include "keyseq_manager.h"
+#include "latency.h"
 #include "layout_manager.h"
 #include "mango_peel.h"
 #include "mouse.h"
@@ -17,6 +19,8 @@
 #include "status_line.h"
 #include "syntax.h"
 #include "timer_manager.h"
+#include "trace.h"
+#include "trigram_index.h"
 #include "utils.h"
 #include "window.h"
 
@@ -61,6 +65,26 @@ class Editor {
     void CursorDown(size_t count);
     void CursorGoSearch(bool next, size_t count, bool keep_current_if_one);
 
+    // Grep files under dir(cwd if empty), results are streamed into a scratch
+    // buffer.
+    void StartGrep(const std::string& pattern, const std::string& dir);
+    // Jump to the grep result under the cursor.
+    // Return false if it's not in the grep buffer or not at a result.
+    bool GrepJumpAtCursor();
+
+    // Run a ":[range]s/pattern/replacement/[flags]" command on the current
+    // buffer, all replacements are one edit.
+    void SubstituteCurrentBuffer(const std::string& cmd_str);
+
+    // Build the trigram index of cwd in background, or rebuild it.
+    void RebuildTrigramIndex();
+    void ShowTrigramIndexStatus();
+
+    // Turn on or off, show, reset or dump to a file the input latency stats.
+    void PerfCommand(const std::string& action, const std::string& path);
+    // Start tracing, or stop and write the trace to path.
+    void TraceCommand(const std::string& action, const std::string& path);
+
     void RemoveCurrentBuffer();
     void SaveCurrentBuffer();
     void SaveCurrentBufferAs(const Path& path);
@@ -83,9 +107,28 @@ class Editor {
     void StartAutoCompletionTimer();
     void StartSearchOnTypeTimer();
     void TrySearchOnType();
+    // Search the rest of the current search context in background slices.
+    void StartSearchSliceTimer();
+    void SearchSlice();
+    // Index screen rows of the current buffer in idle time for wrap mode.
+    void ScheduleWrapRowsJob();
+    bool WrapRowsJob(std::chrono::steady_clock::time_point deadline);
+    void NotifySearchState(const BufferSearchContext& context,
+                           const BufferSearchState& state);
+
+    void OnGrepMatches(std::vector<GrepMatch>& matches, bool done);
+    // Return false if failed.
+    bool CreateTrigramIndex();
+    void OnFileSaved(const Path& path);
 
     void Draw();
     void PreProcess();
+    // nullptr if perf_stats is off.
+    LatencyStats* PerfStats();
+    // Return false and start the frame timer if frame_pacer_ says the frame
+    // should wait, it's drawn when the timer times out.
+    bool FrameDue();
+    void TryLoadBuffer(Buffer* buffer);
 
     // Count is at least 1.
     size_t Count() { return count_ == 0 ? 1 : count_; }
@@ -167,6 +210,20 @@ class Editor {
 
     std::unique_ptr<SingleTimer> autocmp_trigger_timer_;
     std::unique_ptr<SingleTimer> search_on_type_timer_;
+    std::unique_ptr<SingleTimer> search_slice_timer_;
+    std::unique_ptr<IdleJob> wrap_rows_job_;
+    std::unique_ptr<SingleTimer> frame_timer_;
+    FramePacer frame_pacer_;
+    // Peel buffer version when the search state is shown.
+    int64_t search_notify_peel_version_ = -1;
+
+    std::unique_ptr<Grep> grep_;
+    int64_t grep_buffer_id_ = -1;
+    size_t grep_match_cnt_ = 0;
+    // Index of cwd, created at the first grep or if it's in cache already.
+    std::unique_ptr<TrigramIndex> trigram_index_;
+
+    LatencyStats latency_stats_;
 
     std::unique_ptr<GlobalOpts> global_opts_;
 
@@ -1,22 +1,64 @@
 #include "event_loop.h"
 
 #include "options.h"
+#include "trace.h"
 
 namespace mango {
 
+#ifdef MGO_EVENT_LOOP_EPOLL
+// Ready events taken in one epoll_wait, more are taken in the next loop.
+static constexpr int kMaxReadyEvents = 64;
+#endif
+
 EventLoop::EventLoop(GlobalOpts* global_opts) : global_opts_(global_opts) {
     // TODO: Remove it when global_opts_ is used.
     (void)global_opts_;
+#ifdef MGO_EVENT_LOOP_EPOLL
+    epoll_fd_ = Fd(epoll_create1(EPOLL_CLOEXEC));
+    if (epoll_fd_.fd == -1) {
+        throw OSException(errno, "epoll_create1 error: {}", strerror(errno));
+    }
+    ready_events_.resize(kMaxReadyEvents);
+#endif
 }
 
 void EventLoop::AddEventHandler(const EventInfo& info) {
-    event_infos_.emplace(info.fd, info);
+    if (!event_infos_.emplace(info.fd, info).second) {
+        return;
+    }
+#ifdef MGO_EVENT_LOOP_EPOLL
+    epoll_event event = {};
+    if (info.Interesting_events & kEventRead) {
+        event.events |= EPOLLIN;
+    }
+    if (info.Interesting_events & kEventWrite) {
+        event.events |= EPOLLOUT;
+    }
+    if (info.edge_triggered) {
+        event.events |= EPOLLET;
+    }
+    event.data.fd = info.fd;
+    if (epoll_ctl(epoll_fd_.fd, EPOLL_CTL_ADD, info.fd, &event) == -1) {
+        int error_code = errno;
+        event_infos_.erase(info.fd);
+        throw OSException(error_code, "epoll_ctl add error: {}",
+                          strerror(error_code));
+    }
+#else
     changed_ = true;
+#endif
 }
 
 void EventLoop::RemoveEventHandler(EventFD fd) {
-    event_infos_.erase(fd);
+    if (event_infos_.erase(fd) == 0) {
+        return;
+    }
+#ifdef MGO_EVENT_LOOP_EPOLL
+    // The fd may have been closed, which removes itself from epoll.
+    epoll_ctl(epoll_fd_.fd, EPOLL_CTL_DEL, fd, nullptr);
+#else
     changed_ = true;
+#endif
 }
 
 void EventLoop::BeforePoll(const std::function<void()>& f) { before_poll_ = f; }
@@ -26,73 +68,131 @@ void EventLoop::AfterAllEvents(const std::function<void()>& f) {
 
 void EventLoop::Loop() {
     while (!quit_) {
-        timer_manager_.Tick();
+        {
+            MGO_TRACE_SCOPE("EventLoop::Timers");
+            timer_manager_.Tick();
+        }
 
         if (before_poll_) {
+            MGO_TRACE_SCOPE("EventLoop::BeforePoll");
             before_poll_();
         }
 
-        if (changed_) {
-            poll_fds_.clear();
-            for (const auto& [fd, info] : event_infos_) {
-                pollfd poll_fd;
-                poll_fd.fd = fd;
-                bzero(&poll_fd.events, sizeof(poll_fd.events));
-                poll_fd.events |=
-                    (info.Interesting_events & kEventRead ? POLLIN : 0);
-                poll_fd.events |=
-                    (info.Interesting_events & kEventWrite ? POLLOUT : 0);
-                poll_fds_.push_back(poll_fd);
+        // Idle jobs run while no fd is ready and no timer is due. Back to
+        // before_poll_ when a job is done, its results may be shown.
+        bool ready = false;
+        bool job_done = false;
+        while (!ready && !job_done && idle_scheduler_.HasJobs() &&
+               timer_manager_.NextTimeout() != 0) {
+            ready = PollEvents(0);
+            if (!ready) {
+                MGO_TRACE_SCOPE("EventLoop::IdleSlice");
+                job_done = idle_scheduler_.RunSlice();
             }
-            changed_ = false;
         }
+        if (job_done) {
+            continue;
+        }
+        if (!ready && !PollEvents(timer_manager_.NextTimeout())) {
+            continue;
+        }
+
+        if (after_all_events_) {
+            MGO_TRACE_SCOPE("EventLoop::AfterAllEvents");
+            after_all_events_();
+        }
+    }
+}
 
-        int rc = poll(poll_fds_.data(), poll_fds_.size(),
-                      timer_manager_.NextTimeout());
+#ifdef MGO_EVENT_LOOP_EPOLL
 
-        if (rc == -1) {
-            if (errno == EAGAIN || errno == EINTR) {
-                continue;
-            }
-            throw OSException(errno, "poll error: {}", strerror(errno));
+bool EventLoop::PollEvents(int timeout) {
+    int rc = epoll_wait(epoll_fd_.fd, ready_events_.data(),
+                        ready_events_.size(), timeout);
+    if (rc == -1) {
+        if (errno == EINTR) {
+            return false;
         }
+        throw OSException(errno, "epoll_wait error: {}", strerror(errno));
+    }
 
-        if (rc == 0) {
+    // Only ready fds are visited.
+    for (int i = 0; i < rc; i++) {
+        const epoll_event& event = ready_events_[i];
+        auto iter = event_infos_.find(event.data.fd);
+        if (iter == event_infos_.end()) {
+            // Just delete
             continue;
         }
+        Event e = 0;
+        e |= (event.events & EPOLLIN ? kEventRead : 0);
+        e |= (event.events & EPOLLOUT ? kEventWrite : 0);
+        e |= (event.events & EPOLLHUP ? kEventClose : 0);
+        e |= (event.events & EPOLLERR ? kEventError : 0);
+        MGO_TRACE_SCOPE("EventLoop::Handler");
+        iter->second.handler(e);
+    }
+    return rc > 0;
+}
 
-        int cnt = 0;
-        for (const pollfd& poll_fd : poll_fds_) {
-            if (cnt == rc) {
-                break;
-            }
+#else
+
+bool EventLoop::PollEvents(int timeout) {
+    if (changed_) {
+        poll_fds_.clear();
+        for (const auto& [fd, info] : event_infos_) {
+            pollfd poll_fd;
+            poll_fd.fd = fd;
+            bzero(&poll_fd.events, sizeof(poll_fd.events));
+            poll_fd.events |=
+                (info.Interesting_events & kEventRead ? POLLIN : 0);
+            poll_fd.events |=
+                (info.Interesting_events & kEventWrite ? POLLOUT : 0);
+            poll_fds_.push_back(poll_fd);
+        }
+        changed_ = false;
+    }
 
-            if (poll_fd.revents == 0) {
-                continue;
-            }
+    int rc = poll(poll_fds_.data(), poll_fds_.size(), timeout);
 
-            cnt++;
-            auto iter = event_infos_.find(poll_fd.fd);
-            if (iter == event_infos_.end()) {
-                // Just delete
-                continue;
-            }
-            Event e = 0;
-            e |= (poll_fd.revents & POLLIN ? kEventRead : 0);
-            e |= (poll_fd.revents & POLLOUT ? kEventWrite : 0);
-            e |= (poll_fd.revents & POLLHUP ? kEventClose : 0);
-            e |= (poll_fd.revents & POLLERR ? kEventError : 0);
-            if (poll_fd.revents & POLLNVAL) {
-                throw OSException(errno, "fd not opened: {}", strerror(errno));
-            }
-            // TODO: POLL_PRI
-            iter->second.handler(e);
+    if (rc == -1) {
+        if (errno == EAGAIN || errno == EINTR) {
+            return false;
+        }
+        throw OSException(errno, "poll error: {}", strerror(errno));
+    }
+
+    int cnt = 0;
+    for (const pollfd& poll_fd : poll_fds_) {
+        if (cnt == rc) {
+            break;
         }
 
-        if (after_all_events_) {
-            after_all_events_();
+        if (poll_fd.revents == 0) {
+            continue;
         }
+
+        cnt++;
+        auto iter = event_infos_.find(poll_fd.fd);
+        if (iter == event_infos_.end()) {
+            // Just delete
+            continue;
+        }
+        Event e = 0;
+        e |= (poll_fd.revents & POLLIN ? kEventRead : 0);
+        e |= (poll_fd.revents & POLLOUT ? kEventWrite : 0);
+        e |= (poll_fd.revents & POLLHUP ? kEventClose : 0);
+        e |= (poll_fd.revents & POLLERR ? kEventError : 0);
+        if (poll_fd.revents & POLLNVAL) {
+            throw OSException(errno, "fd not opened: {}", strerror(errno));
+        }
+        // TODO: POLL_PRI
+        MGO_TRACE_SCOPE("EventLoop::Handler");
+        iter->second.handler(e);
     }
+    return rc > 0;
 }
 
+#endif
+
 }  // namespace mango
\ No newline at end of file
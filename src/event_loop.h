@@ -7,6 +7,15 @@
 #include "poll.h"
 #include "timer_manager.h"
 
+#ifdef __linux__
+#include <sys/epoll.h>
+
+#include "os.h"
+
+// epoll is used on linux, poll is the portable fallback.
+#define MGO_EVENT_LOOP_EPOLL
+#endif
+
 namespace mango {
 
 constexpr int kEventRead = 0b1;
@@ -22,6 +31,10 @@ struct EventInfo {
     EventFD fd;
     Event Interesting_events = 0;
     EventHandler handler;
+    // The handler is only called when new events arrive, so it must consume
+    // all of them, e.g. read until EAGAIN. Only takes effect with epoll, with
+    // poll it's level triggered anyway, which is fine for such handlers.
+    bool edge_triggered = false;
 };
 
 class GlobalOpts;
@@ -29,8 +42,10 @@ class GlobalOpts;
 // Event loop will handle handler events.
 class EventLoop {
    public:
+    // throw OSException
     EventLoop(GlobalOpts* global_opts);
 
+    // throw OSException
     void AddEventHandler(const EventInfo& info);
     void RemoveEventHandler(EventFD fd);
 
@@ -41,10 +56,20 @@ class EventLoop {
     void EndLoop() { quit_ = true; }
 
    private:
+    // Wait at most timeout ms and call handlers of ready fds.
+    // Return false if no fd is ready.
+    // throw OSException
+    bool PollEvents(int timeout);
+
+#ifdef MGO_EVENT_LOOP_EPOLL
+    Fd epoll_fd_;
+    std::vector<epoll_event> ready_events_;
+#else
     std::vector<pollfd> poll_fds_;
+    bool changed_ = false;
+#endif
 
     std::unordered_map<EventFD, EventInfo> event_infos_;
-    bool changed_ = false;
     bool quit_ = false;
 
     std::function<void()> before_poll_;
@@ -54,6 +79,7 @@ class EventLoop {
 
     public:
     TimerManager timer_manager_;
+    IdleScheduler idle_scheduler_;
 };
 
 }  // namespace mango
\ No newline at end of file
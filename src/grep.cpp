@@ -0,0 +1,267 @@
+#include "grep.h"
+
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#include <algorithm>
+#include <gsl/util>
+#include <thread>
+
+#include "character.h"
+#include "fmt/format.h"
+
+namespace mango {
+
+// A NUL byte in the first bytes means a binary file, like what grep does.
+static constexpr size_t kGrepBinaryCheckBytes = 8192;
+// Contents are first tested by chunks, lines of a chunk are only searched one
+// by one when the chunk matches, which is rare. Most of a file is skipped by
+// the dfa then.
+static constexpr size_t kGrepChunkBytes = 64 * 1024;
+static constexpr size_t kGrepMaxLineBytes = 256;
+static constexpr size_t kGrepMaxMatches = 100000;
+static constexpr size_t kGrepMaxThreads = 16;
+
+bool GrepContents(std::string_view contents, Regex& regex,
+                  const GrepMatchHandler& on_match) {
+    if (contents.substr(0, kGrepBinaryCheckBytes).find('\0') !=
+        std::string_view::npos) {
+        return false;
+    }
+
+    size_t line = 0;
+    size_t chunk_begin = 0;
+    while (chunk_begin < contents.size()) {
+        // A chunk always ends at an eol.
+        size_t chunk_end = contents.find(
+            '\n', std::min(chunk_begin + kGrepChunkBytes, contents.size()));
+        if (chunk_end == std::string_view::npos) {
+            chunk_end = contents.size();
+        }
+        std::string_view chunk =
+            contents.substr(chunk_begin, chunk_end - chunk_begin);
+        if (!regex.Test(chunk)) {
+            line += std::count(chunk.begin(), chunk.end(), '\n') + 1;
+            chunk_begin = chunk_end + 1;
+            continue;
+        }
+
+        for (size_t pos = chunk_begin;;) {
+            size_t eol = contents.find('\n', pos);
+            if (eol == std::string_view::npos || eol > chunk_end) {
+                eol = chunk_end;
+            }
+            std::string_view line_str = contents.substr(pos, eol - pos);
+            if (!line_str.empty() && line_str.back() == '\r') {
+                line_str.remove_suffix(1);
+            }
+            RegexMatch m;
+            if (regex.Search(line_str, 0, m)) {
+                if (!CheckUtf8Valid(line_str)) {
+                    return false;
+                }
+                if (!on_match(line, m.begin, line_str)) {
+                    return true;
+                }
+            }
+            line++;
+            // The empty text after the last eol is not a line.
+            if (eol == chunk_end || eol + 1 == contents.size()) {
+                break;
+            }
+            pos = eol + 1;
+        }
+        chunk_begin = chunk_end + 1;
+    }
+    return true;
+}
+
+std::string FormatGrepMatch(const GrepMatch& match) {
+    return fmt::format("{}:{}:{}: {}", match.path, match.line + 1,
+                       match.byte_offset + 1, match.text);
+}
+
+// Parse digits and a ':' at str[i], i will be set after the ':'.
+static bool ParseGrepNumber(std::string_view str, size_t& i, size_t& n) {
+    size_t begin = i;
+    n = 0;
+    for (; i < str.size() && str[i] >= '0' && str[i] <= '9'; i++) {
+        n = n * 10 + str[i] - '0';
+    }
+    if (i == begin || i == str.size() || str[i] != ':' || n == 0) {
+        return false;
+    }
+    i++;
+    return true;
+}
+
+bool ParseGrepMatch(std::string_view str, std::string& path, Pos& pos) {
+    // Path may contain ':', so we find the first ":line:col:".
+    for (size_t colon = str.find(':'); colon != std::string_view::npos;
+         colon = str.find(':', colon + 1)) {
+        if (colon == 0) {
+            continue;
+        }
+        size_t i = colon + 1;
+        size_t line, col;
+        if (ParseGrepNumber(str, i, line) && ParseGrepNumber(str, i, col)) {
+            path = str.substr(0, colon);
+            pos = {line - 1, col - 1};
+            return true;
+        }
+    }
+    return false;
+}
+
+// Truncate at a codepoint boundary.
+static std::string TruncateGrepLine(std::string_view line_str) {
+    if (line_str.size() <= kGrepMaxLineBytes) {
+        return std::string(line_str);
+    }
+    size_t len = kGrepMaxLineBytes;
+    while (len > 0 && (line_str[len] & 0xC0) == 0x80) {
+        len--;
+    }
+    return std::string(line_str.substr(0, len)) + "...";
+}
+
+Grep::Grep(const std::string& pattern, int regex_flags,
+           const std::string& root, EventLoop* loop,
+           const MatchesHandler& on_matches,
+           const std::vector<std::string>* files)
+    : loop_(loop), on_matches_(on_matches) {
+    // '^' and '$' must match at every line when testing a chunk, whose eols
+    // may be CRLF.
+    regex_flags |= kRegexMultiLine | kRegexCRLF;
+    size_t thread_cnt = std::clamp<size_t>(std::thread::hardware_concurrency(),
+                                           1, kGrepMaxThreads);
+    for (size_t i = 0; i < thread_cnt; i++) {
+        regexes_.push_back(std::make_unique<Regex>(pattern, regex_flags));
+    }
+
+    Pipe(wake_);
+    for (const Fd& fd : wake_) {
+        int flags = fcntl(fd.fd, F_GETFL);
+        fcntl(fd.fd, F_SETFL, flags | O_NONBLOCK);
+        fcntl(fd.fd, F_SETFD, FD_CLOEXEC);
+    }
+    EventInfo info;
+    info.fd = wake_[0].fd;
+    info.Interesting_events = kEventRead;
+    info.handler = [this](Event e) {
+        (void)e;
+        OnWakeUp();
+    };
+    loop_->AddEventHandler(info);
+
+    if (files && files->empty()) {
+        Push({}, true);
+        return;
+    }
+    auto on_file = [this](size_t worker, const std::string& path) {
+        SearchFile(worker, path);
+    };
+    auto on_done = [this] { Push({}, true); };
+    std::lock_guard<std::mutex> lk(mtx_);
+    if (files) {
+        walker_ = std::make_unique<ParallelWalker>(root, *files, thread_cnt,
+                                                   on_file, on_done);
+    } else {
+        walker_ = std::make_unique<ParallelWalker>(root, thread_cnt, on_file,
+                                                   on_done);
+    }
+}
+
+Grep::~Grep() {
+    Stop();
+    walker_.reset();
+    loop_->RemoveEventHandler(wake_[0].fd);
+}
+
+void Grep::Stop() {
+    stopped_ = true;
+    std::lock_guard<std::mutex> lk(mtx_);
+    done_ = true;
+    if (walker_) {
+        walker_->Stop();
+    }
+}
+
+void Grep::SearchFile(size_t worker, const std::string& path) {
+    if (stopped_) {
+        return;
+    }
+    Fd fd(open(path.c_str(), O_RDONLY | O_CLOEXEC));
+    struct stat st;
+    if (fd.fd == -1 || fstat(fd.fd, &st) == -1 || st.st_size == 0) {
+        return;
+    }
+    size_t size = st.st_size;
+    void* addr = mmap(nullptr, size, PROT_READ, MAP_PRIVATE, fd.fd, 0);
+    if (addr == MAP_FAILED) {
+        return;
+    }
+    auto _ = gsl::finally([addr, size] { munmap(addr, size); });
+    madvise(addr, size, MADV_SEQUENTIAL);
+
+    std::vector<GrepMatch> matches;
+    if (!GrepContents({static_cast<const char*>(addr), size},
+                      *regexes_[worker],
+                      [&](size_t line, size_t byte_offset,
+                          std::string_view line_str) {
+                          matches.push_back({path, line, byte_offset,
+                                             TruncateGrepLine(line_str)});
+                          return !stopped_;
+                      })) {
+        // Not text, matches before the invalid part are dropped too.
+        matches.clear();
+    }
+    searched_files_++;
+    if (!matches.empty()) {
+        Push(std::move(matches), false);
+    }
+}
+
+void Grep::Push(std::vector<GrepMatch>&& matches, bool done) {
+    std::lock_guard<std::mutex> lk(mtx_);
+    if (done_) {
+        return;
+    }
+    for (auto& match : matches) {
+        if (match_cnt_ == kGrepMaxMatches) {
+            truncated_ = true;
+            done = true;
+            walker_->Stop();
+            break;
+        }
+        matches_.push_back(std::move(match));
+        match_cnt_++;
+    }
+    done_ = done;
+    if (!wake_pending_) {
+        wake_pending_ = true;
+        char c = 0;
+        // Never blocks: at most one byte is in the pipe.
+        (void)!write(wake_[1].fd, &c, 1);
+    }
+}
+
+void Grep::OnWakeUp() {
+    char buf[16];
+    (void)!read(wake_[0].fd, buf, sizeof(buf));
+
+    std::vector<GrepMatch> matches;
+    bool done;
+    {
+        std::lock_guard<std::mutex> lk(mtx_);
+        matches.swap(matches_);
+        done = done_;
+        wake_pending_ = false;
+    }
+    if (stopped_) {
+        return;
+    }
+    on_matches_(matches, done);
+}
+
+}  // namespace mango
@@ -0,0 +1,100 @@
+#pragma once
+
+#include <atomic>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+
+#include "event_loop.h"
+#include "os.h"
+#include "pos.h"
+#include "regex_engine.h"
+#include "walker.h"
+
+namespace mango {
+
+struct GrepMatch {
+    std::string path;
+    size_t line;
+    size_t byte_offset;
+    std::string text;  // the matched line, may be truncated
+};
+
+// line_str is the whole line without the eol.
+// Return false to stop searching.
+using GrepMatchHandler = std::function<bool(
+    size_t line, size_t byte_offset, std::string_view line_str)>;
+
+// Search contents line by line, the first match of every line is reported.
+// Like grep, an empty match counts, e.g. "^$" reports empty lines.
+// Return false if contents looks like binary or isn't valid utf-8, searching
+// stops then.
+bool GrepContents(std::string_view contents, Regex& regex,
+                  const GrepMatchHandler& on_match);
+
+// "path:line:col: text", line and col are from 1.
+std::string FormatGrepMatch(const GrepMatch& match);
+// Parse a line formatted by FormatGrepMatch.
+// Return false if str is not a grep result.
+bool ParseGrepMatch(std::string_view str, std::string& path, Pos& pos);
+
+// Search all files under a directory with a pattern (project-wide grep).
+// The tree is walked and files are searched on the threads of a
+// ParallelWalker, files are read by mmap. Matches are streamed back to the
+// event loop thread through a pipe, so on_matches is always called in the
+// loop, never on a worker thread.
+class Grep {
+   public:
+    // done is true at the last call.
+    using MatchesHandler =
+        std::function<void(std::vector<GrepMatch>& matches, bool done)>;
+
+    // root should end with a slash or be empty(cwd).
+    // If files is not null, only these files(relative to root) are searched
+    // instead of walking root, e.g. candidates from a TrigramIndex.
+    // throws RegexCompileException, OSException
+    Grep(const std::string& pattern, int regex_flags, const std::string& root,
+         EventLoop* loop, const MatchesHandler& on_matches,
+         const std::vector<std::string>* files = nullptr);
+    ~Grep();
+    MGO_DELETE_COPY(Grep);
+    MGO_DELETE_MOVE(Grep);
+
+    // Stop searching, on_matches won't be called anymore.
+    void Stop();
+
+    size_t searched_files() const { return searched_files_; }
+    // True if too many matches, the rest are dropped.
+    bool truncated() const { return truncated_; }
+
+   private:
+    // Called on worker threads.
+    void SearchFile(size_t worker, const std::string& path);
+    void Push(std::vector<GrepMatch>&& matches, bool done);
+
+    void OnWakeUp();
+
+    EventLoop* loop_;
+    MatchesHandler on_matches_;
+    // One per worker, Regex is not thread safe.
+    std::vector<std::unique_ptr<Regex>> regexes_;
+    Fd wake_[2];  // pipe, workers write to wake the loop up
+
+    std::mutex mtx_;  // protects the fields below and walker_ creation
+    std::vector<GrepMatch> matches_;
+    size_t match_cnt_ = 0;
+    bool wake_pending_ = false;
+    bool done_ = false;
+
+    std::atomic<bool> stopped_ = false;
+    std::atomic<bool> truncated_ = false;
+    std::atomic<size_t> searched_files_ = 0;
+
+    // Declared last, so threads are joined first. Null if there is no file
+    // to search.
+    std::unique_ptr<ParallelWalker> walker_;
+};
+
+}  // namespace mango
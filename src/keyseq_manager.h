@@ -10,6 +10,11 @@
 
 namespace mango {
 
+// Keyseq types.
+// Feeding a counted motion n times is the same as feeding it once with count
+// n, so repeated ones can be folded.
+constexpr int kKeyseqCountedMotion = 1;
+
 struct Keyseq {
     std::string name;
     std::string description;
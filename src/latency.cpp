@@ -0,0 +1,156 @@
+#include "latency.h"
+
+#include <cmath>
+#include <cstring>
+#include <string_view>
+
+#include "exception.h"
+#include "file.h"
+#include "fmt/format.h"
+
+namespace mango {
+
+static constexpr std::string_view kLatencyPhaseNames[__kLatencyPhaseCount] = {
+    "input", "preprocess", "draw", "present", "key_to_photon"};
+
+LatencyHistogram::LatencyHistogram()
+    : counts_((64 - kSubBucketBits + 2) * kSubBucketHalfCnt) {}
+
+// Values in [0, kSubBucketCnt) are in bucket 0, [2^k, 2^(k+1)) above are in
+// bucket k - kSubBucketBits + 1. A bucket is sub bucketed by value >> bucket,
+// whose lower half is covered by the previous bucket except bucket 0.
+size_t LatencyHistogram::BucketIndex(uint64_t value) {
+    int bucket = 0;
+    if (value >= kSubBucketCnt) {
+        bucket = 63 - __builtin_clzll(value) - kSubBucketBits + 1;
+    }
+    return bucket * kSubBucketHalfCnt + (value >> bucket);
+}
+
+uint64_t LatencyHistogram::BucketHighest(size_t index) {
+    if (index < kSubBucketCnt) {
+        return index;
+    }
+    int bucket = index / kSubBucketHalfCnt - 1;
+    uint64_t sub_bucket = index - bucket * kSubBucketHalfCnt;
+    // Wraps to UINT64_MAX for the last one.
+    return ((sub_bucket + 1) << bucket) - 1;
+}
+
+void LatencyHistogram::Record(uint64_t value) {
+    counts_[BucketIndex(value)]++;
+    count_++;
+    max_ = std::max(max_, value);
+}
+
+void LatencyHistogram::Clear() {
+    std::fill(counts_.begin(), counts_.end(), 0);
+    count_ = 0;
+    max_ = 0;
+}
+
+uint64_t LatencyHistogram::Percentile(double p) const {
+    if (count_ == 0) {
+        return 0;
+    }
+    uint64_t target = std::ceil(count_ * std::min(p, 100.0) / 100.0);
+    target = std::max<uint64_t>(target, 1);
+    uint64_t seen = 0;
+    for (size_t i = 0; i < counts_.size(); i++) {
+        seen += counts_[i];
+        if (seen >= target) {
+            return std::min(BucketHighest(i), max_);
+        }
+    }
+    return max_;
+}
+
+static uint64_t ToMicroseconds(LatencyStats::Clock::duration duration) {
+    int64_t us =
+        std::chrono::duration_cast<std::chrono::microseconds>(duration)
+            .count();
+    return us < 0 ? 0 : us;
+}
+
+void LatencyStats::Record(LatencyPhase phase, Clock::time_point begin,
+                          Clock::time_point end) {
+    histograms_[phase].Record(ToMicroseconds(end - begin));
+}
+
+void LatencyStats::EventHandled(Clock::time_point event_time) {
+    Record(kLatencyInput, event_time, Clock::now());
+    if (!has_unpresented_event_) {
+        unpresented_event_time_ = event_time;
+        has_unpresented_event_ = true;
+    }
+}
+
+void LatencyStats::FramePresented() {
+    if (!has_unpresented_event_) {
+        return;
+    }
+    Record(kLatencyKeyToPhoton, unpresented_event_time_, Clock::now());
+    has_unpresented_event_ = false;
+}
+
+void LatencyStats::Clear() {
+    for (LatencyHistogram& histogram : histograms_) {
+        histogram.Clear();
+    }
+    has_unpresented_event_ = false;
+}
+
+std::string LatencyStats::Report() const {
+    std::string res = fmt::format("{:<14}{:>8}{:>10}{:>10}{:>10}", "[perf] us",
+                                  "count", "p50", "p99", "max");
+    for (int i = 0; i < __kLatencyPhaseCount; i++) {
+        const LatencyHistogram& histogram = histograms_[i];
+        res += fmt::format("\n{:<14}{:>8}{:>10}{:>10}{:>10}",
+                           kLatencyPhaseNames[i], histogram.Count(),
+                           histogram.Percentile(50), histogram.Percentile(99),
+                           histogram.Max());
+    }
+    return res;
+}
+
+// Like the percentile distribution output of HdrHistogram, so it can be
+// plotted by its tools.
+void LatencyStats::Dump(const std::string& path) const {
+    std::string content;
+    for (int i = 0; i < __kLatencyPhaseCount; i++) {
+        const LatencyHistogram& histogram = histograms_[i];
+        content += fmt::format("# {}\n{:>12} {:>14} {:>10}\n\n",
+                               kLatencyPhaseNames[i], "Value(us)",
+                               "Percentile", "TotalCount");
+        uint64_t seen = 0;
+        histogram.ForEachBucket([&](uint64_t value, uint64_t count) {
+            seen += count;
+            content += fmt::format(
+                "{:>12} {:>14.12f} {:>10}\n", value,
+                static_cast<double>(seen) / histogram.Count(), seen);
+        });
+        content += fmt::format("#[Max = {}, Count = {}]\n\n", histogram.Max(),
+                               histogram.Count());
+    }
+
+    File file(path, "w", false);
+    if (fwrite(content.data(), 1, content.size(), file.file()) !=
+        content.size()) {
+        throw IOException("fwrite error: {}", strerror(errno));
+    }
+}
+
+FramePacer::Clock::duration FramePacer::Wait(Clock::time_point now,
+                                            int64_t max_fps) const {
+    if (max_fps <= 0 || (input_since_frame_ && !last_frame_for_input_)) {
+        return Clock::duration::zero();
+    }
+    auto frame_interval = std::chrono::microseconds(1000000 / max_fps);
+    auto since_last_frame = now - last_frame_time_;
+    if (since_last_frame >= frame_interval) {
+        return Clock::duration::zero();
+    }
+    return frame_interval - since_last_frame;
+}
+
+}  // namespace mango
@@ -0,0 +1,151 @@
+#pragma once
+
+#include <algorithm>
+#include <chrono>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+#include "utils.h"
+
+namespace mango {
+
+// A histogram of values in the layout of HdrHistogram: values below
+// kSubBucketCnt are counted one by one, every [2^k, 2^(k+1)) above is split
+// into kSubBucketCnt / 2 equal sub buckets. So recording is O(1) with a fixed
+// size of memory, and a value is reported off by less than 1 / 16 of itself.
+class LatencyHistogram {
+   public:
+    LatencyHistogram();
+
+    void Record(uint64_t value);
+    void Clear();
+
+    uint64_t Count() const { return count_; }
+    uint64_t Max() const { return max_; }
+    // The value that p percent of the recorded values are not above,
+    // p in (0, 100]. It's the highest value of its sub bucket, and never
+    // above Max(). 0 if nothing recorded.
+    uint64_t Percentile(double p) const;
+
+    // Call f(highest value, count) for every non-empty sub bucket in order.
+    template <typename F>
+    void ForEachBucket(F f) const {
+        for (size_t i = 0; i < counts_.size(); i++) {
+            if (counts_[i] != 0) {
+                f(std::min(BucketHighest(i), max_), counts_[i]);
+            }
+        }
+    }
+
+   private:
+    static constexpr int kSubBucketBits = 5;
+    static constexpr uint64_t kSubBucketCnt = 1 << kSubBucketBits;
+    static constexpr uint64_t kSubBucketHalfCnt = kSubBucketCnt / 2;
+
+    static size_t BucketIndex(uint64_t value);
+    static uint64_t BucketHighest(size_t index);
+
+    std::vector<uint64_t> counts_;
+    uint64_t count_ = 0;
+    uint64_t max_ = 0;
+};
+
+enum LatencyPhase {
+    kLatencyInput,  // from an event read to it handled
+    kLatencyPreProcess,
+    kLatencyDraw,
+    kLatencyPresent,
+    kLatencyKeyToPhoton,  // from an event read to the frame showing it
+    __kLatencyPhaseCount,
+};
+
+// Where the time goes from reading terminal events to presenting the frame
+// showing them. Durations are in microseconds.
+class LatencyStats {
+   public:
+    using Clock = std::chrono::steady_clock;
+
+    LatencyStats() = default;
+    MGO_DELETE_COPY(LatencyStats);
+    MGO_DELETE_MOVE(LatencyStats);
+
+    void Record(LatencyPhase phase, Clock::time_point begin,
+                Clock::time_point end);
+    // An event read at event_time has been handled.
+    void EventHandled(Clock::time_point event_time);
+    // A frame is presented, it shows all events handled before.
+    void FramePresented();
+    void Clear();
+
+    const LatencyHistogram& histogram(LatencyPhase phase) const {
+        return histograms_[phase];
+    }
+
+    // p50, p99 and max of every phase, one line per phase.
+    std::string Report() const;
+    // Write the percentile distribution of every phase to path.
+    // throws IOException
+    void Dump(const std::string& path) const;
+
+   private:
+    LatencyHistogram histograms_[__kLatencyPhaseCount];
+    // The earliest event not presented yet.
+    Clock::time_point unpresented_event_time_;
+    bool has_unpresented_event_ = false;
+};
+
+// Record the time from the construction to End() or the destruction into a
+// phase. Nothing is done when stats is nullptr, so it's nearly free when
+// stats are off.
+class LatencyScope {
+   public:
+    LatencyScope(LatencyStats* stats, LatencyPhase phase)
+        : stats_(stats), phase_(phase) {
+        if (stats_) {
+            begin_ = LatencyStats::Clock::now();
+        }
+    }
+    ~LatencyScope() { End(); }
+    MGO_DELETE_COPY(LatencyScope);
+    MGO_DELETE_MOVE(LatencyScope);
+
+    void End() {
+        if (stats_) {
+            stats_->Record(phase_, begin_, LatencyStats::Clock::now());
+            stats_ = nullptr;
+        }
+    }
+
+   private:
+    LatencyStats* stats_;
+    LatencyPhase phase_;
+    LatencyStats::Clock::time_point begin_;
+};
+
+// Paces frames for max_fps. Only bursts of input are paced: the first input
+// after a frame not drawn for input is drawn at once, so a lone keystroke is
+// never held. Frames for other wakeups, e.g. background search slices, are
+// paced too, so they don't redraw for each of them.
+class FramePacer {
+   public:
+    using Clock = std::chrono::steady_clock;
+
+    // Some input has been handled since the last frame.
+    void InputHandled() { input_since_frame_ = true; }
+    // How long the next frame should wait, zero if it can be drawn now.
+    // max_fps <= 0 means no limit.
+    Clock::duration Wait(Clock::time_point now, int64_t max_fps) const;
+    void FrameDrawn(Clock::time_point now) {
+        last_frame_time_ = now;
+        last_frame_for_input_ = input_since_frame_;
+        input_since_frame_ = false;
+    }
+
+   private:
+    Clock::time_point last_frame_time_;
+    bool input_since_frame_ = false;
+    bool last_frame_for_input_ = false;
+};
+
+}  // namespace mango
@@ -26,7 +26,7 @@ MangoPeel::MangoPeel(Cursor* cursor, GlobalOpts* global_opts,
     opts_.SetOpt(kOptTrailingWhite, false);
 }
 
-void MangoPeel::Draw() { area_.Draw(nullptr); }
+bool MangoPeel::Draw() { return area_.Draw(nullptr); }
 
 void MangoPeel::MakeCursorVisible() {
     MGO_ASSERT(area_.cursor_->in_window == nullptr);
@@ -181,7 +181,7 @@ size_t MangoPeel::NeedHeight(size_t width) {
     size_t height = 0;
     auto tabstop = GetOpt<int64_t>(kOptTabStop);
     for (size_t i = 0; i < line_cnt; i++) {
-        height += ScreenRows(buffer_.GetLine(i), width, tabstop);
+        height += buffer_.GetWrapLayout(i, width, tabstop).ScreenRows();
     }
     return std::max<size_t>(height, 1);
 }
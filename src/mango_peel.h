@@ -17,7 +17,8 @@ class MangoPeel {
     MGO_DELETE_COPY(MangoPeel);
     MGO_DEFAULT_MOVE(MangoPeel);
 
-    void Draw();
+    // Return true if the peel is repainted.
+    bool Draw();
 
     void MakeCursorVisible();
 
@@ -36,7 +36,9 @@ static const std::unordered_map<std::string_view, OptKey> kStrRepToOptKey{
     {"highlight_on_search", kOptHighlightOnSearch},
     {"input_idle_timeout", kOptInputIdleTimeout},
     {"logverbose", kOptLogVerbose},
+    {"max_fps", kOptMaxFps},
     {"max_jump_history", kOptMaxJumpHistory},
+    {"perf_stats", kOptPerfStats},
     {"search_ignore_case", kOptSearchIgnoreCase},
     {"scroll_rows", kOptScrollRows},
     {"truecolor", kOptTrueColor},
@@ -72,8 +74,10 @@ static void OptStaticInit(const OptInfo*& opt_info) {
         static_opt_info[kOptInputIdleTimeout] = {OptScope::kGlobal,
                                                  Type::kInteger};
         static_opt_info[kOptLogVerbose] = {OptScope::kGlobal, Type::kBool};
+        static_opt_info[kOptMaxFps] = {OptScope::kGlobal, Type::kInteger};
         static_opt_info[kOptMaxJumpHistory] = {OptScope::kGlobal,
                                                Type::kInteger};
+        static_opt_info[kOptPerfStats] = {OptScope::kGlobal, Type::kBool};
         static_opt_info[kOptScrollRows] = {OptScope::kGlobal, Type::kBool};
         static_opt_info[kOptScrollRows] = {OptScope::kGlobal, Type::kInteger};
         static_opt_info[kOptTrueColor] = {OptScope::kGlobal, Type::kBool};
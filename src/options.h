@@ -76,7 +76,9 @@ enum OptKey {
     kOptHighlightOnSearch,
     kOptInputIdleTimeout,
     kOptLogVerbose,
+    kOptMaxFps,
     kOptMaxJumpHistory,
+    kOptPerfStats,
     kOptScrollRows,
     kOptSearchIgnoreCase,
     kOptTrueColor,
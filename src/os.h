@@ -110,9 +110,9 @@ inline Fd Open(const char* file, int oflags = O_RDWR, mode_t mode = 0644) {
     Fd fd;
     while (true) {
         if (oflags & O_CREAT) {
-            fd.fd = open(file, oflags);
-        } else {
             fd.fd = open(file, oflags, mode);
+        } else {
+            fd.fd = open(file, oflags);
         }
         if (fd.fd >= 0) {
             return fd;
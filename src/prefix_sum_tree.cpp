@@ -0,0 +1,225 @@
+#include "prefix_sum_tree.h"
+
+#include "utils.h"
+
+namespace mango {
+
+void PrefixSumTree::Clear() {
+    nodes_.clear();
+    free_nodes_.clear();
+    root_ = kNull;
+}
+
+size_t PrefixSumTree::Get(size_t i) const {
+    MGO_ASSERT(i < size());
+    uint32_t t = root_;
+    while (true) {
+        const Node& node = nodes_[t];
+        size_t left_cnt = Cnt(node.left);
+        if (i < left_cnt) {
+            t = node.left;
+        } else if (i == left_cnt) {
+            return node.value;
+        } else {
+            i -= left_cnt + 1;
+            t = node.right;
+        }
+    }
+}
+
+void PrefixSumTree::Set(size_t i, size_t value) {
+    MGO_ASSERT(i < size());
+    std::vector<uint32_t> path;
+    uint32_t t = root_;
+    while (true) {
+        path.push_back(t);
+        const Node& node = nodes_[t];
+        size_t left_cnt = Cnt(node.left);
+        if (i < left_cnt) {
+            t = node.left;
+        } else if (i == left_cnt) {
+            break;
+        } else {
+            i -= left_cnt + 1;
+            t = node.right;
+        }
+    }
+    nodes_[t].value = value;
+    for (auto iter = path.rbegin(); iter != path.rend(); iter++) {
+        Update(*iter);
+    }
+}
+
+void PrefixSumTree::Insert(size_t i, const std::vector<size_t>& values) {
+    MGO_ASSERT(i <= size());
+    if (values.empty()) {
+        return;
+    }
+    uint32_t t = Build(values);
+    uint32_t l, r;
+    Split(root_, i, l, r);
+    root_ = Merge(Merge(l, t), r);
+}
+
+void PrefixSumTree::Erase(size_t i, size_t cnt) {
+    MGO_ASSERT(i + cnt <= size());
+    if (cnt == 0) {
+        return;
+    }
+    uint32_t l, m, r;
+    Split(root_, i, l, r);
+    Split(r, cnt, m, r);
+    FreeTree(m);
+    root_ = Merge(l, r);
+}
+
+size_t PrefixSumTree::PrefixSum(size_t i) const {
+    MGO_ASSERT(i <= size());
+    size_t sum = 0;
+    uint32_t t = root_;
+    while (t != kNull && i > 0) {
+        const Node& node = nodes_[t];
+        size_t left_cnt = Cnt(node.left);
+        if (i <= left_cnt) {
+            t = node.left;
+        } else {
+            sum += (node.left == kNull ? 0 : nodes_[node.left].sum) +
+                   node.value;
+            i -= left_cnt + 1;
+            t = node.right;
+        }
+    }
+    return sum;
+}
+
+size_t PrefixSumTree::Find(size_t sum, size_t& rest) const {
+    MGO_ASSERT(sum < Sum());
+    size_t i = 0;
+    uint32_t t = root_;
+    while (true) {
+        const Node& node = nodes_[t];
+        size_t left_sum = node.left == kNull ? 0 : nodes_[node.left].sum;
+        if (sum < left_sum) {
+            t = node.left;
+        } else if (sum < left_sum + node.value) {
+            rest = sum - left_sum;
+            return i + Cnt(node.left);
+        } else {
+            sum -= left_sum + node.value;
+            i += Cnt(node.left) + 1;
+            t = node.right;
+        }
+    }
+}
+
+uint32_t PrefixSumTree::NewNode(size_t value) {
+    // xorshift32
+    seed_ ^= seed_ << 13;
+    seed_ ^= seed_ >> 17;
+    seed_ ^= seed_ << 5;
+    Node node = {value, value, 1, seed_, kNull, kNull};
+    if (!free_nodes_.empty()) {
+        uint32_t t = free_nodes_.back();
+        free_nodes_.pop_back();
+        nodes_[t] = node;
+        return t;
+    }
+    nodes_.push_back(node);
+    return nodes_.size() - 1;
+}
+
+void PrefixSumTree::FreeTree(uint32_t t) {
+    std::vector<uint32_t> stack;
+    if (t != kNull) {
+        stack.push_back(t);
+    }
+    while (!stack.empty()) {
+        t = stack.back();
+        stack.pop_back();
+        free_nodes_.push_back(t);
+        if (nodes_[t].left != kNull) {
+            stack.push_back(nodes_[t].left);
+        }
+        if (nodes_[t].right != kNull) {
+            stack.push_back(nodes_[t].right);
+        }
+    }
+}
+
+void PrefixSumTree::Update(uint32_t t) {
+    Node& node = nodes_[t];
+    node.sum = node.value;
+    node.cnt = 1;
+    if (node.left != kNull) {
+        node.sum += nodes_[node.left].sum;
+        node.cnt += nodes_[node.left].cnt;
+    }
+    if (node.right != kNull) {
+        node.sum += nodes_[node.right].sum;
+        node.cnt += nodes_[node.right].cnt;
+    }
+}
+
+// The rightmost path is kept in a stack, a new node takes the nodes with
+// smaller priorities on the path as its left subtree.
+uint32_t PrefixSumTree::Build(const std::vector<size_t>& values) {
+    std::vector<uint32_t> stack;
+    for (size_t value : values) {
+        uint32_t t = NewNode(value);
+        uint32_t last = kNull;
+        while (!stack.empty() &&
+               nodes_[stack.back()].priority < nodes_[t].priority) {
+            last = stack.back();
+            stack.pop_back();
+            Update(last);
+        }
+        nodes_[t].left = last;
+        if (!stack.empty()) {
+            nodes_[stack.back()].right = t;
+        }
+        stack.push_back(t);
+    }
+    for (auto iter = stack.rbegin(); iter != stack.rend(); iter++) {
+        Update(*iter);
+    }
+    return stack.front();
+}
+
+void PrefixSumTree::Split(uint32_t t, size_t k, uint32_t& l, uint32_t& r) {
+    if (t == kNull) {
+        l = r = kNull;
+        return;
+    }
+    size_t left_cnt = Cnt(nodes_[t].left);
+    if (k <= left_cnt) {
+        uint32_t ll;
+        Split(nodes_[t].left, k, l, ll);
+        nodes_[t].left = ll;
+        r = t;
+    } else {
+        uint32_t rr;
+        Split(nodes_[t].right, k - left_cnt - 1, rr, r);
+        nodes_[t].right = rr;
+        l = t;
+    }
+    Update(t);
+}
+
+uint32_t PrefixSumTree::Merge(uint32_t l, uint32_t r) {
+    if (l == kNull) {
+        return r;
+    }
+    if (r == kNull) {
+        return l;
+    }
+    if (nodes_[l].priority > nodes_[r].priority) {
+        nodes_[l].right = Merge(nodes_[l].right, r);
+        Update(l);
+        return l;
+    }
+    nodes_[r].left = Merge(l, nodes_[r].left);
+    Update(r);
+    return r;
+}
+
+}  // namespace mango
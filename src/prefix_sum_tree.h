@@ -0,0 +1,62 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+namespace mango {
+
+// A sequence of values, which supports inserting, erasing, updating and prefix
+// sums in O(log n). It's an implicit treap, nodes are kept in a vector and
+// reused.
+class PrefixSumTree {
+   public:
+    PrefixSumTree() = default;
+
+    void Clear();
+
+    size_t size() const { return root_ == kNull ? 0 : nodes_[root_].cnt; }
+    // Sum of all values.
+    size_t Sum() const { return root_ == kNull ? 0 : nodes_[root_].sum; }
+
+    size_t Get(size_t i) const;
+    void Set(size_t i, size_t value);
+    // Insert values before i, i == size() to append.
+    void Insert(size_t i, const std::vector<size_t>& values);
+    void Erase(size_t i, size_t cnt);
+
+    // Sum of values in [0, i), i <= size().
+    size_t PrefixSum(size_t i) const;
+    // Return i that PrefixSum(i) <= sum < PrefixSum(i + 1), rest is set to
+    // sum - PrefixSum(i). sum should < Sum().
+    size_t Find(size_t sum, size_t& rest) const;
+
+   private:
+    static constexpr uint32_t kNull = UINT32_MAX;
+
+    struct Node {
+        size_t value;
+        size_t sum;  // of the subtree
+        uint32_t cnt;  // nodes in the subtree
+        uint32_t priority;
+        uint32_t left;
+        uint32_t right;
+    };
+
+    uint32_t NewNode(size_t value);
+    void FreeTree(uint32_t t);
+    void Update(uint32_t t);
+    uint32_t Cnt(uint32_t t) const { return t == kNull ? 0 : nodes_[t].cnt; }
+    // Build a tree of values in O(n).
+    uint32_t Build(const std::vector<size_t>& values);
+    // The first k nodes of t go to l, others go to r.
+    void Split(uint32_t t, size_t k, uint32_t& l, uint32_t& r);
+    uint32_t Merge(uint32_t l, uint32_t r);
+
+    std::vector<Node> nodes_;
+    std::vector<uint32_t> free_nodes_;
+    uint32_t root_ = kNull;
+    uint32_t seed_ = 2463534242;
+};
+
+}  // namespace mango
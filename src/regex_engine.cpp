@@ -0,0 +1,1160 @@
+#include "regex_engine.h"
+
+#include <algorithm>
+#include <unordered_map>
+#include <vector>
+
+#include "character.h"
+#include "exception.h"
+
+namespace mango {
+
+static constexpr size_t kRepeatInf = static_cast<size_t>(-1);
+static constexpr size_t kMaxRepeat = 1000;
+static constexpr size_t kMaxProgramSize = 100000;
+static constexpr size_t kMaxDFAStates = 4096;
+// If the dfa cache is reset more than this times in a single scan, we give up
+// dfa and use the nfa simulation.
+static constexpr int kMaxDFAResetsPerScan = 2;
+static constexpr size_t kRegexCacheCapacity = 64;
+
+enum RegexCType : uint32_t {
+    kCTypeAlpha = 1 << 0,
+    kCTypeDigit = 1 << 1,
+    kCTypeUpper = 1 << 2,
+    kCTypeLower = 1 << 3,
+    kCTypeSpace = 1 << 4,
+    kCTypeBlank = 1 << 5,
+    kCTypePunct = 1 << 6,
+    kCTypeCntrl = 1 << 7,
+    kCTypePrint = 1 << 8,
+    kCTypeGraph = 1 << 9,
+    kCTypeXDigit = 1 << 10,
+    kCTypeWord = 1 << 11,
+};
+
+static const std::pair<std::string_view, uint32_t> kCTypeNames[] = {
+    {"alpha", kCTypeAlpha},
+    {"digit", kCTypeDigit},
+    {"alnum", kCTypeAlpha | kCTypeDigit},
+    {"upper", kCTypeUpper},
+    {"lower", kCTypeLower},
+    {"space", kCTypeSpace},
+    {"blank", kCTypeBlank},
+    {"punct", kCTypePunct},
+    {"cntrl", kCTypeCntrl},
+    {"print", kCTypePrint},
+    {"graph", kCTypeGraph},
+    {"xdigit", kCTypeXDigit},
+    {"word", kCTypeWord},
+};
+
+static bool IsSpace(Codepoint cp, utf8proc_category_t cat) {
+    return (cp >= '\t' && cp <= '\r') || cp == ' ' ||
+           cat == UTF8PROC_CATEGORY_ZS || cat == UTF8PROC_CATEGORY_ZL ||
+           cat == UTF8PROC_CATEGORY_ZP;
+}
+
+static bool CTypeMatch(uint32_t ctypes, Codepoint cp) {
+    if ((ctypes & kCTypeXDigit) &&
+        ((cp >= '0' && cp <= '9') || (cp >= 'a' && cp <= 'f') ||
+         (cp >= 'A' && cp <= 'F'))) {
+        return true;
+    }
+    if ((ctypes & kCTypeBlank) && (cp == ' ' || cp == '\t')) {
+        return true;
+    }
+    if ((ctypes & kCTypeWord) && cp == '_') {
+        return true;
+    }
+
+    utf8proc_category_t cat = utf8proc_category(cp);
+    bool letter = cat >= UTF8PROC_CATEGORY_LU && cat <= UTF8PROC_CATEGORY_LO;
+    bool digit = cat == UTF8PROC_CATEGORY_ND;
+    bool space = IsSpace(cp, cat);
+    bool cntrl = cat == UTF8PROC_CATEGORY_CC;
+    bool print = !cntrl && cat != UTF8PROC_CATEGORY_CN &&
+                 cat != UTF8PROC_CATEGORY_CS && cp != '\n';
+    if ((ctypes & kCTypeAlpha) && letter) {
+        return true;
+    }
+    if ((ctypes & kCTypeDigit) && digit) {
+        return true;
+    }
+    if ((ctypes & kCTypeUpper) &&
+        (cat == UTF8PROC_CATEGORY_LU || cat == UTF8PROC_CATEGORY_LT)) {
+        return true;
+    }
+    if ((ctypes & kCTypeLower) && cat == UTF8PROC_CATEGORY_LL) {
+        return true;
+    }
+    if ((ctypes & kCTypeSpace) && space) {
+        return true;
+    }
+    if ((ctypes & kCTypeBlank) && cat == UTF8PROC_CATEGORY_ZS) {
+        return true;
+    }
+    if ((ctypes & kCTypePunct) &&
+        ((cat >= UTF8PROC_CATEGORY_PC && cat <= UTF8PROC_CATEGORY_PO) ||
+         (cat >= UTF8PROC_CATEGORY_SM && cat <= UTF8PROC_CATEGORY_SO))) {
+        return true;
+    }
+    if ((ctypes & kCTypeCntrl) && cntrl) {
+        return true;
+    }
+    if ((ctypes & kCTypePrint) && print) {
+        return true;
+    }
+    if ((ctypes & kCTypeGraph) && print && !space) {
+        return true;
+    }
+    if ((ctypes & kCTypeWord) &&
+        (letter || digit || cat == UTF8PROC_CATEGORY_MN ||
+         cat == UTF8PROC_CATEGORY_MC || cat == UTF8PROC_CATEGORY_PC)) {
+        return true;
+    }
+    return false;
+}
+
+struct RegexCharClass {
+    std::vector<std::pair<Codepoint, Codepoint>> ranges;  // inclusive
+    uint32_t ctypes = 0;
+    bool negated = false;
+
+    bool Contains(Codepoint cp) const {
+        for (auto [lo, hi] : ranges) {
+            if (cp >= lo && cp <= hi) {
+                return true;
+            }
+        }
+        return ctypes != 0 && CTypeMatch(ctypes, cp);
+    }
+};
+
+enum class RegexOp : uint8_t {
+    kChar,      // c
+    kClass,     // x is the class index
+    kAny,       // any codepoint
+    kAnyNotNL,  // any codepoint except '\n'
+    kSplit,     // goto x and y
+    kJmp,       // goto x
+    kBol,       // assert beginning of line
+    kEol,       // assert end of line
+    kWordBoundary,     // \b
+    kNotWordBoundary,  // \B
+    kWordBegin,        // \<
+    kWordEnd,          // \>
+    kMatch,
+};
+
+struct RegexInst {
+    RegexOp op;
+    Codepoint c = 0;
+    int x = 0;
+    int y = 0;
+};
+
+static bool IsAssert(RegexOp op) {
+    return op >= RegexOp::kBol && op <= RegexOp::kWordEnd;
+}
+
+static bool IsEpsilon(RegexOp op) {
+    return op == RegexOp::kSplit || op == RegexOp::kJmp || IsAssert(op);
+}
+
+// What zero width assertions see at a position, a bit set.
+enum : uint8_t {
+    kCtxBol = 1 << 0,
+    kCtxPrevWord = 1 << 1,  // the codepoint before is a word char
+    kCtxEol = 1 << 2,
+    kCtxNextWord = 1 << 3,  // the codepoint after is a word char
+};
+
+static bool AssertHolds(RegexOp op, uint8_t ctx) {
+    bool prev_word = ctx & kCtxPrevWord;
+    bool next_word = ctx & kCtxNextWord;
+    switch (op) {
+        case RegexOp::kBol:
+            return ctx & kCtxBol;
+        case RegexOp::kEol:
+            return ctx & kCtxEol;
+        case RegexOp::kWordBoundary:
+            return prev_word != next_word;
+        case RegexOp::kNotWordBoundary:
+            return prev_word == next_word;
+        case RegexOp::kWordBegin:
+            return !prev_word && next_word;
+        case RegexOp::kWordEnd:
+            return prev_word && !next_word;
+        default:
+            MGO_ASSERT(false);
+            return false;
+    }
+}
+
+// Decode a codepoint at str[offset], invalid coding will be treated as a
+// single byte replacement char.
+static inline int DecodeAt(std::string_view str, size_t offset,
+                           Codepoint& cp) {
+    unsigned char b = str[offset];
+    if (b < 0x80) {
+        cp = b;
+        return 1;
+    }
+    int len;
+    if (Utf8ToUnicode(str.data() + offset, str.size() - offset, len, cp) !=
+        kOk) {
+        cp = kReplacementChar;
+        return 1;
+    }
+    return len;
+}
+
+static bool IsWordChar(Codepoint cp) { return CTypeMatch(kCTypeWord, cp); }
+
+// Whether the codepoint ending at str[offset] is a word char.
+static bool IsWordCharBefore(std::string_view str, size_t offset) {
+    if (offset == 0) {
+        return false;
+    }
+    size_t begin = offset - 1;
+    while (begin > 0 && offset - begin < 4 &&
+           (static_cast<unsigned char>(str[begin]) & 0xC0) == 0x80) {
+        begin--;
+    }
+    Codepoint cp;
+    if (begin + DecodeAt(str, begin, cp) != offset) {
+        // A stray continuation byte.
+        return false;
+    }
+    return IsWordChar(cp);
+}
+
+struct RegexProgram {
+    std::vector<RegexInst> insts;
+    std::vector<RegexCharClass> classes;
+    bool icase = false;
+    bool multiline = false;
+    bool crlf = false;
+    // Word assertions need to look at codepoints around, skip that if none.
+    bool word_assert = false;
+
+    bool Consume(const RegexInst& inst, Codepoint cp) const {
+        switch (inst.op) {
+            case RegexOp::kChar:
+                return cp == inst.c ||
+                       (icase && utf8proc_tolower(cp) == inst.c);
+            case RegexOp::kAny:
+                return true;
+            case RegexOp::kAnyNotNL:
+                return cp != '\n';
+            case RegexOp::kClass: {
+                const RegexCharClass& cls = classes[inst.x];
+                bool in = cls.Contains(cp) ||
+                          (icase && (cls.Contains(utf8proc_tolower(cp)) ||
+                                     cls.Contains(utf8proc_toupper(cp))));
+                return in != cls.negated;
+            }
+            default:
+                return false;
+        }
+    }
+
+    bool Bol(std::string_view str, size_t i) const {
+        return i == 0 || (multiline && str[i - 1] == '\n');
+    }
+    bool Eol(std::string_view str, size_t i) const {
+        if (i == str.size()) {
+            return true;
+        }
+        if (!multiline) {
+            return false;
+        }
+        return str[i] == '\n' ||
+               (crlf && str[i] == '\r' &&
+                (i + 1 == str.size() || str[i + 1] == '\n'));
+    }
+    uint8_t Context(std::string_view str, size_t i) const {
+        uint8_t ctx = 0;
+        if (Bol(str, i)) {
+            ctx |= kCtxBol;
+        }
+        if (Eol(str, i)) {
+            ctx |= kCtxEol;
+        }
+        if (word_assert) {
+            if (IsWordCharBefore(str, i)) {
+                ctx |= kCtxPrevWord;
+            }
+            Codepoint cp;
+            if (i < str.size() && (DecodeAt(str, i, cp), IsWordChar(cp))) {
+                ctx |= kCtxNextWord;
+            }
+        }
+        return ctx;
+    }
+
+    bool PikeSearch(std::string_view str, size_t offset, RegexMatch& m) const;
+};
+
+// Regex syntax tree, only used when compiling.
+struct RegexNode {
+    enum Type {
+        kEmpty,
+        kChar,
+        kClass,
+        kAny,
+        kBol,
+        kEol,
+        kWordAssert,  // op is the assertion
+        kConcat,
+        kAlter,
+        kRepeat,
+    };
+    Type type;
+    Codepoint c = 0;
+    int cls = 0;
+    RegexOp op = RegexOp::kMatch;
+    size_t min = 0;
+    size_t max = 0;
+    std::vector<std::unique_ptr<RegexNode>> subs;
+
+    RegexNode(Type t) : type(t) {}
+};
+
+class RegexParser {
+   public:
+    RegexParser(std::string_view pattern, RegexProgram& prog)
+        : pattern_(pattern), prog_(prog) {}
+
+    // throws RegexCompileException
+    std::unique_ptr<RegexNode> Parse() {
+        auto node = ParseAlter();
+        MGO_ASSERT(pos_ == pattern_.size());
+        return node;
+    }
+
+   private:
+    std::unique_ptr<RegexNode> ParseAlter() {
+        auto node = std::make_unique<RegexNode>(RegexNode::kAlter);
+        node->subs.push_back(ParseConcat());
+        while (pos_ < pattern_.size() && pattern_[pos_] == '|') {
+            pos_++;
+            node->subs.push_back(ParseConcat());
+        }
+        if (node->subs.size() == 1) {
+            return std::move(node->subs[0]);
+        }
+        return node;
+    }
+
+    std::unique_ptr<RegexNode> ParseConcat() {
+        auto node = std::make_unique<RegexNode>(RegexNode::kConcat);
+        while (pos_ < pattern_.size() && pattern_[pos_] != '|' &&
+               !(pattern_[pos_] == ')' && depth_ > 0)) {
+            node->subs.push_back(ParseRepeat());
+        }
+        if (node->subs.empty()) {
+            return std::make_unique<RegexNode>(RegexNode::kEmpty);
+        }
+        if (node->subs.size() == 1) {
+            return std::move(node->subs[0]);
+        }
+        return node;
+    }
+
+    std::unique_ptr<RegexNode> ParseRepeat() {
+        auto node = ParseAtom();
+        while (pos_ < pattern_.size()) {
+            size_t min, max;
+            char c = pattern_[pos_];
+            if (c == '*') {
+                min = 0, max = kRepeatInf;
+                pos_++;
+            } else if (c == '+') {
+                min = 1, max = kRepeatInf;
+                pos_++;
+            } else if (c == '?') {
+                min = 0, max = 1;
+                pos_++;
+            } else if (c == '{' && ParseBound(min, max)) {
+                ;
+            } else {
+                break;
+            }
+            auto repeat = std::make_unique<RegexNode>(RegexNode::kRepeat);
+            repeat->min = min;
+            repeat->max = max;
+            repeat->subs.push_back(std::move(node));
+            node = std::move(repeat);
+        }
+        return node;
+    }
+
+    // Parse "{m}", "{m,}", "{m,n}", "{,n}". If it is not a bound, return
+    // false and the '{' will be treated as a literal.
+    bool ParseBound(size_t& min, size_t& max) {
+        size_t p = pos_ + 1;
+        auto parse_num = [&](size_t& out) {
+            size_t begin = p;
+            out = 0;
+            while (p < pattern_.size() && pattern_[p] >= '0' &&
+                   pattern_[p] <= '9') {
+                out = out * 10 + (pattern_[p] - '0');
+                if (out > kMaxRepeat) {
+                    throw RegexCompileException("repeat count too big");
+                }
+                p++;
+            }
+            return p != begin;
+        };
+        bool has_min = parse_num(min);
+        max = min;
+        if (p < pattern_.size() && pattern_[p] == ',') {
+            p++;
+            if (!parse_num(max)) {
+                if (!has_min) {
+                    return false;
+                }
+                max = kRepeatInf;
+            }
+        } else if (!has_min) {
+            return false;
+        }
+        if (p >= pattern_.size() || pattern_[p] != '}') {
+            return false;
+        }
+        if (max < min) {
+            throw RegexCompileException("invalid repeat bound {{{},{}}}", min,
+                                        max);
+        }
+        pos_ = p + 1;
+        return true;
+    }
+
+    Codepoint NextCodepoint() {
+        Codepoint cp;
+        int len;
+        if (Utf8ToUnicode(pattern_.data() + pos_, pattern_.size() - pos_, len,
+                          cp) != kOk) {
+            throw RegexCompileException("invalid utf-8 in pattern at {}",
+                                        pos_);
+        }
+        pos_ += len;
+        return cp;
+    }
+
+    std::unique_ptr<RegexNode> MakeChar(Codepoint cp) {
+        auto node = std::make_unique<RegexNode>(RegexNode::kChar);
+        node->c = prog_.icase ? utf8proc_tolower(cp) : cp;
+        return node;
+    }
+
+    std::unique_ptr<RegexNode> MakeClass(RegexCharClass&& cls) {
+        auto node = std::make_unique<RegexNode>(RegexNode::kClass);
+        node->cls = prog_.classes.size();
+        prog_.classes.push_back(std::move(cls));
+        return node;
+    }
+
+    std::unique_ptr<RegexNode> MakeWordAssert(RegexOp op) {
+        auto node = std::make_unique<RegexNode>(RegexNode::kWordAssert);
+        node->op = op;
+        prog_.word_assert = true;
+        return node;
+    }
+
+    std::unique_ptr<RegexNode> ParseAtom() {
+        char c = pattern_[pos_];
+        switch (c) {
+            case '(': {
+                pos_++;
+                depth_++;
+                auto node = ParseAlter();
+                if (pos_ >= pattern_.size() || pattern_[pos_] != ')') {
+                    throw RegexCompileException("unmatched (");
+                }
+                pos_++;
+                depth_--;
+                return node;
+            }
+            case '[':
+                pos_++;
+                return ParseBracket();
+            case '.':
+                pos_++;
+                return std::make_unique<RegexNode>(RegexNode::kAny);
+            case '^':
+                pos_++;
+                return std::make_unique<RegexNode>(RegexNode::kBol);
+            case '$':
+                pos_++;
+                return std::make_unique<RegexNode>(RegexNode::kEol);
+            case '\\':
+                pos_++;
+                return ParseEscape();
+            default:
+                // Include quantifiers with nothing to repeat, unmatched ')' at
+                // top level and '{' which is not a bound, like glibc does.
+                return MakeChar(NextCodepoint());
+        }
+    }
+
+    std::unique_ptr<RegexNode> ParseEscape() {
+        if (pos_ >= pattern_.size()) {
+            throw RegexCompileException("trailing backslash");
+        }
+        char c = pattern_[pos_];
+        RegexCharClass cls;
+        switch (c) {
+            case 'w':
+            case 'W':
+                cls.ctypes = kCTypeWord;
+                break;
+            case 'd':
+            case 'D':
+                cls.ctypes = kCTypeDigit;
+                break;
+            case 's':
+            case 'S':
+                cls.ctypes = kCTypeSpace;
+                break;
+            case 'n':
+                pos_++;
+                return MakeChar('\n');
+            case 't':
+                pos_++;
+                return MakeChar('\t');
+            case 'r':
+                pos_++;
+                return MakeChar('\r');
+            case 'f':
+                pos_++;
+                return MakeChar('\f');
+            case 'v':
+                pos_++;
+                return MakeChar('\v');
+            case 'b':
+                pos_++;
+                return MakeWordAssert(RegexOp::kWordBoundary);
+            case 'B':
+                pos_++;
+                return MakeWordAssert(RegexOp::kNotWordBoundary);
+            case '<':
+                pos_++;
+                return MakeWordAssert(RegexOp::kWordBegin);
+            case '>':
+                pos_++;
+                return MakeWordAssert(RegexOp::kWordEnd);
+            default:
+                // Reject escapes like \x and backreferences instead of
+                // matching them literally, users would get wrong results
+                // quietly. Other escaped punctuations are literals.
+                if ((c >= 'a' && c <= 'z') || (c >= 'A' && c <= 'Z') ||
+                    (c >= '0' && c <= '9')) {
+                    throw RegexCompileException("unsupported escape \\{}", c);
+                }
+                return MakeChar(NextCodepoint());
+        }
+        pos_++;
+        cls.negated = c >= 'A' && c <= 'Z';
+        return MakeClass(std::move(cls));
+    }
+
+    // Like posix, backslash is a literal in a bracket expression.
+    std::unique_ptr<RegexNode> ParseBracket() {
+        RegexCharClass cls;
+        if (pos_ < pattern_.size() && pattern_[pos_] == '^') {
+            cls.negated = true;
+            pos_++;
+        }
+        bool first = true;
+        while (true) {
+            if (pos_ >= pattern_.size()) {
+                throw RegexCompileException("unmatched [");
+            }
+            if (pattern_[pos_] == ']' && !first) {
+                pos_++;
+                break;
+            }
+            first = false;
+
+            if (pattern_.compare(pos_, 2, "[:") == 0) {
+                size_t end = pattern_.find(":]", pos_ + 2);
+                if (end == std::string_view::npos) {
+                    throw RegexCompileException("unmatched [:");
+                }
+                std::string_view name =
+                    pattern_.substr(pos_ + 2, end - pos_ - 2);
+                auto iter = std::find_if(
+                    std::begin(kCTypeNames), std::end(kCTypeNames),
+                    [name](const auto& p) { return p.first == name; });
+                if (iter == std::end(kCTypeNames)) {
+                    throw RegexCompileException("unknown class [:{}:]", name);
+                }
+                cls.ctypes |= iter->second;
+                pos_ = end + 2;
+                continue;
+            }
+
+            Codepoint lo = NextCodepoint();
+            Codepoint hi = lo;
+            if (pos_ + 1 < pattern_.size() && pattern_[pos_] == '-' &&
+                pattern_[pos_ + 1] != ']') {
+                pos_++;
+                hi = NextCodepoint();
+                if (hi < lo) {
+                    throw RegexCompileException("invalid range in []");
+                }
+            }
+            cls.ranges.push_back({lo, hi});
+        }
+        return MakeClass(std::move(cls));
+    }
+
+    std::string_view pattern_;
+    size_t pos_ = 0;
+    int depth_ = 0;
+    RegexProgram& prog_;
+};
+
+class RegexCompiler {
+   public:
+    RegexCompiler(RegexProgram& prog) : prog_(prog) {}
+
+    // throws RegexCompileException
+    void Compile(const RegexNode* root) {
+        Emit(root);
+        Push({RegexOp::kMatch});
+    }
+
+   private:
+    int Push(RegexInst inst) {
+        if (prog_.insts.size() >= kMaxProgramSize) {
+            throw RegexCompileException("regex too big");
+        }
+        prog_.insts.push_back(inst);
+        return prog_.insts.size() - 1;
+    }
+
+    int Pc() { return prog_.insts.size(); }
+
+    void Emit(const RegexNode* node) {
+        switch (node->type) {
+            case RegexNode::kEmpty:
+                break;
+            case RegexNode::kChar:
+                Push({RegexOp::kChar, node->c});
+                break;
+            case RegexNode::kClass:
+                Push({RegexOp::kClass, 0, node->cls});
+                break;
+            case RegexNode::kAny:
+                Push({prog_.multiline ? RegexOp::kAnyNotNL : RegexOp::kAny});
+                break;
+            case RegexNode::kBol:
+                Push({RegexOp::kBol});
+                break;
+            case RegexNode::kEol:
+                Push({RegexOp::kEol});
+                break;
+            case RegexNode::kWordAssert:
+                Push({node->op});
+                break;
+            case RegexNode::kConcat:
+                for (const auto& sub : node->subs) {
+                    Emit(sub.get());
+                }
+                break;
+            case RegexNode::kAlter: {
+                std::vector<int> jmps;
+                for (size_t i = 0; i + 1 < node->subs.size(); i++) {
+                    int split = Push({RegexOp::kSplit});
+                    prog_.insts[split].x = Pc();
+                    Emit(node->subs[i].get());
+                    jmps.push_back(Push({RegexOp::kJmp}));
+                    prog_.insts[split].y = Pc();
+                }
+                Emit(node->subs.back().get());
+                for (int jmp : jmps) {
+                    prog_.insts[jmp].x = Pc();
+                }
+                break;
+            }
+            case RegexNode::kRepeat: {
+                const RegexNode* sub = node->subs[0].get();
+                for (size_t i = 0; i < node->min; i++) {
+                    Emit(sub);
+                }
+                if (node->max == kRepeatInf) {
+                    int split = Push({RegexOp::kSplit});
+                    prog_.insts[split].x = Pc();
+                    Emit(sub);
+                    Push({RegexOp::kJmp, 0, split});
+                    prog_.insts[split].y = Pc();
+                } else {
+                    // x{0,n} -> (x(x(x)?)?)?
+                    std::vector<int> splits;
+                    for (size_t i = node->min; i < node->max; i++) {
+                        int split = Push({RegexOp::kSplit});
+                        prog_.insts[split].x = Pc();
+                        splits.push_back(split);
+                        Emit(sub);
+                    }
+                    for (int split : splits) {
+                        prog_.insts[split].y = Pc();
+                    }
+                }
+                break;
+            }
+        }
+    }
+
+    RegexProgram& prog_;
+};
+
+namespace {
+
+// Sparse set of nfa threads, in insertion order.
+struct ThreadList {
+    struct Thread {
+        int pc;
+        size_t start;
+    };
+    std::vector<int> sparse;
+    std::vector<Thread> dense;
+
+    ThreadList(size_t n) : sparse(n) { dense.reserve(n); }
+
+    bool Contains(int pc) const {
+        size_t i = sparse[pc];
+        return i < dense.size() && dense[i].pc == pc;
+    }
+    void Add(int pc, size_t start) {
+        sparse[pc] = dense.size();
+        dense.push_back({pc, start});
+    }
+    void Clear() { dense.clear(); }
+};
+
+void AddThread(const RegexProgram& prog, ThreadList& list, int pc,
+               size_t start, uint8_t ctx, std::vector<int>& stack) {
+    stack.push_back(pc);
+    while (!stack.empty()) {
+        pc = stack.back();
+        stack.pop_back();
+        if (list.Contains(pc)) {
+            continue;
+        }
+        list.Add(pc, start);
+        const RegexInst& inst = prog.insts[pc];
+        switch (inst.op) {
+            case RegexOp::kJmp:
+                stack.push_back(inst.x);
+                break;
+            case RegexOp::kSplit:
+                stack.push_back(inst.y);
+                stack.push_back(inst.x);
+                break;
+            default:
+                if (IsAssert(inst.op) && AssertHolds(inst.op, ctx)) {
+                    stack.push_back(pc + 1);
+                }
+                break;
+        }
+    }
+}
+
+}  // namespace
+
+// Pike VM with leftmost-longest semantic. Threads are kept in the order of
+// their start, so a thread which starts earlier wins when two threads reach
+// the same pc.
+bool RegexProgram::PikeSearch(std::string_view str, size_t offset,
+                              RegexMatch& m) const {
+    ThreadList clist(insts.size()), nlist(insts.size());
+    std::vector<int> stack;
+    bool matched = false;
+
+    uint8_t ctx = Context(str, offset);
+    for (size_t i = offset;;) {
+        if (!matched) {
+            AddThread(*this, clist, 0, i, ctx, stack);
+        }
+
+        Codepoint cp = 0;
+        int len = 0;
+        if (i < str.size()) {
+            len = DecodeAt(str, i, cp);
+        }
+        size_t next_i = i + len;
+        uint8_t next_ctx = len != 0 ? Context(str, next_i) : 0;
+
+        nlist.Clear();
+        for (const auto& t : clist.dense) {
+            if (matched && t.start > m.begin) {
+                break;
+            }
+            const RegexInst& inst = insts[t.pc];
+            if (inst.op == RegexOp::kMatch) {
+                if (!matched || t.start < m.begin ||
+                    (t.start == m.begin && i > m.end)) {
+                    m.begin = t.start;
+                    m.end = i;
+                    matched = true;
+                }
+                continue;
+            }
+            if (len != 0 && !IsEpsilon(inst.op) && Consume(inst, cp)) {
+                AddThread(*this, nlist, t.pc + 1, t.start, next_ctx, stack);
+            }
+        }
+
+        if (i == str.size()) {
+            break;
+        }
+        std::swap(clist, nlist);
+        i = next_i;
+        ctx = next_ctx;
+        if (matched && clist.dense.empty()) {
+            break;
+        }
+    }
+    return matched;
+}
+
+// A lazily built dfa, only used for unanchored matching to find out
+// whether a match exists. States are built on demand and cached. The cache
+// is bounded by kMaxDFAStates.
+class RegexDFA {
+   public:
+    enum class ScanResult {
+        kMatch,
+        kNoMatch,
+        kGiveUp,  // the caller should use nfa simulation
+    };
+
+    RegexDFA(const RegexProgram* prog)
+        : prog_(prog), mark_(prog->insts.size(), 0) {}
+
+    // Scan str from offset, stop at the earliest match end.
+    ScanResult Scan(std::string_view str, size_t offset) {
+        uint8_t ctx = StateContext(prog_->Context(str, offset));
+        State* s = start_[ctx];
+        if (s == nullptr) {
+            seeds_.assign(1, 0);
+            s = start_[ctx] = GetState(Closure(seeds_, ctx, false), ctx);
+        }
+        int resets = 0;
+        for (size_t i = offset;;) {
+            if (s->match || (s->match_at_eol && prog_->Eol(str, i))) {
+                return ScanResult::kMatch;
+            }
+            if (i == str.size()) {
+                return ScanResult::kNoMatch;
+            }
+
+            Codepoint cp;
+            int len = DecodeAt(str, i, cp);
+            State* next =
+                cp < kAsciiCnt ? s->ascii_next[cp] : LookupNext(s, cp);
+            if (next == nullptr) {
+                next = Next(s, cp);
+                if (next == nullptr) {
+                    // Cache is full.
+                    if (++resets > kMaxDFAResetsPerScan) {
+                        return ScanResult::kGiveUp;
+                    }
+                    std::vector<int> insts = s->insts;
+                    uint8_t s_ctx = s->ctx;
+                    Reset();
+                    s = GetState(std::move(insts), s_ctx);
+                    next = Next(s, cp);
+                    MGO_ASSERT(next);
+                }
+            }
+            s = next;
+            i += len;
+        }
+    }
+
+   private:
+    static constexpr Codepoint kAsciiCnt = 128;
+
+    struct State {
+        // Sorted pcs, only non-epsilon ones and assertions which depend on
+        // the next codepoint.
+        std::vector<int> insts;
+        uint8_t ctx;  // kCtxBol and kCtxPrevWord
+        bool match;
+        bool match_at_eol;
+        State* ascii_next[kAsciiCnt] = {nullptr};
+        std::unordered_map<Codepoint, State*> next;
+    };
+
+    struct KeyHash {
+        size_t operator()(const std::vector<int>& key) const {
+            size_t h = key.size();
+            for (int pc : key) {
+                h ^= pc + 0x9e3779b9 + (h << 6) + (h >> 2);
+            }
+            return h;
+        }
+    };
+
+    void Reset() {
+        states_.clear();
+        std::fill(std::begin(start_), std::end(start_), nullptr);
+    }
+
+    // Only keep the part of ctx known by the time a state is entered.
+    static uint8_t StateContext(uint8_t ctx) {
+        return ctx & (kCtxBol | kCtxPrevWord);
+    }
+
+    State* LookupNext(State* s, Codepoint cp) {
+        auto iter = s->next.find(cp);
+        return iter == s->next.end() ? nullptr : iter->second;
+    }
+
+    // Epsilon closure of seeds. kBol is followed if ctx says so. Assertions
+    // on the next codepoint are resolved by ctx if resolve, otherwise kept in
+    // the result and resolved later.
+    std::vector<int> Closure(const std::vector<int>& seeds, uint8_t ctx,
+                             bool resolve) {
+        if (++generation_ == 0) {
+            std::fill(mark_.begin(), mark_.end(), 0);
+            generation_ = 1;
+        }
+        std::vector<int> out;
+        stack_.assign(seeds.rbegin(), seeds.rend());
+        while (!stack_.empty()) {
+            int pc = stack_.back();
+            stack_.pop_back();
+            if (mark_[pc] == generation_) {
+                continue;
+            }
+            mark_[pc] = generation_;
+            const RegexInst& inst = prog_->insts[pc];
+            switch (inst.op) {
+                case RegexOp::kJmp:
+                    stack_.push_back(inst.x);
+                    break;
+                case RegexOp::kSplit:
+                    stack_.push_back(inst.y);
+                    stack_.push_back(inst.x);
+                    break;
+                case RegexOp::kBol:
+                    if (ctx & kCtxBol) {
+                        stack_.push_back(pc + 1);
+                    }
+                    break;
+                default:
+                    if (!IsAssert(inst.op) || !resolve) {
+                        out.push_back(pc);
+                    } else if (AssertHolds(inst.op, ctx)) {
+                        stack_.push_back(pc + 1);
+                    }
+                    break;
+            }
+        }
+        std::sort(out.begin(), out.end());
+        return out;
+    }
+
+    bool HasMatch(const std::vector<int>& insts) {
+        return std::any_of(insts.begin(), insts.end(), [this](int pc) {
+            return prog_->insts[pc].op == RegexOp::kMatch;
+        });
+    }
+
+    // Return nullptr if the cache is full.
+    State* GetState(std::vector<int>&& insts, uint8_t ctx) {
+        insts.push_back(-1 - ctx);
+        auto iter = states_.find(insts);
+        if (iter != states_.end()) {
+            return iter->second.get();
+        }
+        if (states_.size() >= kMaxDFAStates) {
+            return nullptr;
+        }
+        auto state = std::make_unique<State>();
+        state->ctx = ctx;
+        state->insts.assign(insts.begin(), insts.end() - 1);
+        state->match = HasMatch(state->insts);
+        // Nothing follows the end of line, or it's a '\n'.
+        state->match_at_eol =
+            state->match ||
+            HasMatch(Closure(state->insts, ctx | kCtxEol, true));
+        State* ret = state.get();
+        states_.emplace(std::move(insts), std::move(state));
+        return ret;
+    }
+
+    State* Next(State* s, Codepoint cp) {
+        bool nl = prog_->multiline && cp == '\n';
+        bool word = prog_->word_assert && IsWordChar(cp);
+        std::vector<int> expanded;
+        const std::vector<int>* from = &s->insts;
+        if (nl || prog_->word_assert) {
+            uint8_t ctx =
+                s->ctx | (nl ? kCtxEol : 0) | (word ? kCtxNextWord : 0);
+            expanded = Closure(s->insts, ctx, true);
+            from = &expanded;
+        }
+        seeds_.clear();
+        for (int pc : *from) {
+            const RegexInst& inst = prog_->insts[pc];
+            if (inst.op == RegexOp::kMatch) {
+                // Matched before cp, e.g. foo\> followed by a space. Carry
+                // the match on, Scan only tells whether there is one.
+                seeds_.push_back(pc);
+            } else if (!IsEpsilon(inst.op) && prog_->Consume(inst, cp)) {
+                seeds_.push_back(pc + 1);
+            }
+        }
+        // Unanchored: a match can start at every position.
+        seeds_.push_back(0);
+        uint8_t next_ctx = (nl ? kCtxBol : 0) | (word ? kCtxPrevWord : 0);
+        State* next = GetState(Closure(seeds_, next_ctx, false), next_ctx);
+        if (next == nullptr) {
+            return nullptr;
+        }
+        if (cp < kAsciiCnt) {
+            s->ascii_next[cp] = next;
+        } else {
+            s->next[cp] = next;
+        }
+        return next;
+    }
+
+    const RegexProgram* prog_;
+    std::unordered_map<std::vector<int>, std::unique_ptr<State>, KeyHash>
+        states_;
+    State* start_[4] = {nullptr};  // index by State::ctx
+
+    std::vector<uint32_t> mark_;
+    uint32_t generation_ = 0;
+    std::vector<int> stack_;
+    std::vector<int> seeds_;
+};
+
+// Collect literals of node which must appear in a match. run is the literal
+// being extended by consecutive chars.
+static void CollectRequiredLiterals(const RegexNode* node, std::string& run,
+                                    std::vector<std::string>& literals) {
+    auto flush = [&run, &literals] {
+        if (!run.empty()) {
+            literals.push_back(std::move(run));
+            run.clear();
+        }
+    };
+    switch (node->type) {
+        case RegexNode::kChar: {
+            char buf[4];
+            int len = UnicodeToUtf8(node->c, buf);
+            run.append(buf, len);
+            break;
+        }
+        case RegexNode::kConcat:
+            for (const auto& sub : node->subs) {
+                CollectRequiredLiterals(sub.get(), run, literals);
+            }
+            break;
+        case RegexNode::kRepeat:
+            // The first copy follows the run, what follows the last copy is
+            // unknown.
+            if (node->min >= 1) {
+                CollectRequiredLiterals(node->subs[0].get(), run, literals);
+            }
+            flush();
+            break;
+        case RegexNode::kEmpty:
+        case RegexNode::kBol:
+        case RegexNode::kEol:
+        case RegexNode::kWordAssert:
+            // Zero width, the run goes on.
+            break;
+        default:
+            // Classes and alternations don't require a certain literal.
+            flush();
+            break;
+    }
+}
+
+Regex::Regex(std::string_view pattern, int flags)
+    : flags_(flags), prog_(std::make_unique<RegexProgram>()) {
+    prog_->icase = flags & kRegexIgnoreCase;
+    prog_->multiline = flags & kRegexMultiLine;
+    prog_->crlf = flags & kRegexCRLF;
+    RegexParser parser(pattern, *prog_);
+    auto root = parser.Parse();
+    std::string run;
+    CollectRequiredLiterals(root.get(), run, required_literals_);
+    if (!run.empty()) {
+        required_literals_.push_back(std::move(run));
+    }
+    RegexCompiler compiler(*prog_);
+    compiler.Compile(root.get());
+    dfa_ = std::make_unique<RegexDFA>(prog_.get());
+}
+
+Regex::~Regex() = default;
+Regex::Regex(Regex&&) noexcept = default;
+Regex& Regex::operator=(Regex&&) noexcept = default;
+
+bool Regex::Search(std::string_view str, size_t offset, RegexMatch& m) {
+    if (offset > str.size()) {
+        return false;
+    }
+    if (dfa_->Scan(str, offset) == RegexDFA::ScanResult::kNoMatch) {
+        return false;
+    }
+    return prog_->PikeSearch(str, offset, m);
+}
+
+bool Regex::Test(std::string_view str) {
+    auto res = dfa_->Scan(str, 0);
+    if (res != RegexDFA::ScanResult::kGiveUp) {
+        return res == RegexDFA::ScanResult::kMatch;
+    }
+    RegexMatch m;
+    return prog_->PikeSearch(str, 0, m);
+}
+
+RegexCache::RegexCache(size_t capacity) : capacity_(capacity) {
+    MGO_ASSERT(capacity_ >= 1);
+}
+
+std::shared_ptr<Regex> RegexCache::Get(std::string_view pattern, int flags) {
+    std::string key(reinterpret_cast<const char*>(&flags), sizeof(flags));
+    key.append(pattern);
+    auto iter = map_.find(key);
+    if (iter != map_.end()) {
+        hits_++;
+        lru_.splice(lru_.begin(), lru_, iter->second);
+        return iter->second->regex;
+    }
+
+    misses_++;
+    auto regex = std::make_shared<Regex>(pattern, flags);
+    if (lru_.size() == capacity_) {
+        map_.erase(lru_.back().key);
+        lru_.pop_back();
+    }
+    lru_.push_front({std::move(key), regex});
+    map_.emplace(lru_.front().key, lru_.begin());
+    return regex;
+}
+
+void RegexCache::Clear() {
+    map_.clear();
+    lru_.clear();
+}
+
+RegexCache& RegexCache::GetInstance() {
+    static RegexCache cache(kRegexCacheCapacity);
+    return cache;
+}
+
+}  // namespace mango
@@ -0,0 +1,121 @@
+#pragma once
+
+#include <list>
+#include <memory>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <vector>
+
+#include "utils.h"
+
+namespace mango {
+
+enum RegexFlag : int {
+    kRegexNone = 0,
+    kRegexIgnoreCase = 1 << 0,
+    // '^' and '$' also match after and before '\n', '.' doesn't match '\n'.
+    kRegexMultiLine = 1 << 1,
+    // With kRegexMultiLine, '$' also matches before "\r\n" and a '\r' ending
+    // the text, for text with CRLF eols.
+    kRegexCRLF = 1 << 2,
+};
+
+// Byte offsets of a match, half-open.
+struct RegexMatch {
+    size_t begin;
+    size_t end;
+};
+
+struct RegexProgram;
+class RegexDFA;
+
+// An in-tree regex engine, working on utf-8 codepoints.
+// Supports posix ERE syntax: | * + ? {m,n} {,n} () [] . ^ $ and bracket
+// classes like [:alpha:], plus escapes \w \W \d \D \s \S \n \t and the word
+// assertions \b \B \< \>. Classes and word chars are unicode aware.
+//
+// Other escaped letters and digits, e.g. \x or backreferences, are rejected.
+//
+// A pattern is compiled to a Thompson NFA. Matching first runs a lazily built
+// DFA, which only tells whether there is a match at all, so subjects without
+// one are rejected at DFA speed. When there is one, a Pike VM finds its exact
+// leftmost-longest bounds, which is as slow as without the DFA. When the DFA
+// cache grows too big, we fall back to the NFA simulation. Both are linear in
+// the subject length, so no pattern can go exponential like a backtracking
+// engine.
+//
+// Not thread safe: the DFA cache is mutated while matching.
+class Regex {
+   public:
+    // throws RegexCompileException
+    Regex(std::string_view pattern, int flags = kRegexNone);
+    ~Regex();
+    MGO_DELETE_COPY(Regex);
+    Regex(Regex&&) noexcept;
+    Regex& operator=(Regex&&) noexcept;
+
+    // Find the leftmost-longest match which begins at or after offset.
+    // str[offset] must be a codepoint beginning byte.
+    // Return true if found and m will be set.
+    bool Search(std::string_view str, size_t offset, RegexMatch& m);
+
+    // Return true if anything in str matches.
+    bool Test(std::string_view str);
+
+    int flags() const { return flags_; }
+
+    // Literal strings which every match contains, for prefiltering like a
+    // trigram index. They are lowercased if ignoring case. May be empty.
+    const std::vector<std::string>& required_literals() const {
+        return required_literals_;
+    }
+
+   private:
+    int flags_;
+    std::vector<std::string> required_literals_;
+    std::unique_ptr<RegexProgram> prog_;
+    std::unique_ptr<RegexDFA> dfa_;
+};
+
+// A bounded LRU cache of compiled regexes keyed by (pattern, flags), so
+// searching on type, every 'n' after an edit and redrawing don't compile the
+// same pattern again and again. A cached regex also keeps its warm dfa.
+// Regexes are shared, users keep them alive even if they are evicted.
+// Not thread safe, it's only used in the main thread.
+class RegexCache {
+   public:
+    explicit RegexCache(size_t capacity);
+    MGO_DELETE_COPY(RegexCache);
+    MGO_DELETE_MOVE(RegexCache);
+
+    // throws RegexCompileException
+    std::shared_ptr<Regex> Get(std::string_view pattern, int flags);
+    void Clear();
+
+    size_t size() const { return lru_.size(); }
+    // Shown by :perf.
+    size_t hits() const { return hits_; }
+    size_t misses() const { return misses_; }
+    void ResetCounters() {
+        hits_ = 0;
+        misses_ = 0;
+    }
+
+    // The cache shared by searching, syntax predicates and commands.
+    static RegexCache& GetInstance();
+
+   private:
+    struct Entry {
+        std::string key;
+        std::shared_ptr<Regex> regex;
+    };
+
+    size_t capacity_;
+    std::list<Entry> lru_;  // most recently used first
+    std::unordered_map<std::string_view, std::list<Entry>::iterator> map_;
+    size_t hits_ = 0;
+    size_t misses_ = 0;
+};
+
+}  // namespace mango
@@ -1,13 +1,31 @@
 #include "search.h"
 
-#include <regex.h>
+#include <algorithm>
 
 #include "buffer.h"
+#include "exception.h"
+#include "regex_engine.h"
+#include "trace.h"
 
 namespace mango {
 
-std::vector<Range> BufferSearch(const Buffer* buffer,
-                                const std::string& pattern, bool ignore_case) {
+// Lines searched in a window of joined lines.
+static constexpr size_t kMultiLineWindowLines = 256;
+
+// A pattern which contains "\n" enables multi-line searching.
+static bool IsMultiLinePattern(const std::string& pattern) {
+    for (size_t i = 0; i + 1 < pattern.size(); i++) {
+        if (pattern[i] == '\\') {
+            if (pattern[i + 1] == 'n') {
+                return true;
+            }
+            i++;
+        }
+    }
+    return false;
+}
+
+int SearchRegexFlags(const std::string& pattern, bool ignore_case) {
     Character c;
     int byte_len;
     char asc;
@@ -18,28 +36,134 @@ std::vector<Range> BufferSearch(const Buffer* buffer,
             break;
         }
     }
-    std::vector<Range> res;
-    regex_t regex;
-    int ret = regcomp(&regex, pattern.c_str(),
-                      REG_EXTENDED | (ignore_case ? REG_ICASE : 0));
-    if (ret != 0) {
-        return {};
+    return (ignore_case ? kRegexIgnoreCase : kRegexNone) |
+           (IsMultiLinePattern(pattern) ? kRegexMultiLine : kRegexNone);
+}
+
+// Run the matcher over a sliding window of joined lines, so we don't need to
+// copy the whole buffer. Matches begin in [from, end) and span at most
+// kMultiLineMatchMaxLines lines, the window covers the lines after the block
+// that matches beginning in it can span. A match running out of the block
+// makes the next window begin at its end, so matches never overlap.
+static bool SearchLinesMultiLine(const SearchLineGetter& get_line,
+                                 size_t line_cnt, Regex& regex, Pos from,
+                                 size_t end, std::vector<Range>& res) {
+    bool dropped = false;
+    std::string window;
+    std::vector<size_t> line_offsets;
+    while (from.line < end) {
+        size_t block_end = std::min(from.line + kMultiLineWindowLines, end);
+        size_t window_end =
+            std::min(block_end + kMultiLineMatchMaxLines - 1, line_cnt);
+        window.clear();
+        line_offsets.clear();
+        for (size_t line = from.line; line < window_end; line++) {
+            if (line != from.line) {
+                window.push_back('\n');
+            }
+            line_offsets.push_back(window.size());
+            window.append(get_line(line));
+        }
+        // Index in the window of the line where offset is.
+        auto to_index = [&](size_t offset) -> size_t {
+            return std::upper_bound(line_offsets.begin(), line_offsets.end(),
+                                    offset) -
+                   line_offsets.begin() - 1;
+        };
+        auto to_pos = [&](size_t offset) -> Pos {
+            size_t i = to_index(offset);
+            return {from.line + i, offset - line_offsets[i]};
+        };
+        // Where the line of index i ends, or the window ends.
+        auto line_end = [&](size_t i) -> size_t {
+            return i + 1 < line_offsets.size() ? line_offsets[i + 1] - 1
+                                               : window.size();
+        };
+        // The leftmost-longest match at or after offset within the span
+        // limit. A longer match is searched again with the text cut off after
+        // the last line it can span, if nothing begins in its line then, go on
+        // from the next line.
+        auto search = [&](size_t offset, RegexMatch& m) {
+            while (offset <= window.size() && regex.Search(window, offset, m)) {
+                size_t i = to_index(m.begin);
+                size_t limit = line_end(
+                    std::min(i + kMultiLineMatchMaxLines - 1,
+                             line_offsets.size() - 1));
+                if (m.end <= limit) {
+                    return true;
+                }
+                RegexMatch shorter;
+                if (regex.Search(std::string_view(window).substr(0, limit),
+                                 m.begin, shorter) &&
+                    to_index(shorter.begin) == i) {
+                    m = shorter;
+                    return true;
+                }
+                if (i + 1 == line_offsets.size()) {
+                    return false;
+                }
+                offset = line_offsets[i + 1];
+            }
+            return false;
+        };
+
+        Pos next_from = {block_end, 0};
+        RegexMatch m;
+        for (size_t offset = from.byte_offset;
+             offset < window.size() && search(offset, m);) {
+            Pos begin = to_pos(m.begin);
+            if (begin.line >= block_end) {
+                break;
+            }
+            if (m.end == m.begin) {
+                // Like single line searching, no more match in this line.
+                size_t i = begin.line - from.line + 1;
+                offset = i < line_offsets.size() ? line_offsets[i]
+                                                 : window.size();
+                continue;
+            }
+
+            Pos end_pos = to_pos(m.end);
+            if (CharacterBoundaryValid(get_line(begin.line),
+                                       begin.byte_offset) &&
+                CharacterBoundaryValid(get_line(end_pos.line),
+                                       end_pos.byte_offset)) {
+                res.push_back({begin, end_pos});
+            } else {
+                dropped = true;
+            }
+            if (end_pos.line >= block_end) {
+                // Next window begins after this match.
+                next_from = end_pos;
+                break;
+            }
+            offset = m.end;
+        }
+        from = next_from;
+    }
+    return dropped;
+}
+
+bool SearchTextLines(const SearchLineGetter& get_line, size_t line_cnt,
+                     Regex& regex, Pos from, size_t end,
+                     std::vector<Range>& res) {
+    if (regex.flags() & kRegexMultiLine) {
+        return SearchLinesMultiLine(get_line, line_cnt, regex, from, end,
+                                    res);
     }
 
-    size_t line_cnt = buffer->LineCnt();
-    for (size_t line = 0; line < line_cnt; line++) {
-        const auto& line_str = buffer->GetLine(line);
-        regmatch_t m;
-        for (size_t pos = 0; pos < line_str.size();) {
-            m.rm_so = pos;
-            m.rm_eo = line_str.size();
-            int ret = regexec(&regex, line_str.data(), 1, &m, REG_STARTEND);
+    bool dropped = false;
+    for (size_t line = from.line; line < end; line++) {
+        std::string_view line_str = get_line(line);
+        RegexMatch m;
+        for (size_t pos = line == from.line ? from.byte_offset : 0;
+             pos < line_str.size();) {
             // No match or empty match
             // pattern like "a*" can have empty match, if empty match occur, no
             // more match in this line because of the leftmost longest strategy
             // of posix regex engine.
             // https://pubs.opengroup.org/onlinepubs/9799919799/basedefs/V1_chap09.html
-            if (ret == REG_NOMATCH || m.rm_eo == m.rm_so) {
+            if (!regex.Search(line_str, pos, m) || m.end == m.begin) {
                 break;
             }
 
@@ -47,38 +171,143 @@ std::vector<Range> BufferSearch(const Buffer* buffer,
             // almost all full-featured regex engine only care about codepoints.
             // But we'd better let users know the limitation of the regex
             // engine.
-            if (CharacterBoundaryValid(line_str, m.rm_so) &&
-                CharacterBoundaryValid(line_str, m.rm_eo)) {
-                res.push_back({{line, static_cast<size_t>(m.rm_so)},
-                               {line, static_cast<size_t>(m.rm_eo)}});
+            if (CharacterBoundaryValid(line_str, m.begin) &&
+                CharacterBoundaryValid(line_str, m.end)) {
+                res.push_back({{line, m.begin}, {line, m.end}});
+            } else {
+                dropped = true;
             }
-            pos = m.rm_eo;
+            pos = m.end;
         }
     }
-    regfree(&regex);
+    return dropped;
+}
+
+// Search lines in [from.line, end) of buffer.
+static void SearchLinesInner(const Buffer* buffer, Regex& regex, Pos from,
+                             size_t end, std::vector<Range>& res) {
+    SearchTextLines(
+        [buffer](size_t line) -> std::string_view {
+            return buffer->GetLine(line);
+        },
+        buffer->LineCnt(), regex, from, end, res);
+}
+
+std::vector<Range> BufferSearch(const Buffer* buffer,
+                                const std::string& pattern, bool ignore_case) {
+    std::shared_ptr<Regex> regex;
+    try {
+        regex = RegexCache::GetInstance().Get(
+            pattern, SearchRegexFlags(pattern, ignore_case));
+    } catch (RegexCompileException&) {
+        return {};
+    }
+
+    std::vector<Range> res;
+    SearchLinesInner(buffer, *regex, {0, 0}, buffer->LineCnt(), res);
     return res;
 }
 
+static int BufferSearchRegexFlags(const std::string& pattern,
+                                  const Buffer* buffer) {
+    return SearchRegexFlags(
+        pattern,
+        buffer->opts().global_opts_->GetOpt<bool>(kOptSearchIgnoreCase));
+}
+
 BufferSearchContext::BufferSearchContext(const std::string& pattern,
                                          const Buffer* buffer) {
     if (pattern.empty()) {
         return;
     }
     search_pattern = pattern;
-    search_result = BufferSearch(
-        buffer, search_pattern,
-        buffer->opts().global_opts_->GetOpt<bool>(kOptSearchIgnoreCase));
+    try {
+        regex = RegexCache::GetInstance().Get(
+            pattern, BufferSearchRegexFlags(pattern, buffer));
+    } catch (RegexCompileException& e) {
+        // Keep the pattern and the error for showing, but no result.
+        compile_error = e.what();
+        return;
+    }
     search_buffer_version = buffer->version();
+    search_buffer_id = buffer->id();
+    line_cnt = buffer->LineCnt();
 }
 
 void BufferSearchContext::Destroy() {
     search_pattern.clear();
+    compile_error.clear();
     search_result.clear();
+    dropped_matches = false;
+    current_search = -1;
     search_buffer_version = -1;
     search_buffer_id = -1;
+    regex.reset();
+    searched_lines.clear();
+    line_cnt = 0;
+}
+
+// A pattern without any regex special character.
+static bool IsLiteralPattern(const std::string& pattern) {
+    return pattern.find_first_of("\\^$.|?*+()[]{}") == std::string::npos;
+}
+
+bool BufferSearchContext::TryRefine(const std::string& pattern,
+                                    const Buffer* buffer) {
+    if (buffer->id() != search_buffer_id ||
+        buffer->version() != search_buffer_version) {
+        return false;
+    }
+    return TryRefine(
+        pattern, BufferSearchRegexFlags(pattern, buffer),
+        [buffer](size_t line) -> std::string_view {
+            return buffer->GetLine(line);
+        });
 }
 
-bool BufferSearchContext::EnsureSearched(const Buffer* buffer) {
+bool BufferSearchContext::TryRefine(const std::string& pattern, int flags,
+                                    const SearchLineGetter& get_line) {
+    if (!regex) {
+        return false;
+    }
+    if (pattern == search_pattern && flags == regex->flags()) {
+        return true;
+    }
+    // A match dropped for not being on grapheme boundaries may be extended
+    // to a result, e.g. "a" followed by a combining mark, but it's not in
+    // the lines we would search again. Smartcase dropping ignore case only
+    // makes the new pattern stricter, other flag changes don't.
+    if (dropped_matches || (flags & ~regex->flags()) != 0 ||
+        pattern.size() < search_pattern.size() ||
+        pattern.compare(0, search_pattern.size(), search_pattern) != 0 ||
+        !IsLiteralPattern(pattern)) {
+        return false;
+    }
+
+    // A literal pattern always compiles.
+    std::shared_ptr<Regex> new_regex =
+        RegexCache::GetInstance().Get(pattern, flags);
+
+    // Lines that haven't been searched are still unsearched.
+    std::vector<Range> res;
+    size_t last_line = static_cast<size_t>(-1);
+    for (const Range& r : search_result) {
+        if (r.begin.line == last_line) {
+            continue;
+        }
+        last_line = r.begin.line;
+        dropped_matches |=
+            SearchTextLines(get_line, line_cnt, *new_regex, {last_line, 0},
+                            last_line + 1, res);
+    }
+    search_result = std::move(res);
+    search_pattern = pattern;
+    regex = std::move(new_regex);
+    current_search = -1;
+    return true;
+}
+
+bool BufferSearchContext::EnsureUpToDate(const Buffer* buffer) {
     if (search_buffer_version == -1) {
         return false;
     }
@@ -86,26 +315,170 @@ bool BufferSearchContext::EnsureSearched(const Buffer* buffer) {
     if (buffer->id() != search_buffer_id ||
         buffer->version() != search_buffer_version) {
         // Another buffer or the buffer has changed, we do search again.
-        search_result = BufferSearch(
-            buffer, search_pattern,
-            buffer->opts().global_opts_->GetOpt<bool>(kOptSearchIgnoreCase));
+        search_result.clear();
+        searched_lines.clear();
+        dropped_matches = false;
         search_buffer_version = buffer->version();
         search_buffer_id = buffer->id();
+        line_cnt = buffer->LineCnt();
         current_search = -1;
     }
+    return true;
+}
 
-    if (search_result.size() == 0) {
-        return false;
+void BufferSearchContext::SearchLines(const Buffer* buffer, size_t begin,
+                                      size_t end) {
+    SearchLines(
+        [buffer](size_t line) -> std::string_view {
+            return buffer->GetLine(line);
+        },
+        begin, end);
+}
+
+void BufferSearchContext::SearchLines(const SearchLineGetter& get_line,
+                                      size_t begin, size_t end) {
+    MGO_TRACE_SCOPE("BufferSearch::SearchLines");
+    MGO_ASSERT(regex);
+    end = std::min(end, line_cnt);
+    while (begin < end) {
+        // The first searched range which ends after begin.
+        auto iter = std::upper_bound(
+            searched_lines.begin(), searched_lines.end(), begin,
+            [](size_t line, const std::pair<size_t, size_t>& searched) {
+                return line < searched.second;
+            });
+        if (iter != searched_lines.end() && iter->first <= begin) {
+            begin = iter->second;
+            continue;
+        }
+
+        size_t gap_end = std::min(
+            end, iter == searched_lines.end() ? line_cnt : iter->first);
+        auto insert_iter = std::lower_bound(
+            search_result.begin(), search_result.end(), Pos{begin, 0},
+            [](const Range& r, const Pos& pos) { return r.begin < pos; });
+        // A multi-line result before may end in the gap, don't overlap it.
+        Pos from = {begin, 0};
+        if (insert_iter != search_result.begin() &&
+            from < (insert_iter - 1)->end) {
+            from = (insert_iter - 1)->end;
+        }
+        std::vector<Range> res;
+        dropped_matches |=
+            SearchTextLines(get_line, line_cnt, *regex, from, gap_end, res);
+        int64_t insert_index = insert_iter - search_result.begin();
+
+        // The last result may run into lines searched before, drop results
+        // there which begin in it.
+        if (!res.empty()) {
+            auto drop_end = insert_iter;
+            while (drop_end != search_result.end() &&
+                   drop_end->begin < res.back().end) {
+                drop_end++;
+            }
+            int64_t drop_cnt = drop_end - insert_iter;
+            if (current_search >= insert_index + drop_cnt) {
+                current_search -= drop_cnt;
+            } else if (current_search >= insert_index) {
+                current_search = -1;
+            }
+            insert_iter = search_result.erase(insert_iter, drop_end);
+        }
+
+        if (current_search != -1 && insert_index <= current_search) {
+            current_search += res.size();
+        }
+        search_result.insert(insert_iter, res.begin(), res.end());
+
+        // Mark searched, merge with neighbours.
+        size_t i = iter - searched_lines.begin();
+        searched_lines.insert(iter, {begin, gap_end});
+        if (i + 1 < searched_lines.size() &&
+            searched_lines[i + 1].first == gap_end) {
+            searched_lines[i].second = searched_lines[i + 1].second;
+            searched_lines.erase(searched_lines.begin() + i + 1);
+        }
+        if (i > 0 && searched_lines[i - 1].second == begin) {
+            searched_lines[i - 1].second = searched_lines[i].second;
+            searched_lines.erase(searched_lines.begin() + i);
+        }
+
+        begin = gap_end;
     }
-    return true;
+}
+
+void BufferSearchContext::SearchSlice(const Buffer* buffer, size_t max_lines) {
+    MGO_TRACE_SCOPE("BufferSearch::SearchSlice");
+    size_t begin = 0;
+    if (!searched_lines.empty() && searched_lines[0].first == 0) {
+        begin = searched_lines[0].second;
+    }
+    SearchLines(buffer, begin, begin + max_lines);
+}
+
+void BufferSearchContext::SearchAround(Pos pos, const Buffer* buffer,
+                                       bool next, size_t count) {
+    MGO_TRACE_SCOPE("BufferSearch::SearchAround");
+    // Lines searched in a step.
+    static constexpr size_t kSearchAroundLines = 256;
+
+    size_t found = 0;
+    size_t walked = 0;
+    size_t line = pos.line;
+    bool first_step = true;
+    while (found < count && walked < line_cnt) {
+        size_t begin, end;
+        if (next) {
+            begin = line;
+            end = std::min(line + kSearchAroundLines, line_cnt);
+            line = end == line_cnt ? 0 : end;
+        } else {
+            end = line + 1;
+            begin = end > kSearchAroundLines ? end - kSearchAroundLines : 0;
+            line = begin == 0 ? line_cnt - 1 : begin - 1;
+        }
+        SearchLines(buffer, begin, end);
+        walked += end - begin;
+
+        auto cmp = [](const Range& r, const Pos& p) { return r.begin < p; };
+        auto first = std::lower_bound(search_result.begin(),
+                                      search_result.end(), Pos{begin, 0}, cmp);
+        auto last = std::lower_bound(first, search_result.end(), Pos{end, 0},
+                                     cmp);
+        if (first_step) {
+            // Only count results after/before pos.
+            if (next) {
+                first = std::upper_bound(
+                    first, last, pos,
+                    [](const Pos& p, const Range& r) { return p < r.begin; });
+            } else {
+                last = std::lower_bound(first, last, pos, cmp);
+            }
+            first_step = false;
+        }
+        found += last - first;
+    }
+}
+
+BufferSearchState BufferSearchContext::CurrentState() const {
+    MGO_ASSERT(current_search >= 0 &&
+               static_cast<size_t>(current_search) < search_result.size());
+    size_t line = search_result[current_search].begin.line;
+    bool i_final = !searched_lines.empty() && searched_lines[0].first == 0 &&
+                   searched_lines[0].second > line;
+    return {static_cast<size_t>(current_search + 1), search_result.size(),
+            Complete(), i_final};
 }
 
 bool BufferSearchContext::NearestSearchPos(Pos pos, const Buffer* buffer,
                                            bool next, size_t count,
                                            bool keep_current_if_one) {
     MGO_ASSERT(count != 0);
-    bool has_result = EnsureSearched(buffer);
-    if (!has_result) {
+    if (!EnsureUpToDate(buffer)) {
+        return false;
+    }
+    SearchAround(pos, buffer, next, count);
+    if (search_result.empty()) {
         return false;
     }
 
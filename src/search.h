@@ -1,37 +1,114 @@
 #pragma once
 
+#include <functional>
+#include <memory>
 #include <string>
+#include <string_view>
 #include <vector>
 
 #include "pos.h"
+#include "regex_engine.h"
 
 namespace mango {
 
 class Buffer;
 
+// Uppercase characters in the pattern disable ignore_case, and a "\n" in the
+// pattern enables multi-line matching.
+int SearchRegexFlags(const std::string& pattern, bool ignore_case);
+
+// Lines that a multi-line match can span at most.
+constexpr size_t kMultiLineMatchMaxLines = 64;
+
+using SearchLineGetter = std::function<std::string_view(size_t line)>;
+
+// Search lines in [from.line, end) of a text with line_cnt lines, from
+// from.byte_offset in the first line. Results are pushed back to res, they are
+// sorted and never overlap. A multi-line match begins in these lines and spans
+// at most kMultiLineMatchMaxLines lines, which may be after end.
+// Return true if some matches are dropped for not being on grapheme
+// boundaries.
+bool SearchTextLines(const SearchLineGetter& get_line, size_t line_cnt,
+                     Regex& regex, Pos from, size_t end,
+                     std::vector<Range>& res);
+
 std::vector<Range> BufferSearch(const Buffer* buffer, const std::string& pattern,
                                 bool ignore_case);
 
+struct BufferSearchState {
+    size_t i = 0;  // from 1 instead of zero
+    size_t total = 0;
+    bool total_final = true;  // false if total is only a lower bound
+    // false if lines before the current result haven't been all searched, i
+    // may grow then.
+    bool i_final = true;
+};
+
+// The search context of a buffer. Searching is lazy: lines are searched on
+// demand (e.g. the visible range, the area around the cursor), and the rest
+// of the buffer can be searched in slices by SearchSlice. search_result only
+// contains results in lines that have been searched, so it may be not
+// complete until Complete() returns true.
 struct BufferSearchContext {
-    std::vector<Range> search_result;
+    std::vector<Range> search_result;  // sorted
     int64_t current_search = -1;
     std::string search_pattern;
+    // Why search_pattern failed to compile, empty if it didn't.
+    std::string compile_error;
+    // Some matches in searched lines were dropped for not being on grapheme
+    // boundaries.
+    bool dropped_matches = false;
     int64_t search_buffer_version = -1;
     int64_t search_buffer_id = -1;
     Buffer* b;
 
+    std::shared_ptr<Regex> regex;  // from RegexCache
+    // Sorted and disjoint line ranges [first, second) that have been searched.
+    std::vector<std::pair<size_t, size_t>> searched_lines;
+    size_t line_cnt = 0;
+
     BufferSearchContext() = default;
-    // if the pattern is a empty string, context will in empty state
+    // if the pattern is a empty string or it is an invalid regex, context will
+    // in empty state.
     BufferSearchContext(const std::string& pattern, const Buffer* buffer);
     void Destroy();
-    bool EnsureSearched(const Buffer* buffer);
+    // If the context is up to date, its pattern is a literal and pattern
+    // extends it with literal characters, results of pattern must be in the
+    // lines that have results now. Then only those lines are searched again,
+    // which is cheap when searching on type. The same pattern with the same
+    // regex flags keeps the context as is.
+    // Return false if the context can't be refined, nothing will change.
+    bool TryRefine(const std::string& pattern, const Buffer* buffer);
+    bool TryRefine(const std::string& pattern, int flags,
+                   const SearchLineGetter& get_line);
+    // If the buffer has changed, drop all results so lines will be searched
+    // again.
+    // Return false if the context is in empty state.
+    bool EnsureUpToDate(const Buffer* buffer);
+    // Search lines in [begin, end) which haven't been searched.
+    // A multi-line result may run into lines searched before, results there
+    // which begin in it are dropped, so results never overlap.
+    void SearchLines(const Buffer* buffer, size_t begin, size_t end);
+    void SearchLines(const SearchLineGetter& get_line, size_t begin,
+                     size_t end);
+    // Search at most max_lines lines which haven't been searched.
+    void SearchSlice(const Buffer* buffer, size_t max_lines);
+    bool Complete() const {
+        return line_cnt != 0 && searched_lines.size() == 1 &&
+               searched_lines[0].first == 0 &&
+               searched_lines[0].second == line_cnt;
+    }
+    // The state of the current result, current_search should be valid.
+    BufferSearchState CurrentState() const;
+    // Only lines from pos to the target result are searched.
     bool NearestSearchPos(Pos pos, const Buffer* buffer, bool next,
                           size_t count, bool keep_current_if_one);
-};
 
-struct BufferSearchState {
-    size_t i = 0;  // from 1 instead of zero
-    size_t total = 0;
+   private:
+    // Search from pos.line forward(next) or backward(!next), wrapping around
+    // the buffer, until count results after/before pos are found or the whole
+    // buffer is searched.
+    void SearchAround(Pos pos, const Buffer* buffer, bool next, size_t count);
 };
 
 }  // namespace mango
@@ -12,27 +12,23 @@ namespace mango {
 StatusLine::StatusLine(Cursor* cursor, GlobalOpts* global_opts, Mode* mode)
     : cursor_(cursor), global_opts_(global_opts), mode_(mode) {}
 
-void StatusLine::Draw() {
+bool StatusLine::Draw() {
     ColorSchemeType t = kStatusLine;
 
     auto scheme = global_opts_->GetOpt<ColorScheme>(kOptColorScheme);
 
-    // make this line reverse
-    term_->Print(0, row_, scheme[t], std::string(width_, kSpaceChar).c_str());
-
-    Buffer* b;
+    const TextArea* area;
     if (IsPeel(*mode_)) {
-        b = cursor_->restore_from_peel->area_.buffer_;
+        area = &cursor_->restore_from_peel->area_;
     } else {
-        b = cursor_->in_window->area_.buffer_;
+        area = &cursor_->in_window->area_;
     }
+    Buffer* b = area->buffer_;
     std::string left_str;
     left_str = fmt::format("{:<" MGO_VIM_MODE_WIDTH "} {}{}",
                            kModeString[static_cast<int>(*mode_)], b->Name(),
                            kBufferStateString[static_cast<int>(b->state())]);
 
-    term_->Print(0, row_, scheme[t], left_str.c_str());
-
     int64_t line, character_in_line;
     if (IsPeel(*mode_)) {
         line = cursor_->restore_from_peel->area_.b_view_->cursor_state.pos.line;
@@ -44,13 +40,32 @@ void StatusLine::Draw() {
     }
 
     std::string right_str =
-        fmt::format("  {},{}  {}  {}{}  {}", line + 1, character_in_line + 1,
+        fmt::format("  {},{}  {}  {}  {}{}  {}", line + 1,
+                    character_in_line + 1, area->ScrollIndicator(),
                     FiletypeStrRep(b->filetype()),
                     b->opts().GetOpt<bool>(kOptTabSpace) ? "Sp" : "Tb",
                     b->opts().GetOpt<int64_t>(kOptTabStop), b->eol_seq());
+
+    if (drawn_ && drawn_width_ == width_ && drawn_row_ == row_ &&
+        drawn_scheme_ == scheme && drawn_left_str_ == left_str &&
+        drawn_right_str_ == right_str) {
+        return false;
+    }
+
+    // make this line reverse
+    term_->Print(0, row_, scheme[t], std::string(width_, kSpaceChar).c_str());
+    term_->Print(0, row_, scheme[t], left_str.c_str());
     // all is ascii character, so str len == width
     term_->Print(width_ - right_str.length(), row_, scheme[t],
                  right_str.c_str());
+
+    drawn_ = true;
+    drawn_width_ = width_;
+    drawn_row_ = row_;
+    drawn_scheme_ = scheme;
+    drawn_left_str_ = std::move(left_str);
+    drawn_right_str_ = std::move(right_str);
+    return true;
 }
 
 }  // namespace mango
@@ -1,5 +1,7 @@
 #pragma once
 
+#include <string>
+
 #include "term.h"
 #include "utils.h"
 
@@ -18,7 +20,12 @@ class StatusLine {
     MGO_DELETE_COPY(StatusLine);
     MGO_DEFAULT_MOVE(StatusLine);
 
-    void Draw();
+    // Nothing is drawn if the content is the same as the last drawn one.
+    // Return true if the status line is repainted.
+    bool Draw();
+
+    // Force the next Draw to repaint.
+    void Invalidate() { drawn_ = false; }
 
    public:
     size_t width_ = 0;
@@ -29,6 +36,14 @@ class StatusLine {
     GlobalOpts* global_opts_;
     Mode* mode_;
 
+    // What is on the screen now.
+    bool drawn_ = false;
+    std::string drawn_left_str_;
+    std::string drawn_right_str_;
+    size_t drawn_width_ = 0;
+    size_t drawn_row_ = 0;
+    const Terminal::AttrPair* drawn_scheme_ = nullptr;
+
     Terminal* term_ = &Terminal::GetInstance();
 };
 
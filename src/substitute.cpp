@@ -0,0 +1,309 @@
+#include "substitute.h"
+
+#include <algorithm>
+
+#include "character.h"
+#include "fmt/format.h"
+
+namespace mango {
+
+static bool IsRangeChar(char c) {
+    return (c >= '0' && c <= '9') || c == '.' || c == '$' || c == ',' ||
+           c == '%' || c == ' ';
+}
+
+static bool IsDelimiter(char c) {
+    return IsAscii(c) && c > ' ' && c < 0x7f && c != '\\' &&
+           !(c >= '0' && c <= '9') && !(c >= 'a' && c <= 'z') &&
+           !(c >= 'A' && c <= 'Z');
+}
+
+// Return the offset of the delimiter after the command name, or npos if str
+// is not a substitute command. The range is before name_begin.
+static size_t FindDelimiter(std::string_view str, size_t& name_begin) {
+    size_t i = 0;
+    while (i < str.size() && IsRangeChar(str[i])) {
+        i++;
+    }
+    name_begin = i;
+    while (i < str.size() && str[i] >= 'a' && str[i] <= 'z') {
+        i++;
+    }
+    std::string_view name = str.substr(name_begin, i - name_begin);
+    if ((name != "s" && name != "substitute") || i == str.size() ||
+        !IsDelimiter(str[i])) {
+        return std::string_view::npos;
+    }
+    return i;
+}
+
+bool IsSubstituteCommand(std::string_view str) {
+    size_t name_begin;
+    return FindDelimiter(str, name_begin) != std::string_view::npos;
+}
+
+static std::string_view TrimSpaces(std::string_view str) {
+    while (!str.empty() && str.front() == ' ') {
+        str.remove_prefix(1);
+    }
+    while (!str.empty() && str.back() == ' ') {
+        str.remove_suffix(1);
+    }
+    return str;
+}
+
+static bool ParseAddress(std::string_view str, size_t cur_line,
+                         size_t line_cnt, size_t& line) {
+    str = TrimSpaces(str);
+    if (str == ".") {
+        line = cur_line;
+        return true;
+    }
+    if (str == "$") {
+        line = line_cnt - 1;
+        return true;
+    }
+    if (str.empty() || str.size() > 18) {
+        return false;
+    }
+    size_t n = 0;
+    for (char c : str) {
+        if (c < '0' || c > '9') {
+            return false;
+        }
+        n = n * 10 + (c - '0');
+    }
+    if (n > line_cnt) {
+        return false;
+    }
+    // Like vim, line 0 is the first line.
+    line = n == 0 ? 0 : n - 1;
+    return true;
+}
+
+static bool ParseRange(std::string_view str, size_t cur_line, size_t line_cnt,
+                       size_t& first, size_t& last, bool& swapped) {
+    swapped = false;
+    str = TrimSpaces(str);
+    if (str.empty()) {
+        first = last = cur_line;
+        return true;
+    }
+    if (str == "%") {
+        first = 0;
+        last = line_cnt - 1;
+        return true;
+    }
+    size_t comma = str.find(',');
+    if (!ParseAddress(str.substr(0, comma), cur_line, line_cnt, first)) {
+        return false;
+    }
+    if (comma == std::string_view::npos) {
+        last = first;
+        return true;
+    }
+    if (!ParseAddress(str.substr(comma + 1), cur_line, line_cnt, last)) {
+        return false;
+    }
+    if (first > last) {
+        std::swap(first, last);
+        swapped = true;
+    }
+    return true;
+}
+
+Result ParseSubstituteCommand(std::string_view str, size_t cur_line,
+                              size_t line_cnt, SubstituteCommand& cmd) {
+    MGO_ASSERT(cur_line < line_cnt);
+    cmd.error.clear();
+    size_t name_begin;
+    size_t i = FindDelimiter(str, name_begin);
+    if (i == std::string_view::npos) {
+        return kCommandInvalidArgs;
+    }
+    if (!ParseRange(str.substr(0, name_begin), cur_line, line_cnt,
+                    cmd.first_line, cmd.last_line, cmd.range_swapped)) {
+        return kCommandInvalidArgs;
+    }
+
+    // Pattern, escaped delimiters are unescaped, other escapes are left to
+    // the regex.
+    char delimiter = str[i++];
+    cmd.pattern.clear();
+    for (; i < str.size() && str[i] != delimiter; i++) {
+        if (str[i] == '\\' && i + 1 < str.size()) {
+            if (str[i + 1] != delimiter) {
+                cmd.pattern.push_back('\\');
+            }
+            i++;
+        }
+        cmd.pattern.push_back(str[i]);
+    }
+    if (cmd.pattern.empty()) {
+        return kCommandInvalidArgs;
+    }
+
+    cmd.replacement.assign(1, "");
+    if (i < str.size()) {
+        i++;
+    }
+    for (; i < str.size() && str[i] != delimiter; i++) {
+        char c = str[i];
+        if (c == '&') {
+            cmd.replacement.emplace_back();
+            continue;
+        }
+        if (c == '\\' && i + 1 < str.size()) {
+            c = str[++i];
+            if (c == 'n') {
+                c = '\n';
+            } else if (c == 't') {
+                c = '\t';
+            } else if (c >= '0' && c <= '9') {
+                cmd.error = fmt::format(
+                    "Group references like \\{} are not supported", c);
+                return kCommandInvalidArgs;
+            }
+        }
+        cmd.replacement.back().push_back(c);
+    }
+
+    cmd.global = false;
+    cmd.ignore_case.reset();
+    if (i < str.size()) {
+        i++;
+    }
+    for (; i < str.size(); i++) {
+        if (str[i] == 'g') {
+            cmd.global = true;
+        } else if (str[i] == 'i') {
+            cmd.ignore_case = true;
+        } else if (str[i] == 'I') {
+            cmd.ignore_case = false;
+        } else if (str[i] != ' ') {
+            return kCommandInvalidArgs;
+        }
+    }
+    return kOk;
+}
+
+namespace {
+
+struct SubstituteMatch {
+    size_t line;
+    size_t begin;
+    size_t end;
+};
+
+}  // namespace
+
+static void FindLineMatches(std::string_view line_str, size_t line,
+                            Regex& regex, bool global,
+                            std::vector<SubstituteMatch>& matches) {
+    RegexMatch m;
+    size_t pos = 0;
+    bool after_match = false;
+    while (pos <= line_str.size() && regex.Search(line_str, pos, m)) {
+        bool empty = m.begin == m.end;
+        // We guarentee grapheme boundry like searching does, and an empty
+        // match right after a match is not a new one.
+        bool valid = !(empty && after_match && m.begin == pos) &&
+                     CharacterBoundaryValid(line_str, m.begin) &&
+                     CharacterBoundaryValid(line_str, m.end);
+        if (valid) {
+            matches.push_back({line, m.begin, m.end});
+            if (!global) {
+                return;
+            }
+        }
+        if (!empty) {
+            pos = m.end;
+            after_match = valid;
+            continue;
+        }
+        if (m.begin == line_str.size()) {
+            return;
+        }
+        Character c;
+        int byte_len;
+        ThisCharacter(line_str, m.begin, c, byte_len);
+        pos = m.begin + byte_len;
+        after_match = false;
+    }
+}
+
+bool BuildSubstitution(const SubstituteLineGetter& get_line, Regex& regex,
+                       const SubstituteCommand& cmd, Substitution& sub) {
+    MGO_ASSERT(cmd.first_line <= cmd.last_line);
+    MGO_ASSERT(!cmd.replacement.empty());
+
+    std::vector<SubstituteMatch> matches;
+    for (size_t line = cmd.first_line; line <= cmd.last_line; line++) {
+        FindLineMatches(get_line(line), line, regex, cmd.global, matches);
+    }
+    if (matches.empty()) {
+        return false;
+    }
+
+    size_t literal_size = 0;
+    size_t literal_newlines = 0;
+    for (const std::string& literal : cmd.replacement) {
+        literal_size += literal.size();
+        literal_newlines += std::count(literal.begin(), literal.end(), '\n');
+    }
+    const size_t copies = cmd.replacement.size() - 1;
+
+    // Reserve the exact size, so content is never reallocated.
+    size_t first_line = matches.front().line;
+    size_t last_line = matches.back().line;
+    size_t size = last_line - first_line;  // '\n's
+    for (size_t line = first_line; line <= last_line; line++) {
+        size += get_line(line).size();
+    }
+    for (const SubstituteMatch& m : matches) {
+        size += literal_size + (m.end - m.begin) * copies;
+        size -= m.end - m.begin;
+    }
+
+    sub.content.clear();
+    sub.content.reserve(size);
+    sub.line_cnt = 0;
+    size_t new_line = first_line;
+    auto iter = matches.begin();
+    for (size_t line = first_line; line <= last_line; line++) {
+        if (line != first_line) {
+            sub.content.push_back('\n');
+            new_line++;
+        }
+        std::string_view line_str = get_line(line);
+        if (iter == matches.end() || iter->line != line) {
+            sub.content.append(line_str);
+            continue;
+        }
+
+        sub.line_cnt++;
+        sub.cursor = {new_line, 0};
+        size_t copied = 0;
+        for (; iter != matches.end() && iter->line == line; iter++) {
+            sub.content.append(line_str, copied, iter->begin - copied);
+            std::string_view matched =
+                line_str.substr(iter->begin, iter->end - iter->begin);
+            for (size_t i = 0; i < cmd.replacement.size(); i++) {
+                if (i != 0) {
+                    sub.content.append(matched);
+                }
+                sub.content.append(cmd.replacement[i]);
+            }
+            copied = iter->end;
+            new_line += literal_newlines;
+        }
+        sub.content.append(line_str, copied);
+    }
+    MGO_ASSERT(sub.content.size() == size);
+
+    sub.range = {{first_line, 0}, {last_line, get_line(last_line).size()}};
+    sub.match_cnt = matches.size();
+    return true;
+}
+
+}  // namespace mango
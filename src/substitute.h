@@ -0,0 +1,72 @@
+#pragma once
+
+#include <functional>
+#include <optional>
+#include <string>
+#include <string_view>
+#include <vector>
+
+#include "pos.h"
+#include "regex_engine.h"
+#include "result.h"
+
+namespace mango {
+
+// A parsed ":[range]s/pattern/replacement/[flags]" command, like vim.
+//
+// range: empty for the current line, "%" for the whole buffer, or "a" or
+// "a,b" where an address is a line number(from 1), "." or "$". A backwards
+// range is swapped.
+// Any punctuation other than '\' can be the delimiter instead of '/', it's
+// escaped by '\' in pattern and replacement.
+// replacement: "&" is the matched text, "\&", "\\", "\n" and "\t" are a
+// literal '&', a '\', a line break and a tab. Group references like "\1"
+// are rejected, the regex engine doesn't track groups.
+// flags: "g" replaces all matches in a line instead of only the first one,
+// "i" and "I" ignore and respect case, otherwise the case rules of searching
+// are used.
+struct SubstituteCommand {
+    size_t first_line;  // from 0
+    size_t last_line;   // inclusive
+    std::string pattern;
+    // Literal parts of the replacement, the matched text goes between every
+    // two of them.
+    std::vector<std::string> replacement;
+    bool global = false;
+    std::optional<bool> ignore_case;
+    bool range_swapped = false;  // the range was given backwards
+    // Why parsing failed if it's not malformed, e.g. "\1" in replacement.
+    std::string error;
+};
+
+// Return true if str(a peel command) looks like a substitute command, it
+// should be parsed by ParseSubstituteCommand then.
+bool IsSubstituteCommand(std::string_view str);
+
+// cur_line and line_cnt resolve the range.
+// Return kCommandInvalidArgs if str is malformed, the range is out of the
+// buffer or something unsupported is used(cmd.error is set then).
+Result ParseSubstituteCommand(std::string_view str, size_t cur_line,
+                              size_t line_cnt, SubstituteCommand& cmd);
+
+// The new content of a buffer after substituting, to be applied as one edit.
+struct Substitution {
+    Range range;          // whole lines from the first to the last changed
+    std::string content;  // replaces range
+    Pos cursor;           // the beginning of the last changed line after edit
+    size_t match_cnt = 0;
+    size_t line_cnt = 0;  // changed lines
+};
+
+using SubstituteLineGetter = std::function<std::string_view(size_t line)>;
+
+// All matches in the lines of cmd are found first, then the new content of
+// the changed lines is built in one pass. So any number of replacements is
+// one edit: one undo item, one reparse.
+// Like vim, empty matches are replaced too(e.g. "s/^/# /"), except the one
+// right after a match.
+// Return false if nothing matches.
+bool BuildSubstitution(const SubstituteLineGetter& get_line, Regex& regex,
+                       const SubstituteCommand& cmd, Substitution& sub);
+
+}  // namespace mango
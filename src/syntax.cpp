@@ -3,6 +3,7 @@
 #include "constants.h"
 #include "exception.h"
 #include "options.h"
+#include "trace.h"
 #include "tree_sitter/api.h"
 
 // TODO: refactor here
@@ -134,29 +135,20 @@ bool SyntaxParser::QueryPredicate(const TSQueryContext& query_context,
         const char* predicate = ts_query_string_value_for_id(
             query_context.query, predicates[i].value_id, &str_size);
         if (strcmp(predicate, "match?") == 0) {
-            const regex_t& regex =
-                query_context.pattern_context[capture->index]->match;
+            Regex& regex =
+                *query_context.pattern_context[capture->index]->match;
 
             if (range.begin.line == range.end.line) {
                 auto str = buffer->GetLine(range.begin.line);
-                regmatch_t m;
-                // We use m.rm_so = 0 and str.data() + range.begin.byte_offset
-                // to make '^' have effect
-                m.rm_so = 0;
-                m.rm_eo = range.end.byte_offset - range.begin.byte_offset;
-                int exec_ret =
-                    regexec(&regex, str.data() + range.begin.byte_offset, 1, &m,
-                            REG_STARTEND);
-                if (exec_ret == REG_NOMATCH) {
+                // Use the capture as the subject to make '^' have effect
+                if (!regex.Test(str.substr(
+                        range.begin.byte_offset,
+                        range.end.byte_offset - range.begin.byte_offset))) {
                     return false;
                 }
             } else {
                 std::string str = buffer->GetContent(range);
-                regmatch_t m;
-                m.rm_so = 0;
-                m.rm_eo = str.size();
-                if (REG_NOMATCH ==
-                    regexec(&regex, str.c_str(), 1, &m, REG_STARTEND)) {
+                if (!regex.Test(str)) {
                     return false;
                 }
             }
@@ -167,6 +159,7 @@ bool SyntaxParser::QueryPredicate(const TSQueryContext& query_context,
 }
 
 void SyntaxParser::GenerateHighlight(const Buffer* buffer, const Range& range) {
+    MGO_TRACE_SCOPE("SyntaxParser::Query");
     MGO_ASSERT(filetype_to_query_.count(buffer->filetype()) == 1);
     TSQueryContext& query_context = filetype_to_query_[buffer->filetype()];
     MGO_ASSERT(buffer_context_.count(buffer->id()) == 1);
@@ -268,6 +261,7 @@ void SyntaxParser::GenerateHighlight(const Buffer* buffer, const Range& range) {
 }
 
 void SyntaxParser::SyntaxInit(const Buffer* buffer) {
+    MGO_TRACE_SCOPE("SyntaxParser::Parse");
     auto filetype = buffer->filetype();
     const TSQueryContext* query_context = GetQueryContext(filetype);
     if (query_context == nullptr) {
@@ -292,6 +286,7 @@ void SyntaxParser::SyntaxInit(const Buffer* buffer) {
 }
 
 void SyntaxParser::ParseSyntaxAfterEdit(Buffer* buffer) {
+    MGO_TRACE_SCOPE("SyntaxParser::ParseAfterEdit");
     auto iter = buffer_context_.find(buffer->id());
     if (iter == buffer_context_.end()) {
         return;
@@ -358,14 +353,14 @@ void SyntaxParser::InitQueryContex(TSQueryContext& query_context) {
                     query_context.query, predicates[j + 2].value_id, &str_size);
                 query_context.pattern_context[i] =
                     std::make_unique<TSQueryPatternContext>();
-                int ret = regcomp(&query_context.pattern_context[i]->match,
-                                  regex_pattern, REG_EXTENDED);
-                if (ret != 0) {
-                    char buf[128];
-                    regerror(ret, &query_context.pattern_context[i]->match, buf,
-                             128);
+                try {
+                    query_context.pattern_context[i]->match =
+                        RegexCache::GetInstance().Get(regex_pattern,
+                                                      kRegexNone);
+                } catch (RegexCompileException& e) {
                     query_context.pattern_context[i].reset();
-                    throw RegexCompileException("regex compile error {}", buf);
+                    throw RegexCompileException("regex compile error {}",
+                                                e.what());
                 }
                 MGO_ASSERT(j + 4 == predicates_steps);
                 j += 4;
@@ -4,7 +4,7 @@
 
 #include "buffer.h"
 #include "options.h"
-#include "regex.h"
+#include "regex_engine.h"
 #include "term.h"
 #include "utils.h"
 
@@ -46,14 +46,7 @@ class SyntaxParser {
 
    private:
     struct TSQueryPatternContext {
-        regex_t match;  // for match? predicate
-        bool match_init = false;
-
-        ~TSQueryPatternContext() {
-            if (match_init) {
-                regfree(&match);
-            }
-        }
+        std::shared_ptr<Regex> match;  // for match? predicate
     };
 
     struct TSQueryContext {
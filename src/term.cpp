@@ -1,12 +1,23 @@
 #include "term.h"
 
+#include <unistd.h>
+
+#include <cerrno>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+#include <string_view>
 #include <vector>
 
 #include "keyseq_manager.h"
 #include "options.h"
+#include "trace.h"
 
 namespace mango {
 
+// Not a codepoint, so a front cell of it always differs from the back one.
+static constexpr uint32_t kInvalidCellChar = UINT32_MAX;
+
 Terminal::~Terminal() { Shutdown(); }
 
 void Terminal::InitEscKeyseq() {
@@ -20,6 +31,18 @@ void Terminal::InitEscKeyseq() {
             event_.type = static_cast<uint8_t>(EventType::kBracketedPasteClose);
         }},
         {Mode::kNone});
+
+    // DECRPM replies of synchronized output, 1 and 2 are set and reset, 3
+    // is permanently set, 0 and 4 mean not supported.
+    for (char state = '0'; state <= '4'; state++) {
+        esc_keyseq_manager_->AddKeyseq(
+            std::string("[?2026;") + state + "$y",
+            {[this, state] {
+                sync_output_ = state >= '1' && state <= '3';
+                event_.type = static_cast<uint8_t>(EventType::kReply);
+            }},
+            {Mode::kNone});
+    }
 }
 
 int my_tb_wcswidth_fn(uint32_t* ch, size_t nch) {
@@ -63,6 +86,8 @@ void Terminal::Init(GlobalOpts* global_opts) {
 
     // Enable Bracketed Paste
     tb_sendf("\e[?2004h");
+    // Query whether synchronized output is supported
+    tb_sendf("\e[?2026$p");
     tb_present();
 }
 
@@ -95,6 +120,101 @@ void Terminal::SetCursorStyle(CursorStyle style) {
     }
 }
 
+// termbox2 only flushes its output in tb_present, so the end of the frame is
+// written to the tty right after it, instead of another tb_present which
+// diffs all cells again.
+void Terminal::EndFrame() {
+    static constexpr std::string_view kEndSeq = "\e[?2026l";
+    int tty_fd, resize_fd;
+    GetFDs(tty_fd, resize_fd);
+    size_t written = 0;
+    while (written < kEndSeq.size()) {
+        ssize_t n = write(tty_fd, kEndSeq.data() + written,
+                          kEndSeq.size() - written);
+        if (n == -1) {
+            if (errno == EINTR) {
+                continue;
+            }
+            MGO_LOG_ERROR("write tty error: {}", strerror(errno));
+            throw TermException("write tty error: {}", strerror(errno));
+        }
+        written += n;
+    }
+}
+
+void Terminal::Present() {
+    MGO_TRACE_SCOPE("Terminal::Present");
+    int ret = tb_present();
+    if (ret != TB_OK) {
+        MGO_LOG_ERROR("{}", tb_strerror(ret));
+        throw TermException("{}", tb_strerror(ret));
+    }
+    if (frame_began_) {
+        frame_began_ = false;
+        EndFrame();
+    }
+}
+
+void Terminal::ScrollRows(int top, int height, int n) {
+    MGO_ASSERT(top >= 0 && top + height <= tb_height() && n != 0 &&
+               std::abs(n) < height);
+    BeginFrame();
+
+    // Save the cursor and attrs termbox2 keeps track of, DECSTBM moves the
+    // cursor. IND at the bottom of the region moves rows up, RI at the top
+    // moves them down.
+    std::string seq = fmt::format("\e7\e[{};{}r", top + 1, top + height);
+    if (n > 0) {
+        seq += fmt::format("\e[{};1H", top + height);
+        for (int i = 0; i < n; i++) {
+            seq += "\eD";
+        }
+    } else {
+        seq += fmt::format("\e[{};1H", top + 1);
+        for (int i = 0; i < -n; i++) {
+            seq += "\eM";
+        }
+    }
+    seq += "\e[r\e8";
+    tb_send(seq.data(), seq.size());
+
+    // termbox2 diffs the back buffer with the front one, which is what the
+    // screen shows. Move the front rows as the terminal does, so it doesn't
+    // send them again. Rows exposed are blank on the screen with unknown
+    // attrs, they are marked to be always sent.
+    int width = tb_width();
+    auto swap_rows = [width](int a, int b) {
+        for (int x = 0; x < width; x++) {
+            tb_cell* cell_a;
+            tb_cell* cell_b;
+            if (tb_get_cell(x, a, 0, &cell_a) == TB_OK &&
+                tb_get_cell(x, b, 0, &cell_b) == TB_OK) {
+                std::swap(*cell_a, *cell_b);
+            }
+        }
+    };
+    int exposed_begin;
+    if (n > 0) {
+        for (int r = top; r < top + height - n; r++) {
+            swap_rows(r, r + n);
+        }
+        exposed_begin = top + height - n;
+    } else {
+        for (int r = top + height - 1; r >= top - n; r--) {
+            swap_rows(r, r + n);
+        }
+        exposed_begin = top;
+    }
+    for (int r = exposed_begin; r < exposed_begin + std::abs(n); r++) {
+        for (int x = 0; x < width; x++) {
+            tb_cell* cell;
+            if (tb_get_cell(x, r, 0, &cell) == TB_OK) {
+                cell->ch = kInvalidCellChar;
+            }
+        }
+    }
+}
+
 void Terminal::SetClearAttr(const AttrPair& attr) {
     int ret;
     if ((ret = tb_set_clear_attrs(attr.fg, attr.bg) != TB_OK)) {
@@ -103,6 +223,87 @@ void Terminal::SetClearAttr(const AttrPair& attr) {
     }
 }
 
+// Set a back cell as tb_set_cell_ex does with TB_OPT_EGC, without its checks
+// for every cell. ech is grown by realloc like termbox2 does, which frees it.
+// Return false if out of memory.
+static bool SetBackCell(tb_cell* cell, const uint32_t* ch, size_t nch,
+                        uintattr_t fg, uintattr_t bg) {
+    if (cell->cech < nch + 1) {
+        auto ech = static_cast<uint32_t*>(
+            realloc(cell->ech, (nch + 1) * sizeof(cell->ech[0])));
+        if (ech == nullptr) {
+            return false;
+        }
+        cell->ech = ech;
+        cell->cech = nch + 1;
+    }
+    memcpy(cell->ech, ch, nch * sizeof(cell->ech[0]));
+    cell->ech[nch] = 0;
+    cell->nech = nch;
+    cell->ch = ch[0];
+    cell->fg = fg;
+    cell->bg = bg;
+    return true;
+}
+
+// The back buffer is row-major, cells of a row are contiguous. Return the
+// first cell of the span, or nullptr if it's out of the screen.
+static tb_cell* BackRowSpan(int col, int row, size_t n) {
+    tb_cell* cells;
+    if (col < 0 || row < 0 || row >= tb_height() ||
+        col + static_cast<int64_t>(n) > tb_width() ||
+        tb_get_cell(col, row, 1, &cells) != TB_OK) {
+        return nullptr;
+    }
+    return cells;
+}
+
+void Terminal::ClearCells(int col, int row, size_t n, const AttrPair& attr) {
+    if (n == 0) {
+        return;
+    }
+    BeginFrame();
+    tb_cell* cells = BackRowSpan(col, row, n);
+    if (cells == nullptr) {
+        MGO_LOG_ERROR("{}", tb_strerror(TB_ERR_OUT_OF_BOUNDS));
+        throw TermException("{}", tb_strerror(TB_ERR_OUT_OF_BOUNDS));
+    }
+    uint32_t space = kSpaceChar;
+    for (size_t i = 0; i < n; i++) {
+        if (!SetBackCell(&cells[i], &space, 1, attr.fg, attr.bg)) {
+            MGO_LOG_ERROR("{}", tb_strerror(TB_ERR_MEM));
+            throw TermException("{}", tb_strerror(TB_ERR_MEM));
+        }
+    }
+}
+
+Result Terminal::BlitRow(int col, int row, const RowCells& cells) {
+    if (cells.cells_.empty()) {
+        return kOk;
+    }
+    BeginFrame();
+    tb_cell* back = BackRowSpan(col, row, cells.Width());
+    if (back == nullptr) {
+        MGO_LOG_ERROR("BlitRow ({}, {}) width {}: {}", col, row, cells.Width(),
+                      tb_strerror(TB_ERR_OUT_OF_BOUNDS));
+        return kError;
+    }
+    for (const RowCells::Cell& cell : cells.cells_) {
+        const Codepoint* codepoint = cell.n_codepoint > 1
+                                         ? &cells.codepoints_[cell.codepoints_i]
+                                         : &cell.codepoint;
+        if (!SetBackCell(back, reinterpret_cast<const uint32_t*>(codepoint),
+                         cell.n_codepoint, cell.attr.fg, cell.attr.bg)) {
+            MGO_LOG_ERROR("BlitRow ({}, {}): {}", col, row,
+                          tb_strerror(TB_ERR_MEM));
+            return kError;
+        }
+        // Cols after the first one of a wide character are left untouched.
+        back += cell.width;
+    }
+    return kOk;
+}
+
 bool Terminal::PollInner(int timeout_ms) {
     while (true) {
         int ret;
@@ -115,6 +316,7 @@ bool Terminal::PollInner(int timeout_ms) {
             MGO_LOG_ERROR("{}", tb_strerror(ret));
             throw TermException("{}", tb_strerror(ret));
         }
+        event_time_ = std::chrono::steady_clock::now();
         return true;
     }
 }
@@ -122,8 +324,7 @@ bool Terminal::PollInner(int timeout_ms) {
 bool Terminal::Poll(int timeout_ms) {
     // Try pendding events.
     while (!pendding_events_.empty()) {
-        event_ = pendding_events_.front();
-        pendding_events_.pop_front();
+        PopPendingEvent();
         return true;
     }
 
@@ -143,18 +344,35 @@ bool Terminal::Poll(int timeout_ms) {
     return true;
 }
 
+size_t Terminal::EatRepeatedEvents() {
+    tb_event current = event_;
+    auto current_time = event_time_;
+    size_t cnt = 0;
+    while (Poll(0)) {
+        if (event_.type != current.type || event_.mod != current.mod ||
+            event_.key != current.key || event_.ch != current.ch ||
+            event_.x != current.x || event_.y != current.y) {
+            PendCurrentEvent();
+            break;
+        }
+        cnt++;
+    }
+    event_ = current;
+    event_time_ = current_time;
+    return cnt;
+}
+
 // We implement a mechenism for custom escape seq detection on termbox2.
 void Terminal::HandleEsc() {
     // We have poll a esc event into event_
     // Now we start detetect if any escape sequence
-    pendding_events_.push_back(event_);
+    pendding_events_.push_back({event_, event_time_});
 
     // Try the first following event
     bool res = PollInner(0);
     if (!res) {
         // pop up esc
-        event_ = pendding_events_.front();
-        pendding_events_.pop_front();
+        PopPendingEvent();
         return;
     }
 
@@ -164,11 +382,10 @@ void Terminal::HandleEsc() {
     // will have chars in buffer if we encounter escape sequence.
     if (event_.type != TB_EVENT_KEY) {
         // pop up esc
-        event_ = pendding_events_.front();
-        pendding_events_.pop_front();
+        PopPendingEvent();
         return;
     }
-    pendding_events_.push_back(event_);
+    pendding_events_.push_back({event_, event_time_});
 
     // We have esc event and a key event in left_events
     // and event_ is the key event.
@@ -176,18 +393,18 @@ void Terminal::HandleEsc() {
         Keyseq* handler;
         if (event_.ch > CHAR_MAX) {
             // pop up esc
-            event_ = pendding_events_.front();
-            pendding_events_.pop_front();
+            PopPendingEvent();
             return;
         }
         Result res = esc_keyseq_manager_->FeedKey(EventKeyInfo(), handler);
         if (res == kKeyseqError) {
             // pop up esc
-            event_ = pendding_events_.front();
-            pendding_events_.pop_front();
+            PopPendingEvent();
             return;
         } else if (res == kKeyseqDone) {
             handler->f();
+            // The sequence is read since its esc.
+            event_time_ = pendding_events_.front().time;
             for (auto iter = pendding_events_.begin();
                  iter != pendding_events_.end();) {
                 iter = pendding_events_.erase(iter);
@@ -199,17 +416,15 @@ void Terminal::HandleEsc() {
         bool poll_res = PollInner(0);
         if (!poll_res) {
             // pop up esc
-            event_ = pendding_events_.front();
-            pendding_events_.pop_front();
+            PopPendingEvent();
             return;
         }
 
-        pendding_events_.push_back(event_);
+        pendding_events_.push_back({event_, event_time_});
 
         if (event_.type != TB_EVENT_KEY) {
             // pop up esc
-            event_ = pendding_events_.front();
-            pendding_events_.pop_front();
+            PopPendingEvent();
             return;
         }
     }
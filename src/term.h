@@ -8,7 +8,9 @@
 
 #pragma once
 
+#include <chrono>
 #include <deque>
+#include <vector>
 
 #include "character.h"
 #include "exception.h"
@@ -112,6 +114,7 @@ class Terminal {
     // throws TermException
     void SetCell(int col, int row, const Codepoint* codepoint,
                  size_t n_codepoint, const AttrPair& attr) {
+        BeginFrame();
         int ret = tb_set_cell_ex(
             col, row,
             const_cast<uint32_t*>(reinterpret_cast<const uint32_t*>(codepoint)),
@@ -124,6 +127,7 @@ class Terminal {
 
     // throws TermException
     void Print(int col, int row, const AttrPair& attr, const char* str) {
+        BeginFrame();
         int ret = tb_print(col, row, attr.fg, attr.bg, str);
         if (ret != TB_OK) {
             MGO_LOG_ERROR("{}", tb_strerror(ret));
@@ -131,6 +135,68 @@ class Terminal {
         }
     }
 
+    // throws TermException
+    // Fill n cells from (col, row) with spaces.
+    void ClearCells(int col, int row, size_t n, const AttrPair& attr);
+
+    // Cells of a screen row prepared for BlitRow.
+    class RowCells {
+        friend Terminal;
+
+       public:
+        void Clear() {
+            cells_.clear();
+            codepoints_.clear();
+            width_ = 0;
+        }
+
+        // Cols the cells take.
+        size_t Width() const { return width_; }
+
+        // A character takes width cols, the cols after the first one are left
+        // to the terminal.
+        void Push(const Codepoint* codepoint, size_t n_codepoint, int width,
+                  const AttrPair& attr) {
+            Cell cell = {codepoint[0], 0, static_cast<uint16_t>(n_codepoint),
+                         static_cast<uint16_t>(width), attr};
+            if (n_codepoint > 1) {
+                cell.codepoints_i = codepoints_.size();
+                codepoints_.insert(codepoints_.end(), codepoint,
+                                   codepoint + n_codepoint);
+            }
+            cells_.push_back(cell);
+            width_ += width;
+        }
+        void Push(Codepoint codepoint, const AttrPair& attr) {
+            cells_.push_back({codepoint, 0, 1, 1, attr});
+            width_++;
+        }
+        void PushSpaces(size_t n, const AttrPair& attr) {
+            cells_.insert(cells_.end(), n, {kSpaceChar, 0, 1, 1, attr});
+            width_ += n;
+        }
+
+       private:
+        struct Cell {
+            Codepoint codepoint;  // the first one
+            uint32_t codepoints_i;  // in codepoints_ if n_codepoint > 1
+            uint16_t n_codepoint;
+            uint16_t width;
+            AttrPair attr;
+        };
+
+        std::vector<Cell> cells_;
+        std::vector<Codepoint> codepoints_;
+        size_t width_ = 0;
+    };
+
+    // Write cells to the row from col. Bounds are checked once for the
+    // whole row, then cells are written into the back buffer of termbox2
+    // directly instead of by tb_set_cell_ex one by one. Return kError and log
+    // if it's out of the screen or out of memory, cells after the failed one
+    // are not written then.
+    Result BlitRow(int col, int row, const RowCells& cells);
+
     // throws TermException
     void SetCursor(int col, int row) {
         int ret = tb_set_cursor(col, row);
@@ -174,6 +240,7 @@ class Terminal {
 
     // throws TermException
     void Clear() {
+        BeginFrame();
         int ret = tb_clear();
         if (ret != TB_OK) {
             MGO_LOG_ERROR("{}", tb_strerror(ret));
@@ -182,13 +249,15 @@ class Terminal {
     }
 
     // throws TermException
-    void Present() {
-        int ret = tb_present();
-        if (ret != TB_OK) {
-            MGO_LOG_ERROR("{}", tb_strerror(ret));
-            throw TermException("{}", tb_strerror(ret));
-        }
-    }
+    // If the terminal supports synchronized output, a frame which changes
+    // cells or scrolls rows is wrapped in it so it's never shown half drawn.
+    void Present();
+
+    // Move the content of rows [top, top + height) up n rows, or down -n rows
+    // if n < 0, 0 < |n| < height. The rows should take the whole width.
+    // The terminal moves them itself with a scroll region at the next
+    // Present, then only cells that differ from the moved ones are sent.
+    void ScrollRows(int top, int height, int n);
 
     // throws TermException
     void GetFDs(int& tty_fd, int& resize_fd) {
@@ -205,6 +274,17 @@ class Terminal {
 
     void HandleEsc();
 
+    // Start synchronized output of a frame if it's supported and not
+    // started yet. Called before the screen is changed.
+    void BeginFrame() {
+        if (sync_output_ && !frame_began_) {
+            tb_sendf("\e[?2026h");
+            frame_began_ = true;
+        }
+    }
+    // throws TermException
+    void EndFrame();
+
    public:
     // throws TermException
     // timeout == -1 means infinite blocking
@@ -216,6 +296,7 @@ class Terminal {
         kMouse = TB_EVENT_MOUSE,
         kBracketedPasteOpen,
         kBracketedPasteClose,
+        kReply,  // A reply to our query, it's handled by the terminal.
     };
 
     EventType WhatEvent() { return static_cast<EventType>(event_.type); }
@@ -356,18 +437,50 @@ class Terminal {
                 static_cast<Mod>(event_.mod)};
     }
 
-    void PendCurrentEvent() { pendding_events_.push_front(event_); }
+    // When the current event was read from the terminal, pending events keep
+    // the time they were read. An escape sequence has the time of its esc.
+    std::chrono::steady_clock::time_point EventTime() const noexcept {
+        return event_time_;
+    }
+
+    void PendCurrentEvent() {
+        pendding_events_.push_front({event_, event_time_});
+    }
+
+    // Consume the following events which are the same as the current one and
+    // have arrived already, return the count of them. The first different
+    // event is kept for the next Poll.
+    // throws TermException
+    size_t EatRepeatedEvents();
 
    private:
+    struct PendingEvent {
+        tb_event event;
+        // Of the read, a pending event keeps it when reported later.
+        std::chrono::steady_clock::time_point time;
+    };
+
+    // Make the first pending event the current one.
+    void PopPendingEvent() {
+        event_ = pendding_events_.front().event;
+        event_time_ = pendding_events_.front().time;
+        pendding_events_.pop_front();
+    }
+
     tb_event event_;
+    std::chrono::steady_clock::time_point event_time_;
 
     // When parsing escape key seq, some events occurs and interrupt it, we
     // should kept it in left_events and report them later.
-    std::deque<tb_event> pendding_events_;
+    std::deque<PendingEvent> pendding_events_;
     KeyseqManager* esc_keyseq_manager_ = nullptr;
     Mode mode_ = Mode::kNone;  // const
 
     bool init_ = false;
+    // Whether the terminal supports synchronized output, known after it
+    // replies our query.
+    bool sync_output_ = false;
+    bool frame_began_ = false;
 
     GlobalOpts* global_opts_;
 };
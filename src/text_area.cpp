@@ -2,6 +2,9 @@
 
 #include <stdint.h>
 
+#include <algorithm>
+#include <cstdlib>
+#include <limits>
 #include <gsl/util>
 
 #include "buffer.h"
@@ -22,25 +25,54 @@ TextArea::TextArea(Cursor* cursor, Opts* opts, SyntaxParser* parser,
                    ClipBoard* clipboard) noexcept
     : cursor_(cursor), clipboard_(clipboard), parser_(parser), opts_(opts) {}
 
-void TextArea::Draw(BufferSearchContext* search_context) {
+bool TextArea::Draw(BufferSearchContext* search_context) {
     MGO_ASSERT(buffer_ != nullptr);
-    if (!buffer_->IsLoad()) {
-        return;
+    size_t sidebar_width = buffer_->IsLoad() ? SidebarWidth() : 0;
+    if (!buffer_->IsLoad() || !SizeValid(sidebar_width)) {
+        // Nothing to show, but stale content of the area shouldn't be left.
+        ClearRows(0, height_);
+        last_draw_state_.reset();
+        return true;
     }
 
-    size_t sidebar_width = SidebarWidth();
-    if (!SizeValid(sidebar_width)) {
-        return;
+    if (search_context && !search_context->EnsureUpToDate(buffer_)) {
+        search_context = nullptr;
+    }
+    DrawState draw_state = MakeDrawState(search_context);
+    if (last_draw_state_ == draw_state) {
+        return false;
+    }
+    // Let the terminal move rows still shown, only rows exposed and what
+    // has changed are sent then. The area is drawn as usual.
+    int64_t scrolled_rows;
+    if (col_ == 0 && width_ == term_->Width() &&
+        ScrolledRows(draw_state, width_ - sidebar_width, scrolled_rows)) {
+        term_->ScrollRows(row_, height_, scrolled_rows);
     }
+    last_draw_state_ = draw_state;
 
     size_t content_s_col = col_ + sidebar_width;
     size_t content_width = width_ - sidebar_width;
 
-    auto scheme = GetOpt<ColorScheme>(kOptColorScheme);
-    auto tabstop = GetOpt<int64_t>(kOptTabStop);
-    auto wrap = GetOpt<bool>(kOptWrap);
-    auto eob_mark = GetOpt<bool>(kOptEndOfBufferMark);
-    auto trailing_white = GetOpt<bool>(kOptTrailingWhite);
+    auto scheme = draw_state.scheme;
+    auto tabstop = draw_state.tabstop;
+    auto wrap = draw_state.wrap;
+    auto eob_mark = draw_state.eob_mark;
+    auto trailing_white = draw_state.trailing_white;
+
+    // Content of a row is prepared here and blitted at once. A row failed to
+    // blit is logged by the terminal and left.
+    Terminal::RowCells cells;
+
+    // The screen isn't cleared before drawing, so every cell of the area
+    // should be drawn.
+    auto draw_eob_row = [&](size_t s_row) {
+        cells.Clear();
+        cells.PushSpaces(sidebar_width, scheme[kNormal]);
+        cells.Push('~', scheme[kNormal]);
+        cells.PushSpaces(content_width - 1, scheme[kNormal]);
+        term_->BlitRow(col_, s_row, cells);
+    };
 
     // Prepare highlights, priority: index 0 -> n, high -> low
     std::vector<const std::vector<Highlight>*> highlights;
@@ -59,15 +91,26 @@ void TextArea::Draw(BufferSearchContext* search_context) {
 
     // Search hl
     std::vector<Highlight> search_hl;
-    if (search_context && search_context->EnsureSearched(buffer_)) {
-        search_hl.reserve(search_context->search_result.size());
-        // TODO: Only highlight ranges in the screen
-        for (size_t i = 0; i < search_context->search_result.size(); i++) {
+    if (search_context) {
+        // The visible range is searched first, other lines are searched
+        // lazily. A multi-line result may begin above the view.
+        size_t search_begin = render_range.begin.line;
+        if (search_context->regex->flags() & kRegexMultiLine) {
+            search_begin -= std::min(search_begin, kMultiLineMatchMaxLines - 1);
+        }
+        search_context->SearchLines(buffer_, search_begin,
+                                    render_range.end.line + 1);
+        const auto& result = search_context->search_result;
+        // Only highlight ranges in the screen
+        auto iter = std::lower_bound(
+            result.begin(), result.end(), render_range.begin,
+            [](const Range& r, const Pos& pos) { return !(pos < r.end); });
+        for (; iter != result.end() && iter->begin < render_range.end;
+             iter++) {
             search_hl.push_back(
-                {search_context->search_result[i],
-                 search_context->current_search == static_cast<int64_t>(i)
-                     ? kSearchCurrent
-                     : kSearch});
+                {*iter, search_context->current_search == iter - result.begin()
+                            ? kSearchCurrent
+                            : kSearch});
         }
         highlights.push_back(&search_hl);
     }
@@ -94,22 +137,12 @@ void TextArea::Draw(BufferSearchContext* search_context) {
             last_line - static_cast<int64_t>(render_range.begin.line) + 1;
         trailing_white_begin_pre_line.reserve(line_cnt);
         for (size_t l = b_view_->line; l < b_view_->line + line_cnt; l++) {
-            const auto& line = buffer_->GetLine(l);
-            int64_t i = static_cast<int64_t>(line.size()) - 1;
-            for (; i >= 0; i--) {
-                // Backward codepoint scan is correct and enough.
-                // '\t' will break all, ' ' only may after a pretend codepoint,
-                // but we render from begin so we will skip it if it's wrong.
-                if (line[i] != kSpaceChar && line[i] != '\t') {
-                    break;
-                }
-            }
-            i++;
+            size_t size = buffer_->GetLine(l).size();
+            size_t i = buffer_->GetLineInfo(l).trailing_white_begin;
             trailing_white_begin_pre_line.push_back(i);
-            if (i != static_cast<int64_t>(line.size())) {
+            if (i != size) {
                 trailing_white_hl.push_back(
-                    {{{l, static_cast<size_t>(i)}, {l, line.size()}},
-                     kTrailingWhite});
+                    {{{l, i}, {l, size}}, kTrailingWhite});
             }
         }
         if (!trailing_white_hl.empty()) {
@@ -126,6 +159,9 @@ void TextArea::Draw(BufferSearchContext* search_context) {
         }
     }
 
+    // Attr runs of the line being drawn, shared by its sublines.
+    std::vector<AttrRun> runs;
+
     if (wrap) {
         // An empty sidebar
         char empty_sidebar[kMaxSizeTWidth + 3 + 1];
@@ -141,10 +177,11 @@ void TextArea::Draw(BufferSearchContext* search_context) {
         MGO_ASSERT(line < buffer_->LineCnt());
         for (size_t i = 0; i < height_; i++) {
             if (line >= buffer_->LineCnt()) {
-                if (!eob_mark) break;
-                Codepoint codepoint = '~';
-                term_->SetCell(content_s_col, i + row_, &codepoint, 1,
-                               scheme[kNormal]);
+                if (!eob_mark) {
+                    ClearRows(i, height_);
+                    break;
+                }
+                draw_eob_row(i + row_);
                 line++;
                 continue;
             }
@@ -174,10 +211,16 @@ void TextArea::Draw(BufferSearchContext* search_context) {
                     ? line_str.size()
                     : trailing_white_begin_pre_line[line -
                                                     render_range.begin.line];
+            if (i == 0 || byte_offset == 0) {
+                ResolveAttrRuns(line, 0, line_str.size(), &highlights, scheme,
+                                kNormal, runs);
+            }
+            cells.Clear();
             byte_offset =
-                DrawLine(*term_, line_str, {line, byte_offset}, 0,
-                         content_width, i + row_, content_s_col, &highlights,
-                         scheme, kNormal, trailing_white_begin, tabstop, true);
+                DrawLine(line_str, {line, byte_offset}, 0, content_width, runs,
+                         trailing_white_begin, tabstop, true, cells);
+            cells.PushSpaces(content_width - cells.Width(), scheme[kNormal]);
+            term_->BlitRow(content_s_col, i + row_, cells);
             if (byte_offset == line_str.size()) {
                 line++;
                 byte_offset = 0;
@@ -190,10 +233,11 @@ void TextArea::Draw(BufferSearchContext* search_context) {
             size_t line = win_r + b_view_->line;
 
             if (line_cnt <= line) {
-                if (!eob_mark) break;
-                Codepoint codepoint = '~';
-                term_->SetCell(content_s_col, cur_s_row, &codepoint, 1,
-                               scheme[kNormal]);
+                if (!eob_mark) {
+                    ClearRows(win_r, height_);
+                    break;
+                }
+                draw_eob_row(cur_s_row);
                 continue;
             }
             DrawSidebar(cur_s_row, line, sidebar_width);
@@ -203,11 +247,106 @@ void TextArea::Draw(BufferSearchContext* search_context) {
                     ? line_str.size()
                     : trailing_white_begin_pre_line[line -
                                                     render_range.begin.line];
-            DrawLine(*term_, line_str, {line, 0}, b_view_->col, content_width,
-                     cur_s_row, content_s_col, &highlights, scheme, kNormal,
-                     trailing_white_begin, tabstop, false);
+            // Start from the nearest checkpoint before the view, only what is
+            // drawn is resolved.
+            const ColumnIndex::Checkpoint& checkpoint =
+                buffer_->GetColumnIndex(line, tabstop)
+                    .BeforeViewCol(b_view_->col);
+            size_t begin_view_col = b_view_->col - checkpoint.view_col;
+            size_t end = ArrangeLine(line_str, checkpoint.byte_offset, 0,
+                                     begin_view_col + content_width, tabstop,
+                                     false);
+            ResolveAttrRuns(line, checkpoint.byte_offset, end, &highlights,
+                            scheme, kNormal, runs);
+            cells.Clear();
+            DrawLine(line_str, {line, checkpoint.byte_offset}, begin_view_col,
+                     content_width, runs, trailing_white_begin, tabstop, false,
+                     cells);
+            cells.PushSpaces(content_width - cells.Width(), scheme[kNormal]);
+            term_->BlitRow(content_s_col, cur_s_row, cells);
         }
     }
+    return true;
+}
+
+TextArea::DrawState TextArea::MakeDrawState(
+    const BufferSearchContext* search_context) {
+    DrawState state;
+    state.buffer_id = buffer_->id();
+    state.buffer_version = buffer_->version();
+    state.filetype = buffer_->filetype().data();
+    state.width = width_;
+    state.height = height_;
+    state.row = row_;
+    state.col = col_;
+    state.view_line = b_view_->line;
+    state.view_col = b_view_->col;
+    state.view_subline = b_view_->subline;
+    state.line_number_type = GetOpt<int64_t>(kOptLineNumber);
+    state.cursor_line = 0;
+    if (static_cast<LineNumberType>(state.line_number_type) ==
+        LineNumberType::kRelative) {
+        state.cursor_line = b_view_->cursor_state_valid
+                                ? b_view_->cursor_state.pos.line
+                                : cursor_->pos.line;
+    }
+    state.selection_active = IsSelectionActive();
+    state.selection_begin = state.selection_end = {0, 0};
+    if (state.selection_active) {
+        Range range = selection_->ToSelectRange(buffer_);
+        state.selection_begin = range.begin;
+        state.selection_end = range.end;
+    }
+    state.search_regex = nullptr;
+    state.search_buffer_version = -1;
+    state.current_search = -1;
+    if (search_context) {
+        state.search_regex = search_context->regex.get();
+        state.search_buffer_version = search_context->search_buffer_version;
+        state.current_search = search_context->current_search;
+    }
+    state.scheme = GetOpt<ColorScheme>(kOptColorScheme);
+    state.tabstop = GetOpt<int64_t>(kOptTabStop);
+    state.wrap = GetOpt<bool>(kOptWrap);
+    state.eob_mark = GetOpt<bool>(kOptEndOfBufferMark);
+    state.trailing_white = GetOpt<bool>(kOptTrailingWhite);
+    return state;
+}
+
+bool TextArea::ScrolledRows(const DrawState& state, size_t content_width,
+                            int64_t& rows) {
+    if (!last_draw_state_) {
+        return false;
+    }
+    const DrawState& last = *last_draw_state_;
+    if (last.buffer_id != state.buffer_id || last.width != state.width ||
+        last.height != state.height || last.row != state.row ||
+        last.col != state.col || last.wrap != state.wrap ||
+        last.view_col != state.view_col) {
+        return false;
+    }
+    if (!state.wrap) {
+        rows = static_cast<int64_t>(state.view_line) -
+               static_cast<int64_t>(last.view_line);
+    } else {
+        const PrefixSumTree* wrap_rows = GetWrapRows(content_width);
+        if (!wrap_rows || last.view_line >= wrap_rows->size() ||
+            state.view_line >= wrap_rows->size()) {
+            return false;
+        }
+        rows = static_cast<int64_t>(wrap_rows->PrefixSum(state.view_line) +
+                                    state.view_subline) -
+               static_cast<int64_t>(wrap_rows->PrefixSum(last.view_line) +
+                                    last.view_subline);
+    }
+    return rows != 0 && std::abs(rows) < static_cast<int64_t>(state.height);
+}
+
+void TextArea::ClearRows(size_t begin, size_t end) {
+    auto scheme = GetOpt<ColorScheme>(kOptColorScheme);
+    for (size_t r = begin; r < end; r++) {
+        term_->ClearCells(col_, row_ + r, width_, scheme[kNormal]);
+    }
 }
 
 bool TextArea::In(size_t s_col, size_t s_row) {
@@ -215,6 +354,65 @@ bool TextArea::In(size_t s_col, size_t s_row) {
            s_row < row_ + height_;
 }
 
+bool TextArea::WrapRowsComplete() {
+    if (!buffer_ || !buffer_->IsLoad() || !GetOpt<bool>(kOptWrap)) {
+        return true;
+    }
+    size_t sidebar_width = SidebarWidth();
+    if (!SizeValid(sidebar_width)) {
+        return true;
+    }
+    return GetWrapRows(width_ - sidebar_width) != nullptr;
+}
+
+void TextArea::BuildWrapRowsSlice(size_t max_bytes) {
+    if (WrapRowsComplete()) {
+        return;
+    }
+    buffer_->BuildWrapRowsSlice(width_ - SidebarWidth(),
+                                GetOpt<int64_t>(kOptTabStop), max_bytes);
+}
+
+std::string TextArea::ScrollIndicator() const {
+    if (!buffer_ || !buffer_->IsLoad()) {
+        return "";
+    }
+    size_t sidebar_width = SidebarWidth();
+    if (!SizeValid(sidebar_width)) {
+        return "";
+    }
+    // The view has been made valid by Editor::PreProcess before drawing.
+
+    size_t above, below;
+    size_t content_width = width_ - sidebar_width;
+    bool wrap = GetOpt<bool>(kOptWrap);
+    const PrefixSumTree* rows = wrap ? GetWrapRows(content_width) : nullptr;
+    if (!wrap) {
+        above = b_view_->line;
+        below = buffer_->LineCnt() -
+                std::min(buffer_->LineCnt(), b_view_->line + height_);
+    } else if (rows) {
+        above = rows->PrefixSum(b_view_->line) + b_view_->subline;
+        below = rows->Sum() - std::min(rows->Sum(), above + height_);
+    } else {
+        // Lines partly shown are counted.
+        Range range = CalcWrapRange(content_width);
+        above = b_view_->line + (b_view_->subline == 0 ? 0 : 1);
+        below = buffer_->LineCnt() - range.end.line;
+    }
+
+    if (above == 0 && below == 0) {
+        return "All";
+    }
+    if (above == 0) {
+        return "Top";
+    }
+    if (below == 0) {
+        return "Bot";
+    }
+    return fmt::format("{}%", above * 100 / (above + below));
+}
+
 // cursor is before the first row.
 // we just put that cursor on the first row of screen.
 // TODO: scrolloff?
@@ -222,54 +420,26 @@ void TextArea::MakeCursorVisibleWrapInnerWhenCursorBeforeRenderRange(
     size_t content_width) {
     b_view_->line = cursor_->pos.line;
 
-    size_t byte_offset = 0;
-    size_t subline = 0;
-    size_t end_b_view_col;
-    while (true) {
-        bool stop_at_target;
-        size_t character_cnt;
-        byte_offset = ArrangeLine(
-            buffer_->GetLine(b_view_->line), byte_offset, 0, content_width,
-            GetOpt<int64_t>(kOptTabStop), true, &end_b_view_col,
-            &cursor_->pos.byte_offset, &stop_at_target, &character_cnt);
-        cursor_->character_in_line += character_cnt;
-        if (stop_at_target) {
-            cursor_->SetScreenPos(end_b_view_col + width_ - content_width,
-                                  subline);
-            b_view_->subline = subline;
-            if (!cursor_->b_view_col_want.has_value()) {
-                cursor_->b_view_col_want = end_b_view_col;
-            }
-            return;
-        }
-        subline++;
+    size_t view_col;
+    size_t subline = LocateInWrapLine(cursor_->pos, content_width, view_col,
+                                      cursor_->character_in_line);
+    cursor_->SetScreenPos(view_col + width_ - content_width, subline);
+    b_view_->subline = subline;
+    if (!cursor_->b_view_col_want.has_value()) {
+        cursor_->b_view_col_want = view_col;
     }
 }
 
 void TextArea::MakeCursorVisibleWrapInnerWhenCursorAfterRenderRange(
     size_t content_width) {
-    int tabstop = GetOpt<int64_t>(kOptTabStop);
     // Which subline of the line the cursor in?
-    size_t byte_offset = 0;
-    size_t subline = 0;
-    size_t end_view_col;
-    while (true) {
-        bool stop_at_target;
-        size_t character_cnt;
-        byte_offset = ArrangeLine(buffer_->GetLine(cursor_->pos.line),
-                                  byte_offset, 0, content_width, tabstop, true,
-                                  &end_view_col, &cursor_->pos.byte_offset,
-                                  &stop_at_target, &character_cnt);
-        cursor_->character_in_line += character_cnt;
-        if (stop_at_target) {
-            cursor_->SetScreenPos(end_view_col + width_ - content_width,
-                                  row_ + height_ - 1);
-            if (!cursor_->b_view_col_want.has_value()) {
-                cursor_->b_view_col_want = end_view_col;
-            }
-            break;
-        }
-        subline++;
+    size_t view_col;
+    size_t subline = LocateInWrapLine(cursor_->pos, content_width, view_col,
+                                      cursor_->character_in_line);
+    cursor_->SetScreenPos(view_col + width_ - content_width,
+                          row_ + height_ - 1);
+    if (!cursor_->b_view_col_want.has_value()) {
+        cursor_->b_view_col_want = view_col;
     }
 
     if (cursor_->pos.line == 0) {
@@ -278,12 +448,19 @@ void TextArea::MakeCursorVisibleWrapInnerWhenCursorAfterRenderRange(
         return;
     }
 
+    const PrefixSumTree* rows = GetWrapRows(content_width);
+    if (rows) {
+        size_t row = rows->PrefixSum(cursor_->pos.line) + subline;
+        row = row > height_ - 1 ? row - (height_ - 1) : 0;
+        b_view_->line = rows->Find(row, b_view_->subline);
+        return;
+    }
+
     // Search backward to set the start.
     size_t row_cnt_before_cursor_line = height_ - (subline + 1);
     size_t line = cursor_->pos.line - 1;
     while (true) {
-        size_t row_cnt =
-            ScreenRows(buffer_->GetLine(line), content_width, tabstop);
+        size_t row_cnt = GetWrapLayout(line, content_width).ScreenRows();
         if (row_cnt < row_cnt_before_cursor_line) {
             row_cnt_before_cursor_line -= row_cnt;
             line--;
@@ -303,19 +480,13 @@ void TextArea::MakeCursorVisibleWrap() {
     }
 
     size_t content_width = width_ - sidebar_width;
-    int tabstop = GetOpt<int64_t>(kOptTabStop);
 
     size_t line = b_view_->line;
-    size_t byte_offset = 0;
-
-    // First, we skip some sub lines.
-    for (size_t i = 0; i < b_view_->subline; i++) {
-        byte_offset = ArrangeLine(buffer_->GetLine(line), byte_offset, 0,
-                                  content_width, tabstop, true);
-    }
+    const WrapLayout& layout = GetWrapLayout(line, content_width);
+    MGO_ASSERT(b_view_->subline < layout.ScreenRows());
 
     cursor_->character_in_line = 0;
-    if (cursor_->pos < Pos{line, byte_offset}) {
+    if (cursor_->pos < Pos{line, layout.sublines[b_view_->subline].begin}) {
         if (!b_view_->make_cursor_visible) {
             cursor_->SetScreenPos(-1, -1);
             return;
@@ -324,37 +495,31 @@ void TextArea::MakeCursorVisibleWrap() {
         return;
     }
 
-    // We walk through the render range.
-    for (size_t i = 0; i < height_; i++) {
-        if (line >= buffer_->LineCnt()) {
-            break;
+    // We walk through the render range, only rows of lines before the cursor
+    // line are counted.
+    int64_t row = -static_cast<int64_t>(b_view_->subline);
+    const PrefixSumTree* rows = GetWrapRows(content_width);
+    if (rows) {
+        row += rows->PrefixSum(cursor_->pos.line) - rows->PrefixSum(line);
+    } else {
+        for (; line < cursor_->pos.line && row < static_cast<int64_t>(height_);
+             line++) {
+            row += GetWrapLayout(line, content_width).ScreenRows();
         }
-        if (line == cursor_->pos.line) {
-            size_t end_view_col;
-            bool stop_at_cursor;
-            size_t character_cnt;
-            byte_offset = ArrangeLine(buffer_->GetLine(line), byte_offset, 0,
-                                      content_width, tabstop, true,
-                                      &end_view_col, &cursor_->pos.byte_offset,
-                                      &stop_at_cursor, &character_cnt);
-            cursor_->character_in_line += character_cnt;
-            // We find the cursor's location.
-            if (stop_at_cursor) {
-                // The cursor is in the screen, just return.
-                cursor_->SetScreenPos(end_view_col + width_ - content_width,
-                                      row_ + i);
-                if (!cursor_->b_view_col_want.has_value()) {
-                    cursor_->b_view_col_want = end_view_col;
-                }
-                return;
+    }
+    if (row < static_cast<int64_t>(height_)) {
+        size_t view_col;
+        size_t subline = LocateInWrapLine(cursor_->pos, content_width,
+                                          view_col, cursor_->character_in_line);
+        row += subline;
+        if (row < static_cast<int64_t>(height_)) {
+            // The cursor is in the screen, just return.
+            cursor_->SetScreenPos(view_col + width_ - content_width,
+                                  row_ + row);
+            if (!cursor_->b_view_col_want.has_value()) {
+                cursor_->b_view_col_want = view_col;
             }
-        } else {
-            byte_offset = ArrangeLine(buffer_->GetLine(line), byte_offset, 0,
-                                      content_width, tabstop, true);
-        }
-        if (byte_offset == buffer_->GetLine(line).size()) {
-            line++;
-            byte_offset = 0;
+            return;
         }
     }
 
@@ -373,32 +538,10 @@ void TextArea::MakeCursorVisibleNotWrap() {
         return;
     }
 
-    auto tabstop = GetOpt<int64_t>(kOptTabStop);
-
     // Calculate the cursor pos if we put the buffer from (0, 0)
     size_t row = cursor_->pos.line;
-
-    const auto& cur_line = buffer_->GetLine(cursor_->pos.line);
-    Character character;
-    size_t cur_b_view_c = 0;
-    size_t offset = 0;
-    cursor_->character_in_line = 0;
-    while (offset < cursor_->pos.byte_offset) {
-        int byte_len;
-        ThisCharacter(cur_line, offset, character, byte_len);
-        offset += byte_len;
-        int character_width = character.Width();
-        if (character_width <= 0) {
-            char c;
-            if (character.Ascii(c) && c == '\t') {
-                character_width = tabstop - cur_b_view_c % tabstop;
-            } else {
-                character_width = kReplacementCharWidth;
-            }
-        }
-        cur_b_view_c += character_width;
-        cursor_->character_in_line++;
-    }
+    size_t cur_b_view_c =
+        LocateInNoWrapLine(cursor_->pos, cursor_->character_in_line);
 
     // some opretions makes want change, reset it
     if (!cursor_->b_view_col_want.has_value()) {
@@ -455,20 +598,19 @@ void TextArea::MakeSureViewValid() {
     if (GetOpt<bool>(kOptWrap)) {
         if (b_view_->line >= buffer_->LineCnt()) {
             b_view_->line = buffer_->LineCnt() - 1;
-            b_view_->subline = ScreenRows(buffer_->GetLine(b_view_->line),
-                                          width_ - SidebarWidth(),
-                                          GetOpt<int64_t>(kOptTabStop)) -
-                               1;
+            b_view_->subline =
+                GetWrapLayout(b_view_->line, width_ - SidebarWidth())
+                    .ScreenRows() -
+                1;
         } else {
             if (b_view_->subline == 0) {
                 return;
             }
-            b_view_->subline =
-                std::min(ScreenRows(buffer_->GetLine(b_view_->line),
-                                    width_ - SidebarWidth(),
-                                    GetOpt<int64_t>(kOptTabStop)) -
-                             1,
-                         b_view_->subline);
+            b_view_->subline = std::min(
+                GetWrapLayout(b_view_->line, width_ - SidebarWidth())
+                        .ScreenRows() -
+                    1,
+                b_view_->subline);
         }
     } else {
         b_view_->line = std::min(buffer_->LineCnt() - 1, b_view_->line);
@@ -481,53 +623,54 @@ void TextArea::MakeSureBColViewWantReady(CursorState& state) {
     }
 
     size_t content_width = width_ - SidebarWidth();
-    int tabstop = GetOpt<int64_t>(kOptTabStop);
     MGO_ASSERT(state.pos.line < buffer_->LineCnt());
     if (GetOpt<bool>(kOptWrap)) {
-        size_t byte_offset = 0;
-        while (true) {
-            bool stop;
-            size_t b_view_col;
-            byte_offset = ArrangeLine(
-                buffer_->GetLine(state.pos.line), byte_offset, 0, content_width,
-                tabstop, false, &b_view_col, &state.pos.byte_offset, &stop);
-            if (stop) {
-                state.b_view_col_want = b_view_col;
-                break;
-            }
-        }
-    } else {
         size_t b_view_col;
-        ArrangeLine(buffer_->GetLine(state.pos.line), 0, 0, content_width,
-                    tabstop, false, &b_view_col, &state.pos.byte_offset);
+        size_t character_cnt;
+        LocateInWrapLine(state.pos, content_width, b_view_col, character_cnt);
         state.b_view_col_want = b_view_col;
+    } else {
+        size_t character_cnt;
+        state.b_view_col_want = LocateInNoWrapLine(state.pos, character_cnt);
     }
 }
 
-size_t TextArea::CalcByteOffsetByBViewCol(std::string_view line,
+size_t TextArea::CalcByteOffsetByBViewCol(size_t line,
                                           size_t b_view_col_from_byte_offset,
                                           size_t byte_offset,
                                           size_t content_width, bool wrap) {
     auto tabstop = GetOpt<int64_t>(kOptTabStop);
 
+    if (!wrap) {
+        MGO_ASSERT(byte_offset == 0);
+        // The character at the view col is the first one that doesn't fit in
+        // the cells before it.
+        const ColumnIndex::Checkpoint& checkpoint =
+            buffer_->GetColumnIndex(line, tabstop)
+                .BeforeViewCol(b_view_col_from_byte_offset);
+        return ArrangeLine(buffer_->GetLine(line), checkpoint.byte_offset, 0,
+                           b_view_col_from_byte_offset - checkpoint.view_col,
+                           tabstop, false);
+    }
+
+    std::string_view line_str = buffer_->GetLine(line);
+
     size_t target_b_view_col = b_view_col_from_byte_offset;
-    Character character;
     size_t cur_b_view_col = 0;
     size_t cur_byte_offset = byte_offset;
-    while (cur_byte_offset < line.size()) {
+    while (cur_byte_offset < line_str.size()) {
         int byte_len;
-        ThisCharacter(line, cur_byte_offset, character, byte_len);
-        int character_width = character.Width();
+        int character_width =
+            ThisCharacterWidth(line_str, cur_byte_offset, byte_len);
         if (character_width <= 0) {
-            char c;
-            if (character.Ascii(c) && c == '\t') {
+            if (byte_len == 1 && line_str[cur_byte_offset] == '\t') {
                 character_width = tabstop - cur_b_view_col % tabstop;
             } else {
                 character_width = kReplacementCharWidth;
             }
         }
         if (cur_b_view_col + character_width <= content_width) {
-            if (wrap && cur_byte_offset + byte_len == line.size() &&
+            if (cur_byte_offset + byte_len == line_str.size() &&
                 cur_b_view_col + character_width == content_width) {
                 break;
             }
@@ -559,35 +702,27 @@ void TextArea::SetCursorHintNoWrap(size_t s_row, size_t s_col,
 
     // Search througn line
     size_t target_b_view_col = s_col - (col_ + sidebar_width) + b_view_->col;
-    cursor_->pos.byte_offset = CalcByteOffsetByBViewCol(
-        buffer_->GetLine(cursor_->pos.line), target_b_view_col, 0,
-        width_ - SidebarWidth(), false);
+    cursor_->pos.byte_offset =
+        CalcByteOffsetByBViewCol(cursor_->pos.line, target_b_view_col, 0,
+                                 width_ - SidebarWidth(), false);
     SelectionFollowCursor();
     cursor_->DontHoldColWant();
 }
 
 void TextArea::SetCursorHintWrap(size_t s_row, size_t s_col,
                                  size_t sidebar_width) {
+    size_t content_width = width_ - sidebar_width;
     size_t line = b_view_->line;
-    size_t byte_offset = 0;
+    size_t subline = b_view_->subline;
     // to the screen row where hint is.
-
-    int tabstop = GetOpt<int64_t>(kOptTabStop);
-    // First, we skip some sub lines.
-    for (size_t i = 0; i < b_view_->subline; i++) {
-        byte_offset = ArrangeLine(buffer_->GetLine(line), byte_offset, 0,
-                                  width_ - sidebar_width, tabstop, true);
-    }
-    size_t cur_screen_row = row_;
-    for (; cur_screen_row < s_row; cur_screen_row++) {
+    for (size_t cur_screen_row = row_; cur_screen_row < s_row;
+         cur_screen_row++) {
         if (line >= buffer_->LineCnt()) {
             break;
         }
-        byte_offset = ArrangeLine(buffer_->GetLine(line), byte_offset, 0,
-                                  width_ - sidebar_width, tabstop, true);
-        if (byte_offset == buffer_->GetLine(line).size()) {
+        if (++subline == GetWrapLayout(line, content_width).ScreenRows()) {
             line++;
-            byte_offset = 0;
+            subline = 0;
         }
     }
     if (line >= buffer_->LineCnt()) {
@@ -598,10 +733,12 @@ void TextArea::SetCursorHintWrap(size_t s_row, size_t s_col,
         return;
     }
 
-    // Search througn line after byte_offset
-    cursor_->pos = {line, CalcByteOffsetByBViewCol(
-                              buffer_->GetLine(line), s_col - sidebar_width,
-                              byte_offset, width_ - sidebar_width, true)};
+    // Search througn line after the subline begin
+    size_t byte_offset =
+        GetWrapLayout(line, content_width).sublines[subline].begin;
+    cursor_->pos = {line, CalcByteOffsetByBViewCol(line, s_col - sidebar_width,
+                                                   byte_offset, content_width,
+                                                   true)};
 
     SelectionFollowCursor();
     cursor_->DontHoldColWant();
@@ -631,11 +768,22 @@ void TextArea::SetCursorHint(size_t s_row, size_t s_col) {
 }
 
 void TextArea::ScrollRowsWrap(int64_t count, size_t content_width) {
-    int tabstop = GetOpt<int64_t>(kOptTabStop);
+    const PrefixSumTree* rows = GetWrapRows(content_width);
+    if (rows) {
+        size_t row = rows->PrefixSum(b_view_->line) + b_view_->subline;
+        if (count > 0) {
+            row = std::min(row + count, rows->Sum() - 1);
+        } else {
+            row = row > static_cast<size_t>(-count) ? row + count : 0;
+        }
+        b_view_->line = rows->Find(row, b_view_->subline);
+        return;
+    }
+
     if (count > 0) {
         while (count > 0) {
-            size_t row_cnt = ScreenRows(buffer_->GetLine(b_view_->line),
-                                        content_width, tabstop);
+            size_t row_cnt =
+                GetWrapLayout(b_view_->line, content_width).ScreenRows();
             if (row_cnt - b_view_->subline <= static_cast<size_t>(count)) {
                 if (b_view_->line == buffer_->LineCnt() - 1) {
                     b_view_->subline = row_cnt - 1;
@@ -658,8 +806,8 @@ void TextArea::ScrollRowsWrap(int64_t count, size_t content_width) {
                     return;
                 }
                 b_view_->line--;
-                size_t row_cnt = ScreenRows(buffer_->GetLine(b_view_->line),
-                                            content_width, tabstop);
+                size_t row_cnt =
+                    GetWrapLayout(b_view_->line, content_width).ScreenRows();
                 b_view_->subline = row_cnt - 1;
                 count -= 1;
             } else {
@@ -716,6 +864,11 @@ bool TextArea::CursorGoRightState(size_t count, CursorState& state) {
         return false;
     }
 
+    if (buffer_->GetLineInfo(state.pos.line).ascii) {
+        state.pos.byte_offset +=
+            std::min(count, line.size() - state.pos.byte_offset);
+        return true;
+    }
     Character c;
     int len;
     for (size_t i = 0; i < count; i++) {
@@ -738,6 +891,10 @@ bool TextArea::CursorGoLeftState(size_t count, CursorState& state) {
         return false;
     }
 
+    if (buffer_->GetLineInfo(state.pos.line).ascii) {
+        state.pos.byte_offset -= std::min(count, state.pos.byte_offset);
+        return true;
+    }
     const auto& line = buffer_->GetLine(state.pos.line);
     Character c;
     int len;
@@ -753,58 +910,39 @@ bool TextArea::CursorGoLeftState(size_t count, CursorState& state) {
 
 bool TextArea::CursorGoUpStateWrap(size_t count, size_t content_width,
                                    CursorState& state) {
-    int tabstop = GetOpt<int64_t>(kOptTabStop);
-    size_t byte_offset = 0;
-    std::vector<size_t> subline_begin_byte_offsets;
-    while (true) {
-        subline_begin_byte_offsets.push_back(byte_offset);
-        byte_offset = ArrangeLine(buffer_->GetLine(state.pos.line), byte_offset,
-                                  0, content_width, tabstop, true);
-        if (state.pos.byte_offset < byte_offset ||
-            byte_offset == buffer_->GetLine(state.pos.line).size()) {
-            break;
-        }
+    size_t subline = GetWrapLayout(state.pos.line, content_width)
+                         .SublineOf(state.pos.byte_offset);
+    if (state.pos.line == 0 && subline == 0) {
+        return false;
     }
-    subline_begin_byte_offsets.pop_back();
+    MakeSureBColViewWantReady(state);
 
-    size_t i = count;
-    while (true) {
-        if (i <= subline_begin_byte_offsets.size()) {
-            byte_offset =
-                subline_begin_byte_offsets[subline_begin_byte_offsets.size() -
-                                           i];
-            i = 0;
-            break;
-        } else {
-            i -= subline_begin_byte_offsets.size();
+    const PrefixSumTree* rows = GetWrapRows(content_width);
+    if (rows) {
+        size_t row = rows->PrefixSum(state.pos.line) + subline;
+        row = row > count ? row - count : 0;
+        state.pos.line = rows->Find(row, subline);
+    } else {
+        // Go up sublines, one line by one line.
+        size_t i = count;
+        while (i > subline) {
             if (state.pos.line == 0) {
-                byte_offset = 0;
+                i = subline;
                 break;
             }
+            i -= subline + 1;
             state.pos.line--;
+            subline =
+                GetWrapLayout(state.pos.line, content_width).ScreenRows() - 1;
         }
-
-        subline_begin_byte_offsets.clear();
-        if (buffer_->GetLine(state.pos.line).size() == 0) {
-            subline_begin_byte_offsets.push_back(0);
-            continue;
-        }
-        byte_offset = 0;
-        while (byte_offset < buffer_->GetLine(state.pos.line).size()) {
-            subline_begin_byte_offsets.push_back(byte_offset);
-            byte_offset =
-                ArrangeLine(buffer_->GetLine(state.pos.line), byte_offset, 0,
-                            content_width, tabstop, true);
-        }
-    }
-    if (i == count) {
-        return false;
+        subline -= i;
     }
 
-    MakeSureBColViewWantReady(state);
-    state.pos.byte_offset = CalcByteOffsetByBViewCol(
-        buffer_->GetLine(state.pos.line), state.b_view_col_want.value(),
-        byte_offset, content_width, true);
+    size_t byte_offset =
+        GetWrapLayout(state.pos.line, content_width).sublines[subline].begin;
+    state.pos.byte_offset =
+        CalcByteOffsetByBViewCol(state.pos.line, state.b_view_col_want.value(),
+                                 byte_offset, content_width, true);
     return true;
 }
 
@@ -818,8 +956,8 @@ bool TextArea::CursorGoUpStateNoWrap(size_t count, size_t content_width,
     state.pos.line = state.pos.line > count ? state.pos.line - count : 0;
     MakeSureBColViewWantReady(state);
     state.pos.byte_offset = CalcByteOffsetByBViewCol(
-        buffer_->GetLine(state.pos.line), cursor_->b_view_col_want.value(), 0,
-        content_width, false);
+        state.pos.line, cursor_->b_view_col_want.value(), 0, content_width,
+        false);
     return true;
 }
 
@@ -839,47 +977,40 @@ bool TextArea::CursorGoUpState(size_t count, CursorState& state) {
 
 bool TextArea::CursorGoDownStateWrap(size_t count, size_t content_width,
                                      CursorState& state) {
-    int tabstop = GetOpt<int64_t>(kOptTabStop);
-    size_t byte_offset = 0;
-
-    size_t subline_begin_byte_offset = byte_offset;
-    while (true) {
-        byte_offset = ArrangeLine(buffer_->GetLine(state.pos.line),
-                                  subline_begin_byte_offset, 0, content_width,
-                                  tabstop, true);
-        if (state.pos.byte_offset < byte_offset ||
-            byte_offset == buffer_->GetLine(state.pos.line).size()) {
-            break;
-        }
-        subline_begin_byte_offset = byte_offset;
+    const WrapLayout* layout = &GetWrapLayout(state.pos.line, content_width);
+    size_t subline = layout->SublineOf(state.pos.byte_offset);
+    if (state.pos.line == buffer_->LineCnt() - 1 &&
+        subline == layout->ScreenRows() - 1) {
+        return false;
     }
+    MakeSureBColViewWantReady(state);
 
-    size_t i = 0;
-    while (true) {
-        if (byte_offset == buffer_->GetLine(state.pos.line).size()) {
+    const PrefixSumTree* rows = GetWrapRows(content_width);
+    if (rows) {
+        size_t row = rows->PrefixSum(state.pos.line) + subline;
+        row = std::min(row + count, rows->Sum() - 1);
+        state.pos.line = rows->Find(row, subline);
+        layout = &GetWrapLayout(state.pos.line, content_width);
+    } else {
+        // Go down sublines, one line by one line.
+        size_t i = count;
+        while (i > layout->ScreenRows() - 1 - subline) {
             if (state.pos.line == buffer_->LineCnt() - 1) {
+                i = layout->ScreenRows() - 1 - subline;
                 break;
             }
+            i -= layout->ScreenRows() - subline;
             state.pos.line++;
-            subline_begin_byte_offset = 0;
-        } else {
-            subline_begin_byte_offset = byte_offset;
+            subline = 0;
+            layout = &GetWrapLayout(state.pos.line, content_width);
         }
-        if (++i == count) {
-            break;
-        }
-        byte_offset = ArrangeLine(buffer_->GetLine(state.pos.line),
-                                  subline_begin_byte_offset, 0, content_width,
-                                  tabstop, true);
-    }
-    if (i == 0) {
-        return false;
+        subline += i;
     }
 
-    MakeSureBColViewWantReady(state);
-    state.pos.byte_offset = CalcByteOffsetByBViewCol(
-        buffer_->GetLine(state.pos.line), state.b_view_col_want.value(),
-        subline_begin_byte_offset, content_width, true);
+    state.pos.byte_offset =
+        CalcByteOffsetByBViewCol(state.pos.line, state.b_view_col_want.value(),
+                                 layout->sublines[subline].begin,
+                                 content_width, true);
     return true;
 }
 
@@ -893,9 +1024,9 @@ bool TextArea::CursorGoDownStateNoWrap(size_t count, size_t content_width,
     // TODO: Overflow?
     state.pos.line = std::min(buffer_->LineCnt() - 1, state.pos.line + count);
     MakeSureBColViewWantReady(state);
-    state.pos.byte_offset = CalcByteOffsetByBViewCol(
-        buffer_->GetLine(state.pos.line), state.b_view_col_want.value(), 0,
-        content_width, false);
+    state.pos.byte_offset =
+        CalcByteOffsetByBViewCol(state.pos.line, state.b_view_col_want.value(),
+                                 0, content_width, false);
     return true;
 }
 
@@ -923,19 +1054,7 @@ bool TextArea::CursorGoHomeState(CursorState& state) {
 }
 bool TextArea::CursorGoFirstNonBlankState(CursorState& state) {
     MGO_ASSERT(buffer_);
-    const auto& line = buffer_->GetLine(cursor_->pos.line);
-    Character c;
-    size_t s = line.size();
-    int byte_len;
-    size_t i = 0;
-    for (; i < s; i += byte_len) {
-        ThisCharacter(line, i, c, byte_len);
-        char ascii;
-        if (c.Ascii(ascii) && (ascii == ' ' || ascii == '\t')) {
-            continue;
-        }
-        break;
-    }
+    size_t i = buffer_->GetLineInfo(cursor_->pos.line).indent_end;
     if (i == state.pos.byte_offset) {
         return false;
     }
@@ -1031,9 +1150,10 @@ bool TextArea::CursorGoLineState(size_t line, CursorState& state) {
 
     state.pos.line = std::min(line, buffer_->LineCnt() - 1);
     MakeSureBColViewWantReady(state);
-    state.pos.byte_offset = CalcByteOffsetByBViewCol(
-        buffer_->GetLine(state.pos.line), state.b_view_col_want.value(), 0,
-        width_ - SidebarWidth(), GetOpt<bool>(kOptWrap));
+    state.pos.byte_offset =
+        CalcByteOffsetByBViewCol(state.pos.line, state.b_view_col_want.value(),
+                                 0, width_ - SidebarWidth(),
+                                 GetOpt<bool>(kOptWrap));
     return true;
 }
 
@@ -1257,16 +1377,13 @@ Result TextArea::TabAtCursor() {
     auto tabstop = GetOpt<int64_t>(kOptTabStop);
     int64_t cur_b_view_row = cursor_->pos.line;
     std::string_view cur_line = buffer_->GetLine(cur_b_view_row);
-    Character character;
     size_t cur_b_view_c = 0;
     size_t offset = 0;
     while (offset < cursor_->pos.byte_offset) {
         int byte_len;
-        ThisCharacter(cur_line, offset, character, byte_len);
-        int character_width = character.Width();
+        int character_width = ThisCharacterWidth(cur_line, offset, byte_len);
         if (character_width <= 0) {
-            char c;
-            if (character.Ascii(c) && c == '\t') {
+            if (byte_len == 1 && cur_line[offset] == '\t') {
                 character_width = tabstop - cur_b_view_c % tabstop;
             } else {
                 character_width = kReplacementCharWidth;
@@ -1464,8 +1581,7 @@ BufferSearchState TextArea::CursorGoSearchResultState(
     }
     state.pos = context.search_result[context.current_search].begin;
     state.DontHoldColWant();
-    return {static_cast<size_t>(context.current_search + 1),
-            context.search_result.size()};
+    return context.CurrentState();
 }
 
 bool TextArea::BufferViewGoSearchResult(BufferSearchContext& context, bool next,
@@ -1486,7 +1602,7 @@ bool TextArea::BufferViewGoSearchResult(BufferSearchContext& context, bool next,
     return true;
 }
 
-size_t TextArea::SidebarWidth() {
+size_t TextArea::SidebarWidth() const {
     auto line_number =
         static_cast<LineNumberType>(GetOpt<int64_t>(kOptLineNumber));
     if (line_number == LineNumberType::kNone) {
@@ -1543,30 +1659,92 @@ void TextArea::DrawSidebar(int s_row, size_t absolute_line,
     term_->Print(col_, s_row, scheme[kSidebar], sidebar_buf);
 }
 
-Range TextArea::CalcWrapRange(size_t content_width) {
-    size_t cur_b_view_line = b_view_->line;
-    size_t byte_offset = 0;
-
-    int tabstop = GetOpt<int64_t>(kOptTabStop);
-    // First, we skip some sub lines.
-    for (size_t i = 0; i < b_view_->subline; i++) {
-        byte_offset = ArrangeLine(buffer_->GetLine(cur_b_view_line),
-                                  byte_offset, 0, content_width, tabstop, true);
-    }
-    size_t start_byte_offset = byte_offset;
+Range TextArea::CalcWrapRange(size_t content_width) const {
+    size_t line = b_view_->line;
+    size_t subline = b_view_->subline;
+    size_t start_byte_offset =
+        GetWrapLayout(line, content_width).sublines[subline].begin;
 
     for (size_t i = 0; i < height_; i++) {
-        if (cur_b_view_line >= buffer_->LineCnt()) {
+        if (line >= buffer_->LineCnt()) {
             break;
         }
-        byte_offset = ArrangeLine(buffer_->GetLine(cur_b_view_line),
-                                  byte_offset, 0, content_width, tabstop, true);
-        if (byte_offset == buffer_->GetLine(cur_b_view_line).size()) {
-            cur_b_view_line++;
-            byte_offset = 0;
+        if (++subline == GetWrapLayout(line, content_width).ScreenRows()) {
+            line++;
+            subline = 0;
         }
     }
-    return {{b_view_->line, start_byte_offset}, {cur_b_view_line, byte_offset}};
+    size_t end_byte_offset =
+        subline == 0
+            ? 0
+            : GetWrapLayout(line, content_width).sublines[subline].begin;
+    return {{b_view_->line, start_byte_offset}, {line, end_byte_offset}};
+}
+
+const WrapLayout& TextArea::GetWrapLayout(size_t line,
+                                          size_t content_width) const {
+    return buffer_->GetWrapLayout(line, content_width,
+                                  GetOpt<int64_t>(kOptTabStop));
+}
+
+const PrefixSumTree* TextArea::GetWrapRows(size_t content_width) const {
+    return buffer_->GetWrapRows(content_width, GetOpt<int64_t>(kOptTabStop));
+}
+
+// Characters before byte_offset are counted without arranging the line if the
+// line is ascii or byte_offset is the line end.
+static bool CountCharactersByInfo(const LineInfo& info, size_t line_size,
+                                  size_t byte_offset, size_t& character_cnt) {
+    if (info.ascii) {
+        character_cnt = byte_offset;
+        return true;
+    }
+    if (byte_offset == line_size) {
+        character_cnt = info.character_cnt;
+        return true;
+    }
+    return false;
+}
+
+size_t TextArea::LocateInWrapLine(const Pos& pos, size_t content_width,
+                                  size_t& view_col, size_t& character_cnt) {
+    const WrapLayout& layout = GetWrapLayout(pos.line, content_width);
+    std::string_view line = buffer_->GetLine(pos.line);
+    bool counted = CountCharactersByInfo(buffer_->GetLineInfo(pos.line),
+                                         line.size(), pos.byte_offset,
+                                         character_cnt);
+    size_t subline = layout.SublineOf(pos.byte_offset);
+    size_t target_byte_offset = pos.byte_offset;
+    size_t cnt;
+    // Only characters in the subline before pos are arranged.
+    ArrangeLine(line, layout.sublines[subline].begin, 0, content_width,
+                layout.tabstop, true, &view_col, &target_byte_offset, nullptr,
+                counted ? nullptr : &cnt);
+    if (!counted) {
+        character_cnt = layout.sublines[subline].character_cnt + cnt;
+    }
+    return subline;
+}
+
+size_t TextArea::LocateInNoWrapLine(const Pos& pos, size_t& character_cnt) {
+    auto tabstop = GetOpt<int64_t>(kOptTabStop);
+    std::string_view line = buffer_->GetLine(pos.line);
+    bool counted = CountCharactersByInfo(buffer_->GetLineInfo(pos.line),
+                                         line.size(), pos.byte_offset,
+                                         character_cnt);
+    const ColumnIndex::Checkpoint& checkpoint =
+        buffer_->GetColumnIndex(pos.line, tabstop)
+            .BeforeByteOffset(pos.byte_offset);
+    size_t target_byte_offset = pos.byte_offset;
+    size_t view_col;
+    size_t cnt;
+    ArrangeLine(line, checkpoint.byte_offset, 0,
+                std::numeric_limits<size_t>::max(), tabstop, false, &view_col,
+                &target_byte_offset, nullptr, counted ? nullptr : &cnt);
+    if (!counted) {
+        character_cnt = checkpoint.character_cnt + cnt;
+    }
+    return checkpoint.view_col + view_col;
 }
 
 void TextArea::UpdateSyntax() {
@@ -1579,7 +1757,7 @@ void TextArea::AfterModify(const Pos& cursor_pos) {
     UpdateSyntax();
 }
 
-bool TextArea::SizeValid(size_t sidebar_width) {
+bool TextArea::SizeValid(size_t sidebar_width) const {
     return sidebar_width < width_ && height_ > 0;
 }
 
@@ -1,5 +1,8 @@
 #pragma once
 #include <cstdint>
+#include <optional>
+#include <string>
+#include <tuple>
 
 #include "buffer.h"
 #include "buffer_view.h"
@@ -30,10 +33,28 @@ class TextArea {
 
     // if search_context != nullptr, frame will draw the search highlight no
     // matter what kHighlighOnSearch is. So caller should be careful.
-    void Draw(BufferSearchContext* search_context);
+    // Nothing is drawn if nothing the area shows has changed since the last
+    // draw, the screen cells keep the last content then.
+    // Return true if the area is repainted.
+    bool Draw(BufferSearchContext* search_context);
+
+    // Force the next Draw to repaint the whole area, e.g. the screen has been
+    // cleared or something else has been drawn over the area.
+    void Invalidate() { last_draw_state_.reset(); }
 
     bool In(size_t s_col, size_t s_row);
 
+    // Return true if there is nothing to index for wrap mode.
+    bool WrapRowsComplete();
+    // Index about max_bytes more of the buffer for wrap mode, see
+    // Buffer::BuildWrapRowsSlice.
+    void BuildWrapRowsSlice(size_t max_bytes);
+
+    // Where the area is in the buffer like vim's ruler: "All", "Top", "Bot"
+    // or the percentage of what is above the area. Rows are counted in wrap
+    // mode once the buffer is indexed, otherwise lines.
+    std::string ScrollIndicator() const;
+
     // Adjust view to a valid view.
     // Now we use this to make sure that the current buffer view is valid.
     // This garrentee will make lots of method implementations easier, like
@@ -132,12 +153,62 @@ class TextArea {
     void AfterModify(const Pos& cursor_pos);
 
    private:
-    size_t SidebarWidth();
+    // Everything that decides the content of the area on the screen.
+    struct DrawState {
+        int64_t buffer_id;
+        int64_t buffer_version;
+        const char* filetype;
+        size_t width, height, row, col;
+        size_t view_line, view_col, view_subline;
+        size_t cursor_line;  // only for relative line number
+        bool selection_active;
+        Pos selection_begin, selection_end;
+        const Regex* search_regex;
+        int64_t search_buffer_version;
+        int64_t current_search;
+        ColorScheme scheme;
+        int64_t tabstop, line_number_type;
+        bool wrap, eob_mark, trailing_white;
+
+        auto Tie() const {
+            return std::tie(buffer_id, buffer_version, filetype, width, height,
+                            row, col, view_line, view_col, view_subline,
+                            cursor_line, selection_active, selection_begin,
+                            selection_end, search_regex, search_buffer_version,
+                            current_search, scheme, tabstop, line_number_type,
+                            wrap, eob_mark, trailing_white);
+        }
+        bool operator==(const DrawState& other) const {
+            return Tie() == other.Tie();
+        }
+    };
+    DrawState MakeDrawState(const BufferSearchContext* search_context);
+    // Return true if the view has moved by less than the height since the
+    // last draw, rows is set to how far the content moves up.
+    bool ScrolledRows(const DrawState& state, size_t content_width,
+                      int64_t& rows);
+
+    // Fill rows [begin, end) of the area with blanks.
+    void ClearRows(size_t begin, size_t end);
+
+    size_t SidebarWidth() const;
+
+    const WrapLayout& GetWrapLayout(size_t line, size_t content_width) const;
+    // Screen rows index of the buffer, nullptr if it isn't complete.
+    const PrefixSumTree* GetWrapRows(size_t content_width) const;
+    // Return which subline pos is in when its line is wrapped. view_col is
+    // set to the col of pos in the subline, character_cnt to the count of
+    // characters before pos in the line.
+    size_t LocateInWrapLine(const Pos& pos, size_t content_width,
+                            size_t& view_col, size_t& character_cnt);
+    // Return the view col of pos when its line is not wrapped, character_cnt
+    // is set to the count of characters before pos in the line.
+    size_t LocateInNoWrapLine(const Pos& pos, size_t& character_cnt);
     void DrawSidebar(int s_row, size_t absolute_line, size_t sidebar_width);
-    Range CalcWrapRange(size_t content_width);
+    Range CalcWrapRange(size_t content_width) const;
 
     // return byte_offset
-    size_t CalcByteOffsetByBViewCol(std::string_view line,
+    size_t CalcByteOffsetByBViewCol(size_t line,
                                     size_t b_view_col_from_byte_offset,
                                     size_t byte_offset, size_t content_width,
                                     bool wrap);
@@ -164,12 +235,12 @@ class TextArea {
     void ScrollRowsWrap(int64_t count, size_t content_width);
     void ScrollRowsNoWrap(int64_t count, size_t content_width);
 
-    bool SizeValid(size_t sidebar_width);
+    bool SizeValid(size_t sidebar_width) const;
 
     void UpdateSyntax();
 
     template <typename T>
-    T GetOpt(OptKey key) {
+    T GetOpt(OptKey key) const {
         if (opts_->GetScope(key) == OptScope::kGlobal) {
             return opts_->global_opts_->GetOpt<T>(key);
         }
@@ -201,6 +272,8 @@ class TextArea {
     SyntaxParser* parser_;
     Opts* opts_;
     Terminal* term_ = &Terminal::GetInstance();
+
+    std::optional<DrawState> last_draw_state_;
 };
 
 }  // namespace mango
@@ -0,0 +1,181 @@
+#include "thread_pool.h"
+
+#include <fcntl.h>
+
+#include <cstdint>
+#include <exception>
+
+#ifdef __linux__
+#include <sys/eventfd.h>
+#endif
+
+#include "logging.h"
+
+namespace mango {
+
+// Which pool and which worker the current thread is.
+static thread_local ThreadPool* tls_pool = nullptr;
+static thread_local size_t tls_worker = 0;
+
+ThreadPool::ThreadPool(size_t thread_cnt) {
+    MGO_ASSERT(thread_cnt >= 1);
+    for (size_t i = 0; i < thread_cnt; i++) {
+        queues_.push_back(std::make_unique<Queue>());
+    }
+    for (size_t i = 0; i < thread_cnt; i++) {
+        threads_.emplace_back([this, i] { Work(i); });
+    }
+}
+
+ThreadPool::~ThreadPool() {
+    {
+        std::lock_guard<std::mutex> lk(mtx_);
+        stop_ = true;
+    }
+    cv_.notify_all();
+    for (auto& t : threads_) {
+        t.join();
+    }
+}
+
+void ThreadPool::Submit(Task task) {
+    size_t i = tls_pool == this
+                   ? tls_worker
+                   : next_queue_.fetch_add(1, std::memory_order_relaxed) %
+                         queues_.size();
+    {
+        std::lock_guard<std::mutex> lk(queues_[i]->mtx);
+        queues_[i]->tasks.push_back(std::move(task));
+    }
+    queued_++;
+    // Lock so that a thread checking queued_ won't miss the notification.
+    { std::lock_guard<std::mutex> lk(mtx_); }
+    cv_.notify_one();
+}
+
+void ThreadPool::Work(size_t worker) {
+    tls_pool = this;
+    tls_worker = worker;
+    while (!stop_) {
+        Task task;
+        if (Take(worker, task)) {
+            task();
+            continue;
+        }
+        std::unique_lock<std::mutex> lk(mtx_);
+        cv_.wait(lk, [this] { return stop_ || queued_ > 0; });
+    }
+}
+
+bool ThreadPool::Take(size_t worker, Task& task) {
+    // The newest task of its own, likely to be hot in cache.
+    {
+        Queue& queue = *queues_[worker];
+        std::lock_guard<std::mutex> lk(queue.mtx);
+        if (!queue.tasks.empty()) {
+            task = std::move(queue.tasks.back());
+            queue.tasks.pop_back();
+            queued_--;
+            return true;
+        }
+    }
+    // The oldest task of others.
+    for (size_t i = 1; i < queues_.size(); i++) {
+        Queue& queue = *queues_[(worker + i) % queues_.size()];
+        std::lock_guard<std::mutex> lk(queue.mtx);
+        if (!queue.tasks.empty()) {
+            task = std::move(queue.tasks.front());
+            queue.tasks.pop_front();
+            queued_--;
+            return true;
+        }
+    }
+    return false;
+}
+
+AsyncRunner::AsyncRunner(EventLoop* loop, size_t thread_cnt) : loop_(loop) {
+#ifdef __linux__
+    wake_[0] = Fd(eventfd(0, EFD_CLOEXEC | EFD_NONBLOCK));
+    if (wake_[0].fd == -1) {
+        throw OSException(errno, "eventfd error: {}", strerror(errno));
+    }
+    wake_write_fd_ = wake_[0].fd;
+#else
+    Pipe(wake_);
+    for (const Fd& fd : wake_) {
+        int flags = fcntl(fd.fd, F_GETFL);
+        fcntl(fd.fd, F_SETFL, flags | O_NONBLOCK);
+        fcntl(fd.fd, F_SETFD, FD_CLOEXEC);
+    }
+    wake_write_fd_ = wake_[1].fd;
+#endif
+    EventInfo info;
+    info.fd = wake_[0].fd;
+    info.Interesting_events = kEventRead;
+    info.handler = [this](Event e) {
+        (void)e;
+        OnWakeUp();
+    };
+    loop_->AddEventHandler(info);
+
+    pool_ = std::make_unique<ThreadPool>(thread_cnt);
+}
+
+AsyncRunner::~AsyncRunner() {
+    pool_.reset();
+    loop_->RemoveEventHandler(wake_[0].fd);
+}
+
+TaskHandle AsyncRunner::Submit(Work work) {
+    TaskHandle handle = std::make_shared<TaskToken>();
+    pool_->Submit([this, handle, work = std::move(work)] {
+        if (handle->Cancelled()) {
+            return;
+        }
+        Continuation continuation;
+        try {
+            continuation = work(*handle);
+        } catch (const std::exception& e) {
+            MGO_LOG_ERROR("async work error: {}", e.what());
+            return;
+        }
+        if (continuation) {
+            Complete(handle, std::move(continuation));
+        }
+    });
+    return handle;
+}
+
+void AsyncRunner::Complete(TaskHandle handle, Continuation continuation) {
+    std::lock_guard<std::mutex> lk(mtx_);
+    completed_.emplace_back(std::move(handle), std::move(continuation));
+    if (!wake_pending_) {
+        wake_pending_ = true;
+        // Never blocks: at most one wake up is pending.
+        uint64_t one = 1;
+#ifdef __linux__
+        (void)!write(wake_write_fd_, &one, sizeof(one));
+#else
+        (void)!write(wake_write_fd_, &one, 1);
+#endif
+    }
+}
+
+void AsyncRunner::OnWakeUp() {
+    uint64_t buf;
+    (void)!read(wake_[0].fd, &buf, sizeof(buf));
+
+    std::vector<std::pair<TaskHandle, Continuation>> completed;
+    {
+        std::lock_guard<std::mutex> lk(mtx_);
+        completed.swap(completed_);
+        wake_pending_ = false;
+    }
+    for (auto& [handle, continuation] : completed) {
+        if (!handle->Cancelled()) {
+            continuation();
+        }
+    }
+}
+
+}  // namespace mango
@@ -0,0 +1,111 @@
+#pragma once
+
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <utility>
+#include <vector>
+
+#include "event_loop.h"
+#include "os.h"
+#include "utils.h"
+
+namespace mango {
+
+// A fixed number of threads running tasks. Every thread has its own deque.
+// Tasks submitted on a worker go to its own deque, others are spread over
+// the deques. A thread takes tasks from the back of its own deque, and steals
+// from the front of others' when it runs out.
+class ThreadPool {
+   public:
+    using Task = std::function<void()>;
+
+    ThreadPool(size_t thread_cnt);
+    // Pending tasks are dropped, running ones are waited.
+    ~ThreadPool();
+    MGO_DELETE_COPY(ThreadPool);
+    MGO_DELETE_MOVE(ThreadPool);
+
+    // Can be called on any thread.
+    void Submit(Task task);
+
+    size_t thread_cnt() const { return threads_.size(); }
+
+   private:
+    struct Queue {
+        std::mutex mtx;
+        std::deque<Task> tasks;
+    };
+
+    void Work(size_t worker);
+    bool Take(size_t worker, Task& task);
+
+    std::vector<std::unique_ptr<Queue>> queues_;
+    std::atomic<size_t> next_queue_ = 0;
+
+    // Threads sleep on cv_ when no task is queued.
+    std::mutex mtx_;
+    std::condition_variable cv_;
+    std::atomic<size_t> queued_ = 0;
+    std::atomic<bool> stop_ = false;
+
+    std::vector<std::thread> threads_;
+};
+
+// Shared by a task and its submitter.
+class TaskToken {
+   public:
+    // The work is skipped if it hasn't started, and the continuation won't be
+    // called if this is called on the loop thread before it.
+    void Cancel() { cancelled_.store(true, std::memory_order_relaxed); }
+    // A long work can check it and return early.
+    bool Cancelled() const {
+        return cancelled_.load(std::memory_order_relaxed);
+    }
+
+   private:
+    std::atomic<bool> cancelled_ = false;
+};
+using TaskHandle = std::shared_ptr<TaskToken>;
+
+// Run work on a ThreadPool and deliver results back to the event loop
+// thread. A work returns a continuation, e.g. a lambda owning the results,
+// which is queued when the work is done. The loop is woken up through an
+// eventfd(a pipe if not on linux), and the continuations are called there.
+class AsyncRunner {
+   public:
+    using Continuation = std::function<void()>;
+    using Work = std::function<Continuation(const TaskToken& token)>;
+
+    // throws OSException
+    AsyncRunner(EventLoop* loop, size_t thread_cnt);
+    ~AsyncRunner();
+    MGO_DELETE_COPY(AsyncRunner);
+    MGO_DELETE_MOVE(AsyncRunner);
+
+    // The returned continuation can be empty if nothing to do on the loop
+    // thread. If work throws, the exception is logged and the task is
+    // dropped.
+    TaskHandle Submit(Work work);
+
+   private:
+    void Complete(TaskHandle handle, Continuation continuation);
+    void OnWakeUp();
+
+    EventLoop* loop_;
+
+    std::mutex mtx_;
+    std::vector<std::pair<TaskHandle, Continuation>> completed_;
+    bool wake_pending_ = false;
+    Fd wake_[2];  // only wake_[0] is used, as an eventfd, on linux
+    int wake_write_fd_;
+
+    // Destroyed first, so no work is running when others go.
+    std::unique_ptr<ThreadPool> pool_;
+};
+
+}  // namespace mango
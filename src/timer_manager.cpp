@@ -1,5 +1,7 @@
 #include "timer_manager.h"
 
+#include <algorithm>
+
 namespace mango {
 
 static inline bool TimeOut(std::chrono::steady_clock::time_point t,
@@ -143,4 +145,34 @@ void TimerManager::Tick() {
     }
 }
 
+void IdleScheduler::Schedule(IdleJob* job) {
+    if (job->scheduled_) {
+        return;
+    }
+    job->scheduled_ = true;
+    jobs_.push_back(job);
+}
+
+void IdleScheduler::Cancel(IdleJob* job) {
+    if (!job->scheduled_) {
+        return;
+    }
+    job->scheduled_ = false;
+    jobs_.erase(std::find(jobs_.begin(), jobs_.end(), job));
+}
+
+bool IdleScheduler::RunSlice() {
+    MGO_ASSERT(!jobs_.empty());
+    IdleJob* job = jobs_.front();
+    jobs_.pop_front();
+    job->scheduled_ = false;
+    bool more = job->run_(std::chrono::steady_clock::now() + kSliceTime);
+    // The job may schedule itself again in run.
+    if (more && !job->scheduled_) {
+        job->scheduled_ = true;
+        jobs_.push_back(job);
+    }
+    return !more;
+}
+
 }  // namespace mango
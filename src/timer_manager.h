@@ -1,6 +1,7 @@
 #pragma once
 
 #include <chrono>
+#include <deque>
 #include <functional>
 #include <vector>
 
@@ -119,4 +120,55 @@ class TimerManager {
     std::vector<Timer*> timer_heap_;  // a Min heap of timer
 };
 
+class IdleScheduler;
+
+// A resumable background job run in idle time, e.g. building an index. Its
+// run function does a piece of work and returns before deadline, true if
+// there is more to do.
+class IdleJob {
+    friend IdleScheduler;
+
+   public:
+    using Run =
+        std::function<bool(std::chrono::steady_clock::time_point deadline)>;
+
+    IdleJob(const Run& run) : run_(run) {}
+
+    bool IsScheduled() { return scheduled_; }
+
+   private:
+    Run run_;
+    bool scheduled_ = false;
+};
+
+// Jobs take turns to run in short slices. The event loop only runs a slice
+// when no fd is ready and no timer is due, so input waits for one slice at
+// most.
+// Like TimerManager, this class doesn't manage jobs lifetime.
+class IdleScheduler {
+   public:
+    static constexpr std::chrono::milliseconds kSliceTime{2};
+
+    MGO_DEFAULT_CONSTRUCT_DESTRUCT(IdleScheduler);
+    MGO_DELETE_COPY(IdleScheduler);
+    MGO_DELETE_MOVE(IdleScheduler);
+
+    // Run the job in idle time until it returns false. If it has already been
+    // scheduled, nothing happens.
+    void Schedule(IdleJob* job);
+
+    // If the job isn't scheduled, nothing happens. Now it's safe to delete a
+    // job.
+    void Cancel(IdleJob* job);
+
+    bool HasJobs() { return !jobs_.empty(); }
+
+    // Run a slice of the next job.
+    // Return true if the job is done.
+    bool RunSlice();
+
+   private:
+    std::deque<IdleJob*> jobs_;
+};
+
 }  // namespace mango
\ No newline at end of file
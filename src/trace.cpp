@@ -0,0 +1,142 @@
+#include "trace.h"
+
+#include <cerrno>
+#include <cstring>
+#include <memory>
+#include <mutex>
+#include <vector>
+
+#include "exception.h"
+#include "file.h"
+#include "fmt/format.h"
+#include "json.h"
+
+namespace mango {
+
+std::atomic<bool> trace_enabled = false;
+
+namespace {
+
+// A slot is guarded by its seq like a seqlock: seq is 0 while the slot is
+// being written, and index + 1 after. A reader drops a slot whose seq changes
+// or isn't the index it wants.
+struct TraceSlot {
+    std::atomic<uint64_t> seq = 0;
+    std::atomic<const char*> name = nullptr;
+    std::atomic<uint64_t> begin_ns = 0;
+    std::atomic<uint64_t> end_ns = 0;
+};
+
+// Only written by its thread.
+struct TraceBuffer {
+    explicit TraceBuffer(uint64_t tid)
+        : tid(tid), slots(new TraceSlot[kTraceBufferCapacity]) {}
+
+    const uint64_t tid;
+    std::unique_ptr<TraceSlot[]> slots;
+    // Count of scopes recorded.
+    std::atomic<uint64_t> head = 0;
+    std::atomic<bool> thread_exited = false;
+};
+
+// Created at the first record of a thread. The buffer is kept after the
+// thread exits until the next TraceStart, so its scopes can still be written.
+struct ThreadTraceBuffer {
+    ~ThreadTraceBuffer() {
+        if (buffer) {
+            buffer->thread_exited.store(true, std::memory_order_release);
+        }
+    }
+
+    std::shared_ptr<TraceBuffer> buffer;
+};
+
+}  // namespace
+
+static std::mutex buffers_mutex;
+static std::vector<std::shared_ptr<TraceBuffer>> buffers;
+static uint64_t next_tid = 0;
+static uint64_t trace_begin_ns = 0;
+
+static thread_local ThreadTraceBuffer thread_buffer;
+
+static TraceBuffer* GetThreadBuffer() {
+    if (!thread_buffer.buffer) {
+        std::lock_guard lock(buffers_mutex);
+        thread_buffer.buffer = std::make_shared<TraceBuffer>(next_tid++);
+        buffers.push_back(thread_buffer.buffer);
+    }
+    return thread_buffer.buffer.get();
+}
+
+void TraceRecord(const char* name, uint64_t begin_ns, uint64_t end_ns) {
+    TraceBuffer* buffer = GetThreadBuffer();
+    uint64_t index = buffer->head.load(std::memory_order_relaxed);
+    TraceSlot& slot = buffer->slots[index % kTraceBufferCapacity];
+    slot.seq.store(0, std::memory_order_relaxed);
+    std::atomic_thread_fence(std::memory_order_release);
+    slot.name.store(name, std::memory_order_relaxed);
+    slot.begin_ns.store(begin_ns, std::memory_order_relaxed);
+    slot.end_ns.store(end_ns, std::memory_order_relaxed);
+    slot.seq.store(index + 1, std::memory_order_release);
+    buffer->head.store(index + 1, std::memory_order_release);
+}
+
+void TraceStart() {
+    std::lock_guard lock(buffers_mutex);
+    std::vector<std::shared_ptr<TraceBuffer>> alive;
+    for (std::shared_ptr<TraceBuffer>& buffer : buffers) {
+        if (!buffer->thread_exited.load(std::memory_order_acquire)) {
+            alive.push_back(std::move(buffer));
+        }
+    }
+    buffers = std::move(alive);
+    trace_begin_ns = TraceNow();
+    trace_enabled.store(true, std::memory_order_relaxed);
+}
+
+void TraceStop(const std::string& file) {
+    trace_enabled.store(false, std::memory_order_relaxed);
+
+    std::string content = "{\"displayTimeUnit\":\"ms\",\"traceEvents\":[";
+    bool first = true;
+    {
+        std::lock_guard lock(buffers_mutex);
+        for (const std::shared_ptr<TraceBuffer>& buffer : buffers) {
+            uint64_t head = buffer->head.load(std::memory_order_acquire);
+            uint64_t begin =
+                head > kTraceBufferCapacity ? head - kTraceBufferCapacity : 0;
+            for (uint64_t index = begin; index < head; index++) {
+                const TraceSlot& slot =
+                    buffer->slots[index % kTraceBufferCapacity];
+                uint64_t seq = slot.seq.load(std::memory_order_acquire);
+                const char* name = slot.name.load(std::memory_order_relaxed);
+                uint64_t begin_ns =
+                    slot.begin_ns.load(std::memory_order_relaxed);
+                uint64_t end_ns = slot.end_ns.load(std::memory_order_relaxed);
+                std::atomic_thread_fence(std::memory_order_acquire);
+                if (seq != index + 1 ||
+                    slot.seq.load(std::memory_order_relaxed) != seq ||
+                    begin_ns < trace_begin_ns) {
+                    continue;
+                }
+                content += fmt::format(
+                    "{}\n{{\"name\":{},\"ph\":\"X\",\"pid\":1,\"tid\":{},"
+                    "\"ts\":{:.3f},\"dur\":{:.3f}}}",
+                    first ? "" : ",", Json(name).dump(), buffer->tid,
+                    (begin_ns - trace_begin_ns) / 1000.0,
+                    (end_ns - begin_ns) / 1000.0);
+                first = false;
+            }
+        }
+    }
+    content += "\n]}\n";
+
+    File f(file, "w", false);
+    if (fwrite(content.data(), 1, content.size(), f.file()) !=
+        content.size()) {
+        throw IOException("fwrite error: {}", strerror(errno));
+    }
+}
+
+}  // namespace mango
@@ -0,0 +1,66 @@
+#pragma once
+
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <string>
+
+#include "utils.h"
+
+namespace mango {
+
+// Tracing records scopes marked by MGO_TRACE_SCOPE on every thread while it's
+// started, and writes them in the Chrome trace event format when stopped,
+// which can be opened by chrome://tracing or Perfetto.
+// Every thread records into its own ring buffer without locks, the latest
+// kTraceBufferCapacity scopes of a thread are kept.
+
+constexpr size_t kTraceBufferCapacity = 1 << 15;
+
+extern std::atomic<bool> trace_enabled;
+
+// Start a new trace, scopes recorded before are dropped.
+void TraceStart();
+
+// Stop tracing and write scopes recorded since TraceStart to file.
+// throws IOException
+void TraceStop(const std::string& file);
+
+inline uint64_t TraceNow() {
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(
+               std::chrono::steady_clock::now().time_since_epoch())
+        .count();
+}
+
+// name should be a string literal, it's kept until written.
+void TraceRecord(const char* name, uint64_t begin_ns, uint64_t end_ns);
+
+class TraceScope {
+   public:
+    explicit TraceScope(const char* name) noexcept {
+        if (trace_enabled.load(std::memory_order_relaxed)) {
+            name_ = name;
+            begin_ns_ = TraceNow();
+        }
+    }
+    ~TraceScope() {
+        if (name_) {
+            TraceRecord(name_, begin_ns_, TraceNow());
+        }
+    }
+    MGO_DELETE_COPY(TraceScope);
+    MGO_DELETE_MOVE(TraceScope);
+
+   private:
+    const char* name_ = nullptr;
+    uint64_t begin_ns_;
+};
+
+#define MGO_TRACE_CONCAT_INNER(a, b) a##b
+#define MGO_TRACE_CONCAT(a, b) MGO_TRACE_CONCAT_INNER(a, b)
+
+// Trace the rest of the enclosing scope as name, a string literal.
+#define MGO_TRACE_SCOPE(name) \
+    TraceScope MGO_TRACE_CONCAT(mgo_trace_scope_, __LINE__)(name)
+
+}  // namespace mango
@@ -0,0 +1,896 @@
+#include "trigram_index.h"
+
+#include <poll.h>
+#include <sys/inotify.h>
+#include <sys/resource.h>
+#include <sys/stat.h>
+#include <sys/syscall.h>
+
+#include <algorithm>
+#include <chrono>
+#include <cstring>
+#include <optional>
+
+#include "fs.h"
+#include "logging.h"
+
+namespace mango {
+
+static constexpr char kIndexMagic[] = "MGOTRIGRAM";
+static constexpr uint32_t kIndexVersion = 1;
+// Larger files are not indexed, they are always candidates.
+static constexpr int64_t kMaxIndexFileBytes = 1 << 20;
+static constexpr size_t kIndexerMaxThreads = 8;
+static constexpr int kIndexerNice = 10;
+// Changed files are reindexed when no more changes come for a while.
+static constexpr int kReindexDelayMs = 200;
+static constexpr int kSaveIntervalMs = 30000;
+static constexpr uint32_t kWatchMask =
+    IN_CREATE | IN_DELETE | IN_MODIFY | IN_CLOSE_WRITE | IN_MOVED_FROM |
+    IN_MOVED_TO | IN_ONLYDIR | IN_DONT_FOLLOW | IN_EXCL_UNLINK;
+static constexpr size_t kTrigramBitmapWords = (1 << 24) / 64;
+static constexpr uint32_t kNoId = static_cast<uint32_t>(-1);
+
+static inline uint8_t TrigramByte(char c) {
+    return c >= 'A' && c <= 'Z' ? c - 'A' + 'a' : c;
+}
+
+// Trigrams of contents, without duplication. bitmap is all zero before and
+// after.
+static void ExtractTrigrams(std::string_view contents,
+                            std::vector<uint64_t>& bitmap,
+                            std::vector<uint32_t>& trigrams) {
+    if (contents.size() < 3) {
+        return;
+    }
+    uint32_t t = TrigramByte(contents[0]) << 8 | TrigramByte(contents[1]);
+    for (size_t i = 2; i < contents.size(); i++) {
+        t = (t << 8 | TrigramByte(contents[i])) & 0xFFFFFF;
+        uint64_t bit = uint64_t(1) << (t & 63);
+        if ((bitmap[t >> 6] & bit) == 0) {
+            bitmap[t >> 6] |= bit;
+            trigrams.push_back(t);
+        }
+    }
+    for (uint32_t tri : trigrams) {
+        bitmap[tri >> 6] = 0;
+    }
+}
+
+static void PutVarint(std::string& bytes, uint32_t n) {
+    while (n >= 0x80) {
+        bytes.push_back(static_cast<char>(n | 0x80));
+        n >>= 7;
+    }
+    bytes.push_back(static_cast<char>(n));
+}
+
+static uint32_t GetVarint(const std::string& bytes, size_t& pos) {
+    uint32_t n = 0;
+    for (int shift = 0; pos < bytes.size(); shift += 7) {
+        uint8_t b = bytes[pos++];
+        n |= static_cast<uint32_t>(b & 0x7F) << shift;
+        if ((b & 0x80) == 0) {
+            break;
+        }
+    }
+    return n;
+}
+
+// Keep the ids which are also in posting p, both are increasing.
+template <typename Posting>
+static void IntersectPosting(const Posting& p, std::vector<uint32_t>& ids) {
+    size_t out = 0;
+    size_t i = 0;
+    size_t pos = 0;
+    uint32_t id = 0;
+    for (uint32_t k = 0; k < p.cnt && i < ids.size(); k++) {
+        id += GetVarint(p.bytes, pos);
+        while (i < ids.size() && ids[i] < id) {
+            i++;
+        }
+        if (i < ids.size() && ids[i] == id) {
+            ids[out++] = id;
+            i++;
+        }
+    }
+    ids.resize(out);
+}
+
+// dir is empty or with a slash at the end.
+static bool IsUnderDir(const std::string& path, const std::string& dir) {
+    return path.compare(0, dir.size(), dir) == 0;
+}
+
+static int64_t MtimeNs(const struct stat& st) {
+    return static_cast<int64_t>(st.st_mtim.tv_sec) * 1000000000 +
+           st.st_mtim.tv_nsec;
+}
+
+static void PutU32(std::string& data, uint32_t n) {
+    data.append(reinterpret_cast<const char*>(&n), sizeof(n));
+}
+static void PutI64(std::string& data, int64_t n) {
+    data.append(reinterpret_cast<const char*>(&n), sizeof(n));
+}
+static void PutStr(std::string& data, std::string_view str) {
+    PutU32(data, str.size());
+    data.append(str);
+}
+
+// Reads the cache file, ok_ turns false if data is truncated.
+class IndexReader {
+   public:
+    IndexReader(std::string_view data) : data_(data) {}
+
+    template <typename T>
+    T Get() {
+        T n = 0;
+        if (data_.size() < sizeof(T)) {
+            ok_ = false;
+            return n;
+        }
+        memcpy(&n, data_.data(), sizeof(T));
+        data_.remove_prefix(sizeof(T));
+        return n;
+    }
+    std::string_view GetStr() {
+        uint32_t len = Get<uint32_t>();
+        if (data_.size() < len) {
+            ok_ = false;
+            return {};
+        }
+        std::string_view str = data_.substr(0, len);
+        data_.remove_prefix(len);
+        return str;
+    }
+    bool ok() const { return ok_; }
+
+   private:
+    std::string_view data_;
+    bool ok_ = true;
+};
+
+TrigramIndex::TrigramIndex(const std::string& root,
+                           const std::string& cache_path)
+    : root_(root), cache_path_(cache_path) {
+    MGO_ASSERT(!root_.empty() && root_.back() == kPathSeperator);
+    Pipe(wake_);
+    for (const Fd& fd : wake_) {
+        int flags = fcntl(fd.fd, F_GETFL);
+        fcntl(fd.fd, F_SETFL, flags | O_NONBLOCK);
+        fcntl(fd.fd, F_SETFD, FD_CLOEXEC);
+    }
+    indexer_ = std::thread([this] { Run(); });
+}
+
+TrigramIndex::~TrigramIndex() {
+    {
+        std::lock_guard<std::mutex> lk(mtx_);
+        stop_ = true;
+    }
+    cv_.notify_all();
+    Wake();
+    indexer_.join();
+}
+
+void TrigramIndex::Rebuild() {
+    {
+        std::lock_guard<std::mutex> lk(mtx_);
+        rebuild_ = true;
+    }
+    cv_.notify_all();
+    Wake();
+}
+
+void TrigramIndex::FileChanged(const std::string& path) {
+    {
+        std::lock_guard<std::mutex> lk(mtx_);
+        auto iter = ids_.find(path);
+        // Unknown files are left to inotify, which knows the ignore rules.
+        if (iter == ids_.end()) {
+            return;
+        }
+        FileEntry& entry = entries_[iter->second];
+        if (entry.kind == FileKind::kIndexed) {
+            entry.kind = FileKind::kStale;
+        }
+        pending_.insert(path);
+    }
+    Wake();
+}
+
+bool TrigramIndex::Candidates(const Regex& regex, const std::string& dir,
+                              std::vector<std::string>& files) {
+    bool icase = regex.flags() & kRegexIgnoreCase;
+    std::vector<uint32_t> trigrams;
+    for (const std::string& literal : regex.required_literals()) {
+        for (size_t i = 0; i + 3 <= literal.size(); i++) {
+            uint8_t b[3];
+            bool ascii = true;
+            for (int j = 0; j < 3; j++) {
+                b[j] = TrigramByte(literal[i + j]);
+                ascii = ascii && b[j] < 0x80;
+            }
+            // Unicode case folding is not indexed.
+            if (icase && !ascii) {
+                continue;
+            }
+            trigrams.push_back(b[0] << 16 | b[1] << 8 | b[2]);
+        }
+    }
+    std::sort(trigrams.begin(), trigrams.end());
+    trigrams.erase(std::unique(trigrams.begin(), trigrams.end()),
+                   trigrams.end());
+
+    std::lock_guard<std::mutex> lk(mtx_);
+    if (state_ != State::kReady) {
+        return false;
+    }
+    for (const PendingDir& pending : pending_dirs_) {
+        // Files in it are unknown until walked.
+        if (IsUnderDir(pending.path, dir) || IsUnderDir(dir, pending.path)) {
+            return false;
+        }
+    }
+
+    std::vector<uint32_t> ids;
+    if (trigrams.empty()) {
+        for (uint32_t id = 0; id < entries_.size(); id++) {
+            ids.push_back(id);
+        }
+    } else {
+        std::vector<const Posting*> postings;
+        for (uint32_t t : trigrams) {
+            auto iter = postings_.find(t);
+            if (iter == postings_.end()) {
+                postings.clear();
+                break;
+            }
+            postings.push_back(&iter->second);
+        }
+        std::sort(postings.begin(), postings.end(),
+                  [](const Posting* p1, const Posting* p2) {
+                      return p1->cnt < p2->cnt;
+                  });
+        for (size_t i = 0; i < postings.size(); i++) {
+            if (i == 0) {
+                size_t pos = 0;
+                uint32_t id = 0;
+                for (uint32_t k = 0; k < postings[0]->cnt; k++) {
+                    id += GetVarint(postings[0]->bytes, pos);
+                    ids.push_back(id);
+                }
+            } else {
+                IntersectPosting(*postings[i], ids);
+            }
+        }
+    }
+
+    files.clear();
+    for (uint32_t id : ids) {
+        const FileEntry& entry = entries_[id];
+        if (entry.kind == FileKind::kIndexed && IsUnderDir(entry.path, dir)) {
+            files.push_back(entry.path);
+        }
+    }
+    for (const FileEntry& entry : entries_) {
+        if ((entry.kind == FileKind::kStale ||
+             entry.kind == FileKind::kLarge) &&
+            IsUnderDir(entry.path, dir)) {
+            files.push_back(entry.path);
+        }
+    }
+    return true;
+}
+
+TrigramIndex::Status TrigramIndex::GetStatus() {
+    std::lock_guard<std::mutex> lk(mtx_);
+    return {state_, ids_.size(), postings_.size(), posting_bytes_,
+            pending_.size()};
+}
+
+std::string TrigramIndex::CachePath(const std::string& root) {
+    std::string dir = Path::GetCache() + "mango_index" + kPathSeperator;
+    mkdir(dir.c_str(), 0755);  // best effort, ignore ret
+    // FNV-1a, stable across runs.
+    uint64_t hash = 14695981039346656037ULL;
+    for (char c : root) {
+        hash = (hash ^ static_cast<uint8_t>(c)) * 1099511628211ULL;
+    }
+    char name[32];
+    snprintf(name, sizeof(name), "%016llx.idx",
+             static_cast<unsigned long long>(hash));
+    return dir + name;
+}
+
+void TrigramIndex::Wake() {
+    char c = 0;
+    // Nonblocking, a full pipe already wakes the indexer up.
+    (void)!write(wake_[1].fd, &c, 1);
+}
+
+void TrigramIndex::Run() {
+    // On linux, nice value is per thread. Best effort.
+    setpriority(PRIO_PROCESS, syscall(SYS_gettid), kIndexerNice);
+
+    if (!Load()) {
+        std::lock_guard<std::mutex> lk(mtx_);
+        Clear();
+    }
+    ResetWatches();
+    bool need_refresh = true;
+    bool reset_watches = false;
+    auto last_save = std::chrono::steady_clock::now();
+    while (true) {
+        bool has_pending;
+        bool dirty;
+        std::optional<PendingDir> pending_dir;
+        {
+            std::lock_guard<std::mutex> lk(mtx_);
+            if (stop_) {
+                break;
+            }
+            if (rebuild_) {
+                rebuild_ = false;
+                reset_watches = true;
+                need_refresh = true;
+                Clear();
+            }
+            has_pending = !pending_.empty();
+            dirty = dirty_;
+            if (!pending_dirs_.empty()) {
+                pending_dir = pending_dirs_.front();
+            }
+        }
+
+        if (reset_watches) {
+            reset_watches = false;
+            ResetWatches();
+        }
+        if (need_refresh) {
+            if (!Refresh()) {
+                continue;
+            }
+            need_refresh = false;
+            Save();
+            last_save = std::chrono::steady_clock::now();
+            continue;
+        }
+        if (pending_dir) {
+            if (!RefreshDir(*pending_dir)) {
+                continue;
+            }
+            // Only changed on this thread, it's still the first.
+            std::lock_guard<std::mutex> lk(mtx_);
+            pending_dirs_.erase(pending_dirs_.begin());
+            continue;
+        }
+
+        // A negative fd(no inotify) is ignored by poll.
+        pollfd fds[2] = {{wake_[0].fd, POLLIN, 0}, {inotify_.fd, POLLIN, 0}};
+        int timeout = -1;
+        if (has_pending) {
+            timeout = kReindexDelayMs;
+        } else if (dirty) {
+            timeout = kSaveIntervalMs;
+        }
+        int rc = poll(fds, 2, timeout);
+        if (rc == -1) {
+            if (errno == EINTR) {
+                continue;
+            }
+            MGO_LOG_ERROR("indexer poll error: {}", strerror(errno));
+            break;
+        }
+        if (fds[0].revents != 0) {
+            char buf[64];
+            while (read(wake_[0].fd, buf, sizeof(buf)) > 0) {
+            }
+        }
+        if (fds[1].revents != 0) {
+            need_refresh = !ReadWatchEvents();
+            continue;
+        }
+        if (rc == 0 && has_pending) {
+            ReindexPending();
+        }
+        auto now = std::chrono::steady_clock::now();
+        if (dirty &&
+            now - last_save >= std::chrono::milliseconds(kSaveIntervalMs)) {
+            Save();
+            last_save = now;
+        }
+    }
+
+    bool dirty;
+    {
+        std::lock_guard<std::mutex> lk(mtx_);
+        dirty = dirty_;
+    }
+    if (dirty) {
+        Save();
+    }
+}
+
+bool TrigramIndex::Refresh() {
+    {
+        std::lock_guard<std::mutex> lk(mtx_);
+        state_ = State::kBuilding;
+        watch_failed_ = false;
+        // All of them are walked.
+        pending_dirs_.clear();
+    }
+    if (!RefreshDir({"", std::make_shared<IgnoreRules>("", nullptr)})) {
+        return false;
+    }
+    std::lock_guard<std::mutex> lk(mtx_);
+    state_ = watch_failed_ ? State::kNotWatching : State::kReady;
+    return true;
+}
+
+bool TrigramIndex::RefreshDir(const PendingDir& dir) {
+    size_t thread_cnt = std::clamp<size_t>(std::thread::hardware_concurrency(),
+                                           1, kIndexerMaxThreads);
+    {
+        std::lock_guard<std::mutex> lk(mtx_);
+        walk_done_ = false;
+        generation_++;
+    }
+    bitmaps_.assign(thread_cnt, std::vector<uint64_t>(kTrigramBitmapWords));
+
+    auto walker = std::make_unique<ParallelWalker>(
+        root_, dir.path, dir.parent_rules, thread_cnt,
+        [this](size_t worker, const std::string& path) {
+            RefreshFile(worker, path);
+        },
+        [this] {
+            {
+                std::lock_guard<std::mutex> lk(mtx_);
+                walk_done_ = true;
+            }
+            cv_.notify_all();
+        },
+        [this](const std::string& path,
+               const std::shared_ptr<const IgnoreRules>& rules) {
+            WatchDir(path, rules);
+        });
+    bool done;
+    {
+        std::unique_lock<std::mutex> lk(mtx_);
+        cv_.wait(lk, [this] { return walk_done_ || stop_ || rebuild_; });
+        done = walk_done_;
+    }
+    walker.reset();
+    bitmaps_.clear();
+    if (!done) {
+        return false;
+    }
+
+    std::lock_guard<std::mutex> lk(mtx_);
+    for (FileEntry& entry : entries_) {
+        if (entry.kind != FileKind::kRemoved &&
+            entry.generation != generation_ &&
+            IsUnderDir(entry.path, dir.path)) {
+            RemoveEntry(std::string(entry.path));
+        }
+    }
+    // Directories gone or ignored now.
+    for (auto iter = watches_.begin(); iter != watches_.end();) {
+        if (iter->second.generation != generation_ &&
+            IsUnderDir(iter->second.path, dir.path)) {
+            inotify_rm_watch(inotify_.fd, iter->first);
+            iter = watches_.erase(iter);
+        } else {
+            iter++;
+        }
+    }
+    if (watch_failed_) {
+        state_ = State::kNotWatching;
+    }
+    return true;
+}
+
+void TrigramIndex::RefreshFile(size_t worker, const std::string& path) {
+    std::string rel = path.substr(root_.size());
+    struct stat st;
+    if (stat(path.c_str(), &st) == -1) {
+        return;
+    }
+    int64_t mtime = MtimeNs(st);
+    {
+        std::lock_guard<std::mutex> lk(mtx_);
+        auto iter = ids_.find(rel);
+        if (iter != ids_.end()) {
+            FileEntry& entry = entries_[iter->second];
+            entry.generation = generation_;
+            if (entry.kind != FileKind::kStale && entry.mtime == mtime &&
+                entry.size == st.st_size) {
+                return;
+            }
+        }
+    }
+    IndexFile(rel, mtime, st.st_size, bitmaps_[worker]);
+}
+
+void TrigramIndex::WatchDir(const std::string& path,
+                            const std::shared_ptr<const IgnoreRules>& rules) {
+    int wd = inotify_add_watch(inotify_.fd, path.c_str(), kWatchMask);
+    std::lock_guard<std::mutex> lk(mtx_);
+    if (wd == -1) {
+        if (!watch_failed_) {
+            MGO_LOG_WARN("inotify_add_watch {} error: {}", path,
+                         strerror(errno));
+        }
+        watch_failed_ = true;
+        return;
+    }
+    watches_[wd] = {path.substr(root_.size()), rules, generation_};
+}
+
+bool TrigramIndex::ReadWatchEvents() {
+    alignas(struct inotify_event) char buf[16384];
+    bool ok = true;
+    while (true) {
+        ssize_t n = read(inotify_.fd, buf, sizeof(buf));
+        if (n <= 0) {
+            break;
+        }
+        std::lock_guard<std::mutex> lk(mtx_);
+        for (char* p = buf; p < buf + n;) {
+            auto ev = reinterpret_cast<struct inotify_event*>(p);
+            p += sizeof(struct inotify_event) + ev->len;
+            if (ev->mask & IN_Q_OVERFLOW) {
+                ok = false;
+                continue;
+            }
+            auto iter = watches_.find(ev->wd);
+            if (iter == watches_.end()) {
+                continue;
+            }
+            if (ev->mask & IN_IGNORED) {
+                // The directory is gone.
+                watches_.erase(iter);
+                continue;
+            }
+            if (ev->len == 0 || strcmp(ev->name, ".git") == 0) {
+                continue;
+            }
+            std::string path = iter->second.path + ev->name;
+            bool is_dir = ev->mask & IN_ISDIR;
+            if (iter->second.rules->Ignored(path, is_dir)) {
+                continue;
+            }
+            if (is_dir) {
+                // Files in a removed directory have their own events.
+                if (ev->mask & IN_MOVED_FROM) {
+                    RemoveDir(path + '/');
+                } else if (ev->mask & (IN_CREATE | IN_MOVED_TO)) {
+                    AddPendingDir({path + '/', iter->second.rules});
+                }
+                continue;
+            }
+            if (strcmp(ev->name, ".gitignore") == 0 ||
+                strcmp(ev->name, ".ignore") == 0) {
+                // Rules of the directory change, walk it again with the
+                // rules of its parent.
+                const WatchedDir& dir = iter->second;
+                std::shared_ptr<const IgnoreRules> parent_rules = dir.rules;
+                if (parent_rules->dir() == dir.path && parent_rules->parent()) {
+                    parent_rules = parent_rules->parent();
+                }
+                AddPendingDir({dir.path, std::move(parent_rules)});
+            }
+
+            auto id_iter = ids_.find(path);
+            if (id_iter == ids_.end()) {
+                AddEntry({path, -1, -1, FileKind::kStale, generation_}, {});
+            } else if (entries_[id_iter->second].kind == FileKind::kIndexed) {
+                entries_[id_iter->second].kind = FileKind::kStale;
+            }
+            pending_.insert(std::move(path));
+        }
+    }
+    return ok;
+}
+
+void TrigramIndex::AddPendingDir(PendingDir&& dir) {
+    for (const PendingDir& pending : pending_dirs_) {
+        if (IsUnderDir(dir.path, pending.path)) {
+            return;
+        }
+    }
+    pending_dirs_.erase(
+        std::remove_if(pending_dirs_.begin(), pending_dirs_.end(),
+                       [&dir](const PendingDir& pending) {
+                           return IsUnderDir(pending.path, dir.path);
+                       }),
+        pending_dirs_.end());
+    pending_dirs_.push_back(std::move(dir));
+}
+
+void TrigramIndex::RemoveDir(const std::string& dir) {
+    for (FileEntry& entry : entries_) {
+        if (entry.kind != FileKind::kRemoved && IsUnderDir(entry.path, dir)) {
+            RemoveEntry(std::string(entry.path));
+        }
+    }
+    for (auto iter = watches_.begin(); iter != watches_.end();) {
+        if (IsUnderDir(iter->second.path, dir)) {
+            inotify_rm_watch(inotify_.fd, iter->first);
+            iter = watches_.erase(iter);
+        } else {
+            iter++;
+        }
+    }
+}
+
+void TrigramIndex::ReindexPending() {
+    std::vector<std::string> paths;
+    {
+        std::lock_guard<std::mutex> lk(mtx_);
+        paths.assign(pending_.begin(), pending_.end());
+        pending_.clear();
+    }
+    std::vector<uint64_t> bitmap(kTrigramBitmapWords);
+    for (const std::string& path : paths) {
+        struct stat st;
+        if (stat((root_ + path).c_str(), &st) == -1 || !S_ISREG(st.st_mode)) {
+            std::lock_guard<std::mutex> lk(mtx_);
+            RemoveEntry(path);
+            continue;
+        }
+        IndexFile(path, MtimeNs(st), st.st_size, bitmap);
+
+        std::lock_guard<std::mutex> lk(mtx_);
+        if (stop_ || rebuild_) {
+            // Not indexed files are still stale.
+            return;
+        }
+    }
+}
+
+void TrigramIndex::IndexFile(const std::string& path, int64_t mtime,
+                             int64_t size, std::vector<uint64_t>& bitmap) {
+    std::vector<uint32_t> trigrams;
+    FileKind kind = FileKind::kIndexed;
+    if (size > kMaxIndexFileBytes) {
+        kind = FileKind::kLarge;
+    } else if (size > 0) {
+        // Read instead of mmap, the file may be truncated while reading since
+        // we are indexing changed files.
+        std::string contents(size, '\0');
+        size_t len = 0;
+        try {
+            Fd fd = Open((root_ + path).c_str(), O_RDONLY | O_CLOEXEC);
+            while (len < contents.size()) {
+                ssize_t n = fd.Read(contents.data() + len,
+                                    contents.size() - len);
+                if (n == 0) {
+                    break;
+                }
+                len += n;
+            }
+        } catch (OSException& e) {
+            std::lock_guard<std::mutex> lk(mtx_);
+            RemoveEntry(path);
+            return;
+        }
+        contents.resize(len);
+        ExtractTrigrams(contents, bitmap, trigrams);
+    }
+
+    std::lock_guard<std::mutex> lk(mtx_);
+    AddEntry({path, mtime, size, kind, generation_}, trigrams);
+}
+
+void TrigramIndex::AddEntry(FileEntry&& entry,
+                            const std::vector<uint32_t>& trigrams) {
+    RemoveEntry(entry.path);
+    uint32_t id = entries_.size();
+    ids_[entry.path] = id;
+    entries_.push_back(std::move(entry));
+    for (uint32_t t : trigrams) {
+        Posting& p = postings_[t];
+        size_t before = p.bytes.size();
+        PutVarint(p.bytes, id - p.last);
+        p.last = id;
+        p.cnt++;
+        posting_bytes_ += p.bytes.size() - before;
+    }
+    dirty_ = true;
+}
+
+void TrigramIndex::RemoveEntry(const std::string& path) {
+    auto iter = ids_.find(path);
+    if (iter == ids_.end()) {
+        return;
+    }
+    FileEntry& entry = entries_[iter->second];
+    ids_.erase(iter);
+    entry.kind = FileKind::kRemoved;
+    entry.path.clear();
+    entry.path.shrink_to_fit();
+    removed_cnt_++;
+    dirty_ = true;
+}
+
+void TrigramIndex::Clear() {
+    state_ = State::kBuilding;
+    entries_.clear();
+    ids_.clear();
+    postings_.clear();
+    removed_cnt_ = 0;
+    posting_bytes_ = 0;
+    pending_.clear();
+    pending_dirs_.clear();
+    dirty_ = true;
+}
+
+void TrigramIndex::ResetWatches() {
+    {
+        std::lock_guard<std::mutex> lk(mtx_);
+        watches_.clear();
+    }
+    // Closing the old instance drops all watches.
+    inotify_ = Fd(inotify_init1(IN_NONBLOCK | IN_CLOEXEC));
+    if (inotify_.fd == -1) {
+        MGO_LOG_WARN("inotify_init1 error: {}", strerror(errno));
+    }
+}
+
+void TrigramIndex::Compact() {
+    std::vector<uint32_t> remap(entries_.size(), kNoId);
+    std::vector<FileEntry> entries;
+    entries.reserve(entries_.size() - removed_cnt_);
+    for (uint32_t id = 0; id < entries_.size(); id++) {
+        if (entries_[id].kind != FileKind::kRemoved) {
+            remap[id] = entries.size();
+            entries.push_back(std::move(entries_[id]));
+        }
+    }
+    entries_ = std::move(entries);
+    ids_.clear();
+    for (uint32_t id = 0; id < entries_.size(); id++) {
+        ids_[entries_[id].path] = id;
+    }
+
+    posting_bytes_ = 0;
+    for (auto iter = postings_.begin(); iter != postings_.end();) {
+        const Posting& old = iter->second;
+        Posting p;
+        size_t pos = 0;
+        uint32_t id = 0;
+        for (uint32_t k = 0; k < old.cnt; k++) {
+            id += GetVarint(old.bytes, pos);
+            if (remap[id] == kNoId) {
+                continue;
+            }
+            PutVarint(p.bytes, remap[id] - p.last);
+            p.last = remap[id];
+            p.cnt++;
+        }
+        if (p.cnt == 0) {
+            iter = postings_.erase(iter);
+            continue;
+        }
+        posting_bytes_ += p.bytes.size();
+        iter->second = std::move(p);
+        iter++;
+    }
+    removed_cnt_ = 0;
+}
+
+bool TrigramIndex::Load() {
+    std::string data;
+    try {
+        Fd fd = Open(cache_path_.c_str(), O_RDONLY | O_CLOEXEC);
+        char buf[65536];
+        while (true) {
+            ssize_t n = fd.Read(buf, sizeof(buf));
+            if (n == 0) {
+                break;
+            }
+            data.append(buf, n);
+        }
+    } catch (OSException& e) {
+        if (e.error_code() != ENOENT) {
+            MGO_LOG_WARN("index {} can't load: {}", cache_path_, e.what());
+        }
+        return false;
+    }
+
+    IndexReader r(data);
+    if (r.GetStr() != kIndexMagic || r.Get<uint32_t>() != kIndexVersion ||
+        r.GetStr() != root_) {
+        return false;
+    }
+    std::lock_guard<std::mutex> lk(mtx_);
+    uint64_t entry_cnt = r.Get<uint64_t>();
+    for (uint64_t i = 0; i < entry_cnt && r.ok(); i++) {
+        FileEntry entry;
+        entry.path = r.GetStr();
+        entry.mtime = r.Get<int64_t>();
+        entry.size = r.Get<int64_t>();
+        entry.kind = static_cast<FileKind>(r.Get<uint8_t>());
+        if (entry.kind == FileKind::kRemoved) {
+            removed_cnt_++;
+        } else {
+            ids_[entry.path] = entries_.size();
+        }
+        entries_.push_back(std::move(entry));
+    }
+    uint64_t posting_cnt = r.Get<uint64_t>();
+    for (uint64_t i = 0; i < posting_cnt && r.ok(); i++) {
+        uint32_t t = r.Get<uint32_t>();
+        Posting& p = postings_[t];
+        p.cnt = r.Get<uint32_t>();
+        p.last = r.Get<uint32_t>();
+        p.bytes = r.GetStr();
+        posting_bytes_ += p.bytes.size();
+        if (p.last >= entries_.size()) {
+            break;
+        }
+    }
+    if (!r.ok() || entries_.size() != entry_cnt ||
+        postings_.size() != posting_cnt) {
+        MGO_LOG_WARN("index {} is broken", cache_path_);
+        return false;
+    }
+    return true;
+}
+
+void TrigramIndex::Save() {
+    // Files are only added and removed on the indexer thread, which is here,
+    // so entries_ and postings_ are serialized out of the lock without
+    // blocking Candidates. Kinds can be changed by FileChanged, they are
+    // copied under the lock.
+    std::vector<FileKind> kinds;
+    {
+        std::lock_guard<std::mutex> lk(mtx_);
+        if (removed_cnt_ * 4 > entries_.size()) {
+            Compact();
+        }
+        kinds.reserve(entries_.size());
+        for (const FileEntry& entry : entries_) {
+            kinds.push_back(entry.kind);
+        }
+        dirty_ = false;
+    }
+
+    std::string data;
+    PutStr(data, kIndexMagic);
+    PutU32(data, kIndexVersion);
+    PutStr(data, root_);
+    PutI64(data, entries_.size());
+    for (size_t id = 0; id < entries_.size(); id++) {
+        const FileEntry& entry = entries_[id];
+        PutStr(data, entry.path);
+        PutI64(data, entry.mtime);
+        PutI64(data, entry.size);
+        data.push_back(static_cast<char>(kinds[id]));
+    }
+    PutI64(data, postings_.size());
+    for (const auto& [t, p] : postings_) {
+        PutU32(data, t);
+        PutU32(data, p.cnt);
+        PutU32(data, p.last);
+        PutStr(data, p.bytes);
+    }
+
+    // Write a temp file and rename, so the cache file is never half written.
+    std::string tmp_path = cache_path_ + ".tmp";
+    try {
+        Fd fd =
+            Open(tmp_path.c_str(), O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC);
+        fd.Write(data.data(), data.size());
+    } catch (OSException& e) {
+        MGO_LOG_WARN("index {} can't save: {}", cache_path_, e.what());
+        return;
+    }
+    if (rename(tmp_path.c_str(), cache_path_.c_str()) == -1) {
+        MGO_LOG_WARN("index {} can't save: {}", cache_path_, strerror(errno));
+    }
+}
+
+}  // namespace mango
@@ -0,0 +1,183 @@
+#pragma once
+
+#include <condition_variable>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <unordered_map>
+#include <unordered_set>
+#include <vector>
+
+#include "os.h"
+#include "regex_engine.h"
+#include "walker.h"
+
+namespace mango {
+
+// A persistent trigram index of a directory tree, used to narrow down the
+// files a project-wide grep has to search.
+//
+// For every file the set of trigrams(3 bytes, ascii lowercased) in it is
+// recorded. A regex can only match a file which contains every trigram of
+// the literals the regex requires, the other files are skipped.
+//
+// The index is maintained by a background indexer thread: it's loaded from
+// the cache file and refreshed by walking the tree, where only files whose
+// mtime or size changed are read again. Then changed files are reindexed
+// incrementally, being told by inotify or FileChanged. A new or moved
+// directory, or a changed ignore file, only makes its own tree walked again.
+// It's saved back to the cache file after building, from time to time and
+// when destructed.
+class TrigramIndex {
+   public:
+    enum class State {
+        kLoading,
+        kBuilding,
+        kReady,
+        // inotify can't watch the whole tree (fs.inotify.max_user_watches),
+        // changes may be missed, so the index is not used.
+        kNotWatching,
+    };
+
+    struct Status {
+        State state;
+        size_t files;
+        size_t trigrams;
+        size_t bytes;    // size of posting lists
+        size_t pending;  // changed files not reindexed yet
+    };
+
+    // root is an absolute directory path with a slash at the end.
+    // The index is persisted to cache_path.
+    TrigramIndex(const std::string& root, const std::string& cache_path);
+    // Stop the indexer and save the index.
+    ~TrigramIndex();
+    MGO_DELETE_COPY(TrigramIndex);
+    MGO_DELETE_MOVE(TrigramIndex);
+
+    // Drop the index and build it from scratch in background.
+    void Rebuild();
+    // Tell the index that a file(relative to root) has been changed, e.g. a
+    // buffer is saved. It's searched as a candidate until reindexed.
+    void FileChanged(const std::string& path);
+
+    // Get the files(relative to root) under dir which may match regex.
+    // dir is relative to root, with a slash at the end or empty for all.
+    // Return false if the index can't be used now, e.g. it's still
+    // building, all files should be searched then.
+    bool Candidates(const Regex& regex, const std::string& dir,
+                    std::vector<std::string>& files);
+
+    Status GetStatus();
+    const std::string& root() const { return root_; }
+
+    // The default cache path of the index of root.
+    static std::string CachePath(const std::string& root);
+
+   private:
+    enum class FileKind : uint8_t {
+        kIndexed,
+        kStale,    // changed and not reindexed, always a candidate
+        kLarge,    // too large to index, always a candidate
+        kRemoved,  // a tombstone, its id is still in posting lists
+    };
+
+    struct FileEntry {
+        std::string path;
+        int64_t mtime;  // ns
+        int64_t size;
+        FileKind kind;
+        uint32_t generation = 0;  // refresh generation when last seen
+    };
+
+    // Ids are delta encoded as varints, appended in increasing order.
+    struct Posting {
+        std::string bytes;
+        uint32_t last = 0;
+        uint32_t cnt = 0;
+    };
+
+    struct WatchedDir {
+        std::string path;  // relative to root_
+        std::shared_ptr<const IgnoreRules> rules;
+        uint32_t generation = 0;  // refresh generation when last watched
+    };
+
+    // A tree to walk again.
+    struct PendingDir {
+        std::string path;  // relative to root_, with a slash at the end
+        std::shared_ptr<const IgnoreRules> parent_rules;
+    };
+
+    void Run();
+    void Wake();
+
+    // Walk the tree, reindex changed files, drop removed ones and watch all
+    // directories. Return false if interrupted.
+    bool Refresh();
+    // Like Refresh but only for the tree of dir, files and watches out of it
+    // are kept.
+    bool RefreshDir(const PendingDir& dir);
+    // Called on walker threads.
+    void RefreshFile(size_t worker, const std::string& path);
+    void WatchDir(const std::string& path,
+                  const std::shared_ptr<const IgnoreRules>& rules);
+
+    // Return false if the tree needs a refresh.
+    bool ReadWatchEvents();
+    // Needs lock.
+    void AddPendingDir(PendingDir&& dir);
+    // Drop files and watches under dir, which is moved away. Needs lock.
+    void RemoveDir(const std::string& dir);
+    void ReindexPending();
+
+    // Read and index a file(relative to root_), mtime and size are from its
+    // stat. Entry of the old file of the same path is removed.
+    void IndexFile(const std::string& path, int64_t mtime, int64_t size,
+                   std::vector<uint64_t>& bitmap);
+    // Needs lock.
+    void AddEntry(FileEntry&& entry, const std::vector<uint32_t>& trigrams);
+    void RemoveEntry(const std::string& path);
+    void Clear();
+    // Drop tombstones and renumber ids.
+    void Compact();
+
+    // Called on the indexer thread.
+    void ResetWatches();
+
+    bool Load();
+    void Save();
+
+    std::string root_;
+    std::string cache_path_;
+
+    std::thread indexer_;
+    Fd wake_[2];  // pipe to wake up the indexer
+    Fd inotify_;
+
+    std::mutex mtx_;  // protects the fields below
+    std::condition_variable cv_;
+    State state_ = State::kLoading;
+    bool stop_ = false;
+    bool rebuild_ = false;
+    bool walk_done_ = false;
+    bool dirty_ = false;  // changed since last saving
+    std::vector<FileEntry> entries_;  // indexed by id
+    std::unordered_map<std::string, uint32_t> ids_;
+    std::unordered_map<uint32_t, Posting> postings_;
+    size_t removed_cnt_ = 0;
+    size_t posting_bytes_ = 0;
+    uint32_t generation_ = 0;
+    std::unordered_map<int, WatchedDir> watches_;  // by wd
+    bool watch_failed_ = false;
+    std::unordered_set<std::string> pending_;  // changed files
+    // Trees to walk again, files in them are unknown until walked. None is
+    // under another.
+    std::vector<PendingDir> pending_dirs_;
+
+    // Per walker thread when refreshing, one bit for every trigram.
+    std::vector<std::vector<uint64_t>> bitmaps_;
+};
+
+}  // namespace mango
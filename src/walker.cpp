@@ -0,0 +1,392 @@
+#include "walker.h"
+
+#include <dirent.h>
+#include <fcntl.h>
+#include <sys/resource.h>
+#include <sys/stat.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <cstring>
+#include <iterator>
+
+#include "exception.h"
+#include "file.h"
+
+namespace mango {
+
+static constexpr const char* kIgnoreFiles[] = {".gitignore", ".ignore"};
+static constexpr const char* kGitDir = ".git";
+// Nice value of worker threads, so the ui thread always wins.
+static constexpr int kWorkerNice = 10;
+
+// Match a bracket expression at pattern[0] ('['). Return false if it is not
+// terminated, else pattern_len and matched will be set.
+static bool GlobMatchClass(std::string_view pattern, char c,
+                           size_t& pattern_len, bool& matched) {
+    size_t i = 1;
+    bool negated = false;
+    if (i < pattern.size() && (pattern[i] == '!' || pattern[i] == '^')) {
+        negated = true;
+        i++;
+    }
+    matched = false;
+    bool first = true;
+    for (; i < pattern.size(); i++) {
+        if (pattern[i] == ']' && !first) {
+            pattern_len = i + 1;
+            matched = matched != negated;
+            return true;
+        }
+        first = false;
+        char lo = pattern[i];
+        char hi = lo;
+        if (i + 2 < pattern.size() && pattern[i + 1] == '-' &&
+            pattern[i + 2] != ']') {
+            hi = pattern[i + 2];
+            i += 2;
+        }
+        if (lo <= c && c <= hi) {
+            matched = true;
+        }
+    }
+    return false;
+}
+
+bool GlobMatch(std::string_view pattern, std::string_view str) {
+    size_t pi = 0;
+    size_t si = 0;
+    while (pi < pattern.size()) {
+        char c = pattern[pi];
+        if (c == '*') {
+            if (pi + 1 < pattern.size() && pattern[pi + 1] == '*') {
+                std::string_view rest = pattern.substr(pi + 2);
+                if (!rest.empty() && rest[0] == '/') {
+                    // "**/" matches nothing or any leading directories.
+                    rest.remove_prefix(1);
+                    if (GlobMatch(rest, str.substr(si))) {
+                        return true;
+                    }
+                    for (size_t i = si; i < str.size(); i++) {
+                        if (str[i] == '/' &&
+                            GlobMatch(rest, str.substr(i + 1))) {
+                            return true;
+                        }
+                    }
+                    return false;
+                }
+                for (size_t i = si; i <= str.size(); i++) {
+                    if (GlobMatch(rest, str.substr(i))) {
+                        return true;
+                    }
+                }
+                return false;
+            }
+
+            std::string_view rest = pattern.substr(pi + 1);
+            for (size_t i = si;; i++) {
+                if (GlobMatch(rest, str.substr(i))) {
+                    return true;
+                }
+                if (i == str.size() || str[i] == '/') {
+                    return false;
+                }
+            }
+        }
+
+        if (si == str.size()) {
+            return false;
+        }
+        if (c == '?') {
+            if (str[si] == '/') {
+                return false;
+            }
+            pi++;
+            si++;
+            continue;
+        }
+        if (c == '[') {
+            size_t len;
+            bool matched;
+            if (GlobMatchClass(pattern.substr(pi), str[si], len, matched)) {
+                if (!matched || str[si] == '/') {
+                    return false;
+                }
+                pi += len;
+                si++;
+                continue;
+            }
+            // Not terminated, a literal '['.
+        } else if (c == '\\' && pi + 1 < pattern.size()) {
+            c = pattern[++pi];
+        }
+        if (c != str[si]) {
+            return false;
+        }
+        pi++;
+        si++;
+    }
+    return si == str.size();
+}
+
+IgnoreRules::IgnoreRules(const std::string& dir,
+                         const std::shared_ptr<const IgnoreRules>& parent)
+    : dir_(dir), parent_(parent) {}
+
+void IgnoreRules::AddRules(std::string_view contents) {
+    while (!contents.empty()) {
+        size_t eol = contents.find('\n');
+        std::string_view line = contents.substr(0, eol);
+        contents.remove_prefix(eol == std::string_view::npos ? contents.size()
+                                                             : eol + 1);
+        if (!line.empty() && line.back() == '\r') {
+            line.remove_suffix(1);
+        }
+        // Trailing spaces are ignored unless they are escaped.
+        while (!line.empty() && line.back() == ' ' &&
+               !(line.size() >= 2 && line[line.size() - 2] == '\\')) {
+            line.remove_suffix(1);
+        }
+        if (line.empty() || line[0] == '#') {
+            continue;
+        }
+
+        Rule rule;
+        if (line[0] == '!') {
+            rule.negated = true;
+            line.remove_prefix(1);
+        } else if (line.size() >= 2 && line[0] == '\\' &&
+                   (line[1] == '!' || line[1] == '#')) {
+            line.remove_prefix(1);
+        }
+        if (!line.empty() && line.back() == '/') {
+            rule.dir_only = true;
+            line.remove_suffix(1);
+        }
+        if (line.find('/') != std::string_view::npos) {
+            rule.anchored = true;
+            if (line[0] == '/') {
+                line.remove_prefix(1);
+            }
+        }
+        if (line.empty()) {
+            continue;
+        }
+        rule.pattern = line;
+        rules_.push_back(std::move(rule));
+    }
+}
+
+bool IgnoreRules::Ignored(std::string_view path, bool is_dir) const {
+    for (const IgnoreRules* r = this; r != nullptr; r = r->parent_.get()) {
+        MGO_ASSERT(path.substr(0, r->dir_.size()) == r->dir_);
+        std::string_view rel = path.substr(r->dir_.size());
+        std::string_view name = rel.substr(rel.find_last_of('/') + 1);
+        // The last matching rule decides.
+        for (auto iter = r->rules_.rbegin(); iter != r->rules_.rend();
+             iter++) {
+            if (iter->dir_only && !is_dir) {
+                continue;
+            }
+            if (GlobMatch(iter->pattern, iter->anchored ? rel : name)) {
+                return !iter->negated;
+            }
+        }
+    }
+    return false;
+}
+
+ParallelWalker::ParallelWalker(const std::string& root, size_t thread_cnt,
+                               const FileHandler& on_file,
+                               const std::function<void()>& on_done,
+                               const DirHandler& on_dir)
+    : ParallelWalker(root, "", std::make_shared<IgnoreRules>("", nullptr),
+                     thread_cnt, on_file, on_done, on_dir) {}
+
+ParallelWalker::ParallelWalker(
+    const std::string& root, const std::string& dir,
+    const std::shared_ptr<const IgnoreRules>& parent_rules, size_t thread_cnt,
+    const FileHandler& on_file, const std::function<void()>& on_done,
+    const DirHandler& on_dir)
+    : root_(root), on_file_(on_file), on_done_(on_done), on_dir_(on_dir) {
+    MGO_ASSERT(parent_rules);
+    jobs_.push_back({dir, parent_rules});
+    pending_ = 1;
+    StartThreads(thread_cnt);
+}
+
+ParallelWalker::ParallelWalker(const std::string& root,
+                               const std::vector<std::string>& files,
+                               size_t thread_cnt, const FileHandler& on_file,
+                               const std::function<void()>& on_done)
+    : root_(root), on_file_(on_file), on_done_(on_done) {
+    MGO_ASSERT(!files.empty());
+    for (const std::string& file : files) {
+        jobs_.push_back({file, nullptr});
+    }
+    pending_ = jobs_.size();
+    StartThreads(thread_cnt);
+}
+
+void ParallelWalker::StartThreads(size_t thread_cnt) {
+    MGO_ASSERT(thread_cnt >= 1);
+    for (size_t i = 0; i < thread_cnt; i++) {
+        threads_.emplace_back([this, i] { Work(i); });
+    }
+}
+
+ParallelWalker::~ParallelWalker() {
+    Stop();
+    for (auto& t : threads_) {
+        t.join();
+    }
+}
+
+void ParallelWalker::Stop() {
+    {
+        std::lock_guard<std::mutex> lk(mtx_);
+        stop_ = true;
+        jobs_.clear();
+    }
+    cv_.notify_all();
+}
+
+void ParallelWalker::Work(size_t worker) {
+    // On linux, nice value is per thread. Best effort.
+    setpriority(PRIO_PROCESS, syscall(SYS_gettid), kWorkerNice);
+
+    while (true) {
+        Job job;
+        {
+            std::unique_lock<std::mutex> lk(mtx_);
+            cv_.wait(lk, [this] {
+                return Stopped() || !jobs_.empty() || pending_ == 0;
+            });
+            if (Stopped() || jobs_.empty()) {
+                return;
+            }
+            job = std::move(jobs_.back());
+            jobs_.pop_back();
+        }
+
+        if (job.rules) {
+            ReadDir(job);
+        } else {
+            on_file_(worker, root_ + job.path);
+        }
+
+        bool done;
+        {
+            std::lock_guard<std::mutex> lk(mtx_);
+            done = --pending_ == 0;
+        }
+        if (done) {
+            cv_.notify_all();
+            if (!Stopped()) {
+                on_done_();
+            }
+            return;
+        }
+    }
+}
+
+void ParallelWalker::ReadDir(Job& job) {
+    std::string dir_path = root_ + job.path;
+    DIR* dir = opendir(dir_path.empty() ? "." : dir_path.c_str());
+    if (dir == nullptr) {
+        // Best effort, e.g. permission denied.
+        return;
+    }
+
+    struct Entry {
+        std::string name;
+        bool is_dir;
+    };
+    std::vector<Entry> entries;
+    bool has_ignore_files[std::size(kIgnoreFiles)] = {};
+    struct dirent* ent;
+    while ((ent = readdir(dir)) != nullptr && !Stopped()) {
+        if (strcmp(ent->d_name, ".") == 0 || strcmp(ent->d_name, "..") == 0 ||
+            strcmp(ent->d_name, kGitDir) == 0) {
+            continue;
+        }
+        unsigned char type = ent->d_type;
+        if (type == DT_UNKNOWN) {
+            struct stat st;
+            if (fstatat(dirfd(dir), ent->d_name, &st, AT_SYMLINK_NOFOLLOW) ==
+                -1) {
+                continue;
+            }
+            type = S_ISDIR(st.st_mode)   ? DT_DIR
+                   : S_ISREG(st.st_mode) ? DT_REG
+                                         : DT_UNKNOWN;
+        }
+        if (type == DT_DIR) {
+            entries.push_back({ent->d_name, true});
+        } else if (type == DT_REG) {
+            for (size_t i = 0; i < std::size(kIgnoreFiles); i++) {
+                if (strcmp(ent->d_name, kIgnoreFiles[i]) == 0) {
+                    has_ignore_files[i] = true;
+                }
+            }
+            entries.push_back({ent->d_name, false});
+        }
+        // We ignore other type file, symlinks are not followed.
+    }
+    closedir(dir);
+
+    std::shared_ptr<const IgnoreRules> rules = job.rules;
+    if (std::count(std::begin(has_ignore_files), std::end(has_ignore_files),
+                   true) != 0) {
+        auto new_rules = std::make_shared<IgnoreRules>(job.path, job.rules);
+        // Later files have a higher priority, so .ignore wins over
+        // .gitignore.
+        for (size_t i = 0; i < std::size(kIgnoreFiles); i++) {
+            if (!has_ignore_files[i]) {
+                continue;
+            }
+            try {
+                File f(dir_path + kIgnoreFiles[i], "r", false);
+                new_rules->AddRules(f.ReadAll());
+            } catch (IOException& e) {
+                // Best effort.
+            }
+        }
+        if (!new_rules->Empty()) {
+            rules = std::move(new_rules);
+        }
+    }
+    if (on_dir_) {
+        on_dir_(dir_path, rules);
+    }
+
+    std::vector<Job> new_jobs;
+    for (auto& entry : entries) {
+        std::string path = job.path + entry.name;
+        if (rules->Ignored(path, entry.is_dir)) {
+            continue;
+        }
+        if (entry.is_dir) {
+            path.push_back('/');
+            new_jobs.push_back({std::move(path), rules});
+        } else {
+            new_jobs.push_back({std::move(path), nullptr});
+        }
+    }
+    if (new_jobs.empty()) {
+        return;
+    }
+
+    {
+        std::lock_guard<std::mutex> lk(mtx_);
+        if (Stopped()) {
+            return;
+        }
+        pending_ += new_jobs.size();
+        std::move(new_jobs.begin(), new_jobs.end(), std::back_inserter(jobs_));
+    }
+    cv_.notify_all();
+}
+
+}  // namespace mango
@@ -0,0 +1,129 @@
+#pragma once
+
+#include <atomic>
+#include <condition_variable>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "utils.h"
+
+namespace mango {
+
+// Match a gitignore style glob against a path. '*' and '?' never match '/',
+// "**" matches anything, and a "**/" can also match nothing.
+bool GlobMatch(std::string_view pattern, std::string_view str);
+
+// Rules of ignore files (.gitignore, .ignore) in a directory. Rules are
+// chained to the rules of the parent directories, deeper rules win.
+// Supported syntax: comments, "!" negation, trailing "/" for directories only,
+// patterns with a "/" anchored to the directory of the ignore file, "**".
+class IgnoreRules {
+   public:
+    // dir is the path relative to the walking root, with a slash at the end
+    // if not empty.
+    IgnoreRules(const std::string& dir,
+                const std::shared_ptr<const IgnoreRules>& parent);
+
+    // Add rules from the contents of an ignore file.
+    void AddRules(std::string_view contents);
+    bool Empty() const { return rules_.empty(); }
+
+    // path is relative to the walking root.
+    bool Ignored(std::string_view path, bool is_dir) const;
+
+    const std::string& dir() const { return dir_; }
+    const std::shared_ptr<const IgnoreRules>& parent() const {
+        return parent_;
+    }
+
+   private:
+    struct Rule {
+        std::string pattern;
+        bool negated = false;
+        bool dir_only = false;
+        bool anchored = false;
+    };
+
+    std::string dir_;
+    std::vector<Rule> rules_;
+    std::shared_ptr<const IgnoreRules> parent_;
+};
+
+// Walk a directory tree on a pool of threads. Directories are read in
+// parallel and every regular file which is not ignored is handed to
+// on_file on one of the threads. Symlinks are not followed and ".git" is
+// always skipped.
+class ParallelWalker {
+   public:
+    // worker is the index of the thread, in [0, thread_cnt).
+    // path is root + the relative path of the file.
+    using FileHandler =
+        std::function<void(size_t worker, const std::string& path)>;
+    // path is root + the relative path of the directory, with a slash at the
+    // end. rules are the ignore rules applied to its entries.
+    using DirHandler =
+        std::function<void(const std::string& path,
+                           const std::shared_ptr<const IgnoreRules>& rules)>;
+
+    // root should end with a slash or be empty(cwd).
+    // on_done will be called once on a worker thread when all files have been
+    // handed out and handled, unless it's stopped.
+    // on_dir is optional, called on a worker thread for every directory
+    // walked.
+    ParallelWalker(const std::string& root, size_t thread_cnt,
+                   const FileHandler& on_file,
+                   const std::function<void()>& on_done,
+                   const DirHandler& on_dir = nullptr);
+    // Only walk the tree of dir(relative to root, with a slash at the end),
+    // parent_rules are the ignore rules applied to the entries of its parent.
+    ParallelWalker(const std::string& root, const std::string& dir,
+                   const std::shared_ptr<const IgnoreRules>& parent_rules,
+                   size_t thread_cnt, const FileHandler& on_file,
+                   const std::function<void()>& on_done,
+                   const DirHandler& on_dir = nullptr);
+    // Hand out the files(relative to root) instead of walking the tree.
+    // files should not be empty.
+    ParallelWalker(const std::string& root,
+                   const std::vector<std::string>& files, size_t thread_cnt,
+                   const FileHandler& on_file,
+                   const std::function<void()>& on_done);
+    // Stop and join all threads.
+    ~ParallelWalker();
+    MGO_DELETE_COPY(ParallelWalker);
+    MGO_DELETE_MOVE(ParallelWalker);
+
+    // Pending files will be dropped, threads exit after their current job.
+    void Stop();
+    bool Stopped() const { return stop_.load(std::memory_order_relaxed); }
+
+    size_t thread_cnt() const { return threads_.size(); }
+
+   private:
+    struct Job {
+        std::string path;  // relative to root_
+        std::shared_ptr<const IgnoreRules> rules;  // null for files
+    };
+
+    void StartThreads(size_t thread_cnt);
+    void Work(size_t worker);
+    void ReadDir(Job& job);
+
+    std::string root_;
+    FileHandler on_file_;
+    std::function<void()> on_done_;
+    DirHandler on_dir_;
+
+    std::mutex mtx_;
+    std::condition_variable cv_;
+    std::vector<Job> jobs_;  // used as a stack, for depth first order
+    size_t pending_ = 0;     // queued and running jobs
+    std::atomic<bool> stop_ = false;
+
+    std::vector<std::thread> threads_;
+};
+
+}  // namespace mango
@@ -31,6 +31,28 @@ void Window::CursorGoLine(size_t line) {
     }
 }
 
+void Window::CursorGoPos(Pos pos) {
+    area_.b_view_->make_cursor_visible = true;
+    Buffer* buffer = area_.buffer_;
+    pos.line = std::min(pos.line, buffer->LineCnt() - 1);
+    std::string_view line_str = buffer->GetLine(pos.line);
+    // Must be a character beginning.
+    if (pos.byte_offset > line_str.size() ||
+        (pos.byte_offset < line_str.size() &&
+         (line_str[pos.byte_offset] & 0xC0) == 0x80) ||
+        !CharacterBoundaryValid(line_str, pos.byte_offset)) {
+        pos.byte_offset = 0;
+    }
+    CursorState state(cursor_);
+    state.pos = pos;
+    state.DontHoldColWant();
+    if (FarEnoughWithCursor(state)) {
+        SetJumpPoint();
+    }
+    state.SetCursor(cursor_);
+    area_.SelectionFollowCursor();
+}
+
 Result Window::DeleteAtCursor() {
     if (area_.IsSelectionActive()) {
         return area_.DeleteSelection();
@@ -149,8 +171,9 @@ Result Window::NewLineUnderCursorline() {
         {cursor_->pos.line, area_.buffer_->GetLine(cursor_->pos.line).size()});
 }
 
-Result Window::Replace(const Range& range, std::string_view str) {
-    return area_.Replace(range, str);
+Result Window::Replace(const Range& range, std::string_view str,
+                       const Pos* cursor_pos) {
+    return area_.Replace(range, str, cursor_pos);
 }
 
 Result Window::TryAutoPair(std::string_view str) {
@@ -207,20 +230,16 @@ Result Window::TryAutoIndent(Pos pos) {
     MGO_ASSERT(!area_.IsSelectionActive());
 
     const auto& line = area_.buffer_->GetLine(pos.line);
-    std::string indent = "";
-    size_t cur_indent = 0;
     // Same as this line's indent
-    size_t i = 0;
+    std::string indent(
+        line.substr(0, area_.buffer_->GetLineInfo(pos.line).indent_end));
+    size_t cur_indent = 0;
     auto tabstop = GetOpt<int64_t>(kOptTabStop);
-    for (; i < line.size(); i++) {
-        if (line[i] == kSpaceChar) {
+    for (char c : indent) {
+        if (c == kSpaceChar) {
             cur_indent++;
-            indent.push_back(kSpaceChar);
-        } else if (line[i] == '\t') {
-            cur_indent = (cur_indent / tabstop + 1) * tabstop;
-            indent.push_back('\t');
         } else {
-            break;
+            cur_indent = (cur_indent / tabstop + 1) * tabstop;
         }
     }
 
@@ -16,10 +16,12 @@ class Window {
 
     int id() { return id_; }
 
-    void Draw(bool highlight_search) {
-        area_.Draw(highlight_search && GetOpt<bool>(kOptHighlightOnSearch)
-                       ? &b_search_context_
-                       : nullptr);
+    // Return true if the window is repainted.
+    bool Draw(bool highlight_search) {
+        return area_.Draw(
+            highlight_search && GetOpt<bool>(kOptHighlightOnSearch)
+                ? &b_search_context_
+                : nullptr);
     }
 
     void MakeCursorVisible() { area_.MakeCursorVisible(); }
@@ -46,6 +48,8 @@ class Window {
         area_.CursorGoNextWordBegin(count);
     }
     void CursorGoLine(size_t line);
+    // pos will be clamped if it is out of the buffer.
+    void CursorGoPos(Pos pos);
 
     void SelectAll() { area_.SelectAll(); }
 
@@ -59,7 +63,8 @@ class Window {
     Result NewLineAboveCursorline();
     Result NewLineUnderCursorline();
     // See Frame::Replace
-    Result Replace(const Range& range, std::string_view str);
+    Result Replace(const Range& range, std::string_view str,
+                   const Pos* cursor_pos = nullptr);
     Result TabAtCursor() { return area_.TabAtCursor(); }
     Result Redo() { return area_.Redo(); }
     Result Undo() { return area_.Undo(); }
@@ -80,7 +85,9 @@ class Window {
 
     // Search relevant
     void BuildSearchContext(const std::string& pattern) {
-        b_search_context_ = BufferSearchContext{pattern, area_.buffer_};
+        if (!b_search_context_.TryRefine(pattern, area_.buffer_)) {
+            b_search_context_ = BufferSearchContext{pattern, area_.buffer_};
+        }
     }
     void DestorySearchContext() { b_search_context_.Destroy(); }
     const std::string& GetSearchPattern() {
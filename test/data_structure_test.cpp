@@ -1,4 +1,10 @@
+#include <algorithm>
+#include <cmath>
+#include <random>
+
 #include "catch2/catch_test_macros.hpp"
+#include "latency.h"
+#include "prefix_sum_tree.h"
 #include "trie.h"
 
 using namespace mango;
@@ -25,4 +31,107 @@ TEST_CASE("trie tree") {
     REQUIRE(trie.PrefixWith("i").size() == 1);
     trie.Delete("int64_t");
     REQUIRE(trie.PrefixWith("i").size() == 0);
-}
\ No newline at end of file
+}
+
+TEST_CASE("prefix sum tree") {
+    PrefixSumTree tree;
+    std::vector<size_t> values;
+    std::mt19937 rng(0);
+
+    auto check = [&tree, &values] {
+        REQUIRE(tree.size() == values.size());
+        size_t sum = 0;
+        for (size_t i = 0; i < values.size(); i++) {
+            REQUIRE(tree.Get(i) == values[i]);
+            REQUIRE(tree.PrefixSum(i) == sum);
+            for (size_t j = 0; j < values[i]; j++) {
+                size_t rest;
+                REQUIRE(tree.Find(sum + j, rest) == i);
+                REQUIRE(rest == j);
+            }
+            sum += values[i];
+        }
+        REQUIRE(tree.PrefixSum(values.size()) == sum);
+        REQUIRE(tree.Sum() == sum);
+    };
+
+    check();
+    for (int round = 0; round < 300; round++) {
+        size_t op = rng() % 3;
+        if (op == 0 || values.empty()) {
+            size_t i = rng() % (values.size() + 1);
+            std::vector<size_t> inserted(rng() % 20);
+            for (size_t& v : inserted) {
+                v = 1 + rng() % 4;
+            }
+            tree.Insert(i, inserted);
+            values.insert(values.begin() + i, inserted.begin(),
+                          inserted.end());
+        } else if (op == 1) {
+            size_t i = rng() % values.size();
+            size_t cnt = rng() % (values.size() - i + 1);
+            tree.Erase(i, cnt);
+            values.erase(values.begin() + i, values.begin() + i + cnt);
+        } else {
+            size_t i = rng() % values.size();
+            values[i] = 1 + rng() % 4;
+            tree.Set(i, values[i]);
+        }
+        check();
+    }
+
+    tree.Clear();
+    values.clear();
+    check();
+}
+
+TEST_CASE("latency histogram") {
+    LatencyHistogram histogram;
+    REQUIRE(histogram.Count() == 0);
+    REQUIRE(histogram.Percentile(50) == 0);
+
+    // Small values are exact.
+    for (uint64_t v = 0; v < 32; v++) {
+        histogram.Record(v);
+    }
+    REQUIRE(histogram.Count() == 32);
+    REQUIRE(histogram.Percentile(50) == 15);
+    REQUIRE(histogram.Percentile(100) == 31);
+    REQUIRE(histogram.Max() == 31);
+
+    histogram.Clear();
+    REQUIRE(histogram.Count() == 0);
+    REQUIRE(histogram.Max() == 0);
+
+    std::mt19937_64 rng(42);
+    std::vector<uint64_t> values;
+    for (int i = 0; i < 10000; i++) {
+        // Spread over all magnitudes.
+        uint64_t v = rng() >> (rng() % 64);
+        values.push_back(v);
+        histogram.Record(v);
+    }
+    std::sort(values.begin(), values.end());
+    REQUIRE(histogram.Max() == values.back());
+    REQUIRE(histogram.Percentile(100) == values.back());
+    for (double p : {0.1, 1.0, 25.0, 50.0, 90.0, 99.0, 99.9}) {
+        uint64_t exact =
+            values[static_cast<size_t>(std::ceil(p / 100 * values.size())) -
+                   1];
+        uint64_t res = histogram.Percentile(p);
+        REQUIRE(res >= exact);
+        REQUIRE(res - exact <= exact / 16);
+    }
+
+    size_t bucket_cnt = 0;
+    uint64_t total = 0;
+    uint64_t last = 0;
+    histogram.ForEachBucket([&](uint64_t value, uint64_t count) {
+        REQUIRE((bucket_cnt == 0 || value > last));
+        last = value;
+        total += count;
+        bucket_cnt++;
+    });
+    REQUIRE(total == values.size());
+    REQUIRE(last == values.back());
+}
@@ -0,0 +1,380 @@
+#include "draw.h"
+
+#include <fcntl.h>
+#include <stdlib.h>
+#include <sys/ioctl.h>
+#include <unistd.h>
+
+#include <limits>
+#include <random>
+
+#include "catch2/benchmark/catch_benchmark.hpp"
+#include "catch2/catch_test_macros.hpp"
+#include "latency.h"
+
+using namespace mango;
+
+static Terminal::AttrPair MakeAttr(Terminal::Attr fg, Terminal::Attr bg,
+                                   bool fg_exist, bool bg_exist) {
+    Terminal::AttrPair attr;
+    attr.fg = fg;
+    attr.bg = bg;
+    attr.fg_exist = fg_exist;
+    attr.bg_exist = bg_exist;
+    return attr;
+}
+
+// Some types only have fg or bg, so layers are merged.
+static std::vector<Terminal::AttrPair> MakeScheme() {
+    std::vector<Terminal::AttrPair> scheme(__kColorSchemeTypeCount);
+    for (int i = 0; i < __kColorSchemeTypeCount; i++) {
+        scheme[i] = MakeAttr(i + 1, i + 101, i % 3 != 1, i % 3 != 2);
+    }
+    scheme[kNormal] = MakeAttr(1, 101, true, true);
+    return scheme;
+}
+
+// Sorted and non-overlapping highlights in lines [0, line_cnt).
+static std::vector<Highlight> RandomHighlights(std::mt19937& rng,
+                                               size_t line_cnt,
+                                               size_t line_size) {
+    std::vector<Highlight> res;
+    Pos pos = {0, 0};
+    while (true) {
+        pos.byte_offset += rng() % 8;
+        if (pos.byte_offset > line_size) {
+            pos.line++;
+            pos.byte_offset = rng() % 4;
+        }
+        if (pos.line >= line_cnt) {
+            return res;
+        }
+        Pos end = pos;
+        end.byte_offset += 1 + rng() % 8;
+        if (end.byte_offset > line_size) {
+            end.line += rng() % 2;
+            end.byte_offset = rng() % (line_size + 1);
+            if (end.line == pos.line || end.line >= line_cnt) {
+                end = {pos.line, line_size};
+            }
+        }
+        if (!(pos < end)) {
+            continue;
+        }
+        res.push_back({{pos, end},
+                       static_cast<ColorSchemeType>(
+                           1 + rng() % (__kColorSchemeTypeCount - 1))});
+        pos = end;
+    }
+}
+
+TEST_CASE("resolve attr runs") {
+    std::mt19937 rng(42);
+    std::vector<Terminal::AttrPair> scheme = MakeScheme();
+    const size_t kLineCnt = 4;
+    const size_t kLineSize = 60;
+
+    std::vector<AttrRun> runs;
+    for (int round = 0; round < 200; round++) {
+        std::vector<std::vector<Highlight>> layers(1 + rng() % 4);
+        for (auto& layer : layers) {
+            layer = RandomHighlights(rng, kLineCnt, kLineSize);
+        }
+        std::vector<const std::vector<Highlight>*> highlights;
+        for (const auto& layer : layers) {
+            highlights.push_back(&layer);
+        }
+
+        for (size_t line = 0; line < kLineCnt; line++) {
+            ResolveAttrRuns(line, 0, kLineSize, &highlights, scheme.data(),
+                            kNormal, runs);
+            REQUIRE(!runs.empty());
+            REQUIRE(runs.front().begin == 0);
+            REQUIRE(runs.back().end == kLineSize);
+            for (size_t i = 0; i < runs.size(); i++) {
+                REQUIRE(runs[i].begin < runs[i].end);
+                if (i > 0) {
+                    REQUIRE(runs[i].begin == runs[i - 1].end);
+                    REQUIRE((runs[i].attr.fg != runs[i - 1].attr.fg ||
+                             runs[i].attr.bg != runs[i - 1].attr.bg));
+                }
+            }
+
+            // Compare with looking up every layer for every byte.
+            auto run = runs.begin();
+            for (size_t b = 0; b < kLineSize; b++) {
+                Terminal::AttrPair attr = MakeAttr(0, 0, false, false);
+                for (const auto& layer : layers) {
+                    for (const Highlight& hl : layer) {
+                        if (!hl.range.PosInMe({line, b})) {
+                            continue;
+                        }
+                        const Terminal::AttrPair& this_attr =
+                            scheme[hl.hl_type];
+                        if (!attr.fg_exist && this_attr.fg_exist) {
+                            attr.fg = this_attr.fg;
+                            attr.fg_exist = true;
+                        }
+                        if (!attr.bg_exist && this_attr.bg_exist) {
+                            attr.bg = this_attr.bg;
+                            attr.bg_exist = true;
+                        }
+                    }
+                }
+                if (!attr.fg_exist) {
+                    attr.fg = scheme[kNormal].fg;
+                }
+                if (!attr.bg_exist) {
+                    attr.bg = scheme[kNormal].bg;
+                }
+                if (run->end == b) {
+                    run++;
+                }
+                REQUIRE(run->attr.fg == attr.fg);
+                REQUIRE(run->attr.bg == attr.bg);
+            }
+        }
+    }
+
+    ResolveAttrRuns(0, 0, 0, nullptr, scheme.data(), kNormal, runs);
+    REQUIRE(runs.empty());
+    ResolveAttrRuns(0, 0, 10, nullptr, scheme.data(), kNormal, runs);
+    REQUIRE(runs.size() == 1);
+    REQUIRE((runs[0].begin == 0 && runs[0].end == 10));
+}
+
+TEST_CASE("column index") {
+    std::mt19937 rng(42);
+    const int kTabstop = 4;
+    const char* pieces[] = {"a", "bc", "\t", "\xe4\xb8\xad", "\xc3\xa9"};
+    std::string line;
+    while (line.size() < 3 * kColumnIndexMinLineSize) {
+        line += pieces[rng() % 5];
+    }
+
+    ColumnIndex index;
+    BuildColumnIndex(line, kTabstop, index);
+    REQUIRE(index.checkpoints.size() > 1);
+    REQUIRE(index.checkpoints.front().byte_offset == 0);
+    for (const ColumnIndex::Checkpoint& checkpoint : index.checkpoints) {
+        REQUIRE(checkpoint.view_col % kTabstop == 0);
+        size_t view_col;
+        size_t character_cnt;
+        size_t target_byte_offset = checkpoint.byte_offset;
+        ArrangeLine(line, 0, 0, std::numeric_limits<size_t>::max(), kTabstop,
+                    false, &view_col, &target_byte_offset, nullptr,
+                    &character_cnt);
+        REQUIRE(view_col == checkpoint.view_col);
+        REQUIRE(character_cnt == checkpoint.character_cnt);
+    }
+
+    // Arranging from a checkpoint is the same as from the line begin.
+    for (int i = 0; i < 100; i++) {
+        size_t view_col = rng() % (line.size() * 2);
+        const ColumnIndex::Checkpoint& checkpoint =
+            index.BeforeViewCol(view_col);
+        REQUIRE(checkpoint.view_col <= view_col);
+        REQUIRE(ArrangeLine(line, checkpoint.byte_offset, 0,
+                            view_col - checkpoint.view_col, kTabstop,
+                            false) ==
+                ArrangeLine(line, 0, 0, view_col, kTabstop, false));
+
+        size_t byte_offset = rng() % (line.size() + 1);
+        REQUIRE(index.BeforeByteOffset(byte_offset).byte_offset <=
+                byte_offset);
+    }
+
+    BuildColumnIndex("a\tb", kTabstop, index);
+    REQUIRE(index.checkpoints.size() == 1);
+}
+
+TEST_CASE("draw line") {
+    std::vector<Terminal::AttrPair> scheme = MakeScheme();
+    std::vector<AttrRun> runs;
+    Terminal::RowCells cells;
+    auto draw = [&](std::string_view line, size_t byte_offset,
+                    size_t begin_view_col, size_t width, bool wrap) {
+        ResolveAttrRuns(0, 0, line.size(), nullptr, scheme.data(), kNormal,
+                        runs);
+        cells.Clear();
+        return DrawLine(line, {0, byte_offset}, begin_view_col, width, runs,
+                        line.size(), 4, wrap, cells);
+    };
+
+    REQUIRE(draw("abcdef", 0, 0, 4, false) == 4);
+    REQUIRE(cells.Width() == 4);
+    // A cell is left for the cursor when wrap.
+    REQUIRE(draw("abcd", 0, 0, 4, true) == 3);
+    REQUIRE(cells.Width() == 3);
+    REQUIRE(draw("abcd", 0, 0, 4, false) == 4);
+    REQUIRE(cells.Width() == 4);
+    // A wide character doesn't fit.
+    REQUIRE(draw("abc\xe4\xb8\xad", 0, 0, 4, false) == 3);
+    REQUIRE(cells.Width() == 3);
+    REQUIRE(draw("\xe4\xb8\xad\xe4\xb8\xad", 3, 0, 4, false) == 6);
+    REQUIRE(cells.Width() == 2);
+    // Skip to begin_view_col, the part of a tab after it is blank.
+    REQUIRE(draw("\tab", 0, 2, 10, false) == 3);
+    REQUIRE(cells.Width() == 4);
+    REQUIRE(draw("abcdef", 0, 4, 10, false) == 6);
+    REQUIRE(cells.Width() == 2);
+    REQUIRE(draw("ab", 0, 4, 10, false) == 2);
+    REQUIRE(cells.Width() == 0);
+}
+
+// Run with: test "[benchmark]"
+// termbox2 only draws after init, so it's inited on a pseudo terminal.
+// Init termbox2 on a new pty, master and slave should be closed after
+// tb_shutdown.
+static void InitPtyTerminal(unsigned short width, unsigned short height,
+                            int& master, int& slave) {
+    master = posix_openpt(O_RDWR | O_NOCTTY);
+    REQUIRE(master != -1);
+    REQUIRE(grantpt(master) == 0);
+    REQUIRE(unlockpt(master) == 0);
+    slave = open(ptsname(master), O_RDWR | O_NOCTTY);
+    REQUIRE(slave != -1);
+    struct winsize ws = {};
+    ws.ws_col = width;
+    ws.ws_row = height;
+    REQUIRE(ioctl(master, TIOCSWINSZ, &ws) == 0);
+    setenv("TERM", "xterm-256color", 0);
+    REQUIRE(tb_init_rwfd(slave, slave) == TB_OK);
+}
+
+TEST_CASE("blit row") {
+    int master, slave;
+    InitPtyTerminal(20, 5, master, slave);
+    Terminal& term = Terminal::GetInstance();
+    Terminal::AttrPair attr = MakeScheme()[kNormal];
+
+    Terminal::RowCells cells;
+    cells.Push('a', attr);
+    Codepoint egc[] = {'e', 0x301};
+    cells.Push(egc, 2, 1, attr);
+    Codepoint wide = 0x4e2d;
+    cells.Push(&wide, 1, 2, attr);
+    cells.PushSpaces(2, attr);
+    REQUIRE(term.BlitRow(3, 1, cells) == kOk);
+    tb_cell* back;
+    REQUIRE(tb_get_cell(3, 1, 1, &back) == TB_OK);
+    REQUIRE((back[0].ch == 'a' && back[0].nech == 1));
+    REQUIRE((back[1].ch == 'e' && back[1].nech == 2 &&
+             back[1].ech[1] == 0x301));
+    REQUIRE((back[2].ch == 0x4e2d && back[2].nech == 1));
+    REQUIRE((back[4].ch == ' ' && back[5].ch == ' '));
+    REQUIRE((back[5].fg == attr.fg && back[5].bg == attr.bg));
+    // Out of the row.
+    REQUIRE(term.BlitRow(15, 1, cells) == kError);
+    REQUIRE(term.BlitRow(0, 5, cells) == kError);
+
+    term.ClearCells(2, 1, 3, attr);
+    REQUIRE((back[-1].ch == ' ' && back[1].ch == ' '));
+    REQUIRE((back[1].nech == 1 && back[2].ch == 0x4e2d));
+    REQUIRE_THROWS_AS(term.ClearCells(1, 1, 20, attr), TermException);
+
+    tb_shutdown();
+    close(slave);
+    close(master);
+}
+
+TEST_CASE("eat repeated events") {
+    int master, slave;
+    InitPtyTerminal(20, 5, master, slave);
+    Terminal& term = Terminal::GetInstance();
+    std::string input = "jjjkk";
+    REQUIRE(write(master, input.data(), input.size()) ==
+            static_cast<ssize_t>(input.size()));
+
+    REQUIRE(term.Poll(1000));
+    REQUIRE(term.EventKeyInfo().codepoint == 'j');
+    auto time = term.EventTime();
+    REQUIRE(term.EatRepeatedEvents() == 2);
+    // The current event is kept, the first different one is pending.
+    REQUIRE(term.EventKeyInfo().codepoint == 'j');
+    REQUIRE(term.EventTime() == time);
+    REQUIRE(term.Poll(0));
+    REQUIRE(term.EventKeyInfo().codepoint == 'k');
+    REQUIRE(term.EatRepeatedEvents() == 1);
+    REQUIRE_FALSE(term.Poll(0));
+
+    tb_shutdown();
+    close(slave);
+    close(master);
+}
+
+TEST_CASE("frame pacing") {
+    using namespace std::chrono_literals;
+    FramePacer pacer;
+    auto now = FramePacer::Clock::now();
+    auto interval = std::chrono::microseconds(1000000 / 60);
+
+    // Frames for other wakeups are paced.
+    pacer.FrameDrawn(now);
+    REQUIRE(pacer.Wait(now + 1ms, 60) == interval - 1ms);
+    REQUIRE(pacer.Wait(now + 1ms, 0) == 0s);
+    // But a lone input after them is drawn at once.
+    pacer.InputHandled();
+    REQUIRE(pacer.Wait(now + 1ms, 60) == 0s);
+    pacer.FrameDrawn(now + 1ms);
+
+    // More input in a frame interval is a burst.
+    pacer.InputHandled();
+    REQUIRE(pacer.Wait(now + 2ms, 60) == interval - 1ms);
+    REQUIRE(pacer.Wait(now + 1ms + interval, 60) == 0s);
+    pacer.FrameDrawn(now + 1ms + interval);
+    // The wakeup of a frame for input is paced too.
+    REQUIRE(pacer.Wait(now + 2ms + interval, 60) == interval - 1ms);
+}
+
+TEST_CASE("draw line benchmark", "[.][benchmark]") {
+    const size_t kWidth = 200;
+    const size_t kLineCnt = 50;
+    const size_t kLineSize = 2000;
+
+    int master, slave;
+    InitPtyTerminal(kWidth, kLineCnt, master, slave);
+
+    std::mt19937 rng(42);
+    std::vector<Terminal::AttrPair> scheme = MakeScheme();
+    std::vector<std::string> lines(kLineCnt);
+    for (std::string& line : lines) {
+        for (size_t i = 0; i < kLineSize; i++) {
+            line.push_back(i % 7 == 0 ? ' ' : 'a' + rng() % 26);
+        }
+    }
+    // Search, selection and syntax like layers, syntax highlights nearly
+    // every word.
+    std::vector<std::vector<Highlight>> layers = {
+        RandomHighlights(rng, kLineCnt, kLineSize),
+        {{{{0, 10}, {kLineCnt - 1, 10}}, kSelection}},
+        RandomHighlights(rng, kLineCnt, kLineSize)};
+    std::vector<const std::vector<Highlight>*> highlights;
+    for (const auto& layer : layers) {
+        highlights.push_back(&layer);
+    }
+
+    Terminal& term = Terminal::GetInstance();
+    std::vector<AttrRun> runs;
+    Terminal::RowCells cells;
+    BENCHMARK("DrawLine wrapped") {
+        size_t row = 0;
+        for (size_t line = 0; line < kLineCnt; line++) {
+            ResolveAttrRuns(line, 0, kLineSize, &highlights, scheme.data(),
+                            kNormal, runs);
+            size_t byte_offset = 0;
+            while (byte_offset < kLineSize) {
+                cells.Clear();
+                byte_offset = DrawLine(lines[line], {line, byte_offset}, 0,
+                                       kWidth, runs, kLineSize, 4, true, cells);
+                REQUIRE(term.BlitRow(0, row, cells) == kOk);
+                row = (row + 1) % kLineCnt;
+            }
+        }
+        return row;
+    };
+
+    tb_shutdown();
+    close(slave);
+    close(master);
+}
@@ -0,0 +1,157 @@
+#include "grep.h"
+
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <cstdio>
+#include <future>
+#include <gsl/util>
+
+#include "catch2/catch_test_macros.hpp"
+#include "walker.h"
+
+using namespace mango;
+
+static void WriteFile(const std::string& path, const std::string& contents) {
+    FILE* f = fopen(path.c_str(), "w");
+    REQUIRE(f != nullptr);
+    fwrite(contents.data(), 1, contents.size(), f);
+    fclose(f);
+}
+
+TEST_CASE("glob match") {
+    REQUIRE(GlobMatch("*.o", "a.o"));
+    REQUIRE_FALSE(GlobMatch("*.o", "a.oo"));
+    REQUIRE_FALSE(GlobMatch("*.o", "dir/a.o"));
+    REQUIRE(GlobMatch("a?c", "abc"));
+    REQUIRE(GlobMatch("[a-c]x", "bx"));
+    REQUIRE_FALSE(GlobMatch("[!a-c]x", "bx"));
+    REQUIRE(GlobMatch("**/build", "build"));
+    REQUIRE(GlobMatch("**/build", "a/b/build"));
+    REQUIRE(GlobMatch("a/**/b", "a/b"));
+    REQUIRE(GlobMatch("a/**/b", "a/x/y/b"));
+    REQUIRE(GlobMatch("a/**", "a/x/y"));
+    REQUIRE(GlobMatch("\\*", "*"));
+}
+
+TEST_CASE("ignore rules") {
+    auto root = std::make_shared<IgnoreRules>("", nullptr);
+    root->AddRules(
+        "# comment\n"
+        "*.log\n"
+        "!keep.log\n"
+        "build/\n"
+        "/top\n"
+        "doc/*.md\n");
+    REQUIRE(root->Ignored("a.log", false));
+    REQUIRE(root->Ignored("x/y/a.log", false));
+    REQUIRE_FALSE(root->Ignored("keep.log", false));
+    REQUIRE(root->Ignored("x/build", true));
+    REQUIRE_FALSE(root->Ignored("x/build", false));
+    REQUIRE(root->Ignored("top", false));
+    REQUIRE_FALSE(root->Ignored("x/top", false));
+    REQUIRE(root->Ignored("doc/a.md", false));
+    REQUIRE_FALSE(root->Ignored("x/doc/a.md", false));
+
+    IgnoreRules child("x/", root);
+    child.AddRules("!*.log\n");
+    REQUIRE_FALSE(child.Ignored("x/a.log", false));
+    REQUIRE(child.Ignored("x/build", true));
+}
+
+TEST_CASE("parallel walker") {
+    char tmpl[] = "/tmp/mango_walker_XXXXXX";
+    REQUIRE(mkdtemp(tmpl) != nullptr);
+    std::string root = std::string(tmpl) + "/";
+    auto _ = gsl::finally([&root] {
+        std::string cmd = "rm -rf " + root;
+        int rc = system(cmd.c_str());
+        (void)rc;
+    });
+
+    mkdir((root + "src").c_str(), 0755);
+    mkdir((root + "src/gen").c_str(), 0755);
+    mkdir((root + "build").c_str(), 0755);
+    mkdir((root + ".git").c_str(), 0755);
+    WriteFile(root + ".gitignore", "build/\n*.o\n");
+    WriteFile(root + "src/.ignore", "gen/\n");
+    WriteFile(root + "a.cpp", "");
+    WriteFile(root + "a.o", "");
+    WriteFile(root + "src/b.cpp", "");
+    WriteFile(root + "src/gen/c.cpp", "");
+    WriteFile(root + "build/d.cpp", "");
+    WriteFile(root + ".git/config", "");
+
+    std::mutex mtx;
+    std::vector<std::string> files;
+    size_t max_worker = 0;
+    std::promise<void> done;
+    ParallelWalker walker(
+        root, 4,
+        [&](size_t worker, const std::string& path) {
+            std::lock_guard<std::mutex> lk(mtx);
+            max_worker = std::max(max_worker, worker);
+            files.push_back(path.substr(root.size()));
+        },
+        [&] { done.set_value(); });
+    done.get_future().wait();
+
+    REQUIRE(max_worker < walker.thread_cnt());
+    std::sort(files.begin(), files.end());
+    REQUIRE(files == std::vector<std::string>{".gitignore", "a.cpp",
+                                              "src/.ignore", "src/b.cpp"});
+}
+
+TEST_CASE("grep contents") {
+    Regex regex("fo+", kRegexMultiLine);
+    std::vector<std::pair<size_t, size_t>> res;
+    auto on_match = [&res](size_t line, size_t byte_offset,
+                           std::string_view line_str) {
+        (void)line_str;
+        res.push_back({line, byte_offset});
+        return true;
+    };
+
+    REQUIRE(GrepContents("a\nxfoo foo\n\nfo\r\nbar", regex, on_match));
+    REQUIRE(res == std::vector<std::pair<size_t, size_t>>{{1, 1}, {3, 0}});
+
+    // Many chunks
+    res.clear();
+    std::string contents;
+    for (int i = 0; i < 100000; i++) {
+        contents += i % 30000 == 29999 ? "foo\n" : "bar baz\n";
+    }
+    REQUIRE(GrepContents(contents, regex, on_match));
+    REQUIRE(res == std::vector<std::pair<size_t, size_t>>{
+                       {29999, 0}, {59999, 0}, {89999, 0}});
+
+    res.clear();
+    REQUIRE_FALSE(GrepContents(std::string("foo\0", 4), regex, on_match));
+    REQUIRE(res.empty());
+
+    // Matches before invalid utf-8 are already reported, Grep drops them.
+    res.clear();
+    REQUIRE_FALSE(GrepContents("foo\nfoo\xff\n", regex, on_match));
+    REQUIRE(res == std::vector<std::pair<size_t, size_t>>{{0, 0}});
+
+    // '$' matches before CRLF eols, like it does per line.
+    Regex eol("foo$", kRegexMultiLine | kRegexCRLF);
+    res.clear();
+    REQUIRE(GrepContents("xfoo\r\nfoox\r\nfoo\r", eol, on_match));
+    REQUIRE(res == std::vector<std::pair<size_t, size_t>>{{0, 1}, {2, 0}});
+
+    // Empty matches count.
+    Regex empty("^$", kRegexMultiLine | kRegexCRLF);
+    res.clear();
+    REQUIRE(GrepContents("a\n\nb\r\n\r\nc\n", empty, on_match));
+    REQUIRE(res == std::vector<std::pair<size_t, size_t>>{{1, 0}, {3, 0}});
+
+    std::string path;
+    Pos pos;
+    GrepMatch match{"dir/a:b.cpp", 9, 3, "x: 1:2: y"};
+    REQUIRE(ParseGrepMatch(FormatGrepMatch(match), path, pos));
+    REQUIRE(path == "dir/a:b.cpp");
+    REQUIRE((pos.line == 9 && pos.byte_offset == 3));
+    REQUIRE_FALSE(ParseGrepMatch("no result here", path, pos));
+}
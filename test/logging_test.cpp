@@ -2,8 +2,14 @@
 
 #include <unistd.h>
 
+#include <map>
+#include <thread>
+
 #include "catch2/catch_test_macros.hpp"
+#include "file.h"
+#include "json.h"
 #include "sys/stat.h"
+#include "trace.h"
 
 using namespace mango;
 
@@ -17,4 +23,47 @@ TEST_CASE("logging test") {
     REQUIRE(my_stat.st_size == 125);
 
     fclose(logging_file);
-}
\ No newline at end of file
+}
+
+TEST_CASE("trace test") {
+    {
+        MGO_TRACE_SCOPE("before start");
+    }
+    TraceStart();
+    {
+        MGO_TRACE_SCOPE("outer");
+        MGO_TRACE_SCOPE("inner");
+    }
+    std::thread thread([] {
+        for (size_t i = 0; i < kTraceBufferCapacity + 10; i++) {
+            MGO_TRACE_SCOPE("thread");
+        }
+    });
+    thread.join();
+    TraceStop("trace_test.json");
+    {
+        MGO_TRACE_SCOPE("after stop");
+    }
+
+    Json trace = Json::parse(File("trace_test.json", "r", false).ReadAll());
+    std::map<std::string, size_t> cnt;
+    std::map<std::string, Json> last;
+    for (const Json& event : trace["traceEvents"]) {
+        REQUIRE(event["ph"] == "X");
+        REQUIRE(event["ts"].get<double>() >= 0);
+        REQUIRE(event["dur"].get<double>() >= 0);
+        cnt[event["name"]]++;
+        last[event["name"]] = event;
+    }
+    REQUIRE(cnt.size() == 3);
+    REQUIRE(cnt["outer"] == 1);
+    REQUIRE(cnt["inner"] == 1);
+    // Only the latest ones are kept.
+    REQUIRE(cnt["thread"] == kTraceBufferCapacity);
+    REQUIRE(last["thread"]["tid"] != last["outer"]["tid"]);
+    // inner is in outer.
+    double outer_ts = last["outer"]["ts"], inner_ts = last["inner"]["ts"];
+    REQUIRE(outer_ts <= inner_ts);
+    REQUIRE(inner_ts + last["inner"]["dur"].get<double>() <=
+            outer_ts + last["outer"]["dur"].get<double>() + 0.002);
+}
@@ -0,0 +1,217 @@
+#include "regex_engine.h"
+
+#include <string>
+
+#include "catch2/catch_test_macros.hpp"
+#include "exception.h"
+
+using namespace mango;
+
+static bool SearchOnce(const char* pattern, std::string_view str,
+                       RegexMatch& m, int flags = kRegexNone) {
+    Regex regex(pattern, flags);
+    return regex.Search(str, 0, m);
+}
+
+TEST_CASE("regex basic") {
+    RegexMatch m;
+    REQUIRE(SearchOnce("abc", "xxabcxx", m));
+    REQUIRE((m.begin == 2 && m.end == 5));
+    REQUIRE_FALSE(SearchOnce("abd", "xxabcxx", m));
+
+    // leftmost longest
+    REQUIRE(SearchOnce("a|ab|abc", "xabcd", m));
+    REQUIRE((m.begin == 1 && m.end == 4));
+    REQUIRE(SearchOnce("abcd|c", "abcd", m));
+    REQUIRE((m.begin == 0 && m.end == 4));
+    REQUIRE(SearchOnce("a*", "baaa", m));
+    REQUIRE((m.begin == 0 && m.end == 0));
+    REQUIRE(SearchOnce("a+", "baaa", m));
+    REQUIRE((m.begin == 1 && m.end == 4));
+
+    REQUIRE(SearchOnce("(ab){2,3}", "abababab", m));
+    REQUIRE((m.begin == 0 && m.end == 6));
+    REQUIRE(SearchOnce("x{2}", "xxxx", m));
+    REQUIRE((m.begin == 0 && m.end == 2));
+    REQUIRE(SearchOnce("colou?r", "my color", m));
+    REQUIRE((m.begin == 3 && m.end == 8));
+    REQUIRE(SearchOnce("x{,3}y", "xxxxy", m));
+    REQUIRE((m.begin == 1 && m.end == 5));
+    // '{' which is not a bound is a literal
+    REQUIRE(SearchOnce("a{b", "a{b", m));
+    REQUIRE((m.begin == 0 && m.end == 3));
+    REQUIRE(SearchOnce("a{,}", "a{,}", m));
+    REQUIRE((m.begin == 0 && m.end == 4));
+    // Escaped punctuations are literals.
+    REQUIRE(SearchOnce("\\.\\(\\{", "a.({", m));
+    REQUIRE((m.begin == 1 && m.end == 4));
+}
+
+TEST_CASE("regex anchors and classes") {
+    RegexMatch m;
+    REQUIRE(SearchOnce("^ab", "abab", m));
+    REQUIRE((m.begin == 0 && m.end == 2));
+    REQUIRE(SearchOnce("ab$", "abab", m));
+    REQUIRE((m.begin == 2 && m.end == 4));
+    REQUIRE_FALSE(SearchOnce("^b", "ab", m));
+
+    Regex regex("^b");
+    REQUIRE_FALSE(regex.Search("ab", 1, m));
+
+    REQUIRE(SearchOnce("[[:digit:]]+", "abc 123 d", m));
+    REQUIRE((m.begin == 4 && m.end == 7));
+    REQUIRE(SearchOnce("[^a-c ]+", "abc 123 d", m));
+    REQUIRE((m.begin == 4 && m.end == 7));
+    REQUIRE(SearchOnce("\\w+", "  foo_1 ", m));
+    REQUIRE((m.begin == 2 && m.end == 7));
+    REQUIRE(SearchOnce("[]x]+", "a]x]", m));
+    REQUIRE((m.begin == 1 && m.end == 4));
+    REQUIRE(SearchOnce("a\\.b", "axb a.b", m));
+    REQUIRE((m.begin == 4 && m.end == 7));
+}
+
+TEST_CASE("regex utf-8 and ignore case") {
+    RegexMatch m;
+    // "你好" is 6 bytes, '.' eats a codepoint instead of a byte.
+    REQUIRE(SearchOnce("你.a", "x你好a", m));
+    REQUIRE((m.begin == 1 && m.end == 8));
+    REQUIRE(SearchOnce("[你好]+", "ab你好你c", m));
+    REQUIRE((m.begin == 2 && m.end == 11));
+
+    REQUIRE(SearchOnce("hello", "Say HeLLo", m, kRegexIgnoreCase));
+    REQUIRE((m.begin == 4 && m.end == 9));
+    REQUIRE(SearchOnce("[a-c]+", "xxABCx", m, kRegexIgnoreCase));
+    REQUIRE((m.begin == 2 && m.end == 5));
+    REQUIRE_FALSE(SearchOnce("hello", "Say HeLLo", m));
+}
+
+TEST_CASE("regex multiline") {
+    RegexMatch m;
+    REQUIRE(SearchOnce("^b.*$", "a\nbc\nd", m, kRegexMultiLine));
+    REQUIRE((m.begin == 2 && m.end == 4));
+    REQUIRE(SearchOnce("c\nd", "a\nbc\nd", m, kRegexMultiLine));
+    REQUIRE((m.begin == 3 && m.end == 6));
+    REQUIRE_FALSE(SearchOnce("^b", "a\nb", m));
+}
+
+TEST_CASE("regex linear time") {
+    // Exponential for backtracking engines.
+    std::string str(5000, 'a');
+    Regex regex("(a*)*(a|aa)*b");
+    RegexMatch m;
+    REQUIRE_FALSE(regex.Search(str, 0, m));
+    REQUIRE_FALSE(regex.Test(str));
+    str.push_back('b');
+    REQUIRE(regex.Test(str));
+    REQUIRE(regex.Search(str, 0, m));
+    REQUIRE((m.begin == 0 && m.end == str.size()));
+
+    // Too many dfa states, fall back to nfa.
+    Regex big("[ab]*a[ab]{12}c");
+    std::string subject;
+    for (int i = 0; i < 3000; i++) {
+        subject.push_back(i * 7 % 3 ? 'a' : 'b');
+    }
+    REQUIRE_FALSE(big.Test(subject));
+    subject += "aaaaaaaaaaaaac";
+    REQUIRE(big.Search(subject, 0, m));
+    REQUIRE(m.end == subject.size());
+}
+
+TEST_CASE("regex compile error") {
+    REQUIRE_THROWS_AS(Regex("(ab"), RegexCompileException);
+    REQUIRE_THROWS_AS(Regex("[ab"), RegexCompileException);
+    REQUIRE_THROWS_AS(Regex("ab\\"), RegexCompileException);
+    REQUIRE_THROWS_AS(Regex("[z-a]"), RegexCompileException);
+    REQUIRE_THROWS_AS(Regex("[[:foo:]]"), RegexCompileException);
+    // Unsupported escapes are not taken as literals.
+    for (const char* pattern : {"(a)\\1", "\\x41", "\\y"}) {
+        REQUIRE_THROWS_AS(Regex(pattern), RegexCompileException);
+    }
+}
+
+TEST_CASE("regex crlf") {
+    RegexMatch m;
+    REQUIRE_FALSE(Regex("foo$", kRegexMultiLine).Test("foo\r\nbar"));
+    Regex crlf("foo$", kRegexMultiLine | kRegexCRLF);
+    REQUIRE(crlf.Test("foo\r\nbar"));
+    REQUIRE(crlf.Test("bar\r\nfoo\r"));
+    REQUIRE_FALSE(crlf.Test("foo\rbar"));
+    REQUIRE((crlf.Search("xfoo\r\n", 0, m) && m.begin == 1 && m.end == 4));
+    // The '\r' is still a char.
+    REQUIRE(Regex("o\r$", kRegexMultiLine | kRegexCRLF).Test("foo\r\n"));
+}
+
+TEST_CASE("regex word assertions") {
+    auto search = [](const char* pattern, std::string_view str) {
+        Regex regex(pattern);
+        RegexMatch m;
+        bool found = regex.Search(str, 0, m);
+        REQUIRE(found == regex.Test(str));
+        return found ? std::make_pair(m.begin, m.end)
+                     : std::make_pair(std::string_view::npos,
+                                      std::string_view::npos);
+    };
+    using P = std::pair<size_t, size_t>;
+    constexpr size_t npos = std::string_view::npos;
+    REQUIRE(search("\\<foo\\>", "foobar foo_ foo.") == P{12, 15});
+    REQUIRE(search("\\bfoo\\b", "afoo foo") == P{5, 8});
+    REQUIRE(search("\\Boo", "oo foo") == P{4, 6});
+    REQUIRE(search("o\\B", "foo") == P{1, 2});
+    REQUIRE(search("\\>", "  ab  ") == P{4, 4});
+    REQUIRE(search("\\<", "   ") == P{npos, npos});
+    REQUIRE(search("\\b", "") == P{npos, npos});
+    REQUIRE(search("\\B", "") == P{0, 0});
+    // Unicode letters are word chars.
+    REQUIRE(search("\\<\u4e2d", "a\u4e2d \u4e2d") == P{5, 8});
+    REQUIRE(search("\u00e9\\>", "\u00e9\u00e9x \u00e9\u00e9") ==
+            P{8, 10});
+    // Matches found only when the next codepoint is seen.
+    REQUIRE(search("(foo|bar)\\>", "foox bar+") == P{5, 8});
+    REQUIRE(search("^x\\b|y$", "xx y") == P{3, 4});
+
+    Regex multiline("\\<b", kRegexMultiLine);
+    REQUIRE(multiline.Test("a\nb"));
+    REQUIRE_FALSE(multiline.Test("ab"));
+    // The codepoint before offset counts.
+    RegexMatch m;
+    REQUIRE_FALSE(multiline.Search("ab", 1, m));
+    Regex end("a\\>", kRegexMultiLine);
+    REQUIRE(end.Test("ba\nb"));
+    REQUIRE_FALSE(end.Test("ab\nb"));
+}
+
+TEST_CASE("regex required literals") {
+    using Literals = std::vector<std::string>;
+    REQUIRE(Regex("foo").required_literals() == Literals{"foo"});
+    REQUIRE(Regex("^foo(bar)+x?baz$").required_literals() ==
+            Literals{"foobar", "baz"});
+    REQUIRE(Regex("foo.bar").required_literals() == Literals{"foo", "bar"});
+    REQUIRE(Regex("a|b").required_literals().empty());
+    REQUIRE(Regex("(ab)*").required_literals().empty());
+    REQUIRE(Regex("FOO", kRegexIgnoreCase).required_literals() ==
+            Literals{"foo"});
+}
+
+TEST_CASE("regex cache") {
+    RegexCache cache(2);
+    auto foo = cache.Get("foo", kRegexNone);
+    REQUIRE(cache.Get("foo", kRegexNone) == foo);
+    REQUIRE(cache.Get("foo", kRegexIgnoreCase) != foo);
+    REQUIRE((cache.hits() == 1 && cache.misses() == 2));
+
+    // "foo" is the least recently used one.
+    cache.Get("bar", kRegexNone);
+    REQUIRE(cache.size() == 2);
+    auto new_foo = cache.Get("foo", kRegexNone);
+    REQUIRE(new_foo != foo);
+    REQUIRE(foo->Test("foo"));  // still alive
+    REQUIRE((cache.hits() == 1 && cache.misses() == 4));
+
+    REQUIRE_THROWS_AS(cache.Get("(", kRegexNone), RegexCompileException);
+    REQUIRE(cache.Get("foo", kRegexNone) == new_foo);
+
+    cache.ResetCounters();
+    REQUIRE((cache.hits() == 0 && cache.misses() == 0));
+    REQUIRE(cache.size() == 2);
+}
@@ -0,0 +1,199 @@
+#include "search.h"
+
+#include <random>
+#include <string>
+#include <vector>
+
+#include "catch2/catch_test_macros.hpp"
+
+using namespace mango;
+
+static std::vector<Range> SearchAll(const std::vector<std::string>& lines,
+                                    Regex& regex) {
+    std::vector<Range> res;
+    SearchTextLines(
+        [&lines](size_t line) -> std::string_view { return lines[line]; },
+        lines.size(), regex, {0, 0}, lines.size(), res);
+    return res;
+}
+
+static void RequireSortedAndDisjoint(const std::vector<Range>& res) {
+    for (size_t i = 0; i < res.size(); i++) {
+        REQUIRE(res[i].begin < res[i].end);
+        if (i > 0) {
+            REQUIRE(!(res[i].begin < res[i - 1].end));
+        }
+    }
+}
+
+TEST_CASE("multi-line search window") {
+    std::vector<std::string> lines(600, "xx");
+    // Across the first window, which has 256 lines.
+    lines[255] = "xa";
+    lines[256] = "bx";
+    // Not at the line begin in a later window.
+    lines[300] = "xxfoo";
+    lines[301] = "barxx";
+
+    Regex regex("a\nb|foo\nbar", kRegexMultiLine);
+    std::vector<Range> res = SearchAll(lines, regex);
+    REQUIRE(res.size() == 2);
+    REQUIRE((res[0].begin == Pos{255, 1} && res[0].end == Pos{256, 1}));
+    REQUIRE((res[1].begin == Pos{300, 2} && res[1].end == Pos{301, 3}));
+}
+
+TEST_CASE("multi-line search span limit") {
+    Regex regex("s(.|\n)*e", kRegexMultiLine);
+    // The longest match is not taken when it spans too many lines, wherever
+    // the match is in a window.
+    for (size_t begin : {10, 250, 255, 256, 400}) {
+        std::vector<std::string> lines(600, "x");
+        lines[begin] = "s";
+        lines[begin + kMultiLineMatchMaxLines - 1] = "e";
+        lines[begin + kMultiLineMatchMaxLines] = "e";
+        std::vector<Range> res = SearchAll(lines, regex);
+        REQUIRE(res.size() == 1);
+        REQUIRE(res[0].begin == Pos{begin, 0});
+        REQUIRE(res[0].end == Pos{begin + kMultiLineMatchMaxLines - 1, 1});
+    }
+
+    // Nothing in the limit, a later match is found.
+    std::vector<std::string> lines(300, "x");
+    lines[10] = "s";
+    lines[10 + kMultiLineMatchMaxLines] = "se";
+    std::vector<Range> res = SearchAll(lines, regex);
+    REQUIRE(res.size() == 1);
+    REQUIRE(res[0].begin == Pos{10 + kMultiLineMatchMaxLines, 0});
+}
+
+TEST_CASE("lazy multi-line search") {
+    std::vector<std::string> lines(300, "x");
+    lines[99] = "a";
+    lines[100] = "b";
+    lines[101] = "c";
+    lines[102] = "d";
+    auto get_line = [&lines](size_t line) -> std::string_view {
+        return lines[line];
+    };
+
+    BufferSearchContext context;
+    context.regex = std::make_shared<Regex>("a\nb\nc|b\nc\nd", kRegexMultiLine);
+    context.line_cnt = lines.size();
+
+    // A slice from line 100 finds the match there, then searching the lines
+    // before finds a match running into it, which wins.
+    context.SearchLines(get_line, 100, 200);
+    REQUIRE(context.search_result.size() == 1);
+    REQUIRE(context.search_result[0].begin == Pos{100, 0});
+    context.current_search = 0;
+    context.SearchLines(get_line, 0, 100);
+    REQUIRE(context.search_result.size() == 1);
+    REQUIRE((context.search_result[0].begin == Pos{99, 0} &&
+             context.search_result[0].end == Pos{101, 1}));
+    REQUIRE(context.current_search == -1);
+    REQUIRE_FALSE(context.Complete());
+    context.SearchLines(get_line, 200, 300);
+    REQUIRE(context.Complete());
+    std::vector<Range> all = SearchAll(lines, *context.regex);
+    REQUIRE(context.search_result.size() == all.size());
+    for (size_t i = 0; i < all.size(); i++) {
+        REQUIRE((context.search_result[i].begin == all[i].begin &&
+                 context.search_result[i].end == all[i].end));
+    }
+
+    // Searching in any order, results are sorted and never overlap.
+    std::mt19937 rng(42);
+    const char* pieces[] = {"a", "b", "c", "d", "x"};
+    for (std::string& line : lines) {
+        line.clear();
+        for (int i = rng() % 4; i > 0; i--) {
+            line += pieces[rng() % 5];
+        }
+    }
+    for (int round = 0; round < 20; round++) {
+        context.search_result.clear();
+        context.searched_lines.clear();
+        while (!context.Complete()) {
+            size_t begin = rng() % lines.size();
+            context.SearchLines(get_line, begin, begin + 1 + rng() % 100);
+            RequireSortedAndDisjoint(context.search_result);
+        }
+    }
+}
+
+TEST_CASE("partial search state") {
+    std::vector<std::string> lines(300, "x");
+    lines[50] = "foo";
+    lines[150] = "foo";
+    lines[250] = "foo";
+    auto get_line = [&lines](size_t line) -> std::string_view {
+        return lines[line];
+    };
+
+    BufferSearchContext context;
+    context.regex = std::make_shared<Regex>("foo");
+    context.line_cnt = lines.size();
+
+    // Only the view is searched, a result may be before the current one.
+    context.SearchLines(get_line, 100, 200);
+    context.current_search = 0;
+    BufferSearchState state = context.CurrentState();
+    REQUIRE(state.total == 1);
+    REQUIRE_FALSE(state.total_final);
+    REQUIRE_FALSE(state.i_final);
+
+    // Lines before are searched, the index is exact but not the total.
+    context.SearchLines(get_line, 0, 100);
+    REQUIRE(context.current_search == 1);
+    state = context.CurrentState();
+    REQUIRE(state.i == 2);
+    REQUIRE(state.i_final);
+    REQUIRE(state.total == 2);
+    REQUIRE_FALSE(state.total_final);
+
+    context.SearchLines(get_line, 200, 300);
+    state = context.CurrentState();
+    REQUIRE((state.i == 2 && state.i_final));
+    REQUIRE((state.total == 3 && state.total_final));
+}
+
+TEST_CASE("search refinement") {
+    std::vector<std::string> lines = {"fox", "foo", "xfoo", "FOO",
+                                      "a\u0301", "b"};
+    auto get_line = [&lines](size_t line) -> std::string_view {
+        return lines[line];
+    };
+    auto make_context = [&](const char* pattern, int flags) {
+        BufferSearchContext context;
+        context.search_pattern = pattern;
+        context.regex = std::make_shared<Regex>(pattern, flags);
+        context.line_cnt = lines.size();
+        context.SearchLines(get_line, 0, lines.size());
+        return context;
+    };
+
+    BufferSearchContext context = make_context("fo", kRegexNone);
+    REQUIRE(context.search_result.size() == 3);
+    REQUIRE(context.TryRefine("foo", kRegexNone, get_line));
+    REQUIRE(context.search_result.size() == 2);
+    REQUIRE(context.search_result[1].begin == Pos{2, 1});
+    REQUIRE(context.TryRefine("foo", kRegexNone, get_line));
+    // Ignore case may find results in other lines.
+    REQUIRE_FALSE(context.TryRefine("foo", kRegexIgnoreCase, get_line));
+    REQUIRE_FALSE(context.TryRefine("fooo", kRegexIgnoreCase, get_line));
+    REQUIRE_FALSE(context.TryRefine("fo.", kRegexNone, get_line));
+
+    // Smartcase turns ignore case off, which is stricter.
+    context = make_context("fo", kRegexIgnoreCase);
+    REQUIRE(context.search_result.size() == 4);
+    REQUIRE(context.TryRefine("foO", kRegexNone, get_line));
+    REQUIRE(context.search_result.empty());
+
+    // "a" is dropped in the middle of a grapheme, "a\u0301" is not.
+    context = make_context("a", kRegexNone);
+    REQUIRE(context.search_result.empty());
+    REQUIRE(context.dropped_matches);
+    REQUIRE_FALSE(context.TryRefine("a\u0301", kRegexNone, get_line));
+    context = make_context("a\u0301", kRegexNone);
+    REQUIRE(context.search_result.size() == 1);
+}
@@ -0,0 +1,111 @@
+#include "substitute.h"
+
+#include "catch2/catch_test_macros.hpp"
+
+using namespace mango;
+
+// Return the whole new content, or empty if nothing matches.
+static std::string Substitute(const std::vector<std::string>& lines,
+                              const char* cmd_str, size_t cur_line = 0) {
+    SubstituteCommand cmd;
+    REQUIRE(ParseSubstituteCommand(cmd_str, cur_line, lines.size(), cmd) ==
+            kOk);
+    Regex regex(cmd.pattern, cmd.ignore_case.value_or(false)
+                                 ? kRegexIgnoreCase
+                                 : kRegexNone);
+    Substitution sub;
+    std::string res;
+    if (!BuildSubstitution(
+            [&lines](size_t line) -> std::string_view { return lines[line]; },
+            regex, cmd, sub)) {
+        return "";
+    }
+    for (size_t line = 0; line < lines.size(); line++) {
+        if (line != 0) {
+            res += '\n';
+        }
+        if (line == sub.range.begin.line) {
+            res += sub.content;
+            line = sub.range.end.line;
+        } else {
+            res += lines[line];
+        }
+    }
+    return res;
+}
+
+TEST_CASE("substitute command parse") {
+    REQUIRE(IsSubstituteCommand("s/a/b/"));
+    REQUIRE(IsSubstituteCommand("%s#a#b#g"));
+    REQUIRE(IsSubstituteCommand("1,$substitute/a/b"));
+    REQUIRE_FALSE(IsSubstituteCommand("smile"));
+    REQUIRE_FALSE(IsSubstituteCommand("s"));
+    REQUIRE_FALSE(IsSubstituteCommand("sa/b/"));
+    REQUIRE_FALSE(IsSubstituteCommand("grep s/a/b/"));
+
+    SubstituteCommand cmd;
+    REQUIRE(ParseSubstituteCommand("s/a b/<&>\\n\\&/", 3, 10, cmd) == kOk);
+    REQUIRE((cmd.first_line == 3 && cmd.last_line == 3));
+    REQUIRE(cmd.pattern == "a b");
+    REQUIRE(cmd.replacement == std::vector<std::string>{"<", ">\n&"});
+    REQUIRE_FALSE(cmd.global);
+    REQUIRE_FALSE(cmd.ignore_case.has_value());
+
+    REQUIRE(ParseSubstituteCommand("%s/a\\/b\\d//gI", 3, 10, cmd) == kOk);
+    REQUIRE((cmd.first_line == 0 && cmd.last_line == 9));
+    REQUIRE(cmd.pattern == "a/b\\d");
+    REQUIRE(cmd.replacement == std::vector<std::string>{""});
+    REQUIRE(cmd.global);
+    REQUIRE(cmd.ignore_case == false);
+
+    REQUIRE(cmd.error.empty());
+    REQUIRE_FALSE(cmd.range_swapped);
+
+    REQUIRE(ParseSubstituteCommand("$,.s|x|y", 3, 10, cmd) == kOk);
+    REQUIRE((cmd.first_line == 3 && cmd.last_line == 9));
+    REQUIRE(cmd.range_swapped);
+    REQUIRE(cmd.pattern == "x");
+    REQUIRE(cmd.replacement == std::vector<std::string>{"y"});
+
+    REQUIRE(ParseSubstituteCommand("2,11s/a/b/", 3, 10, cmd) ==
+            kCommandInvalidArgs);
+    REQUIRE(ParseSubstituteCommand("s//b/", 3, 10, cmd) ==
+            kCommandInvalidArgs);
+    REQUIRE(ParseSubstituteCommand("s/a/b/x", 3, 10, cmd) ==
+            kCommandInvalidArgs);
+    REQUIRE(cmd.error.empty());
+    REQUIRE(ParseSubstituteCommand("s/(a)/\\1/", 3, 10, cmd) ==
+            kCommandInvalidArgs);
+    REQUIRE(cmd.error == "Group references like \\1 are not supported");
+}
+
+TEST_CASE("substitute") {
+    std::vector<std::string> lines = {"foo foo", "bar", "Foo", "foo"};
+    REQUIRE(Substitute(lines, "%s/foo/x/") == "x foo\nbar\nFoo\nx");
+    REQUIRE(Substitute(lines, "%s/foo/x/g") == "x x\nbar\nFoo\nx");
+    REQUIRE(Substitute(lines, "%s/foo/x/gi") == "x x\nbar\nx\nx");
+    REQUIRE(Substitute(lines, "2,3s/o/[&&]/g") ==
+            "foo foo\nbar\nF[oo][oo]\nfoo");
+    REQUIRE(Substitute(lines, "s/ /\\n/") == "foo\nfoo\nbar\nFoo\nfoo");
+    REQUIRE(Substitute(lines, "%s/baz/x/").empty());
+
+    // Empty matches
+    REQUIRE(Substitute(lines, "%s/^/# /") ==
+            "# foo foo\n# bar\n# Foo\n# foo");
+    REQUIRE(Substitute({"axb"}, "s/x*/-/g") == "-a-b-");
+    REQUIRE(Substitute({"你好"}, "s/$/!/") == "你好!");
+
+    SubstituteCommand cmd;
+    REQUIRE(ParseSubstituteCommand("%s/o/\\n/g", 0, lines.size(), cmd) ==
+            kOk);
+    Regex regex(cmd.pattern);
+    Substitution sub;
+    REQUIRE(BuildSubstitution(
+        [&lines](size_t line) -> std::string_view { return lines[line]; },
+        regex, cmd, sub));
+    REQUIRE(sub.match_cnt == 8);
+    REQUIRE(sub.line_cnt == 3);
+    REQUIRE((sub.range.begin == Pos{0, 0} && sub.range.end == Pos{3, 3}));
+    // 6 line breaks are added before the last line.
+    REQUIRE(sub.cursor == Pos{9, 0});
+}
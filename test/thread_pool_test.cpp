@@ -0,0 +1,88 @@
+#include "thread_pool.h"
+
+#include <future>
+#include <thread>
+
+#include "catch2/catch_test_macros.hpp"
+
+using namespace mango;
+
+TEST_CASE("thread pool") {
+    const int kTaskCnt = 1000;
+    std::atomic<int> sum = 0;
+    std::promise<void> done;
+    std::atomic<int> left = kTaskCnt;
+    {
+        ThreadPool pool(4);
+        REQUIRE(pool.thread_cnt() == 4);
+        // Half of the tasks are submitted by tasks on the workers.
+        for (int i = 0; i < kTaskCnt / 2; i++) {
+            pool.Submit([&, i] {
+                sum += i;
+                pool.Submit([&, i] {
+                    sum += i;
+                    if (--left == 0) {
+                        done.set_value();
+                    }
+                });
+                if (--left == 0) {
+                    done.set_value();
+                }
+            });
+        }
+        done.get_future().wait();
+    }
+    REQUIRE(sum == (kTaskCnt / 2 - 1) * (kTaskCnt / 2));
+}
+
+TEST_CASE("async runner") {
+    EventLoop loop(nullptr);
+    AsyncRunner runner(&loop, 2);
+    std::thread::id loop_thread = std::this_thread::get_id();
+
+    std::vector<int> results;
+    const int kTaskCnt = 100;
+    int finished = 0;
+    for (int i = 0; i < kTaskCnt; i++) {
+        runner.Submit([&, i](const TaskToken&) -> AsyncRunner::Continuation {
+            // Assertions are only made on the loop thread.
+            bool on_worker = std::this_thread::get_id() != loop_thread;
+            int result = i * i;
+            return [&, on_worker, result] {
+                REQUIRE(on_worker);
+                REQUIRE(std::this_thread::get_id() == loop_thread);
+                results.push_back(result);
+                if (++finished == kTaskCnt + 1) {
+                    loop.EndLoop();
+                }
+            };
+        });
+    }
+
+    // Cancelled after the work is done, the continuation isn't called.
+    std::promise<void> worked;
+    TaskHandle handle = runner.Submit([&](const TaskToken&) {
+        worked.set_value();
+        return [] { FAIL("cancelled continuation called"); };
+    });
+    worked.get_future().wait();
+    handle->Cancel();
+
+    // A work returns no continuation.
+    runner.Submit([&](const TaskToken&) { return nullptr; });
+    runner.Submit([&](const TaskToken&) -> AsyncRunner::Continuation {
+        return [&] {
+            if (++finished == kTaskCnt + 1) {
+                loop.EndLoop();
+            }
+        };
+    });
+
+    loop.Loop();
+    REQUIRE(results.size() == kTaskCnt);
+    long sum = 0;
+    for (int r : results) {
+        sum += r;
+    }
+    REQUIRE(sum == (kTaskCnt - 1) * kTaskCnt * (2 * kTaskCnt - 1) / 6);
+}
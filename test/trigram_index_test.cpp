@@ -0,0 +1,145 @@
+#include "trigram_index.h"
+
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <gsl/util>
+#include <thread>
+
+#include "catch2/catch_test_macros.hpp"
+#include "logging.h"
+
+using namespace mango;
+
+static void WriteFile(const std::string& path, const std::string& contents) {
+    FILE* f = fopen(path.c_str(), "w");
+    REQUIRE(f != nullptr);
+    fwrite(contents.data(), 1, contents.size(), f);
+    fclose(f);
+}
+
+static bool WaitReady(TrigramIndex& index) {
+    for (int i = 0; i < 1000; i++) {
+        if (index.GetStatus().state == TrigramIndex::State::kReady) {
+            return true;
+        }
+        std::this_thread::sleep_for(std::chrono::milliseconds(10));
+    }
+    return false;
+}
+
+static std::vector<std::string> Candidates(TrigramIndex& index,
+                                           const char* pattern,
+                                           int flags = kRegexNone,
+                                           const std::string& dir = "") {
+    std::vector<std::string> files;
+    REQUIRE(index.Candidates(Regex(pattern, flags), dir, files));
+    std::sort(files.begin(), files.end());
+    return files;
+}
+
+// Candidates may be unknown for a while when a tree is walked again.
+static bool WaitCandidates(TrigramIndex& index, const char* pattern,
+                           const std::vector<std::string>& expected) {
+    for (int i = 0; i < 1000; i++) {
+        std::vector<std::string> files;
+        if (index.Candidates(Regex(pattern), "", files)) {
+            std::sort(files.begin(), files.end());
+            if (files == expected) {
+                return true;
+            }
+        }
+        std::this_thread::sleep_for(std::chrono::milliseconds(10));
+    }
+    return false;
+}
+
+TEST_CASE("trigram index") {
+    LogInit("trigram_index_test.log");
+    auto log_deinit = gsl::finally([] { LogDeinit(); });
+
+    char tmpl[] = "/tmp/mango_index_XXXXXX";
+    REQUIRE(mkdtemp(tmpl) != nullptr);
+    std::string tmp = std::string(tmpl) + "/";
+    auto _ = gsl::finally([&tmp] {
+        std::string cmd = "rm -rf " + tmp;
+        int rc = system(cmd.c_str());
+        (void)rc;
+    });
+    std::string root = tmp + "root/";
+    std::string cache_path = tmp + "index.idx";
+    mkdir(root.c_str(), 0755);
+    mkdir((root + "sub").c_str(), 0755);
+    WriteFile(root + ".gitignore", "ignored.txt\n");
+    WriteFile(root + "a.txt", "hello world\n");
+    WriteFile(root + "b.txt", "goodbye\n");
+    WriteFile(root + "sub/c.txt", "Hello again\n");
+    WriteFile(root + "ignored.txt", "hello\n");
+
+    using Files = std::vector<std::string>;
+    {
+        TrigramIndex index(root, cache_path);
+        REQUIRE(WaitReady(index));
+        REQUIRE(index.GetStatus().files == 4);
+        REQUIRE(Candidates(index, "wor+ld") == Files{"a.txt"});
+        // Trigrams are case insensitive, the matcher tells them apart.
+        REQUIRE(Candidates(index, "hello") == Files{"a.txt", "sub/c.txt"});
+        REQUIRE(Candidates(index, "hello", kRegexIgnoreCase, "sub/") ==
+                Files{"sub/c.txt"});
+        REQUIRE(Candidates(index, "hello|bye").size() == 4);
+        REQUIRE(Candidates(index, "nothing").empty());
+
+        // A changed file is a candidate at once, then reindexed.
+        WriteFile(root + "b.txt", "hello\n");
+        index.FileChanged("b.txt");
+        REQUIRE(Candidates(index, "hello") ==
+                Files{"a.txt", "b.txt", "sub/c.txt"});
+        REQUIRE(Candidates(index, "bye") == Files{"b.txt"});
+        for (int i = 0; i < 1000 && Candidates(index, "bye").size() != 0;
+             i++) {
+            std::this_thread::sleep_for(std::chrono::milliseconds(10));
+        }
+        REQUIRE(Candidates(index, "bye").empty());
+
+        // New files are found by inotify.
+        WriteFile(root + "d.txt", "hello\n");
+        for (int i = 0; i < 1000 && Candidates(index, "hello").size() != 4;
+             i++) {
+            std::this_thread::sleep_for(std::chrono::milliseconds(10));
+        }
+        REQUIRE(Candidates(index, "hello") ==
+                Files{"a.txt", "b.txt", "d.txt", "sub/c.txt"});
+
+        // Only the tree of a new directory is walked, the index stays ready.
+        mkdir((root + "new").c_str(), 0755);
+        mkdir((root + "new/deep").c_str(), 0755);
+        WriteFile(root + "new/deep/e.txt", "hello\n");
+        REQUIRE(WaitCandidates(index, "hello",
+                               {"a.txt", "b.txt", "d.txt", "new/deep/e.txt",
+                                "sub/c.txt"}));
+        REQUIRE(index.GetStatus().state == TrigramIndex::State::kReady);
+
+        // Files of a directory moved away are dropped.
+        rename((root + "new").c_str(), (tmp + "moved").c_str());
+        REQUIRE(WaitCandidates(index, "hello",
+                               {"a.txt", "b.txt", "d.txt", "sub/c.txt"}));
+
+        // A changed ignore file walks its directory again.
+        WriteFile(root + "sub/.ignore", "c.txt\n");
+        REQUIRE(WaitCandidates(index, "hello", {"a.txt", "b.txt", "d.txt"}));
+        unlink((root + "sub/.ignore").c_str());
+        REQUIRE(WaitCandidates(index, "hello",
+                               {"a.txt", "b.txt", "d.txt", "sub/c.txt"}));
+        REQUIRE(index.GetStatus().state == TrigramIndex::State::kReady);
+    }
+
+    // Loaded from the cache file, changes are found when refreshing.
+    unlink((root + "a.txt").c_str());
+    TrigramIndex index(root, cache_path);
+    REQUIRE(WaitReady(index));
+    REQUIRE(Candidates(index, "hello") ==
+            Files{"b.txt", "d.txt", "sub/c.txt"});
+}
@@ -18,6 +18,77 @@ TEST_CASE("test string display width") {
           33);
 }
 
+TEST_CASE("codepoint width table") {
+    // Same as utf8proc, except that RIs are wide.
+    for (Codepoint c = 0; c < 0x110000; c++) {
+        int expected = c >= 0x1F1E6 && c < 0x1F1E6 + 26
+                           ? 2
+                           : utf8proc_charwidth(c);
+        if (CodepointWidth(c) != expected) {
+            FAIL(fmt::format("U+{:04X}: {} != {}", c, CodepointWidth(c),
+                             expected));
+        }
+    }
+    CHECK(CodepointWidth(0x110000) == utf8proc_charwidth(0x110000));
+    CHECK(CodepointWidth(-1) == utf8proc_charwidth(-1));
+}
+
+TEST_CASE("character width without codepoints") {
+    std::string str =
+        " a é न 🇺🇸 👩‍👩‍👧 🏳️‍🌈 👨‍⚕️ ❤️ ☝︎ ✊🏿 1️⃣ ǟ̋ 你好\t\x01 z";
+    Character c;
+    size_t offset = 0;
+    while (offset < str.size()) {
+        int byte_len, width_byte_len;
+        ThisCharacter(str, offset, c, byte_len);
+        CHECK(ThisCharacterWidth(str, offset, width_byte_len) == c.Width());
+        CHECK(width_byte_len == byte_len);
+        offset += byte_len;
+    }
+}
+
+TEST_CASE("long character") {
+    // e with 12 acutes, more than kept inline.
+    std::string str = "e";
+    for (int i = 0; i < 12; i++) {
+        str += "\u0301";
+    }
+    Character c;
+    int byte_len;
+    ThisCharacter(str, 0, c, byte_len);
+    REQUIRE(byte_len == static_cast<int>(str.size()));
+    REQUIRE(c.CodePointCount() == 13);
+    CHECK(c.Codepoints()[0] == 'e');
+    for (int i = 1; i < 13; i++) {
+        CHECK(c.Codepoints()[i] == 0x301);
+    }
+    CHECK(c.Width() == 1);
+
+    // Reused after spilled.
+    ThisCharacter("ab", 0, c, byte_len);
+    char ascii;
+    CHECK((c.Ascii(ascii) && ascii == 'a'));
+    ThisCharacter(str, 0, c, byte_len);
+    CHECK(c.CodePointCount() == 13);
+    CHECK(c.Codepoints()[12] == 0x301);
+}
+
+TEST_CASE("printable ascii run") {
+    CHECK(PrintableAsciiRun("", 0) == 0);
+    CHECK(PrintableAsciiRun("int main() { return 0; }", 0) == 24);
+    CHECK(PrintableAsciiRun("int main() { return 0; }", 4) == 20);
+    CHECK(PrintableAsciiRun("int main() { return 0; }", 4, 3) == 3);
+    // Control characters and tabs aren't one cell wide.
+    CHECK(PrintableAsciiRun("0123456789abcdef\tx", 0) == 16);
+    CHECK(PrintableAsciiRun("0123456789\x7f", 0) == 10);
+    CHECK(PrintableAsciiRun("\r\n", 0) == 0);
+    // e may be combined with U+0301.
+    CHECK(PrintableAsciiRun("0123456789ae\u0301", 0) == 11);
+    CHECK(PrintableAsciiRun("0123456789ae\u0301", 0, 11) == 11);
+    CHECK(PrintableAsciiRun("0123456789ae\u0301", 0, 12) == 11);
+    CHECK(PrintableAsciiRun("你好", 0) == 0);
+}
+
 TEST_CASE("bound class test") {
     int byte_eat;
     Codepoint c;
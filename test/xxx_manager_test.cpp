@@ -158,3 +158,39 @@ TEST_CASE("timer_manager test") {
     manager.Tick();
     REQUIRE(first == 2);
 }
+
+TEST_CASE("idle_scheduler test") {
+    IdleScheduler scheduler;
+    std::vector<int> runs;
+    int left1 = 3;
+    int left2 = 1;
+    IdleJob j1([&](std::chrono::steady_clock::time_point deadline) {
+        REQUIRE(deadline > std::chrono::steady_clock::now());
+        runs.push_back(1);
+        return --left1 > 0;
+    });
+    IdleJob j2([&](std::chrono::steady_clock::time_point) {
+        runs.push_back(2);
+        return --left2 > 0;
+    });
+    IdleJob j3([&](std::chrono::steady_clock::time_point) {
+        runs.push_back(3);
+        return true;
+    });
+
+    scheduler.Schedule(&j1);
+    scheduler.Schedule(&j2);
+    scheduler.Schedule(&j1);
+    scheduler.Schedule(&j3);
+    scheduler.Cancel(&j3);
+    REQUIRE(!j3.IsScheduled());
+
+    // Jobs take turns.
+    REQUIRE(!scheduler.RunSlice());
+    REQUIRE(scheduler.RunSlice());
+    REQUIRE(!j2.IsScheduled());
+    REQUIRE(!scheduler.RunSlice());
+    REQUIRE(scheduler.RunSlice());
+    REQUIRE(!scheduler.HasJobs());
+    REQUIRE(runs == std::vector<int>{1, 2, 1, 1});
+}
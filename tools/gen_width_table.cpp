@@ -0,0 +1,84 @@
+// Generate the codepoint display width table used by CharacterWidth.
+// Usage: gen_width_table <output file>
+//
+// The table has two levels: the high bits of a codepoint pick a block, the low
+// bits pick the width in the block. Same blocks are shared, so the table is
+// small while a lookup is only two loads.
+
+#include <cstdint>
+#include <cstdio>
+#include <map>
+#include <vector>
+
+#include "utf8proc.h"
+
+static constexpr int kShift = 8;
+static constexpr int kBlockSize = 1 << kShift;
+static constexpr int32_t kCodepointEnd = 0x110000;
+
+// VS rules are applied in CharacterWidth.
+static constexpr int32_t kRIStart = 0x1F1E6;
+static constexpr int kRICnt = 26;
+
+static int Width(int32_t codepoint) {
+    // Fix RI width
+    if (codepoint >= kRIStart && codepoint < kRIStart + kRICnt) {
+        return 2;
+    }
+    return utf8proc_charwidth(codepoint);
+}
+
+int main(int argc, char* argv[]) {
+    if (argc != 2) {
+        fprintf(stderr, "usage: %s <output file>\n", argv[0]);
+        return 1;
+    }
+
+    std::map<std::vector<uint8_t>, int> block_ids;
+    std::vector<const std::vector<uint8_t>*> blocks;
+    std::vector<int> index;
+    for (int32_t begin = 0; begin < kCodepointEnd; begin += kBlockSize) {
+        std::vector<uint8_t> block(kBlockSize);
+        for (int i = 0; i < kBlockSize; i++) {
+            block[i] = Width(begin + i);
+        }
+        auto [iter, inserted] = block_ids.emplace(block, blocks.size());
+        if (inserted) {
+            blocks.push_back(&iter->first);
+        }
+        index.push_back(iter->second);
+    }
+
+    FILE* f = fopen(argv[1], "w");
+    if (f == nullptr) {
+        perror(argv[1]);
+        return 1;
+    }
+    fprintf(f,
+            "// Generated by tools/gen_width_table.cpp, don't edit.\n"
+            "// %zu blocks for utf8proc %s.\n\n",
+            blocks.size(), utf8proc_unicode_version());
+    fprintf(f, "static constexpr int kWidthTableShift = %d;\n", kShift);
+    fprintf(f, "static constexpr uint32_t kWidthTableEnd = 0x%X;\n",
+            kCodepointEnd);
+    fprintf(f, "static constexpr %s kWidthTableIndex[%zu] = {",
+            blocks.size() <= UINT8_MAX + 1 ? "uint8_t" : "uint16_t",
+            index.size());
+    for (size_t i = 0; i < index.size(); i++) {
+        fprintf(f, "%s%d,", i % 16 == 0 ? "\n    " : " ", index[i]);
+    }
+    fprintf(f, "\n};\n");
+    fprintf(f, "static constexpr uint8_t kWidthTableBlocks[%zu] = {",
+            blocks.size() * kBlockSize);
+    for (const std::vector<uint8_t>* block : blocks) {
+        for (int i = 0; i < kBlockSize; i++) {
+            fprintf(f, "%s%d,", i % 32 == 0 ? "\n    " : " ", (*block)[i]);
+        }
+    }
+    fprintf(f, "\n};\n");
+    if (fclose(f) != 0) {
+        perror(argv[1]);
+        return 1;
+    }
+    return 0;
+}